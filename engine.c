@@ -0,0 +1,7922 @@
+// -------------------------------------------------------------------------------------
+// Engine.c -- Calculation engine for the QuickMAN SSE/SSE2-based Mandelbrot Set calculator
+// Copyright (C) 2006-2008 Paul Gentieu (paul.gentieu@yahoo.com)
+//
+// This file is part of QuickMAN.
+//
+// QuickMAN is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+//
+// Project Page: http://quickman.sourceforge.net
+//
+// Author: Paul Gentieu (main code, ASM iteration cores, palettes)
+//
+// -------------------------------------------------------------------------------------
+//
+// Split the calculation engine (iteration functions, point queuing, threading, coordinate
+// setup) off from the GUI in quickman.c. Everything here runs from a man_calc_struct and
+// has no GUI dependencies, so it can also be driven headless (see man_render()) and built
+// on other platforms through port.h. The GUI-only state that used to be touched here
+// (status bits, benchmark totals) is now handled by the callers.
+//
+// The inline ASM iteration functions only build with 32-bit MSVC. Other builds use
+// equivalent SSE/SSE2 intrinsic versions.
+
+#define STRICT
+#define WIN32_LEAN_AND_MEAN
+#define _WIN32_WINNT 0x501 // Windows XP
+
+#include "port.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <emmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>     // for __cpuid
+#else
+#include <cpuid.h>
+#endif
+
+#ifdef _WIN32
+#include <mmsystem.h>   // for timer functions
+#endif
+
+#include "quickman.h"
+
+#if defined(USE_AVX_KERNELS) || defined(USE_AVX512_KERNELS)  // set in quickman.h
+#include <immintrin.h>
+#endif
+
+int num_threads = 1;       // number of calculation threads (1 to MAX_THREADS; normally one per core)
+
+// CPU features usable by the iteration functions (CPU_* bits). Set by detect_cpu_features.
+unsigned cpu_features = 0;
+
+// Autotuned kernel choices (TUNED_* bitfield; see autotune). Set by the caller, e.g. from the
+// "tuned" setting in quickman.cfg.
+unsigned kernel_tuning = 0;
+
+// Thread and memory placement (NUMA_*). Set by the caller before allocating any calculation
+// structures, e.g. from the "numa" setting in quickman.cfg.
+int numa_policy = NUMA_OFF;
+
+// Fused palette mapping for man_render and the like (see set_fused_palette). Set by the caller,
+// e.g. from the "fused" setting in quickman.cfg.
+int fused_palette = 1;
+
+// Constants and variables used in the fast "wave" algorithm
+
+// Starting values for x and y. Now seems faster to have these as static globals
+static const int wave_ystart[7]   = {3, 1, 3, 1, 0, 1, 0};   // calculates y = 0, needs dummy line at y = -1 (set to 0's)
+static const int wave_xstart[7]   = {0, 2, 2, 0, 1, 1, 0};
+
+// X and Y increments for each wave
+static const int wave_inc[7]      = {4, 4, 4, 4, 2, 2, 2};
+
+// Offsets from current pixel location. If all 4 pixels there are equal, set the current pixel
+// to that value (not used for wave 0). Stored in increasing pointer order
+
+static const int wave_xoffs[7][4] = {{ 0, 0, 0,  0}, {-2, 2, -2, 2}, {0, -2, 2, 0}, {0, -2, 2, 0},
+                                     {-1, 1, -1, 1}, { 0, -1, 1, 0}, {0, -1, 1, 0}};
+static const int wave_yoffs[7][4] = {{ 0,  0, 0, 0}, {-2, -2, 2, 2}, {-2, 0, 0, 2}, {-2, 0, 0, 2},
+                                     {-1, -1, 1, 1}, {-1,  0, 0, 1}, {-1, 0, 0, 1}};
+
+// ----------------------- Timer / coordinate functions -----------------------------------
+
+// Timer function: returns current time in TIME_UNITs (changed from previous versions).
+// Can use two different methods based on #define: QueryPerformanceCounter is more
+// precise, but has a bug when running on dual-core CPUs. Randomly selects one or
+// the other core to read the number from, and gets bogus results if it reads the wrong one.
+
+TIME_UNIT get_timer(void)
+{
+   #ifdef USE_PERFORMANCE_COUNTER
+   TIME_UNIT t;
+   QueryPerformanceCounter(&t);
+   return t;
+   #else
+   return timeGetTime();
+   #endif
+}
+
+// Get the number of seconds elapsed since start_time.
+double get_seconds_elapsed(TIME_UNIT start_time)
+{
+   #ifdef USE_PERFORMANCE_COUNTER
+   TIME_UNIT t, f;
+   QueryPerformanceFrequency(&f);
+   QueryPerformanceCounter(&t);
+   t.QuadPart -= start_time.QuadPart;
+   if (f.QuadPart)
+      return (double) t.QuadPart / (double) f.QuadPart;
+   return 1e10;
+   #else
+   TIME_UNIT t;
+   // Need to use TIME_UNIT (dword) to avoid wrapping issues with timeGetTime().
+   // Can subtract in DWORD domain, but not double.
+   t = timeGetTime() - start_time;
+   return 1e-3 * (double) t;
+   #endif
+}
+
+// Get the real or imaginary coordinate delta based on the pixel delta (offs) from
+// the image center, the image smaller dimension, and the magnification.
+
+// Returns value on ST(0), so there should be no precision loss from calling a function
+// as opposed to doing a macro.
+double get_re_im_offs(man_calc_struct *m, long long offs)
+{
+  return ldexp((((double) offs * 4.0) / (double) m->min_dimension) / m->mag, -m->mag_exp);
+}
+
+// Same as above, as a floatexp. Doesn't underflow past the double range.
+floatexp get_re_im_offs_fe(man_calc_struct *m, long long offs)
+{
+   floatexp f;
+
+   f.val = (((double) offs * 4.0) / (double) m->min_dimension) / m->mag;
+   f.exp = -m->mag_exp;
+   return f;
+}
+
+// Add the coordinate offsets of pixel offset (xoffs, yoffs) from the image center to re/im
+void add_re_im_offs(man_calc_struct *m, hp_num *re, hp_num *im, long long xoffs, long long yoffs)
+{
+   floatexp f;
+
+   hp_add_fe(re, get_re_im_offs_fe(m, xoffs));
+   f = get_re_im_offs_fe(m, yoffs);
+   f.val = -f.val;
+   hp_add_fe(im, f);
+}
+
+// Magnifications past the double range are kept as mag * 2^mag_exp. Keep mag between 2^256 and
+// 2^512 when mag_exp is nonzero, so the GUI can multiply it by zoom factors without overflowing.
+// Call after changing mag. The scaling is exact, and does nothing below 2^512.
+
+#define MAG_NORM_STEP   256
+
+void normalize_mag(man_calc_struct *m)
+{
+   while (m->mag >= ldexp(1.0, 2 * MAG_NORM_STEP))
+   {
+      m->mag = ldexp(m->mag, -MAG_NORM_STEP);
+      m->mag_exp += MAG_NORM_STEP;
+   }
+   while (m->mag_exp > 0 && m->mag < ldexp(1.0, MAG_NORM_STEP))
+   {
+      m->mag = ldexp(m->mag, MAG_NORM_STEP);
+      m->mag_exp -= MAG_NORM_STEP;
+   }
+}
+
+// Get the magnification as a string (for display and the logfile). Uses the usual %lf format
+// unless it's past the double range.
+void get_mag_str(man_calc_struct *m, char *s, int size)
+{
+   floatexp f;
+
+   if (!m->mag_exp)
+   {
+      sprintf_s(s, size, "%-16lf", m->mag);
+      return;
+   }
+   f.val = m->mag;
+   f.exp = m->mag_exp;
+   fe_to_string(f, s, size);
+}
+
+// Update the image center coordinates (re/im) based on xoffs and yoffs (pixels from current center).
+// Any time this is done, the pan offsets need to be reset to 0.
+
+// Also, call this with pan_xoffs and pan_yoffs to calculate a new re/im from the current
+// pan offsets (and then reset the offsets).
+
+// The offsets are added to the high precision re/im, so deep images don't lose the center.
+
+void update_re_im(man_calc_struct *m, long long xoffs, long long yoffs)
+{
+   sync_re_im_hp(m);
+   add_re_im_offs(m, &m->re_hp, &m->im_hp, xoffs, yoffs);
+   m->re = hp_to_double(&m->re_hp);
+   m->im = hp_to_double(&m->im_hp);
+   m->pan_xoffs = 0;
+   m->pan_yoffs = 0;
+}
+
+// Reset the high precision re/im from re/im if they were set directly (i.e., they no longer
+// match). Code that needs more precision than a double sets re_hp/im_hp, then sets re/im to
+// them rounded with hp_to_double.
+void sync_re_im_hp(man_calc_struct *m)
+{
+   if (hp_to_double(&m->re_hp) != m->re)
+      hp_from_double(&m->re_hp, m->re);
+   if (hp_to_double(&m->im_hp) != m->im)
+      hp_from_double(&m->im_hp, m->im);
+}
+// ----------------------- Iteration functions -----------------------------------
+
+// Periodicity checking. Interior points never diverge, so without it they always run to
+// max_iters, which dominates the time for images with large black areas. But their orbits
+// settle into a cycle: the kernels save z now and then, and if a later z comes back within
+// period_tol of the saved one, the point is periodic and gets retired as max_iters. Saves
+// are at doubling intervals (Brent's method), so a cycle of any length is found soon after
+// the orbit reaches it.
+//
+// The saves are at fixed counts of the point's own iterations (PERIOD_FIRST_SAVE, then
+// doubling), so which points are found periodic doesn't depend on the kernel width or on where
+// its calls start and stop. The C kernel checks every iteration. The SIMD kernels check every
+// 2 iterations (after the unrolled pair), and keep the saved points and each point's next
+// save count (ps_ptr->period_next) in the pointstruct between calls. They only look at the
+// save counts when the call gets to the first one of any of their points, and save z for the
+// points that are at theirs (see period_save_sse2). A periodic point ends the call like a
+// diverged one; its bit is set in ps_ptr->periodic for the queue function.
+//
+// The tolerance is no less than a few ulps of z in the arithmetic the kernel uses (see
+// man_setup): the single precision C kernel computes in double.
+
+#define PERIOD_FIRST_SAVE     16              // iterations before the first save; must be even
+#define PERIOD_TOL_SCALE      (1.0 / 65536.0) // tolerance relative to the pixel spacing...
+#define PERIOD_TOL_MIN_DOUBLE 1e-13           // ...but no less than a few ulps of z, or
+#define PERIOD_TOL_MIN_FLOAT  4e-7            // cycles wouldn't be found at high mags
+
+// Starting c and z for the point in ab_in: c is the point and z is 0, or in Julia mode, z is
+// the point and c is the Julia parameter (set by man_setup). The orbit point saved for
+// periodicity checking starts at z.
+
+static __inline void get_start_point(man_pointstruct *ps_ptr, double *a, double *b, double *x, double *y)
+{
+   if (ps_ptr->julia)
+   {
+      *a = ps_ptr->julia_c[0];
+      *b = ps_ptr->julia_c[1];
+      *x = ps_ptr->ab_in[0];
+      *y = ps_ptr->ab_in[1];
+   }
+   else
+   {
+      *a = ps_ptr->ab_in[0];
+      *b = ps_ptr->ab_in[1];
+      *x = *y = 0.0;
+   }
+}
+
+// Same, setting queue slot i (double precision kernels)
+static __inline void set_start_point(man_pointstruct *ps_ptr, unsigned i)
+{
+   get_start_point(ps_ptr, &ps_ptr->a[i], &ps_ptr->b[i], &ps_ptr->x[i], &ps_ptr->y[i]);
+   ps_ptr->period_x[i] = ps_ptr->x[i];
+   ps_ptr->period_y[i] = ps_ptr->y[i];
+}
+
+// Signed 32-bit minimum (SSE4.1 has _mm_min_epi32)
+static __inline __m128i min_epi32_sse2(__m128i a, __m128i b)
+{
+   __m128i lt = _mm_cmplt_epi32(a, b);
+
+   return _mm_or_si128(_mm_and_si128(lt, a), _mm_andnot_si128(lt, b));
+}
+
+// Save count bookkeeping for the SIMD kernels, done when the call gets to a save (iters ==
+// ps_ptr->period_save at the start of the call). Works on the points' counts at the start of
+// the call (ps_ptr->iters) and their next save counts (ps_ptr->period_next), which stay in
+// memory. For points 0 to 4n - 1, sets due[] to the mask of the points at their save count
+// after iters iterations of the call and doubles their save counts. Returns the call's next
+// save. Counts are below MAX_ITERS, so the signed minimum will do.
+static __inline unsigned period_save_sse2(man_pointstruct *ps_ptr, __m128i *due, int n, unsigned iters)
+{
+   __m128i count, next, d;
+   int i;
+
+   d = _mm_set1_epi32(MAX_ITERS);
+   for (i = 0; i < n; i++)
+   {
+      count = _mm_add_epi32(_mm_load_si128((__m128i *) ps_ptr->iters + i), _mm_set1_epi32(iters));
+      next = _mm_load_si128((__m128i *) ps_ptr->period_next + i);
+      due[i] = _mm_cmpeq_epi32(count, next);
+      next = _mm_add_epi32(next, _mm_and_si128(due[i], next));
+      _mm_store_si128((__m128i *) ps_ptr->period_next + i, next);
+      d = min_epi32_sse2(d, _mm_sub_epi32(next, count));
+   }
+   d = min_epi32_sse2(d, _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+   d = min_epi32_sse2(d, _mm_shuffle_epi32(d, _MM_SHUFFLE(2, 3, 0, 1)));
+   return iters + _mm_cvtsi128_si32(d);
+}
+
+// Lame unoptimized C iteration function. Just does one point at a time, using point 0
+// in the point structure.
+
+static unsigned iterate_c(man_pointstruct *ps_ptr)
+{
+   double a, b, x, y, xx, yy, rad, px, py, tol;
+   unsigned iters, iter_ct, save, save_ct;
+
+   iters = 0;
+   iter_ct = ps_ptr->cur_max_iters;
+
+   get_start_point(ps_ptr, &a, &b, &x, &y);
+   rad = DIVERGED_THRESH;
+   xx = x * x;
+   yy = y * y;
+
+   px = x;                       // saved orbit point (see PERIOD_FIRST_SAVE)
+   py = y;
+   tol = ps_ptr->period_tol;
+   save = save_ct = PERIOD_FIRST_SAVE;
+   ps_ptr->periodic = 0;
+
+   // A Julia mode point can start outside. The SIMD kernels count these as 1 iteration
+   // (see DIVERGED_PREV), which is what queue_point_c makes of 0.
+   if ((xx + yy) >= rad)
+   {
+      ps_ptr->mag[0] = xx + yy;
+      return 0;
+   }
+
+   do
+   {
+      y = (x + x) * y + b;
+      x = xx - yy + a;
+      yy = y * y;
+      xx = x * x;
+      iters++;
+      if ((xx + yy) >= rad)
+         break;
+      if (fabs(x - px) + fabs(y - py) < tol)
+      {
+         ps_ptr->periodic = 1;   // will never diverge; queue_point_c stores max iters
+         break;
+      }
+      if (!--save_ct)
+      {
+         px = x;
+         py = y;
+         save_ct = save += save;
+      }
+   }
+   while (--iter_ct);
+
+   // Store final count and magnitude (squared)
+
+   ps_ptr->mag[0] = xx + yy;  // use this for tmp storage (mag stored to array below)
+
+   return iters;
+}
+
+// Distance estimation. The DE kernels also iterate the derivative dz/dc (dz = 2 * z * dz + 1,
+// from the previous z), and when a point escapes, 0.5 * |z| * log|z| / |dz| is a lower bound on
+// its distance from the set (a quarter of the usual estimate). It's stored in DE() in pixels,
+// for DE shading. Points that don't escape get 0.
+
+#define DE_FLOPS_PER_ITER  18
+#define DE_MAX             1e30  // for points with no derivative (far outside the set)
+
+static __inline float de_estimate(man_calc_struct *m, double mag, double dx, double dy)
+{
+   double d;
+
+   d = 0.25 * sqrt(mag) * log(mag) / sqrt(dx * dx + dy * dy) * m->de_scale;
+   if (!(d > 0.0)) // also catches NaN
+      return 0.0f;
+   return (float) ((d < DE_MAX) ? d : DE_MAX);
+}
+
+// C distance estimation version of the above. No periodicity checking; the z iteration is the
+// same, so the counts match.
+static unsigned iterate_de_c(man_pointstruct *ps_ptr)
+{
+   double a, b, x, y, xx, yy, dx, dy, t, rad;
+   unsigned iters, iter_ct;
+
+   iters = 0;
+   iter_ct = ps_ptr->cur_max_iters;
+
+   a = ps_ptr->ab_in[0];
+   b = ps_ptr->ab_in[1];
+   rad = DIVERGED_THRESH;
+   x = y = xx = yy = 0.0;
+   dx = dy = 0.0;
+   ps_ptr->periodic = 0;
+
+   do
+   {
+      t = x * dx - y * dy;
+      dy = 2.0 * (x * dy + y * dx);
+      dx = t + t + 1.0;
+      y = (x + x) * y + b;
+      x = xx - yy + a;
+      yy = y * y;
+      xx = x * x;
+      iters++;
+      if ((xx + yy) >= rad)
+         break;
+   }
+   while (--iter_ct);
+
+   ps_ptr->mag[0] = xx + yy;
+   ps_ptr->dx[0] = dx;
+   ps_ptr->dy[0] = dy;
+
+   return iters;
+}
+
+// Queue a point to be iterated, for the C iteration function
+static void FASTCALL queue_point_c(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr)
+{
+   man_calc_struct *m;
+   unsigned iters;
+
+   m = (man_calc_struct *) calc_struct;
+
+   // Debug dump of oversampled iteration counts around each point, for testing oversampling.
+   // Slow, and iterates each point more than once- only enable for testing.
+   #ifdef OVERSAMPLE_DEBUG
+   FILE* fp;
+   static int fileNo = 0;
+   static int currLines = 0;
+   char szFilename[1024];
+   if (currLines >= 1000000)
+   {
+	   currLines = 0;
+	   fileNo++;
+   }
+   sprintf_s(szFilename, 1024, "oversample_debug.%d.csv", fileNo);
+   fopen_s(&fp, szFilename, "a");
+   double center_re = ps_ptr->ab_in[0];
+   double center_im = ps_ptr->ab_in[1];
+   double im_width = m->img_im[0] - m->img_im[1];
+   double re_width = m->img_re[1] - m->img_re[0];
+
+   int max_iters_reached = 0;
+   #define SQUARE_SIZE		1
+   int iters_log[SQUARE_SIZE];
+   int log_ended_early = 0;
+   for (int i = 0; i < SQUARE_SIZE; i++)
+   {
+	   memset(iters_log, 0, sizeof(iters_log));
+	   for (int j = 0; !max_iters_reached && j < SQUARE_SIZE; j++)
+	   {
+		   ps_ptr->ab_in[0] = center_re - re_width / 2 + re_width * (1.0 * j / SQUARE_SIZE);
+		   ps_ptr->ab_in[1] = center_im - im_width / 2 + im_width * (1.0 * i / SQUARE_SIZE);
+		   iters = m->mandel_iterate(ps_ptr);
+		   iters_log[j] = iters;
+
+		   //sprintf_s(szFileLine, 1024, "%16.16lf,%16.16lf,%d,%d,%d\n", center_re, center_im, i + 1, j + 1, iters);
+		   //sprintf_s(szFileLine, 1024, "%16.16lf,%16.16lf,%16.16lf,%16.16lf,%d\r\n", center_re, center_im, ps_ptr->ab_in[0], ps_ptr->ab_in[1], iters);
+		   //fputs(szFileLine, fp);
+		   if (iters == m->max_iters)
+		   {
+			   //max_iters_reached = 1;
+		   }
+	   }
+
+	   char szFileLine[1024];
+	   memset(szFileLine, 0, sizeof(szFileLine));
+	   char szTmp[1024];
+	   if (i == 0)
+	   {
+		   sprintf_s(szTmp, sizeof(szTmp), "%16.16lf,%16.16lf",
+						center_re - re_width / 2,
+						center_im - im_width / 2
+		   );
+		   strcat_s(szFileLine, sizeof(szFileLine), szTmp);
+	   }
+	   else if (i == SQUARE_SIZE - 1)
+	   {
+		   sprintf_s(szTmp, sizeof(szTmp), "%16.16lf,%16.16lf",
+			   center_re + re_width / 2,
+			   center_im + im_width / 2
+			   );
+		   strcat_s(szFileLine, sizeof(szFileLine), szTmp);
+	   }
+	   else
+	   {
+		   strcat_s(szFileLine, sizeof(szFileLine), ",");
+	   }
+	   for (int i = 0; i < SQUARE_SIZE; i++)
+	   {
+		   if (!log_ended_early)
+		   {
+			   sprintf_s(szTmp, sizeof(szTmp), ",%d", iters_log[i]);
+			   strcat_s(szFileLine, sizeof(szFileLine), szTmp);
+			   if (iters_log[i] == m->max_iters)
+			   {
+				   log_ended_early = 1;
+				   log_ended_early = 0;
+			   }
+		   }
+		   else
+		   {
+			   strcat_s(szFileLine, sizeof(szFileLine), ",");
+		   }
+	   }
+	   strcat_s(szFileLine, sizeof(szFileLine), "\n");
+	   currLines++;
+	   if (i > 1 && i == SQUARE_SIZE - 1)
+	   {
+		   strcat_s(szFileLine, sizeof(szFileLine), "\n");
+		   currLines++;
+	   }
+	   fputs(szFileLine, fp);
+   }
+   fclose(fp);
+
+   ps_ptr->ab_in[0] = center_re;
+   ps_ptr->ab_in[1] = center_im;
+   if (!max_iters_reached)
+   #endif
+   {
+      iters = m->mandel_iterate(ps_ptr);  // No queuing- just iterate 1 point
+      if (iters != m->max_iters)          // do this just to match iteration offset of ASM versions
+         iters++;
+   }
+
+   ps_ptr->iters_ptr[0] = iters_ptr;   // Store iters and mag
+   ps_ptr->iterctr += iters;
+   if (ps_ptr->periodic)
+   {
+      iters = m->max_iters;
+      if (iters_ptr != m->iter_data_dummy)
+         ps_ptr->periodic_ctr++;
+   }
+   *ps_ptr->iters_ptr[0] = iters;
+
+   MAG(m, ps_ptr->iters_ptr[0]) = (float) ps_ptr->mag[0];
+   if (m->de)
+      DE(m, ps_ptr->iters_ptr[0]) = (iters == m->max_iters) ? 0.0f :
+                                    de_estimate(m, ps_ptr->mag[0], ps_ptr->dx[0], ps_ptr->dy[0]);
+}
+
+#ifdef USE_ASM_KERNELS
+
+// The asm uses the constant PS4_/PS8_ offsets from quickman.h. Fail the build if the pointstruct
+// layout no longer matches them.
+typedef char ps_offsets_check[(offsetof(man_pointstruct, x) == PS_OFFS_X &&
+                               offsetof(man_pointstruct, y) == PS_OFFS_Y &&
+                               offsetof(man_pointstruct, yy) == PS_OFFS_YY &&
+                               offsetof(man_pointstruct, a) == PS_OFFS_A &&
+                               offsetof(man_pointstruct, b) == PS_OFFS_B &&
+                               offsetof(man_pointstruct, mag) == PS_OFFS_MAG &&
+                               offsetof(man_pointstruct, magprev) == PS_OFFS_MAGPREV &&
+                               offsetof(man_pointstruct, two_d) == PS_OFFS_TWO_D &&
+                               offsetof(man_pointstruct, two_f) == PS_OFFS_TWO_F &&
+                               offsetof(man_pointstruct, rad_d) == PS_OFFS_RAD_D &&
+                               offsetof(man_pointstruct, rad_f) == PS_OFFS_RAD_F &&
+                               offsetof(man_pointstruct, iters) == PS_OFFS_ITERS &&
+                               offsetof(man_pointstruct, iterctr) == PS_OFFS_ITERCTR &&
+                               offsetof(man_pointstruct, cur_max_iters) == PS_OFFS_CUR_MAX_ITERS) ? 1 : -1];
+
+#endif
+
+#ifdef USE_ASM_ITERATE
+
+// Code for ASM iteration functions.
+
+// XMM registers for the SSE2 algorithms
+#define xmm_x01   xmm0
+#define xmm_y01   xmm1
+#define xmm_yy01  xmm2
+#define xmm_mag   xmm3
+#define xmm_x23   xmm4
+#define xmm_y23   xmm5
+#define xmm_yy23  xmm6
+#define xmm_two   xmm7
+
+// XMM registers for the SSE algorithms
+#define xmm_x03   xmm0
+#define xmm_y03   xmm1
+#define xmm_yy03  xmm2
+#define xmm_x47   xmm4
+#define xmm_y47   xmm5
+#define xmm_yy47  xmm6
+
+// Optimized SSE2 (double precision) ASM algorithm that iterates 4 points at a time. The point
+// 2,3 calculations are about a half-iteration behind the point 0,1 calculations, to allow
+// improved interleaving of multiplies and adds. Additionally, the loop is unrolled twice and
+// divergence detection is done only every 2nd iteration. After the loop finishes, the code
+// backs out to check if the points actually diverged during the previous iteration.
+//
+// The divergence detection is done using integer comparisons on the magnitude exponents
+// (the divergence threshold should be a power of two).
+//
+// 8 total iterations (4 points * 2x unroll) are done per loop. It consists
+// of independent, interleaved iteration blocks:
+//
+// do
+// {
+// // Points 0,1     Points 2,3
+//    y += b;        y *= x;
+//    mag += yy;     x *= x;
+//    x += a;        y *= 2;
+//    yy = y;        mag = x;
+//    yy *= yy;      x -= yy;
+//    y *= x;        y += b;
+//    x *= x;        mag += yy;
+//    y *= 2;        x += a;
+//    mag = x;       yy = y;
+//    x -= yy;       yy *= yy;
+//
+//    [2nd iter: repeat above blocks]
+//
+//    if (any 2nd iter mag diverged)
+//       break;
+// }
+// while (--cur_max_iters);
+//
+// Initial conditions: x = y = yy = 0.0
+//
+// Note: The mags in the first half of the loop are not actually calculated in
+// the loop, but are determined afterwards in the backout calculations from
+// stored intermediate values.
+//
+// From timing measurements, the 53-instruction loop takes ~41 clocks on an Athlon 64 4000+ 2.4 GHz.
+//
+// Very slow on a Pentium 4 (~100 clocks) due to blocked store fowarding; see Intel code.
+
+static unsigned iterate_amd_sse2(man_pointstruct *ps_ptr) // sip4
+{
+   __asm
+   {
+   // Tried getting rid of the xmm save/restore by having queue_point load directly into
+   // the xmm registers (see qhold_load_xmm.c): overhead reduction is negligible.
+
+   mov      ebx,           ps_ptr      // Get pointstruct pointer. PS4_ macros below reference [ebx + offset]
+   movapd   xmm_x23,       PS4_X23     // Restore point states
+   movapd   xmm_x01,       PS4_X01
+   movapd   xmm_two,       PS4_TWO
+   movapd   xmm_y23,       PS4_Y23
+   movapd   xmm_y01,       PS4_Y01
+   movapd   xmm_yy23,      PS4_YY23
+
+   mov      edx,           DIV_EXP           // Exp for magnitude exponent comparison. Slower to compare to const directly
+   mov      ecx,           PS4_CUR_MAX_ITERS // max iters to do this call; always even
+   mov      eax,           0                 // iteration counter (for each of the 4 points)
+   jmp      skip_top                         // Jump past 1st 2 movapds for loop entry, eliminating
+   nop                                       // need to restore yy01- lower overhead
+   nop
+   nop                                       // Achieve the magic alignment (see below)
+   nop
+   nop
+   nop
+
+   // Found that it's important for the end-of-loop branch to be on a 16-byte boundary
+   // (code is slower if not). Choose instructions above to cause this.
+   //
+   // v1.0 update: The above no longer holds. Now the magic alignment seems random...
+   // the number of nops above must be determined by trial and error.
+
+iter_loop:
+   movapd   PS4_YY01,      xmm_yy01    // save yy01 for mag backout checking
+   movapd   PS4_X01,       xmm_x01     // save x01 for mag backout checking; contains xx01 - yy01 here
+skip_top:
+   addpd    xmm_y01,       PS4_B01     // y01 += b01; faster at top of loop. Initial y01 = 0
+   mulpd    xmm_y23,       xmm_x23     // y23 *= x23; faster at top of loop.
+   add      eax,           2           // update iteration counter; faster here than 2 insts below
+   mulpd    xmm_x23,       xmm_x23     // x23 *= x23
+   addpd    xmm_x01,       PS4_A01     // x01 += a01
+   addpd    xmm_y23,       xmm_y23     // y23 *= 2; faster here than mulpd xmm_y23, xmm_two
+   movapd   xmm_yy01,      xmm_y01     // yy01 = y01
+   movapd   PS4_X23,       xmm_x23     // save xx23 for magnitude backout checking
+   mulpd    xmm_yy01,      xmm_yy01    // yy01 *= yy01
+   subpd    xmm_x23,       xmm_yy23    // x23 -= yy23
+   mulpd    xmm_y01,       xmm_x01     // y01 *= x01
+   addpd    xmm_y23,       PS4_B23     // y23 += b23
+   mulpd    xmm_x01,       xmm_x01     // x01 *= x01
+   movapd   PS4_YY23,      xmm_yy23    // save yy23 for magnitude backout checking
+   mulpd    xmm_y01,       xmm_two     // y01 *= 2; add slower here; bb stall
+   addpd    xmm_x23,       PS4_A23     // x23 += a23
+   movapd   xmm_mag,       xmm_x01     // mag01 = x01
+   movapd   xmm_yy23,      xmm_y23     // yy23 = y23
+   subpd    xmm_x01,       xmm_yy01    // x01 -= yy01
+   mulpd    xmm_yy23,      xmm_yy23    // yy23 *= yy23
+   addpd    xmm_y01,       PS4_B01     // y01 += b01
+   mulpd    xmm_y23,       xmm_x23     // y23 *= x23
+   // ----- Start of 2nd iteration block ------
+   addpd    xmm_mag,       xmm_yy01
+   mulpd    xmm_x23,       xmm_x23
+   addpd    xmm_x01,       PS4_A01
+   movapd   xmm_yy01,      xmm_y01     // these 2 instrs: faster in this order than reversed (fixes y23 dep?)
+   mulpd    xmm_y23,       xmm_two     // (yy01 is apparently just "marked" to get y01 here; doesn't cause a dep delay)
+   movapd   PS4_MAG01,     xmm_mag     // save point 0,1 magnitudes for comparison
+   movapd   xmm_mag,       xmm_x23
+   mulpd    xmm_yy01,      xmm_yy01
+   subpd    xmm_x23,       xmm_yy23
+   mulpd    xmm_y01,       xmm_x01
+   addpd    xmm_y23,       PS4_B23
+   mulpd    xmm_x01,       xmm_x01
+   addpd    xmm_mag,       xmm_yy23
+   movapd   PS4_MAG23,     xmm_mag     // Save point 2,3 magnitudes. Best here, despite dep
+   cmp      PS4_MEXP0,     edx         // Compare the magnitude exponents of points 0 and 1
+   cmovge   ecx,           eax         // to the divergence threshold. AMD doesn't seem to mind
+   cmp      PS4_MEXP1,     edx         // the store fowarding issue, but Intel does.
+   cmovge   ecx,           eax         // Conditional moves set ecx to eax on divergence,
+   mulpd    xmm_y01,       xmm_two     // breaking the loop.
+   addpd    xmm_x23,       PS4_A23     // add y, y and mul y, two seem equal speed here
+   movapd   xmm_yy23,      xmm_y23
+   subpd    xmm_x01,       xmm_yy01
+   mulpd    xmm_yy23,      xmm_yy23
+   cmp      PS4_MEXP2,     edx         // Compare the magnitude exponents of points 2 and 3.
+   cmovge   ecx,           eax
+   cmp      PS4_MEXP3,     edx
+   cmovge   ecx,           eax
+   cmp      ecx,           eax         // Continue iterating until max iters reached for this call,
+   jne      iter_loop                  // or one of the points diverged.
+
+   // Exited loop: save iterating point states, and update point iteration counts. Because
+   // divergence detection is only done every 2 iterations, need to "back out" and see if
+   // a point diverged the previous iteration. Calculate previous magnitudes from stored
+   // values and save in expp. Caller can then use DIVERGED and DIVERGED_PREV macros
+   // to detect if/when the point diverged.
+
+   // Structure contents here: PS4.x = xx01 - yy01;  PS4.yy = yy01; PS4.x + 16 = xx23; PS4.yy + 16 = yy23
+   // Order here seems fastest, despite dependencies
+   // Really only need to calculate prev mags for points that diverged... could save overhead
+
+   movapd   PS4_Y01,       xmm_y01     // save y01 state
+   movapd   PS4_Y23,       xmm_y23     // save y23 state
+
+   mulpd    xmm_two,       PS4_YY01    // Use xmm_two for tmp var; tmp1 = 2 * yy01
+   movapd   xmm_mag,       PS4_X23     // tmp2 = xx23
+   addpd    xmm_two,       PS4_X01     // get mag01 = xx01 - yy01 + 2 * yy01 = xx01 + yy01
+   addpd    xmm_mag,       PS4_YY23    // get mag23 = xx23 + yy23
+   movapd   PS4_MAGPREV01, xmm_two     // store prev_mag 01
+   movapd   PS4_MAGPREV23, xmm_mag     // store prev_mag 23
+
+   xor      ecx,           ecx         // Get a 0
+   add      PS4_ITERCTR_L, eax         // Update iteration counter. Multiply by 36 to get effective flops.
+   adc      PS4_ITERCTR_H, ecx         // Update iterctr high dword
+
+   movapd   PS4_YY01,      xmm_yy01    // save yy01 state
+   movapd   PS4_X23,       xmm_x23     // save x23 state
+   movapd   PS4_X01,       xmm_x01     // save x01 state
+   movapd   PS4_YY23,      xmm_yy23    // save yy23 state
+
+   add      PS4_ITERS0,    eax         // update point iteration counts
+   add      PS4_ITERS1,    eax
+   add      PS4_ITERS2,    eax
+   add      PS4_ITERS3,    eax
+
+   // return value (iters done per point) is in eax
+
+   // 0xF3 prefix for AMD single byte return fix: does seem to make a difference
+   // Don't put any code between here and ret. Watch for compiler-inserted pops if
+   // using extra registers.
+
+   //pop      ebx        // compiler pushes ebx, ebp on entry
+   //pop      ebp        // accessing ebp gives compiler warning
+   //__emit(0xF3);
+   //ret
+   }
+}
+
+// Intel version. Basically the same as the AMD version, but doesn't do magnitude
+// comparison in the INT domain because this causes a blocked store-forwarding
+// penalty (from XMM store to INT load) of 40-50 clock cycles. Uses cmppd/movmskpd instead.
+//
+// Changed to use same initial conditions as AMD code. No consistent speed difference
+// vs. old version. Appears to be about 0.3% slower on the home benchmark, but
+// 0.5% faster on bmark.log.
+
+// From timing measurements, the loop takes 50 clocks on a Pentium D 820 2.8 GHz.
+
+static unsigned iterate_intel_sse2(man_pointstruct *ps_ptr) // sip4
+{
+   __asm
+   {
+   mov      ebx,           ps_ptr      // Get pointstruct pointer
+   movapd   xmm_yy01,      PS4_YY01    // Restore point states
+   movapd   xmm_y01,       PS4_Y01
+   movapd   xmm_x23,       PS4_X23
+   movapd   xmm_x01,       PS4_X01
+   movapd   xmm_two,       PS4_TWO
+   movapd   xmm_y23,       PS4_Y23
+   movapd   xmm_yy23,      PS4_YY23
+   addpd    xmm_y01,       PS4_B01     // pre-add y01 to get correct initial condition
+
+   mov      eax,           2           // iteration counter (for each of the 4 points)
+   jmp      skip_top
+
+iter_loop:                             // alignment doesn't seem to matter on Intel
+   movapd   PS4_YY01,      xmm_yy01    // save yy01 for mag backout checking
+   movapd   PS4_X01,       xmm_x01     // save x01 for mag backout checking; contains xx01 - yy01 here
+   add      eax,           2           // update iteration counter
+skip_top:
+   mulpd    xmm_x23,       xmm_x23     // x23 *= x23
+   addpd    xmm_x01,       PS4_A01     // x01 += a01
+   addpd    xmm_y23,       xmm_y23     // y23 *= 2; faster here than mulpd xmm_y23, xmm_two
+   movapd   xmm_yy01,      xmm_y01     // yy01 = y01
+   movapd   PS4_X23,       xmm_x23     // save xx23 for magnitude backout checking
+   mulpd    xmm_yy01,      xmm_yy01    // yy01 *= yy01
+   subpd    xmm_x23,       xmm_yy23    // x23 -= yy23
+   mulpd    xmm_y01,       xmm_x01     // y01 *= x01
+   addpd    xmm_y23,       PS4_B23     // y23 += b23
+   mulpd    xmm_x01,       xmm_x01     // x01 *= x01
+   movapd   PS4_YY23,      xmm_yy23    // save yy23 for magnitude backout checking
+   mulpd    xmm_y01,       xmm_two     // y01 *= 2; add slower here
+   addpd    xmm_x23,       PS4_A23     // x23 += a23
+   movapd   xmm_mag,       xmm_x01     // mag01 = x01
+   movapd   xmm_yy23,      xmm_y23     // yy23 = y23
+   subpd    xmm_x01,       xmm_yy01    // x01 -= yy01
+   mulpd    xmm_yy23,      xmm_yy23    // yy23 *= yy23
+   addpd    xmm_y01,       PS4_B01     // y01 += b01
+   mulpd    xmm_y23,       xmm_x23     // y23 *= x23
+   // ----- Start of 2nd iteration block ------
+   addpd    xmm_mag,       xmm_yy01
+   mulpd    xmm_x23,       xmm_x23
+   addpd    xmm_x01,       PS4_A01
+   mulpd    xmm_y23,       xmm_two
+   movapd   xmm_yy01,      xmm_y01
+   movapd   PS4_MAG01,     xmm_mag     // new, mag store for normalized iteration count alg -- not much effect on speed
+   cmpnltpd xmm_mag,       PS4_RAD     // compare point 0, 1 magnitudes (mag >= rad): let cpu reorder these
+   movmskpd edx,           xmm_mag     // save result in edx
+   movapd   xmm_mag,       xmm_x23
+   mulpd    xmm_yy01,      xmm_yy01
+   subpd    xmm_x23,       xmm_yy23
+   mulpd    xmm_y01,       xmm_x01
+   addpd    xmm_y23,       PS4_B23
+   mulpd    xmm_x01,       xmm_x01
+   addpd    xmm_mag,       xmm_yy23
+   mulpd    xmm_y01,       xmm_two
+   addpd    xmm_x23,       PS4_A23
+   add      edx,           edx         // shift point 01 mag compare results left 2
+   add      edx,           edx
+   movapd   xmm_yy23,      xmm_y23
+   subpd    xmm_x01,       xmm_yy01
+   movapd   PS4_MAG23,     xmm_mag     // new, mag store for normalized iteration count alg -- not much effect on speed
+   cmpnltpd xmm_mag,       PS4_RAD     // compare point 2, 3 magnitudes
+   mulpd    xmm_yy23,      xmm_yy23
+   addpd    xmm_y01,       PS4_B01
+   movmskpd ecx,           xmm_mag
+   mulpd    xmm_y23,       xmm_x23
+   or       ecx,           edx         // Continue iterating until max iters reached for this call,
+   jnz      done                       // or one of the points diverged.
+   cmp      PS4_CUR_MAX_ITERS, eax     // No penalty for comparing from memory vs. register here
+   jne      iter_loop
+
+done:
+   subpd    xmm_y01,       PS4_B01     // subtract out pre-add (see loop top)
+   movapd   PS4_Y01,       xmm_y01     // save y01 state
+   movapd   PS4_Y23,       xmm_y23     // save y23 state
+
+   // Get previous magnitudes. See AMD code
+   mulpd    xmm_two,       PS4_YY01    // Use xmm_two for tmp var; tmp1 = 2 * yy01
+   movapd   xmm_mag,       PS4_X23     // tmp2 = xx23
+   addpd    xmm_two,       PS4_X01     // get mag01 = xx01 - yy01 + 2 * yy01 = xx01 + yy01
+   addpd    xmm_mag,       PS4_YY23    // get mag23 = xx23 + yy23
+   movapd   PS4_MAGPREV01, xmm_two     // store prev_mag 01
+   movapd   PS4_MAGPREV23, xmm_mag     // store prev_mag 23
+
+   xor      edx,           edx         // Get a 0
+   add      PS4_ITERCTR_L, eax         // Update iteration counter. Multiply by 36 to get effective flops.
+   adc      PS4_ITERCTR_H, edx         // Update iterctr high dword
+
+   movapd   PS4_YY01,      xmm_yy01    // save yy01 state
+   movapd   PS4_X23,       xmm_x23     // save x23 state
+   movapd   PS4_X01,       xmm_x01     // save x01 state
+   movapd   PS4_YY23,      xmm_yy23    // save yy23 state
+
+   add      PS4_ITERS0,    eax         // update point iteration counts
+   add      PS4_ITERS1,    eax
+   add      PS4_ITERS2,    eax
+   add      PS4_ITERS3,    eax
+   }
+}
+
+// SSE (single precision) algorithm for AMD; iterates 8 points at a time,
+// or 16 iterations per loop. Based on AMD SSE2 algorithm.
+
+// Loop appears to take 42.25 clocks- the 8 extra int compare/cmov
+// instructions add 2 extra clocks per loop vs. the SSE2 algorithm.
+// Tried rearranging them but current order seems best.
+
+static unsigned iterate_amd_sse(man_pointstruct *ps_ptr) // sip8
+{
+   __asm
+   {
+   mov      ebx,           ps_ptr            // Get pointstruct pointer
+   movaps   xmm_x47,       PS8_X47           // Restore point states
+   movaps   xmm_x03,       PS8_X03
+   movaps   xmm_two,       PS8_TWO
+   movaps   xmm_y47,       PS8_Y47
+   movaps   xmm_y03,       PS8_Y03
+   movaps   xmm_yy47,      PS8_YY47
+
+   mov      edx,           DIV_EXP_FLOAT     // Exp for magnitude exponent comparison. Slower to compare to const directly
+   mov      ecx,           PS8_CUR_MAX_ITERS // max iters to do this call; always even
+   mov      eax,           0                 // Iteration counter (for each of the 4 points)
+   jmp      skip_top                         // Allows removing yy03 restore above
+   nop
+   nop                                       // Achieve the magic alignment...
+   nop
+   nop
+   nop
+   nop
+   nop
+   nop
+   nop
+
+iter_loop:
+   movaps   PS8_YY03,      xmm_yy03    // save yy03 for mag backout checking
+   movaps   PS8_X03,       xmm_x03     // save x03 for mag backout checking; contains xx03 - yy03 here
+skip_top:
+   addps    xmm_y03,       PS8_B03     // y03 += b03; faster at top of loop. Initial y03 = 0
+   mulps    xmm_y47,       xmm_x47     // y47 *= x47; faster at top of loop.
+   add      eax,           2           // update iteration counter; faster here than 2 insts below
+   mulps    xmm_x47,       xmm_x47     // x47 *= x47
+   addps    xmm_x03,       PS8_A03     // x03 += a03
+   addps    xmm_y47,       xmm_y47     // y47 *= 2; faster here than mulps xmm_y47, xmm_two
+   movaps   xmm_yy03,      xmm_y03     // yy03 = y03
+   movaps   PS8_X47,       xmm_x47     // save xx47 for magnitude backout checking
+   mulps    xmm_yy03,      xmm_yy03    // yy03 *= yy03
+   subps    xmm_x47,       xmm_yy47    // x47 -= yy47
+   mulps    xmm_y03,       xmm_x03     // y03 *= x03
+   addps    xmm_y47,       PS8_B47     // y47 += b47
+   mulps    xmm_x03,       xmm_x03     // x03 *= x03
+   movaps   PS8_YY47,      xmm_yy47    // save yy47 for magnitude backout checking
+   mulps    xmm_y03,       xmm_two     // y03 *= 2; add slower here; bb stall
+   addps    xmm_x47,       PS8_A47     // x47 += a47
+   movaps   xmm_mag,       xmm_x03     // mag03 = x03
+   movaps   xmm_yy47,      xmm_y47     // yy47 = y47
+   subps    xmm_x03,       xmm_yy03    // x03 -= yy03
+   mulps    xmm_yy47,      xmm_yy47    // yy47 *= yy47
+   addps    xmm_y03,       PS8_B03     // y03 += b03
+   mulps    xmm_y47,       xmm_x47     // y47 *= x47
+   // ----- Start of 2nd iteration block ------
+   addps    xmm_mag,       xmm_yy03
+   mulps    xmm_x47,       xmm_x47
+   addps    xmm_x03,       PS8_A03
+   movaps   xmm_yy03,      xmm_y03     // these 2 instrs: faster in this order than reversed (fixes y47 dep?)
+   mulps    xmm_y47,       xmm_two     // (yy03 is apparently just "marked" to get y03 here; doesn't cause a dep delay)
+   movaps   PS8_MAG03,     xmm_mag     // save point 0-3 magnitudes for comparison
+   movaps   xmm_mag,       xmm_x47
+   mulps    xmm_yy03,      xmm_yy03
+   subps    xmm_x47,       xmm_yy47
+   mulps    xmm_y03,       xmm_x03
+   addps    xmm_y47,       PS8_B47
+   mulps    xmm_x03,       xmm_x03
+   addps    xmm_mag,       xmm_yy47
+   movaps   PS8_MAG47,     xmm_mag     // Save point 4-7 magnitudes. Best here, despite dep
+   cmp      PS8_MEXP0,     edx         // Compare the magnitude exponents of points 0-3
+   cmovge   ecx,           eax         // to the divergence threshold. AMD doesn't seem to mind
+   cmp      PS8_MEXP1,     edx         // the store fowarding issue, but Intel does.
+   cmovge   ecx,           eax         // Conditional moves set ecx to eax on divergence,
+   cmp      PS8_MEXP2,     edx         // breaking the loop.
+   cmovge   ecx,           eax
+   cmp      PS8_MEXP3,     edx
+   cmovge   ecx,           eax
+   mulps    xmm_y03,       xmm_two     // add y, y and mul y, two seem equal speed here
+   addps    xmm_x47,       PS8_A47
+   movaps   xmm_yy47,      xmm_y47
+   subps    xmm_x03,       xmm_yy03
+   mulps    xmm_yy47,      xmm_yy47
+   cmp      PS8_MEXP4,     edx         // Compare the magnitude exponents of points 4-7.
+   cmovge   ecx,           eax
+   cmp      PS8_MEXP5,     edx
+   cmovge   ecx,           eax
+   cmp      PS8_MEXP6,     edx
+   cmovge   ecx,           eax
+   cmp      PS8_MEXP7,     edx
+   //cmovge   ecx,           eax       // jge done seems a hair faster. When changing instrs, don't forget
+   jge      done                       // to adjust nops to put jne iter_loop on a 16-byte boundary.
+   cmp      ecx,           eax         // Continue iterating until max iters reached for this call,
+   jne      iter_loop                  // or one of the points diverged.
+
+done:
+   // Get previous magnitudes. See AMD SSE2 code
+   movaps   PS8_Y03,       xmm_y03     // save y03 state
+   movaps   PS8_Y47,       xmm_y47     // save y47 state
+
+   mulps    xmm_two,       PS8_YY03    // Use xmm_two for tmp var; tmp1 = 2 * yy03
+   movaps   xmm_mag,       PS8_X47     // tmp2 = xx47
+   addps    xmm_two,       PS8_X03     // get mag03 = xx03 - yy03 + 2 * yy03 = xx03 + yy03
+   addps    xmm_mag,       PS8_YY47    // get mag47 = xx47 + yy47
+   movaps   PS8_MAGPREV03, xmm_two     // store prev_mag 03
+   movaps   PS8_MAGPREV47, xmm_mag     // store prev_mag 47
+
+   xor      ecx,           ecx         // Get a 0
+   add      PS8_ITERCTR_L, eax         // Update iteration counter. Multiply by 72 to get effective flops.
+   adc      PS8_ITERCTR_H, ecx         // Update iterctr high dword
+
+   movaps   PS8_YY03,      xmm_yy03    // save yy03 state
+   movaps   PS8_X47,       xmm_x47     // save x47 state
+   movaps   PS8_X03,       xmm_x03     // save x03 state
+   movaps   PS8_YY47,      xmm_yy47    // save yy47 state
+
+   add      PS8_ITERS0,    eax         // update point iteration counts
+   add      PS8_ITERS1,    eax
+   add      PS8_ITERS2,    eax
+   add      PS8_ITERS3,    eax
+   add      PS8_ITERS4,    eax
+   add      PS8_ITERS5,    eax
+   add      PS8_ITERS6,    eax
+   add      PS8_ITERS7,    eax
+   // return value (iterations done per point) is in eax
+   }
+}
+
+// SSE (single precision) algorithm for Intel; iterates 8 points at a time,
+// or 16 iterations per loop. Based on Intel SSE2 algorithm.
+static unsigned iterate_intel_sse(man_pointstruct *ps_ptr) // sip8
+{
+   __asm
+   {
+   mov      ebx,           ps_ptr      // Get pointstruct pointer
+   movaps   xmm_yy03,      PS8_YY03    // Restore point states
+   movaps   xmm_x47,       PS8_X47
+   movaps   xmm_x03,       PS8_X03
+   movaps   xmm_two,       PS8_TWO
+   movaps   xmm_y47,       PS8_Y47
+   movaps   xmm_y03,       PS8_Y03
+   movaps   xmm_yy47,      PS8_YY47
+   addps    xmm_y03,       PS8_B03     // pre-add y03 to get correct initial condition
+
+   mov      eax,           2           // iteration counter (for each of the 4 points)
+   jmp      skip_top
+
+iter_loop:                             // alignment doesn't seem to matter on Intel
+   movaps   PS8_YY03,      xmm_yy03    // save yy03 for mag backout checking
+   movaps   PS8_X03,       xmm_x03     // save x03 for mag backout checking; contains xx03 - yy03 here
+   add      eax,           2           // update iteration counter
+skip_top:
+   mulps    xmm_x47,       xmm_x47     // x47 *= x47
+   addps    xmm_x03,       PS8_A03     // x03 += a03
+   addps    xmm_y47,       xmm_y47     // y47 *= 2; faster here than mulps xmm_y47, xmm_two
+   movaps   xmm_yy03,      xmm_y03     // yy03 = y03
+   movaps   PS8_X47,       xmm_x47     // save xx47 for magnitude backout checking
+   mulps    xmm_yy03,      xmm_yy03    // yy03 *= yy03
+   subps    xmm_x47,       xmm_yy47    // x47 -= yy47
+   mulps    xmm_y03,       xmm_x03     // y03 *= x03
+   addps    xmm_y47,       PS8_B47     // y47 += b47
+   mulps    xmm_x03,       xmm_x03     // x03 *= x03
+   movaps   PS8_YY47,      xmm_yy47    // save yy47 for magnitude backout checking
+   mulps    xmm_y03,       xmm_two     // y03 *= 2; add slower here
+   addps    xmm_x47,       PS8_A47     // x47 += a47
+   movaps   xmm_mag,       xmm_x03     // mag03 = x03
+   movaps   xmm_yy47,      xmm_y47     // yy47 = y47
+   subps    xmm_x03,       xmm_yy03    // x03 -= yy03
+   mulps    xmm_yy47,      xmm_yy47    // yy47 *= yy47
+   addps    xmm_y03,       PS8_B03     // y03 += b03
+   mulps    xmm_y47,       xmm_x47     // y47 *= x47
+   // ----- Start of 2nd iteration block ------
+   addps    xmm_mag,       xmm_yy03
+   mulps    xmm_x47,       xmm_x47
+   addps    xmm_x03,       PS8_A03
+   mulps    xmm_y47,       xmm_two
+   movaps   xmm_yy03,      xmm_y03
+   movapd   PS8_MAG03,     xmm_mag     // new, mag store for normalized iteration count alg -- not much effect on speed
+   cmpnltps xmm_mag,       PS8_RAD     // compare point 0-3 magnitudes (mag >= rad): let cpu reorder these
+   movmskps edx,           xmm_mag     // save result in edx
+   movaps   xmm_mag,       xmm_x47
+   mulps    xmm_yy03,      xmm_yy03
+   subps    xmm_x47,       xmm_yy47
+   mulps    xmm_y03,       xmm_x03
+   addps    xmm_y47,       PS8_B47
+   mulps    xmm_x03,       xmm_x03
+   addps    xmm_mag,       xmm_yy47
+   mulps    xmm_y03,       xmm_two
+   addps    xmm_x47,       PS8_A47
+   shl      edx,           4           // shift point 0-3 mag compare results left 4
+   movaps   xmm_yy47,      xmm_y47
+   subps    xmm_x03,       xmm_yy03
+   movapd   PS8_MAG47,     xmm_mag     // new, mag store for normalized iteration count alg -- not much effect on speed
+   cmpnltps xmm_mag,       PS8_RAD     // compare point 4-7 magnitudes
+   mulps    xmm_yy47,      xmm_yy47
+   addps    xmm_y03,       PS8_B03
+   movmskps ecx,           xmm_mag
+   mulps    xmm_y47,       xmm_x47
+   or       ecx,           edx         // Continue iterating until max iters reached for this call,
+   jnz      done                       // or one of the points diverged.
+   cmp      PS8_CUR_MAX_ITERS, eax     // No penalty for comparing from memory vs. register here
+   jne      iter_loop
+
+ done:
+   subps    xmm_y03,       PS8_B03     // subtract out pre-add (see loop top)
+   movaps   PS8_Y03,       xmm_y03     // save y03 state
+   movaps   PS8_Y47,       xmm_y47     // save y47 state
+
+   // Get previous magnitudes. See AMD SSE2 code
+   mulps    xmm_two,       PS8_YY03    // Use xmm_two for tmp var; tmp1 = 2 * yy03
+   movaps   xmm_mag,       PS8_X47     // tmp2 = xx47
+   addps    xmm_two,       PS8_X03     // get mag03 = xx03 - yy03 + 2 * yy03 = xx03 + yy03
+   addps    xmm_mag,       PS8_YY47    // get mag47 = xx47 + yy47
+   movaps   PS8_MAGPREV03, xmm_two     // store prev_mag 03
+   movaps   PS8_MAGPREV47, xmm_mag     // store prev_mag 47
+
+   xor      edx,           edx         // Get a 0
+   add      PS8_ITERCTR_L, eax         // Update iteration counter. Multiply by 72 to get effective flops.
+   adc      PS8_ITERCTR_H, edx         // Update iterctr high dword
+
+   movaps   PS8_YY03,      xmm_yy03    // save yy03 state
+   movaps   PS8_X47,       xmm_x47     // save x47 state
+   movaps   PS8_X03,       xmm_x03     // save x03 state
+   movaps   PS8_YY47,      xmm_yy47    // save yy47 state
+
+   add      PS8_ITERS0,    eax         // update point iteration counts
+   add      PS8_ITERS1,    eax
+   add      PS8_ITERS2,    eax
+   add      PS8_ITERS3,    eax
+   add      PS8_ITERS4,    eax
+   add      PS8_ITERS5,    eax
+   add      PS8_ITERS6,    eax
+   add      PS8_ITERS7,    eax
+   }
+}
+
+
+#else // !USE_ASM_ITERATE
+
+// SSE2/SSE intrinsic versions of the ASM iteration functions, for compilers/targets without
+// inline ASM (gcc, clang, 64-bit MSVC), and for 32-bit MSVC unless USE_ASM_ITERATE is defined:
+// unlike the ASM code, they have periodicity checking. Same interface otherwise: the loop is
+// unrolled twice, divergence is only checked every 2nd iteration, and the previous magnitudes
+// are left in magprev for the DIVERGED_PREV check in the queue functions.
+//
+// The stored state is simpler than the ASM code's: x and y hold the current z, and yy isn't
+// used. Per iteration: xx = x * x, yy = y * y, mag = xx + yy, y = 2 * x * y + b, x = xx - yy + a.
+// The mag computed by an iteration is the magnitude of the point before the update, so after n
+// iterations mag has |z(n-1)|^2 and magprev has |z(n-2)|^2- the same as the ASM code.
+//
+// Compare with cmpnlt (not less than) so NaNs count as diverged.
+
+static unsigned iterate_sse2(man_pointstruct *ps_ptr) // sip4
+{
+   __m128d x01, x23, y01, y23, xx01, xx23, yy01, yy23, mag01, mag23, magprev01, magprev23;
+   __m128d a01, a23, b01, b23, rad;
+   __m128d px01, px23, py01, py23, per01, per23, tol, sign, sv;
+   __m128i due;
+   unsigned iters, max, save;
+
+   x01 = _mm_load_pd(&ps_ptr->x[0]);   // Restore point states
+   x23 = _mm_load_pd(&ps_ptr->x[2]);
+   y01 = _mm_load_pd(&ps_ptr->y[0]);
+   y23 = _mm_load_pd(&ps_ptr->y[2]);
+   a01 = _mm_load_pd(&ps_ptr->a[0]);
+   a23 = _mm_load_pd(&ps_ptr->a[2]);
+   b01 = _mm_load_pd(&ps_ptr->b[0]);
+   b23 = _mm_load_pd(&ps_ptr->b[2]);
+   rad = _mm_set1_pd(DIVERGED_THRESH);
+   px01 = _mm_load_pd(&ps_ptr->period_x[0]);   // Restore saved orbit points
+   px23 = _mm_load_pd(&ps_ptr->period_x[2]);
+   py01 = _mm_load_pd(&ps_ptr->period_y[0]);
+   py23 = _mm_load_pd(&ps_ptr->period_y[2]);
+   tol = _mm_set1_pd(ps_ptr->period_tol);
+   sign = _mm_set1_pd(-0.0);
+
+   max = ps_ptr->cur_max_iters;        // max iters to do this call; always even
+   iters = 0;
+   save = ps_ptr->period_save;   // iterations to the first save count
+
+   do
+   {
+      // 1st iteration; points 0,1 and 2,3 are independent so the CPU can interleave them
+      xx01 = _mm_mul_pd(x01, x01);
+      xx23 = _mm_mul_pd(x23, x23);
+      yy01 = _mm_mul_pd(y01, y01);
+      yy23 = _mm_mul_pd(y23, y23);
+      magprev01 = _mm_add_pd(xx01, yy01);
+      magprev23 = _mm_add_pd(xx23, yy23);
+      y01 = _mm_add_pd(_mm_mul_pd(_mm_add_pd(x01, x01), y01), b01);
+      y23 = _mm_add_pd(_mm_mul_pd(_mm_add_pd(x23, x23), y23), b23);
+      x01 = _mm_add_pd(_mm_sub_pd(xx01, yy01), a01);
+      x23 = _mm_add_pd(_mm_sub_pd(xx23, yy23), a23);
+
+      // 2nd iteration
+      xx01 = _mm_mul_pd(x01, x01);
+      xx23 = _mm_mul_pd(x23, x23);
+      yy01 = _mm_mul_pd(y01, y01);
+      yy23 = _mm_mul_pd(y23, y23);
+      mag01 = _mm_add_pd(xx01, yy01);
+      mag23 = _mm_add_pd(xx23, yy23);
+      y01 = _mm_add_pd(_mm_mul_pd(_mm_add_pd(x01, x01), y01), b01);
+      y23 = _mm_add_pd(_mm_mul_pd(_mm_add_pd(x23, x23), y23), b23);
+      x01 = _mm_add_pd(_mm_sub_pd(xx01, yy01), a01);
+      x23 = _mm_add_pd(_mm_sub_pd(xx23, yy23), a23);
+
+      // Periodicity check: is z back within tolerance of the saved orbit point? At the save
+      // counts, save z instead (see PERIOD_FIRST_SAVE).
+      per01 = _mm_cmplt_pd(_mm_add_pd(_mm_andnot_pd(sign, _mm_sub_pd(x01, px01)),
+                                      _mm_andnot_pd(sign, _mm_sub_pd(y01, py01))), tol);
+      per23 = _mm_cmplt_pd(_mm_add_pd(_mm_andnot_pd(sign, _mm_sub_pd(x23, px23)),
+                                      _mm_andnot_pd(sign, _mm_sub_pd(y23, py23))), tol);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         save = period_save_sse2(ps_ptr, &due, 1, iters);
+         sv = _mm_castsi128_pd(_mm_unpacklo_epi32(due, due));
+         px01 = _mm_or_pd(_mm_and_pd(sv, x01), _mm_andnot_pd(sv, px01));
+         py01 = _mm_or_pd(_mm_and_pd(sv, y01), _mm_andnot_pd(sv, py01));
+         sv = _mm_castsi128_pd(_mm_unpackhi_epi32(due, due));
+         px23 = _mm_or_pd(_mm_and_pd(sv, x23), _mm_andnot_pd(sv, px23));
+         py23 = _mm_or_pd(_mm_and_pd(sv, y23), _mm_andnot_pd(sv, py23));
+      }
+   }
+   while (!(_mm_movemask_pd(_mm_or_pd(_mm_cmpnlt_pd(mag01, rad), per01)) |
+            _mm_movemask_pd(_mm_or_pd(_mm_cmpnlt_pd(mag23, rad), per23)))
+          && iters != max);
+
+   _mm_store_pd(&ps_ptr->x[0], x01);   // Save point states and magnitudes
+   _mm_store_pd(&ps_ptr->x[2], x23);
+   _mm_store_pd(&ps_ptr->y[0], y01);
+   _mm_store_pd(&ps_ptr->y[2], y23);
+   _mm_store_pd(&ps_ptr->mag[0], mag01);
+   _mm_store_pd(&ps_ptr->mag[2], mag23);
+   _mm_store_pd(&ps_ptr->magprev[0], magprev01);
+   _mm_store_pd(&ps_ptr->magprev[2], magprev23);
+   _mm_store_pd(&ps_ptr->period_x[0], px01);
+   _mm_store_pd(&ps_ptr->period_x[2], px23);
+   _mm_store_pd(&ps_ptr->period_y[0], py01);
+   _mm_store_pd(&ps_ptr->period_y[2], py23);
+   ps_ptr->periodic = _mm_movemask_pd(per01) | (_mm_movemask_pd(per23) << 2);
+
+   ps_ptr->period_save = save - iters;
+   ps_ptr->iterctr += iters;
+   ps_ptr->iters[0] += iters;          // update point iteration counts
+   ps_ptr->iters[1] += iters;
+   ps_ptr->iters[2] += iters;
+   ps_ptr->iters[3] += iters;
+
+   return iters;
+}
+
+// Single precision version; iterates 8 points at a time. Floats are packed into the double arrays.
+static unsigned iterate_sse(man_pointstruct *ps_ptr) // sip8
+{
+   __m128 x03, x47, y03, y47, xx03, xx47, yy03, yy47, mag03, mag47, magprev03, magprev47;
+   __m128 a03, a47, b03, b47, rad;
+   __m128 px03, px47, py03, py47, per03, per47, tol, sign, sv;
+   __m128i due[2];
+   unsigned i, iters, max, save;
+
+   x03 = _mm_load_ps((float *) ps_ptr->x);
+   x47 = _mm_load_ps((float *) ps_ptr->x + 4);
+   y03 = _mm_load_ps((float *) ps_ptr->y);
+   y47 = _mm_load_ps((float *) ps_ptr->y + 4);
+   a03 = _mm_load_ps((float *) ps_ptr->a);
+   a47 = _mm_load_ps((float *) ps_ptr->a + 4);
+   b03 = _mm_load_ps((float *) ps_ptr->b);
+   b47 = _mm_load_ps((float *) ps_ptr->b + 4);
+   rad = _mm_set1_ps((float) DIVERGED_THRESH);
+   px03 = _mm_load_ps((float *) ps_ptr->period_x);   // Restore saved orbit points
+   px47 = _mm_load_ps((float *) ps_ptr->period_x + 4);
+   py03 = _mm_load_ps((float *) ps_ptr->period_y);
+   py47 = _mm_load_ps((float *) ps_ptr->period_y + 4);
+   tol = _mm_set1_ps((float) ps_ptr->period_tol);
+   sign = _mm_set1_ps(-0.0f);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   save = ps_ptr->period_save;   // iterations to the first save count
+
+   do
+   {
+      xx03 = _mm_mul_ps(x03, x03);
+      xx47 = _mm_mul_ps(x47, x47);
+      yy03 = _mm_mul_ps(y03, y03);
+      yy47 = _mm_mul_ps(y47, y47);
+      magprev03 = _mm_add_ps(xx03, yy03);
+      magprev47 = _mm_add_ps(xx47, yy47);
+      y03 = _mm_add_ps(_mm_mul_ps(_mm_add_ps(x03, x03), y03), b03);
+      y47 = _mm_add_ps(_mm_mul_ps(_mm_add_ps(x47, x47), y47), b47);
+      x03 = _mm_add_ps(_mm_sub_ps(xx03, yy03), a03);
+      x47 = _mm_add_ps(_mm_sub_ps(xx47, yy47), a47);
+
+      xx03 = _mm_mul_ps(x03, x03);
+      xx47 = _mm_mul_ps(x47, x47);
+      yy03 = _mm_mul_ps(y03, y03);
+      yy47 = _mm_mul_ps(y47, y47);
+      mag03 = _mm_add_ps(xx03, yy03);
+      mag47 = _mm_add_ps(xx47, yy47);
+      y03 = _mm_add_ps(_mm_mul_ps(_mm_add_ps(x03, x03), y03), b03);
+      y47 = _mm_add_ps(_mm_mul_ps(_mm_add_ps(x47, x47), y47), b47);
+      x03 = _mm_add_ps(_mm_sub_ps(xx03, yy03), a03);
+      x47 = _mm_add_ps(_mm_sub_ps(xx47, yy47), a47);
+
+      // Periodicity check (see iterate_sse2)
+      per03 = _mm_cmplt_ps(_mm_add_ps(_mm_andnot_ps(sign, _mm_sub_ps(x03, px03)),
+                                      _mm_andnot_ps(sign, _mm_sub_ps(y03, py03))), tol);
+      per47 = _mm_cmplt_ps(_mm_add_ps(_mm_andnot_ps(sign, _mm_sub_ps(x47, px47)),
+                                      _mm_andnot_ps(sign, _mm_sub_ps(y47, py47))), tol);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         save = period_save_sse2(ps_ptr, due, 2, iters);
+         sv = _mm_castsi128_ps(due[0]);
+         px03 = _mm_or_ps(_mm_and_ps(sv, x03), _mm_andnot_ps(sv, px03));
+         py03 = _mm_or_ps(_mm_and_ps(sv, y03), _mm_andnot_ps(sv, py03));
+         sv = _mm_castsi128_ps(due[1]);
+         px47 = _mm_or_ps(_mm_and_ps(sv, x47), _mm_andnot_ps(sv, px47));
+         py47 = _mm_or_ps(_mm_and_ps(sv, y47), _mm_andnot_ps(sv, py47));
+      }
+   }
+   while (!(_mm_movemask_ps(_mm_or_ps(_mm_cmpnlt_ps(mag03, rad), per03)) |
+            _mm_movemask_ps(_mm_or_ps(_mm_cmpnlt_ps(mag47, rad), per47)))
+          && iters != max);
+
+   _mm_store_ps((float *) ps_ptr->x, x03);
+   _mm_store_ps((float *) ps_ptr->x + 4, x47);
+   _mm_store_ps((float *) ps_ptr->y, y03);
+   _mm_store_ps((float *) ps_ptr->y + 4, y47);
+   _mm_store_ps((float *) ps_ptr->mag, mag03);
+   _mm_store_ps((float *) ps_ptr->mag + 4, mag47);
+   _mm_store_ps((float *) ps_ptr->magprev, magprev03);
+   _mm_store_ps((float *) ps_ptr->magprev + 4, magprev47);
+   _mm_store_ps((float *) ps_ptr->period_x, px03);
+   _mm_store_ps((float *) ps_ptr->period_x + 4, px47);
+   _mm_store_ps((float *) ps_ptr->period_y, py03);
+   _mm_store_ps((float *) ps_ptr->period_y + 4, py47);
+   ps_ptr->periodic = _mm_movemask_ps(per03) | (_mm_movemask_ps(per47) << 4);
+
+   ps_ptr->period_save = save - iters;
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 8; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+#endif // USE_ASM_ITERATE
+
+#ifdef USE_AVX_KERNELS
+
+// AVX iteration functions. Same as the SSE2/SSE intrinsic versions above, but with 256-bit
+// registers: 8 doubles or 16 floats in flight, as two independent chains of 4 (8) points.
+// Each function is compiled for AVX on its own, so the rest of the code still runs on
+// CPUs without it; they're only in the kernel table if detect_cpu_features found AVX.
+// (Only AVX floating point instructions are needed, not AVX2.)
+//
+// x and y hold the current z (yy isn't used), and mag/magprev get the same values as the
+// SSE2 code, so the queue functions can use the usual DIVERGED macros.
+
+#ifdef _MSC_VER
+#define TARGET_AVX
+#else
+#define TARGET_AVX __attribute__((target("avx")))
+#endif
+
+// period_save_sse2 with the SSE4.1 minimum
+TARGET_AVX static __inline unsigned period_save_avx(man_pointstruct *ps_ptr, __m128i *due, int n, unsigned iters)
+{
+   __m128i count, next, d;
+   int i;
+
+   d = _mm_set1_epi32(MAX_ITERS);
+   for (i = 0; i < n; i++)
+   {
+      count = _mm_add_epi32(_mm_load_si128((__m128i *) ps_ptr->iters + i), _mm_set1_epi32(iters));
+      next = _mm_load_si128((__m128i *) ps_ptr->period_next + i);
+      due[i] = _mm_cmpeq_epi32(count, next);
+      next = _mm_add_epi32(next, _mm_and_si128(due[i], next));
+      _mm_store_si128((__m128i *) ps_ptr->period_next + i, next);
+      d = _mm_min_epi32(d, _mm_sub_epi32(next, count));
+   }
+   d = _mm_min_epi32(d, _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+   d = _mm_min_epi32(d, _mm_shuffle_epi32(d, _MM_SHUFFLE(2, 3, 0, 1)));
+   return iters + _mm_cvtsi128_si32(d);
+}
+
+// Masks for the points period_save_avx found at their save counts, for 4 doubles or 8 floats
+TARGET_AVX static __inline __m256d period_mask_pd(__m128i due)
+{
+   return _mm256_castsi256_pd(_mm256_insertf128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi32(due, due)),
+                                                      _mm_unpackhi_epi32(due, due), 1));
+}
+
+TARGET_AVX static __inline __m256 period_mask_ps(__m128i lo, __m128i hi)
+{
+   return _mm256_castsi256_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+}
+
+// x where the mask is set, else p. Not blendv: GCC turns that into a select on the integer
+// compare behind the mask, which AVX without AVX2 does one element at a time.
+TARGET_AVX static __inline __m256d period_blend_pd(__m256d mask, __m256d x, __m256d p)
+{
+   return _mm256_or_pd(_mm256_and_pd(mask, x), _mm256_andnot_pd(mask, p));
+}
+
+TARGET_AVX static __inline __m256 period_blend_ps(__m256 mask, __m256 x, __m256 p)
+{
+   return _mm256_or_ps(_mm256_and_ps(mask, x), _mm256_andnot_ps(mask, p));
+}
+
+TARGET_AVX static unsigned iterate_avx(man_pointstruct *ps_ptr) // sip8d
+{
+   __m256d x03, x47, y03, y47, xx03, xx47, yy03, yy47, mag03, mag47, magprev03, magprev47;
+   __m256d a03, a47, b03, b47, rad;
+   __m256d px03, px47, py03, py47, per03, per47, tol, sign;
+   __m128i due[2];
+   unsigned i, iters, max, save;
+
+   x03 = _mm256_load_pd(&ps_ptr->x[0]);   // Restore point states
+   x47 = _mm256_load_pd(&ps_ptr->x[4]);
+   y03 = _mm256_load_pd(&ps_ptr->y[0]);
+   y47 = _mm256_load_pd(&ps_ptr->y[4]);
+   a03 = _mm256_load_pd(&ps_ptr->a[0]);
+   a47 = _mm256_load_pd(&ps_ptr->a[4]);
+   b03 = _mm256_load_pd(&ps_ptr->b[0]);
+   b47 = _mm256_load_pd(&ps_ptr->b[4]);
+   rad = _mm256_set1_pd(DIVERGED_THRESH);
+   px03 = _mm256_load_pd(&ps_ptr->period_x[0]);   // Restore saved orbit points
+   px47 = _mm256_load_pd(&ps_ptr->period_x[4]);
+   py03 = _mm256_load_pd(&ps_ptr->period_y[0]);
+   py47 = _mm256_load_pd(&ps_ptr->period_y[4]);
+   tol = _mm256_set1_pd(ps_ptr->period_tol);
+   sign = _mm256_set1_pd(-0.0);
+
+   max = ps_ptr->cur_max_iters;           // max iters to do this call; always even
+   iters = 0;
+   save = ps_ptr->period_save;   // iterations to the first save count
+
+   do
+   {
+      xx03 = _mm256_mul_pd(x03, x03);
+      xx47 = _mm256_mul_pd(x47, x47);
+      yy03 = _mm256_mul_pd(y03, y03);
+      yy47 = _mm256_mul_pd(y47, y47);
+      magprev03 = _mm256_add_pd(xx03, yy03);
+      magprev47 = _mm256_add_pd(xx47, yy47);
+      y03 = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(x03, x03), y03), b03);
+      y47 = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(x47, x47), y47), b47);
+      x03 = _mm256_add_pd(_mm256_sub_pd(xx03, yy03), a03);
+      x47 = _mm256_add_pd(_mm256_sub_pd(xx47, yy47), a47);
+
+      xx03 = _mm256_mul_pd(x03, x03);
+      xx47 = _mm256_mul_pd(x47, x47);
+      yy03 = _mm256_mul_pd(y03, y03);
+      yy47 = _mm256_mul_pd(y47, y47);
+      mag03 = _mm256_add_pd(xx03, yy03);
+      mag47 = _mm256_add_pd(xx47, yy47);
+      y03 = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(x03, x03), y03), b03);
+      y47 = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(x47, x47), y47), b47);
+      x03 = _mm256_add_pd(_mm256_sub_pd(xx03, yy03), a03);
+      x47 = _mm256_add_pd(_mm256_sub_pd(xx47, yy47), a47);
+
+      // Periodicity check (see iterate_sse2)
+      per03 = _mm256_cmp_pd(_mm256_add_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(x03, px03)),
+                                          _mm256_andnot_pd(sign, _mm256_sub_pd(y03, py03))), tol, _CMP_LT_OQ);
+      per47 = _mm256_cmp_pd(_mm256_add_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(x47, px47)),
+                                          _mm256_andnot_pd(sign, _mm256_sub_pd(y47, py47))), tol, _CMP_LT_OQ);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         save = period_save_avx(ps_ptr, due, 2, iters);
+         px03 = period_blend_pd(period_mask_pd(due[0]), x03, px03);
+         px47 = period_blend_pd(period_mask_pd(due[1]), x47, px47);
+         py03 = period_blend_pd(period_mask_pd(due[0]), y03, py03);
+         py47 = period_blend_pd(period_mask_pd(due[1]), y47, py47);
+      }
+   }
+   while (!(_mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(mag03, rad, _CMP_NLT_UQ), per03)) |
+            _mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(mag47, rad, _CMP_NLT_UQ), per47)))
+          && iters != max);
+
+   _mm256_store_pd(&ps_ptr->x[0], x03);   // Save point states and magnitudes
+   _mm256_store_pd(&ps_ptr->x[4], x47);
+   _mm256_store_pd(&ps_ptr->y[0], y03);
+   _mm256_store_pd(&ps_ptr->y[4], y47);
+   _mm256_store_pd(&ps_ptr->mag[0], mag03);
+   _mm256_store_pd(&ps_ptr->mag[4], mag47);
+   _mm256_store_pd(&ps_ptr->magprev[0], magprev03);
+   _mm256_store_pd(&ps_ptr->magprev[4], magprev47);
+   _mm256_store_pd(&ps_ptr->period_x[0], px03);
+   _mm256_store_pd(&ps_ptr->period_x[4], px47);
+   _mm256_store_pd(&ps_ptr->period_y[0], py03);
+   _mm256_store_pd(&ps_ptr->period_y[4], py47);
+   ps_ptr->periodic = _mm256_movemask_pd(per03) | (_mm256_movemask_pd(per47) << 4);
+
+   ps_ptr->period_save = save - iters;
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 8; i++)                // update point iteration counts
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+// Single precision version; iterates 16 points at a time
+TARGET_AVX static unsigned iterate_avx_s(man_pointstruct *ps_ptr) // sip16
+{
+   __m256 x07, x8f, y07, y8f, xx07, xx8f, yy07, yy8f, mag07, mag8f, magprev07, magprev8f;
+   __m256 a07, a8f, b07, b8f, rad;
+   __m256 px07, px8f, py07, py8f, per07, per8f, tol, sign;
+   __m128i due[4];
+   unsigned i, iters, max, save;
+
+   x07 = _mm256_load_ps((float *) ps_ptr->x);
+   x8f = _mm256_load_ps((float *) ps_ptr->x + 8);
+   y07 = _mm256_load_ps((float *) ps_ptr->y);
+   y8f = _mm256_load_ps((float *) ps_ptr->y + 8);
+   a07 = _mm256_load_ps((float *) ps_ptr->a);
+   a8f = _mm256_load_ps((float *) ps_ptr->a + 8);
+   b07 = _mm256_load_ps((float *) ps_ptr->b);
+   b8f = _mm256_load_ps((float *) ps_ptr->b + 8);
+   rad = _mm256_set1_ps((float) DIVERGED_THRESH);
+   px07 = _mm256_load_ps((float *) ps_ptr->period_x);   // Restore saved orbit points
+   px8f = _mm256_load_ps((float *) ps_ptr->period_x + 8);
+   py07 = _mm256_load_ps((float *) ps_ptr->period_y);
+   py8f = _mm256_load_ps((float *) ps_ptr->period_y + 8);
+   tol = _mm256_set1_ps((float) ps_ptr->period_tol);
+   sign = _mm256_set1_ps(-0.0f);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   save = ps_ptr->period_save;   // iterations to the first save count
+
+   do
+   {
+      xx07 = _mm256_mul_ps(x07, x07);
+      xx8f = _mm256_mul_ps(x8f, x8f);
+      yy07 = _mm256_mul_ps(y07, y07);
+      yy8f = _mm256_mul_ps(y8f, y8f);
+      magprev07 = _mm256_add_ps(xx07, yy07);
+      magprev8f = _mm256_add_ps(xx8f, yy8f);
+      y07 = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(x07, x07), y07), b07);
+      y8f = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(x8f, x8f), y8f), b8f);
+      x07 = _mm256_add_ps(_mm256_sub_ps(xx07, yy07), a07);
+      x8f = _mm256_add_ps(_mm256_sub_ps(xx8f, yy8f), a8f);
+
+      xx07 = _mm256_mul_ps(x07, x07);
+      xx8f = _mm256_mul_ps(x8f, x8f);
+      yy07 = _mm256_mul_ps(y07, y07);
+      yy8f = _mm256_mul_ps(y8f, y8f);
+      mag07 = _mm256_add_ps(xx07, yy07);
+      mag8f = _mm256_add_ps(xx8f, yy8f);
+      y07 = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(x07, x07), y07), b07);
+      y8f = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(x8f, x8f), y8f), b8f);
+      x07 = _mm256_add_ps(_mm256_sub_ps(xx07, yy07), a07);
+      x8f = _mm256_add_ps(_mm256_sub_ps(xx8f, yy8f), a8f);
+
+      // Periodicity check (see iterate_sse2)
+      per07 = _mm256_cmp_ps(_mm256_add_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(x07, px07)),
+                                          _mm256_andnot_ps(sign, _mm256_sub_ps(y07, py07))), tol, _CMP_LT_OQ);
+      per8f = _mm256_cmp_ps(_mm256_add_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(x8f, px8f)),
+                                          _mm256_andnot_ps(sign, _mm256_sub_ps(y8f, py8f))), tol, _CMP_LT_OQ);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         save = period_save_avx(ps_ptr, due, 4, iters);
+         px07 = period_blend_ps(period_mask_ps(due[0], due[1]), x07, px07);
+         px8f = period_blend_ps(period_mask_ps(due[2], due[3]), x8f, px8f);
+         py07 = period_blend_ps(period_mask_ps(due[0], due[1]), y07, py07);
+         py8f = period_blend_ps(period_mask_ps(due[2], due[3]), y8f, py8f);
+      }
+   }
+   while (!(_mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(mag07, rad, _CMP_NLT_UQ), per07)) |
+            _mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(mag8f, rad, _CMP_NLT_UQ), per8f)))
+          && iters != max);
+
+   _mm256_store_ps((float *) ps_ptr->x, x07);
+   _mm256_store_ps((float *) ps_ptr->x + 8, x8f);
+   _mm256_store_ps((float *) ps_ptr->y, y07);
+   _mm256_store_ps((float *) ps_ptr->y + 8, y8f);
+   _mm256_store_ps((float *) ps_ptr->mag, mag07);
+   _mm256_store_ps((float *) ps_ptr->mag + 8, mag8f);
+   _mm256_store_ps((float *) ps_ptr->magprev, magprev07);
+   _mm256_store_ps((float *) ps_ptr->magprev + 8, magprev8f);
+   _mm256_store_ps((float *) ps_ptr->period_x, px07);
+   _mm256_store_ps((float *) ps_ptr->period_x + 8, px8f);
+   _mm256_store_ps((float *) ps_ptr->period_y, py07);
+   _mm256_store_ps((float *) ps_ptr->period_y + 8, py8f);
+   ps_ptr->periodic = _mm256_movemask_ps(per07) | (_mm256_movemask_ps(per8f) << 8);
+
+   ps_ptr->period_save = save - iters;
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 16; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+// FMA versions of the AVX functions. Per iteration:
+//
+//    yy = y * y
+//    mag = x * x + yy       (fused)
+//    t = a - y * y          (fused)
+//    y = (x + x) * y + b    (fused)
+//    x = x * x + t          (fused)
+//
+// 6 instructions instead of 8, but 10 flops (x * x is done twice). The fused ops round
+// once instead of twice, so iteration counts can differ a little from the other versions.
+
+#ifdef _MSC_VER
+#define TARGET_AVX_FMA
+#else
+#define TARGET_AVX_FMA __attribute__((target("avx,fma")))
+#endif
+
+TARGET_AVX_FMA static unsigned iterate_avx_fma(man_pointstruct *ps_ptr) // sip8f
+{
+   __m256d x03, x47, y03, y47, yy03, yy47, t03, t47, mag03, mag47, magprev03, magprev47;
+   __m256d a03, a47, b03, b47, rad;
+   __m256d px03, px47, py03, py47, per03, per47, tol, sign;
+   __m128i due[2];
+   unsigned i, iters, max, save;
+
+   x03 = _mm256_load_pd(&ps_ptr->x[0]);
+   x47 = _mm256_load_pd(&ps_ptr->x[4]);
+   y03 = _mm256_load_pd(&ps_ptr->y[0]);
+   y47 = _mm256_load_pd(&ps_ptr->y[4]);
+   a03 = _mm256_load_pd(&ps_ptr->a[0]);
+   a47 = _mm256_load_pd(&ps_ptr->a[4]);
+   b03 = _mm256_load_pd(&ps_ptr->b[0]);
+   b47 = _mm256_load_pd(&ps_ptr->b[4]);
+   rad = _mm256_set1_pd(DIVERGED_THRESH);
+   px03 = _mm256_load_pd(&ps_ptr->period_x[0]);   // Restore saved orbit points
+   px47 = _mm256_load_pd(&ps_ptr->period_x[4]);
+   py03 = _mm256_load_pd(&ps_ptr->period_y[0]);
+   py47 = _mm256_load_pd(&ps_ptr->period_y[4]);
+   tol = _mm256_set1_pd(ps_ptr->period_tol);
+   sign = _mm256_set1_pd(-0.0);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   save = ps_ptr->period_save;   // iterations to the first save count
+
+   do
+   {
+      yy03 = _mm256_mul_pd(y03, y03);
+      yy47 = _mm256_mul_pd(y47, y47);
+      t03 = _mm256_fnmadd_pd(y03, y03, a03);
+      t47 = _mm256_fnmadd_pd(y47, y47, a47);
+      magprev03 = _mm256_fmadd_pd(x03, x03, yy03);
+      magprev47 = _mm256_fmadd_pd(x47, x47, yy47);
+      y03 = _mm256_fmadd_pd(_mm256_add_pd(x03, x03), y03, b03);
+      y47 = _mm256_fmadd_pd(_mm256_add_pd(x47, x47), y47, b47);
+      x03 = _mm256_fmadd_pd(x03, x03, t03);
+      x47 = _mm256_fmadd_pd(x47, x47, t47);
+
+      yy03 = _mm256_mul_pd(y03, y03);
+      yy47 = _mm256_mul_pd(y47, y47);
+      t03 = _mm256_fnmadd_pd(y03, y03, a03);
+      t47 = _mm256_fnmadd_pd(y47, y47, a47);
+      mag03 = _mm256_fmadd_pd(x03, x03, yy03);
+      mag47 = _mm256_fmadd_pd(x47, x47, yy47);
+      y03 = _mm256_fmadd_pd(_mm256_add_pd(x03, x03), y03, b03);
+      y47 = _mm256_fmadd_pd(_mm256_add_pd(x47, x47), y47, b47);
+      x03 = _mm256_fmadd_pd(x03, x03, t03);
+      x47 = _mm256_fmadd_pd(x47, x47, t47);
+
+      // Periodicity check (see iterate_sse2)
+      per03 = _mm256_cmp_pd(_mm256_add_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(x03, px03)),
+                                          _mm256_andnot_pd(sign, _mm256_sub_pd(y03, py03))), tol, _CMP_LT_OQ);
+      per47 = _mm256_cmp_pd(_mm256_add_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(x47, px47)),
+                                          _mm256_andnot_pd(sign, _mm256_sub_pd(y47, py47))), tol, _CMP_LT_OQ);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         save = period_save_avx(ps_ptr, due, 2, iters);
+         px03 = period_blend_pd(period_mask_pd(due[0]), x03, px03);
+         px47 = period_blend_pd(period_mask_pd(due[1]), x47, px47);
+         py03 = period_blend_pd(period_mask_pd(due[0]), y03, py03);
+         py47 = period_blend_pd(period_mask_pd(due[1]), y47, py47);
+      }
+   }
+   while (!(_mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(mag03, rad, _CMP_NLT_UQ), per03)) |
+            _mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(mag47, rad, _CMP_NLT_UQ), per47)))
+          && iters != max);
+
+   _mm256_store_pd(&ps_ptr->x[0], x03);
+   _mm256_store_pd(&ps_ptr->x[4], x47);
+   _mm256_store_pd(&ps_ptr->y[0], y03);
+   _mm256_store_pd(&ps_ptr->y[4], y47);
+   _mm256_store_pd(&ps_ptr->mag[0], mag03);
+   _mm256_store_pd(&ps_ptr->mag[4], mag47);
+   _mm256_store_pd(&ps_ptr->magprev[0], magprev03);
+   _mm256_store_pd(&ps_ptr->magprev[4], magprev47);
+   _mm256_store_pd(&ps_ptr->period_x[0], px03);
+   _mm256_store_pd(&ps_ptr->period_x[4], px47);
+   _mm256_store_pd(&ps_ptr->period_y[0], py03);
+   _mm256_store_pd(&ps_ptr->period_y[4], py47);
+   ps_ptr->periodic = _mm256_movemask_pd(per03) | (_mm256_movemask_pd(per47) << 4);
+
+   ps_ptr->period_save = save - iters;
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 8; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+TARGET_AVX_FMA static unsigned iterate_avx_fma_s(man_pointstruct *ps_ptr) // sip16f
+{
+   __m256 x07, x8f, y07, y8f, yy07, yy8f, t07, t8f, mag07, mag8f, magprev07, magprev8f;
+   __m256 a07, a8f, b07, b8f, rad;
+   __m256 px07, px8f, py07, py8f, per07, per8f, tol, sign;
+   __m128i due[4];
+   unsigned i, iters, max, save;
+
+   x07 = _mm256_load_ps((float *) ps_ptr->x);
+   x8f = _mm256_load_ps((float *) ps_ptr->x + 8);
+   y07 = _mm256_load_ps((float *) ps_ptr->y);
+   y8f = _mm256_load_ps((float *) ps_ptr->y + 8);
+   a07 = _mm256_load_ps((float *) ps_ptr->a);
+   a8f = _mm256_load_ps((float *) ps_ptr->a + 8);
+   b07 = _mm256_load_ps((float *) ps_ptr->b);
+   b8f = _mm256_load_ps((float *) ps_ptr->b + 8);
+   rad = _mm256_set1_ps((float) DIVERGED_THRESH);
+   px07 = _mm256_load_ps((float *) ps_ptr->period_x);   // Restore saved orbit points
+   px8f = _mm256_load_ps((float *) ps_ptr->period_x + 8);
+   py07 = _mm256_load_ps((float *) ps_ptr->period_y);
+   py8f = _mm256_load_ps((float *) ps_ptr->period_y + 8);
+   tol = _mm256_set1_ps((float) ps_ptr->period_tol);
+   sign = _mm256_set1_ps(-0.0f);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   save = ps_ptr->period_save;   // iterations to the first save count
+
+   do
+   {
+      yy07 = _mm256_mul_ps(y07, y07);
+      yy8f = _mm256_mul_ps(y8f, y8f);
+      t07 = _mm256_fnmadd_ps(y07, y07, a07);
+      t8f = _mm256_fnmadd_ps(y8f, y8f, a8f);
+      magprev07 = _mm256_fmadd_ps(x07, x07, yy07);
+      magprev8f = _mm256_fmadd_ps(x8f, x8f, yy8f);
+      y07 = _mm256_fmadd_ps(_mm256_add_ps(x07, x07), y07, b07);
+      y8f = _mm256_fmadd_ps(_mm256_add_ps(x8f, x8f), y8f, b8f);
+      x07 = _mm256_fmadd_ps(x07, x07, t07);
+      x8f = _mm256_fmadd_ps(x8f, x8f, t8f);
+
+      yy07 = _mm256_mul_ps(y07, y07);
+      yy8f = _mm256_mul_ps(y8f, y8f);
+      t07 = _mm256_fnmadd_ps(y07, y07, a07);
+      t8f = _mm256_fnmadd_ps(y8f, y8f, a8f);
+      mag07 = _mm256_fmadd_ps(x07, x07, yy07);
+      mag8f = _mm256_fmadd_ps(x8f, x8f, yy8f);
+      y07 = _mm256_fmadd_ps(_mm256_add_ps(x07, x07), y07, b07);
+      y8f = _mm256_fmadd_ps(_mm256_add_ps(x8f, x8f), y8f, b8f);
+      x07 = _mm256_fmadd_ps(x07, x07, t07);
+      x8f = _mm256_fmadd_ps(x8f, x8f, t8f);
+
+      // Periodicity check (see iterate_sse2)
+      per07 = _mm256_cmp_ps(_mm256_add_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(x07, px07)),
+                                          _mm256_andnot_ps(sign, _mm256_sub_ps(y07, py07))), tol, _CMP_LT_OQ);
+      per8f = _mm256_cmp_ps(_mm256_add_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(x8f, px8f)),
+                                          _mm256_andnot_ps(sign, _mm256_sub_ps(y8f, py8f))), tol, _CMP_LT_OQ);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         save = period_save_avx(ps_ptr, due, 4, iters);
+         px07 = period_blend_ps(period_mask_ps(due[0], due[1]), x07, px07);
+         px8f = period_blend_ps(period_mask_ps(due[2], due[3]), x8f, px8f);
+         py07 = period_blend_ps(period_mask_ps(due[0], due[1]), y07, py07);
+         py8f = period_blend_ps(period_mask_ps(due[2], due[3]), y8f, py8f);
+      }
+   }
+   while (!(_mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(mag07, rad, _CMP_NLT_UQ), per07)) |
+            _mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(mag8f, rad, _CMP_NLT_UQ), per8f)))
+          && iters != max);
+
+   _mm256_store_ps((float *) ps_ptr->x, x07);
+   _mm256_store_ps((float *) ps_ptr->x + 8, x8f);
+   _mm256_store_ps((float *) ps_ptr->y, y07);
+   _mm256_store_ps((float *) ps_ptr->y + 8, y8f);
+   _mm256_store_ps((float *) ps_ptr->mag, mag07);
+   _mm256_store_ps((float *) ps_ptr->mag + 8, mag8f);
+   _mm256_store_ps((float *) ps_ptr->magprev, magprev07);
+   _mm256_store_ps((float *) ps_ptr->magprev + 8, magprev8f);
+   _mm256_store_ps((float *) ps_ptr->period_x, px07);
+   _mm256_store_ps((float *) ps_ptr->period_x + 8, px8f);
+   _mm256_store_ps((float *) ps_ptr->period_y, py07);
+   _mm256_store_ps((float *) ps_ptr->period_y + 8, py8f);
+   ps_ptr->periodic = _mm256_movemask_ps(per07) | (_mm256_movemask_ps(per8f) << 8);
+
+   ps_ptr->period_save = save - iters;
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 16; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+#endif // USE_AVX_KERNELS
+
+#ifdef USE_AVX512_KERNELS
+
+// AVX-512 iteration functions: 16 doubles or 32 floats in flight, as two chains of 8 (16)
+// points. The divergence test at the bottom of the loop compares directly into mask
+// registers. The queue functions use mask compares as well (see queue_16point_avx512).
+
+#ifdef _MSC_VER
+#define TARGET_AVX512
+#else
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+// AVX-512 versions of period_save_sse2, with the counts and save counts in registers: 16
+// points to a vector, and the call save is for two vectors (pass the same one twice for 16
+// points)
+TARGET_AVX512 static __inline __mmask16 period_due_avx512(__m512i iters_v, __m512i *next, unsigned iters)
+{
+   __mmask16 due;
+
+   due = _mm512_cmpeq_epi32_mask(_mm512_add_epi32(iters_v, _mm512_set1_epi32(iters)), *next);
+   *next = _mm512_mask_add_epi32(*next, due, *next, *next);
+   return due;
+}
+
+TARGET_AVX512 static __inline unsigned period_call_save_avx512(__m512i iters_lo, __m512i next_lo,
+                                                              __m512i iters_hi, __m512i next_hi)
+{
+   return _mm512_reduce_min_epu32(_mm512_min_epu32(_mm512_sub_epi32(next_lo, iters_lo),
+                                                   _mm512_sub_epi32(next_hi, iters_hi)));
+}
+
+TARGET_AVX512 static unsigned iterate_avx512(man_pointstruct *ps_ptr) // sip16d
+{
+   __m512d x07, x8f, y07, y8f, xx07, xx8f, yy07, yy8f, mag07, mag8f, magprev07, magprev8f;
+   __m512d a07, a8f, b07, b8f, rad;
+   __m512d px07, px8f, py07, py8f, tol;
+   __mmask8 per07, per8f;
+   __mmask16 due;
+   __m512i iters_v, next;
+   unsigned iters, max, save;
+
+   x07 = _mm512_load_pd(&ps_ptr->x[0]);   // Restore point states
+   x8f = _mm512_load_pd(&ps_ptr->x[8]);
+   y07 = _mm512_load_pd(&ps_ptr->y[0]);
+   y8f = _mm512_load_pd(&ps_ptr->y[8]);
+   a07 = _mm512_load_pd(&ps_ptr->a[0]);
+   a8f = _mm512_load_pd(&ps_ptr->a[8]);
+   b07 = _mm512_load_pd(&ps_ptr->b[0]);
+   b8f = _mm512_load_pd(&ps_ptr->b[8]);
+   rad = _mm512_set1_pd(DIVERGED_THRESH);
+   px07 = _mm512_load_pd(&ps_ptr->period_x[0]);   // Restore saved orbit points
+   px8f = _mm512_load_pd(&ps_ptr->period_x[8]);
+   py07 = _mm512_load_pd(&ps_ptr->period_y[0]);
+   py8f = _mm512_load_pd(&ps_ptr->period_y[8]);
+   tol = _mm512_set1_pd(ps_ptr->period_tol);
+
+   max = ps_ptr->cur_max_iters;           // max iters to do this call; always even
+   iters = 0;
+   iters_v = _mm512_load_si512(ps_ptr->iters);   // counts and save counts (see period_save_sse2)
+   next = _mm512_load_si512(ps_ptr->period_next);
+   save = period_call_save_avx512(iters_v, next, iters_v, next);
+
+   do
+   {
+      xx07 = _mm512_mul_pd(x07, x07);
+      xx8f = _mm512_mul_pd(x8f, x8f);
+      yy07 = _mm512_mul_pd(y07, y07);
+      yy8f = _mm512_mul_pd(y8f, y8f);
+      magprev07 = _mm512_add_pd(xx07, yy07);
+      magprev8f = _mm512_add_pd(xx8f, yy8f);
+      y07 = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(x07, x07), y07), b07);
+      y8f = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(x8f, x8f), y8f), b8f);
+      x07 = _mm512_add_pd(_mm512_sub_pd(xx07, yy07), a07);
+      x8f = _mm512_add_pd(_mm512_sub_pd(xx8f, yy8f), a8f);
+
+      xx07 = _mm512_mul_pd(x07, x07);
+      xx8f = _mm512_mul_pd(x8f, x8f);
+      yy07 = _mm512_mul_pd(y07, y07);
+      yy8f = _mm512_mul_pd(y8f, y8f);
+      mag07 = _mm512_add_pd(xx07, yy07);
+      mag8f = _mm512_add_pd(xx8f, yy8f);
+      y07 = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(x07, x07), y07), b07);
+      y8f = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(x8f, x8f), y8f), b8f);
+      x07 = _mm512_add_pd(_mm512_sub_pd(xx07, yy07), a07);
+      x8f = _mm512_add_pd(_mm512_sub_pd(xx8f, yy8f), a8f);
+
+      // Periodicity check (see iterate_sse2)
+      per07 = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_abs_pd(_mm512_sub_pd(x07, px07)),
+                                               _mm512_abs_pd(_mm512_sub_pd(y07, py07))), tol, _CMP_LT_OQ);
+      per8f = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_abs_pd(_mm512_sub_pd(x8f, px8f)),
+                                               _mm512_abs_pd(_mm512_sub_pd(y8f, py8f))), tol, _CMP_LT_OQ);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         due = period_due_avx512(iters_v, &next, iters);
+         px07 = _mm512_mask_mov_pd(px07, (__mmask8) due, x07);
+         px8f = _mm512_mask_mov_pd(px8f, (__mmask8) (due >> 8), x8f);
+         py07 = _mm512_mask_mov_pd(py07, (__mmask8) due, y07);
+         py8f = _mm512_mask_mov_pd(py8f, (__mmask8) (due >> 8), y8f);
+         save = period_call_save_avx512(iters_v, next, iters_v, next);
+      }
+   }
+   while (!(_mm512_cmp_pd_mask(mag07, rad, _CMP_NLT_UQ) | _mm512_cmp_pd_mask(mag8f, rad, _CMP_NLT_UQ) |
+            per07 | per8f)
+          && iters != max);
+
+   _mm512_store_pd(&ps_ptr->x[0], x07);   // Save point states and magnitudes
+   _mm512_store_pd(&ps_ptr->x[8], x8f);
+   _mm512_store_pd(&ps_ptr->y[0], y07);
+   _mm512_store_pd(&ps_ptr->y[8], y8f);
+   _mm512_store_pd(&ps_ptr->mag[0], mag07);
+   _mm512_store_pd(&ps_ptr->mag[8], mag8f);
+   _mm512_store_pd(&ps_ptr->magprev[0], magprev07);
+   _mm512_store_pd(&ps_ptr->magprev[8], magprev8f);
+   _mm512_store_pd(&ps_ptr->period_x[0], px07);
+   _mm512_store_pd(&ps_ptr->period_x[8], px8f);
+   _mm512_store_pd(&ps_ptr->period_y[0], py07);
+   _mm512_store_pd(&ps_ptr->period_y[8], py8f);
+   _mm512_store_si512(ps_ptr->period_next, next);
+   ps_ptr->periodic = per07 | (per8f << 8);
+
+   ps_ptr->iterctr += iters;              // update point iteration counts
+   iters_v = _mm512_add_epi32(_mm512_load_si512(ps_ptr->iters), _mm512_set1_epi32(iters));
+   _mm512_store_si512(ps_ptr->iters, iters_v);
+
+   return iters;
+}
+
+// Single precision version; iterates 32 points at a time
+TARGET_AVX512 static unsigned iterate_avx512_s(man_pointstruct *ps_ptr) // sip32
+{
+   __m512 x0f, xgv, y0f, ygv, xx0f, xxgv, yy0f, yygv, mag0f, maggv, magprev0f, magprevgv;
+   __m512 a0f, agv, b0f, bgv, rad;
+   __m512 px0f, pxgv, py0f, pygv, tol;
+   __mmask16 per0f, pergv, due;
+   __m512i iters_v[2], next[2], inc;
+   unsigned iters, max, save;
+
+   x0f = _mm512_load_ps((float *) ps_ptr->x);
+   xgv = _mm512_load_ps((float *) ps_ptr->x + 16);
+   y0f = _mm512_load_ps((float *) ps_ptr->y);
+   ygv = _mm512_load_ps((float *) ps_ptr->y + 16);
+   a0f = _mm512_load_ps((float *) ps_ptr->a);
+   agv = _mm512_load_ps((float *) ps_ptr->a + 16);
+   b0f = _mm512_load_ps((float *) ps_ptr->b);
+   bgv = _mm512_load_ps((float *) ps_ptr->b + 16);
+   rad = _mm512_set1_ps((float) DIVERGED_THRESH);
+   px0f = _mm512_load_ps((float *) ps_ptr->period_x);   // Restore saved orbit points
+   pxgv = _mm512_load_ps((float *) ps_ptr->period_x + 16);
+   py0f = _mm512_load_ps((float *) ps_ptr->period_y);
+   pygv = _mm512_load_ps((float *) ps_ptr->period_y + 16);
+   tol = _mm512_set1_ps((float) ps_ptr->period_tol);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   iters_v[0] = _mm512_load_si512(ps_ptr->iters);   // counts and save counts (see period_save_sse2)
+   iters_v[1] = _mm512_load_si512(ps_ptr->iters + 16);
+   next[0] = _mm512_load_si512(ps_ptr->period_next);
+   next[1] = _mm512_load_si512(ps_ptr->period_next + 16);
+   save = period_call_save_avx512(iters_v[0], next[0], iters_v[1], next[1]);
+
+   do
+   {
+      xx0f = _mm512_mul_ps(x0f, x0f);
+      xxgv = _mm512_mul_ps(xgv, xgv);
+      yy0f = _mm512_mul_ps(y0f, y0f);
+      yygv = _mm512_mul_ps(ygv, ygv);
+      magprev0f = _mm512_add_ps(xx0f, yy0f);
+      magprevgv = _mm512_add_ps(xxgv, yygv);
+      y0f = _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(x0f, x0f), y0f), b0f);
+      ygv = _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(xgv, xgv), ygv), bgv);
+      x0f = _mm512_add_ps(_mm512_sub_ps(xx0f, yy0f), a0f);
+      xgv = _mm512_add_ps(_mm512_sub_ps(xxgv, yygv), agv);
+
+      xx0f = _mm512_mul_ps(x0f, x0f);
+      xxgv = _mm512_mul_ps(xgv, xgv);
+      yy0f = _mm512_mul_ps(y0f, y0f);
+      yygv = _mm512_mul_ps(ygv, ygv);
+      mag0f = _mm512_add_ps(xx0f, yy0f);
+      maggv = _mm512_add_ps(xxgv, yygv);
+      y0f = _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(x0f, x0f), y0f), b0f);
+      ygv = _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(xgv, xgv), ygv), bgv);
+      x0f = _mm512_add_ps(_mm512_sub_ps(xx0f, yy0f), a0f);
+      xgv = _mm512_add_ps(_mm512_sub_ps(xxgv, yygv), agv);
+
+      // Periodicity check (see iterate_sse2)
+      per0f = _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_abs_ps(_mm512_sub_ps(x0f, px0f)),
+                                               _mm512_abs_ps(_mm512_sub_ps(y0f, py0f))), tol, _CMP_LT_OQ);
+      pergv = _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_abs_ps(_mm512_sub_ps(xgv, pxgv)),
+                                               _mm512_abs_ps(_mm512_sub_ps(ygv, pygv))), tol, _CMP_LT_OQ);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         due = period_due_avx512(iters_v[0], &next[0], iters);
+         px0f = _mm512_mask_mov_ps(px0f, due, x0f);
+         py0f = _mm512_mask_mov_ps(py0f, due, y0f);
+         due = period_due_avx512(iters_v[1], &next[1], iters);
+         pxgv = _mm512_mask_mov_ps(pxgv, due, xgv);
+         pygv = _mm512_mask_mov_ps(pygv, due, ygv);
+         save = period_call_save_avx512(iters_v[0], next[0], iters_v[1], next[1]);
+      }
+   }
+   while (!(_mm512_cmp_ps_mask(mag0f, rad, _CMP_NLT_UQ) | _mm512_cmp_ps_mask(maggv, rad, _CMP_NLT_UQ) |
+            per0f | pergv)
+          && iters != max);
+
+   _mm512_store_ps((float *) ps_ptr->x, x0f);
+   _mm512_store_ps((float *) ps_ptr->x + 16, xgv);
+   _mm512_store_ps((float *) ps_ptr->y, y0f);
+   _mm512_store_ps((float *) ps_ptr->y + 16, ygv);
+   _mm512_store_ps((float *) ps_ptr->mag, mag0f);
+   _mm512_store_ps((float *) ps_ptr->mag + 16, maggv);
+   _mm512_store_ps((float *) ps_ptr->magprev, magprev0f);
+   _mm512_store_ps((float *) ps_ptr->magprev + 16, magprevgv);
+   _mm512_store_ps((float *) ps_ptr->period_x, px0f);
+   _mm512_store_ps((float *) ps_ptr->period_x + 16, pxgv);
+   _mm512_store_ps((float *) ps_ptr->period_y, py0f);
+   _mm512_store_ps((float *) ps_ptr->period_y + 16, pygv);
+   _mm512_store_si512(ps_ptr->period_next, next[0]);
+   _mm512_store_si512(ps_ptr->period_next + 16, next[1]);
+   ps_ptr->periodic = per0f | ((unsigned) pergv << 16);
+
+   ps_ptr->iterctr += iters;
+   inc = _mm512_set1_epi32(iters);
+   _mm512_store_si512(ps_ptr->iters, _mm512_add_epi32(_mm512_load_si512(ps_ptr->iters), inc));
+   _mm512_store_si512(ps_ptr->iters + 16, _mm512_add_epi32(_mm512_load_si512(ps_ptr->iters + 16), inc));
+
+   return iters;
+}
+
+// FMA versions of the AVX-512 functions (AVX-512F includes FMA). See iterate_avx_fma.
+
+TARGET_AVX512 static unsigned iterate_avx512_fma(man_pointstruct *ps_ptr) // sip16df
+{
+   __m512d x07, x8f, y07, y8f, yy07, yy8f, t07, t8f, mag07, mag8f, magprev07, magprev8f;
+   __m512d a07, a8f, b07, b8f, rad;
+   __m512d px07, px8f, py07, py8f, tol;
+   __mmask8 per07, per8f;
+   __mmask16 due;
+   __m512i iters_v, next;
+   unsigned iters, max, save;
+
+   x07 = _mm512_load_pd(&ps_ptr->x[0]);
+   x8f = _mm512_load_pd(&ps_ptr->x[8]);
+   y07 = _mm512_load_pd(&ps_ptr->y[0]);
+   y8f = _mm512_load_pd(&ps_ptr->y[8]);
+   a07 = _mm512_load_pd(&ps_ptr->a[0]);
+   a8f = _mm512_load_pd(&ps_ptr->a[8]);
+   b07 = _mm512_load_pd(&ps_ptr->b[0]);
+   b8f = _mm512_load_pd(&ps_ptr->b[8]);
+   rad = _mm512_set1_pd(DIVERGED_THRESH);
+   px07 = _mm512_load_pd(&ps_ptr->period_x[0]);   // Restore saved orbit points
+   px8f = _mm512_load_pd(&ps_ptr->period_x[8]);
+   py07 = _mm512_load_pd(&ps_ptr->period_y[0]);
+   py8f = _mm512_load_pd(&ps_ptr->period_y[8]);
+   tol = _mm512_set1_pd(ps_ptr->period_tol);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   iters_v = _mm512_load_si512(ps_ptr->iters);   // counts and save counts (see period_save_sse2)
+   next = _mm512_load_si512(ps_ptr->period_next);
+   save = period_call_save_avx512(iters_v, next, iters_v, next);
+
+   do
+   {
+      yy07 = _mm512_mul_pd(y07, y07);
+      yy8f = _mm512_mul_pd(y8f, y8f);
+      t07 = _mm512_fnmadd_pd(y07, y07, a07);
+      t8f = _mm512_fnmadd_pd(y8f, y8f, a8f);
+      magprev07 = _mm512_fmadd_pd(x07, x07, yy07);
+      magprev8f = _mm512_fmadd_pd(x8f, x8f, yy8f);
+      y07 = _mm512_fmadd_pd(_mm512_add_pd(x07, x07), y07, b07);
+      y8f = _mm512_fmadd_pd(_mm512_add_pd(x8f, x8f), y8f, b8f);
+      x07 = _mm512_fmadd_pd(x07, x07, t07);
+      x8f = _mm512_fmadd_pd(x8f, x8f, t8f);
+
+      yy07 = _mm512_mul_pd(y07, y07);
+      yy8f = _mm512_mul_pd(y8f, y8f);
+      t07 = _mm512_fnmadd_pd(y07, y07, a07);
+      t8f = _mm512_fnmadd_pd(y8f, y8f, a8f);
+      mag07 = _mm512_fmadd_pd(x07, x07, yy07);
+      mag8f = _mm512_fmadd_pd(x8f, x8f, yy8f);
+      y07 = _mm512_fmadd_pd(_mm512_add_pd(x07, x07), y07, b07);
+      y8f = _mm512_fmadd_pd(_mm512_add_pd(x8f, x8f), y8f, b8f);
+      x07 = _mm512_fmadd_pd(x07, x07, t07);
+      x8f = _mm512_fmadd_pd(x8f, x8f, t8f);
+
+      // Periodicity check (see iterate_sse2)
+      per07 = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_abs_pd(_mm512_sub_pd(x07, px07)),
+                                               _mm512_abs_pd(_mm512_sub_pd(y07, py07))), tol, _CMP_LT_OQ);
+      per8f = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_abs_pd(_mm512_sub_pd(x8f, px8f)),
+                                               _mm512_abs_pd(_mm512_sub_pd(y8f, py8f))), tol, _CMP_LT_OQ);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         due = period_due_avx512(iters_v, &next, iters);
+         px07 = _mm512_mask_mov_pd(px07, (__mmask8) due, x07);
+         px8f = _mm512_mask_mov_pd(px8f, (__mmask8) (due >> 8), x8f);
+         py07 = _mm512_mask_mov_pd(py07, (__mmask8) due, y07);
+         py8f = _mm512_mask_mov_pd(py8f, (__mmask8) (due >> 8), y8f);
+         save = period_call_save_avx512(iters_v, next, iters_v, next);
+      }
+   }
+   while (!(_mm512_cmp_pd_mask(mag07, rad, _CMP_NLT_UQ) | _mm512_cmp_pd_mask(mag8f, rad, _CMP_NLT_UQ) |
+            per07 | per8f)
+          && iters != max);
+
+   _mm512_store_pd(&ps_ptr->x[0], x07);
+   _mm512_store_pd(&ps_ptr->x[8], x8f);
+   _mm512_store_pd(&ps_ptr->y[0], y07);
+   _mm512_store_pd(&ps_ptr->y[8], y8f);
+   _mm512_store_pd(&ps_ptr->mag[0], mag07);
+   _mm512_store_pd(&ps_ptr->mag[8], mag8f);
+   _mm512_store_pd(&ps_ptr->magprev[0], magprev07);
+   _mm512_store_pd(&ps_ptr->magprev[8], magprev8f);
+   _mm512_store_pd(&ps_ptr->period_x[0], px07);
+   _mm512_store_pd(&ps_ptr->period_x[8], px8f);
+   _mm512_store_pd(&ps_ptr->period_y[0], py07);
+   _mm512_store_pd(&ps_ptr->period_y[8], py8f);
+   _mm512_store_si512(ps_ptr->period_next, next);
+   ps_ptr->periodic = per07 | (per8f << 8);
+
+   ps_ptr->iterctr += iters;
+   _mm512_store_si512(ps_ptr->iters, _mm512_add_epi32(_mm512_load_si512(ps_ptr->iters), _mm512_set1_epi32(iters)));
+
+   return iters;
+}
+
+TARGET_AVX512 static unsigned iterate_avx512_fma_s(man_pointstruct *ps_ptr) // sip32f
+{
+   __m512 x0f, xgv, y0f, ygv, yy0f, yygv, t0f, tgv, mag0f, maggv, magprev0f, magprevgv;
+   __m512 a0f, agv, b0f, bgv, rad;
+   __m512 px0f, pxgv, py0f, pygv, tol;
+   __mmask16 per0f, pergv, due;
+   __m512i iters_v[2], next[2], inc;
+   unsigned iters, max, save;
+
+   x0f = _mm512_load_ps((float *) ps_ptr->x);
+   xgv = _mm512_load_ps((float *) ps_ptr->x + 16);
+   y0f = _mm512_load_ps((float *) ps_ptr->y);
+   ygv = _mm512_load_ps((float *) ps_ptr->y + 16);
+   a0f = _mm512_load_ps((float *) ps_ptr->a);
+   agv = _mm512_load_ps((float *) ps_ptr->a + 16);
+   b0f = _mm512_load_ps((float *) ps_ptr->b);
+   bgv = _mm512_load_ps((float *) ps_ptr->b + 16);
+   rad = _mm512_set1_ps((float) DIVERGED_THRESH);
+   px0f = _mm512_load_ps((float *) ps_ptr->period_x);   // Restore saved orbit points
+   pxgv = _mm512_load_ps((float *) ps_ptr->period_x + 16);
+   py0f = _mm512_load_ps((float *) ps_ptr->period_y);
+   pygv = _mm512_load_ps((float *) ps_ptr->period_y + 16);
+   tol = _mm512_set1_ps((float) ps_ptr->period_tol);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   iters_v[0] = _mm512_load_si512(ps_ptr->iters);   // counts and save counts (see period_save_sse2)
+   iters_v[1] = _mm512_load_si512(ps_ptr->iters + 16);
+   next[0] = _mm512_load_si512(ps_ptr->period_next);
+   next[1] = _mm512_load_si512(ps_ptr->period_next + 16);
+   save = period_call_save_avx512(iters_v[0], next[0], iters_v[1], next[1]);
+
+   do
+   {
+      yy0f = _mm512_mul_ps(y0f, y0f);
+      yygv = _mm512_mul_ps(ygv, ygv);
+      t0f = _mm512_fnmadd_ps(y0f, y0f, a0f);
+      tgv = _mm512_fnmadd_ps(ygv, ygv, agv);
+      magprev0f = _mm512_fmadd_ps(x0f, x0f, yy0f);
+      magprevgv = _mm512_fmadd_ps(xgv, xgv, yygv);
+      y0f = _mm512_fmadd_ps(_mm512_add_ps(x0f, x0f), y0f, b0f);
+      ygv = _mm512_fmadd_ps(_mm512_add_ps(xgv, xgv), ygv, bgv);
+      x0f = _mm512_fmadd_ps(x0f, x0f, t0f);
+      xgv = _mm512_fmadd_ps(xgv, xgv, tgv);
+
+      yy0f = _mm512_mul_ps(y0f, y0f);
+      yygv = _mm512_mul_ps(ygv, ygv);
+      t0f = _mm512_fnmadd_ps(y0f, y0f, a0f);
+      tgv = _mm512_fnmadd_ps(ygv, ygv, agv);
+      mag0f = _mm512_fmadd_ps(x0f, x0f, yy0f);
+      maggv = _mm512_fmadd_ps(xgv, xgv, yygv);
+      y0f = _mm512_fmadd_ps(_mm512_add_ps(x0f, x0f), y0f, b0f);
+      ygv = _mm512_fmadd_ps(_mm512_add_ps(xgv, xgv), ygv, bgv);
+      x0f = _mm512_fmadd_ps(x0f, x0f, t0f);
+      xgv = _mm512_fmadd_ps(xgv, xgv, tgv);
+
+      // Periodicity check (see iterate_sse2)
+      per0f = _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_abs_ps(_mm512_sub_ps(x0f, px0f)),
+                                               _mm512_abs_ps(_mm512_sub_ps(y0f, py0f))), tol, _CMP_LT_OQ);
+      pergv = _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_abs_ps(_mm512_sub_ps(xgv, pxgv)),
+                                               _mm512_abs_ps(_mm512_sub_ps(ygv, pygv))), tol, _CMP_LT_OQ);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         due = period_due_avx512(iters_v[0], &next[0], iters);
+         px0f = _mm512_mask_mov_ps(px0f, due, x0f);
+         py0f = _mm512_mask_mov_ps(py0f, due, y0f);
+         due = period_due_avx512(iters_v[1], &next[1], iters);
+         pxgv = _mm512_mask_mov_ps(pxgv, due, xgv);
+         pygv = _mm512_mask_mov_ps(pygv, due, ygv);
+         save = period_call_save_avx512(iters_v[0], next[0], iters_v[1], next[1]);
+      }
+   }
+   while (!(_mm512_cmp_ps_mask(mag0f, rad, _CMP_NLT_UQ) | _mm512_cmp_ps_mask(maggv, rad, _CMP_NLT_UQ) |
+            per0f | pergv)
+          && iters != max);
+
+   _mm512_store_ps((float *) ps_ptr->x, x0f);
+   _mm512_store_ps((float *) ps_ptr->x + 16, xgv);
+   _mm512_store_ps((float *) ps_ptr->y, y0f);
+   _mm512_store_ps((float *) ps_ptr->y + 16, ygv);
+   _mm512_store_ps((float *) ps_ptr->mag, mag0f);
+   _mm512_store_ps((float *) ps_ptr->mag + 16, maggv);
+   _mm512_store_ps((float *) ps_ptr->magprev, magprev0f);
+   _mm512_store_ps((float *) ps_ptr->magprev + 16, magprevgv);
+   _mm512_store_ps((float *) ps_ptr->period_x, px0f);
+   _mm512_store_ps((float *) ps_ptr->period_x + 16, pxgv);
+   _mm512_store_ps((float *) ps_ptr->period_y, py0f);
+   _mm512_store_ps((float *) ps_ptr->period_y + 16, pygv);
+   _mm512_store_si512(ps_ptr->period_next, next[0]);
+   _mm512_store_si512(ps_ptr->period_next + 16, next[1]);
+   ps_ptr->periodic = per0f | ((unsigned) pergv << 16);
+
+   ps_ptr->iterctr += iters;
+   inc = _mm512_set1_epi32(iters);
+   _mm512_store_si512(ps_ptr->iters, _mm512_add_epi32(_mm512_load_si512(ps_ptr->iters), inc));
+   _mm512_store_si512(ps_ptr->iters + 16, _mm512_add_epi32(_mm512_load_si512(ps_ptr->iters + 16), inc));
+
+   return iters;
+}
+
+#endif // USE_AVX512_KERNELS
+
+// ----------------------- Formula iteration functions -----------------------------------
+//
+// Kernels for the other formulas (FORMULA_*). Each kernel family is written once, with the
+// formula as a constant parameter of an inline function; the thin wrappers at the end of each
+// family pass a literal, so the compiler drops the other formulas' code from each version (the
+// same as the chain count in the multi-chain functions below). The SIMD versions have the same
+// state layout, periodicity checking and two-iterations-per-loop divergence test as the
+// Mandelbrot kernels they're based on, so they share their queue functions: the SSE2 version
+// goes with queue_4point_sse2, AVX with queue_8point_avx and AVX-512 with queue_16point_avx512.
+// Double precision only.
+
+// One iteration of formula f on W-bit vectors (W is empty for SSE2, 256 or 512): z = f(z) + c.
+// Sets mag to the magnitude before the iteration (see iterate_sse2); t and yy are temporaries.
+// FORMULA_ABS needs a sign vector (-0.0) in scope for SSE2 and AVX.
+
+#define FORMULA_ABS_(v)       _mm_andnot_pd(sign, v)
+#define FORMULA_ABS_256(v)    _mm256_andnot_pd(sign, v)
+#define FORMULA_ABS_512(v)    _mm512_abs_pd(v)
+
+#define FORMULA_ITERATE(W, f, x, y, a, b, mag, t, yy)                                        \
+   t = _mm##W##_mul_pd(x, x);                                                                \
+   yy = _mm##W##_mul_pd(y, y);                                                               \
+   mag = _mm##W##_add_pd(t, yy);                                                             \
+   if ((f) == FORMULA_MULTIBROT3) /* x(xx - 3yy), y(3xx - yy) */                             \
+   {                                                                                         \
+      y = _mm##W##_add_pd(_mm##W##_mul_pd(y, _mm##W##_sub_pd(_mm##W##_mul_pd(_mm##W##_set1_pd(3.0), t), yy)), b); \
+      x = _mm##W##_add_pd(_mm##W##_mul_pd(x, _mm##W##_sub_pd(t, _mm##W##_mul_pd(_mm##W##_set1_pd(3.0), yy))), a); \
+   }                                                                                         \
+   else if ((f) == FORMULA_MULTIBROT4) /* square twice */                                    \
+   {                                                                                         \
+      y = _mm##W##_mul_pd(_mm##W##_add_pd(x, x), y);                                         \
+      x = _mm##W##_sub_pd(t, yy);                                                            \
+      t = _mm##W##_mul_pd(x, x);                                                             \
+      yy = _mm##W##_mul_pd(y, y);                                                            \
+      y = _mm##W##_add_pd(_mm##W##_mul_pd(_mm##W##_add_pd(x, x), y), b);                     \
+      x = _mm##W##_add_pd(_mm##W##_sub_pd(t, yy), a);                                        \
+   }                                                                                         \
+   else                                                                                      \
+   {                                                                                         \
+      if ((f) == FORMULA_BURNING_SHIP) /* |2xy| */                                           \
+         y = _mm##W##_add_pd(FORMULA_ABS_##W(_mm##W##_mul_pd(_mm##W##_add_pd(x, x), y)), b); \
+      else if ((f) == FORMULA_TRICORN) /* -2xy */                                            \
+         y = _mm##W##_sub_pd(b, _mm##W##_mul_pd(_mm##W##_add_pd(x, x), y));                  \
+      else                                                                                   \
+         y = _mm##W##_add_pd(_mm##W##_mul_pd(_mm##W##_add_pd(x, x), y), b);                  \
+      x = _mm##W##_add_pd(_mm##W##_sub_pd(t, yy), a);                                        \
+   }
+
+// Flops per iteration for each formula, for the benchmark
+static const unsigned formula_flops[NUM_FORMULAS] = {9, 11, 12, 10, 9};
+
+// C version (see iterate_c). Same operations in the same order as FORMULA_ITERATE, so the
+// counts match the SIMD versions.
+static __inline unsigned iterate_formula_c(man_pointstruct *ps_ptr, int f)
+{
+   double a, b, x, y, xx, yy, t, rad, px, py, tol;
+   unsigned iters, iter_ct, save, save_ct;
+
+   iters = 0;
+   iter_ct = ps_ptr->cur_max_iters;
+
+   get_start_point(ps_ptr, &a, &b, &x, &y);
+   rad = DIVERGED_THRESH;
+   xx = x * x;
+   yy = y * y;
+
+   px = x;
+   py = y;
+   tol = ps_ptr->period_tol;
+   save = save_ct = PERIOD_FIRST_SAVE;
+   ps_ptr->periodic = 0;
+
+   if ((xx + yy) >= rad)   // Julia mode start outside (see iterate_c)
+   {
+      ps_ptr->mag[0] = xx + yy;
+      return 0;
+   }
+
+   do
+   {
+      if (f == FORMULA_MULTIBROT3)
+      {
+         y = y * (3.0 * xx - yy) + b;
+         x = x * (xx - 3.0 * yy) + a;
+      }
+      else if (f == FORMULA_MULTIBROT4)
+      {
+         y = (x + x) * y;
+         x = xx - yy;
+         t = y * y;
+         y = (x + x) * y + b;
+         x = x * x - t + a;
+      }
+      else
+      {
+         if (f == FORMULA_BURNING_SHIP)
+            y = fabs((x + x) * y) + b;
+         else if (f == FORMULA_TRICORN)
+            y = b - (x + x) * y;
+         else
+            y = (x + x) * y + b;
+         x = xx - yy + a;
+      }
+      yy = y * y;
+      xx = x * x;
+      iters++;
+      if ((xx + yy) >= rad)
+         break;
+      if (fabs(x - px) + fabs(y - py) < tol)
+      {
+         ps_ptr->periodic = 1;
+         break;
+      }
+      if (!--save_ct)
+      {
+         px = x;
+         py = y;
+         save_ct = save += save;
+      }
+   }
+   while (--iter_ct);
+
+   ps_ptr->mag[0] = xx + yy;
+
+   return iters;
+}
+
+static unsigned iterate_multibrot3_c(man_pointstruct *ps_ptr) { return iterate_formula_c(ps_ptr, FORMULA_MULTIBROT3); }
+static unsigned iterate_multibrot4_c(man_pointstruct *ps_ptr) { return iterate_formula_c(ps_ptr, FORMULA_MULTIBROT4); }
+static unsigned iterate_burning_ship_c(man_pointstruct *ps_ptr) { return iterate_formula_c(ps_ptr, FORMULA_BURNING_SHIP); }
+static unsigned iterate_tricorn_c(man_pointstruct *ps_ptr) { return iterate_formula_c(ps_ptr, FORMULA_TRICORN); }
+
+// C versions and kernel names, by formula (see set_kernel)
+static unsigned (* const formula_c[NUM_FORMULAS])(man_pointstruct *ps_ptr) =
+   {iterate_c, iterate_multibrot3_c, iterate_multibrot4_c, iterate_burning_ship_c, iterate_tricorn_c};
+static char * const formula_c_names[NUM_FORMULAS] =
+   {"C", "C Multibrot z^3", "C Multibrot z^4", "C Burning Ship", "C Tricorn"};
+
+// SSE2 version: 4 points as two chains of 2 (see iterate_sse2). Intrinsics, so it's also
+// used with the ASM kernels.
+static __inline unsigned iterate_sse2_formula(man_pointstruct *ps_ptr, int f)
+{
+   __m128d x01, x23, y01, y23, t01, t23, yy01, yy23, mag01, mag23, magprev01, magprev23;
+   __m128d a01, a23, b01, b23, rad;
+   __m128d px01, px23, py01, py23, per01, per23, tol, sign, sv;
+   __m128i due;
+   unsigned iters, max, save;
+
+   x01 = _mm_load_pd(&ps_ptr->x[0]);   // Restore point states
+   x23 = _mm_load_pd(&ps_ptr->x[2]);
+   y01 = _mm_load_pd(&ps_ptr->y[0]);
+   y23 = _mm_load_pd(&ps_ptr->y[2]);
+   a01 = _mm_load_pd(&ps_ptr->a[0]);
+   a23 = _mm_load_pd(&ps_ptr->a[2]);
+   b01 = _mm_load_pd(&ps_ptr->b[0]);
+   b23 = _mm_load_pd(&ps_ptr->b[2]);
+   rad = _mm_set1_pd(DIVERGED_THRESH);
+   px01 = _mm_load_pd(&ps_ptr->period_x[0]);   // Restore saved orbit points
+   px23 = _mm_load_pd(&ps_ptr->period_x[2]);
+   py01 = _mm_load_pd(&ps_ptr->period_y[0]);
+   py23 = _mm_load_pd(&ps_ptr->period_y[2]);
+   tol = _mm_set1_pd(ps_ptr->period_tol);
+   sign = _mm_set1_pd(-0.0);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   save = ps_ptr->period_save;   // iterations to the first save count
+
+   do
+   {
+      FORMULA_ITERATE(, f, x01, y01, a01, b01, magprev01, t01, yy01)
+      FORMULA_ITERATE(, f, x23, y23, a23, b23, magprev23, t23, yy23)
+      FORMULA_ITERATE(, f, x01, y01, a01, b01, mag01, t01, yy01)
+      FORMULA_ITERATE(, f, x23, y23, a23, b23, mag23, t23, yy23)
+
+      per01 = _mm_cmplt_pd(_mm_add_pd(_mm_andnot_pd(sign, _mm_sub_pd(x01, px01)),
+                                      _mm_andnot_pd(sign, _mm_sub_pd(y01, py01))), tol);
+      per23 = _mm_cmplt_pd(_mm_add_pd(_mm_andnot_pd(sign, _mm_sub_pd(x23, px23)),
+                                      _mm_andnot_pd(sign, _mm_sub_pd(y23, py23))), tol);
+
+      iters += 2;
+      if (iters == save)   // some points are at a save count
+      {
+         save = period_save_sse2(ps_ptr, &due, 1, iters);
+         sv = _mm_castsi128_pd(_mm_unpacklo_epi32(due, due));
+         px01 = _mm_or_pd(_mm_and_pd(sv, x01), _mm_andnot_pd(sv, px01));
+         py01 = _mm_or_pd(_mm_and_pd(sv, y01), _mm_andnot_pd(sv, py01));
+         sv = _mm_castsi128_pd(_mm_unpackhi_epi32(due, due));
+         px23 = _mm_or_pd(_mm_and_pd(sv, x23), _mm_andnot_pd(sv, px23));
+         py23 = _mm_or_pd(_mm_and_pd(sv, y23), _mm_andnot_pd(sv, py23));
+      }
+   }
+   while (!(_mm_movemask_pd(_mm_or_pd(_mm_cmpnlt_pd(mag01, rad), per01)) |
+            _mm_movemask_pd(_mm_or_pd(_mm_cmpnlt_pd(mag23, rad), per23)))
+          && iters != max);
+
+   _mm_store_pd(&ps_ptr->x[0], x01);   // Save point states and magnitudes
+   _mm_store_pd(&ps_ptr->x[2], x23);
+   _mm_store_pd(&ps_ptr->y[0], y01);
+   _mm_store_pd(&ps_ptr->y[2], y23);
+   _mm_store_pd(&ps_ptr->mag[0], mag01);
+   _mm_store_pd(&ps_ptr->mag[2], mag23);
+   _mm_store_pd(&ps_ptr->magprev[0], magprev01);
+   _mm_store_pd(&ps_ptr->magprev[2], magprev23);
+   _mm_store_pd(&ps_ptr->period_x[0], px01);
+   _mm_store_pd(&ps_ptr->period_x[2], px23);
+   _mm_store_pd(&ps_ptr->period_y[0], py01);
+   _mm_store_pd(&ps_ptr->period_y[2], py23);
+   ps_ptr->periodic = _mm_movemask_pd(per01) | (_mm_movemask_pd(per23) << 2);
+
+   ps_ptr->period_save = save - iters;
+   ps_ptr->iterctr += iters;
+   ps_ptr->iters[0] += iters;
+   ps_ptr->iters[1] += iters;
+   ps_ptr->iters[2] += iters;
+   ps_ptr->iters[3] += iters;
+
+   return iters;
+}
+
+static unsigned iterate_sse2_multibrot3(man_pointstruct *ps_ptr) { return iterate_sse2_formula(ps_ptr, FORMULA_MULTIBROT3); }
+static unsigned iterate_sse2_multibrot4(man_pointstruct *ps_ptr) { return iterate_sse2_formula(ps_ptr, FORMULA_MULTIBROT4); }
+static unsigned iterate_sse2_burning_ship(man_pointstruct *ps_ptr) { return iterate_sse2_formula(ps_ptr, FORMULA_BURNING_SHIP); }
+static unsigned iterate_sse2_tricorn(man_pointstruct *ps_ptr) { return iterate_sse2_formula(ps_ptr, FORMULA_TRICORN); }
+
+// ----------------------- Multi-chain iteration functions -----------------------------------
+//
+// The kernels above keep two independent chains of vectors in flight (the "unrolled twice" of
+// the SSE2 code). Every iteration is a dependent sequence of multiplies and adds, so with two
+// chains the loop is bound by FP latency, not throughput, on current cores (4-cycle latency,
+// two multiply/FMA ports). These versions keep 3 or 4 chains in flight: 12/16 doubles or 24/32
+// floats with AVX, 24/32 doubles with AVX-512. The AVX-512 single precision kernel stays at 2
+// chains (32 floats), because queue_status and the periodic mask are 32 bits.
+//
+// More chains also means a longer tail at the end of each stripe, when the last slow points
+// iterate with the other lanes empty, so the best count depends on the CPU and the image
+// ("qmrender -chainbench" shows it). The 2-chain versions stay first in the kernel table, so
+// they're the default; the chains setting picks another count (see find_kernel).
+//
+// The code for one chain is written once, as macros over the chain index c. CHAINS_DO expands
+// op for chains 0 to n - 1 with constant indices, so the vector arrays stay in registers.
+
+#define CHAINS_DO(n, op, T, F, mg) op(0, T, F, mg) op(1, T, F, mg)           \
+                                   if ((n) > 2) { op(2, T, F, mg) }          \
+                                   if ((n) > 3) { op(3, T, F, mg) }
+
+#ifdef USE_AVX_KERNELS
+
+// AVX versions. T is pd or ps and F the matching element type; a vector holds 32 / sizeof(F)
+// points. mg is the magnitude array to set (mag or magprev).
+
+#define AVX_LANES(F)    (32 / (int) sizeof(F))
+
+#define AVX_CHAIN_LOAD(c, T, F, mg)                                              \
+   x[c] = _mm256_load_##T((F *) ps_ptr->x + AVX_LANES(F) * c);                   \
+   y[c] = _mm256_load_##T((F *) ps_ptr->y + AVX_LANES(F) * c);                   \
+   a[c] = _mm256_load_##T((F *) ps_ptr->a + AVX_LANES(F) * c);                   \
+   b[c] = _mm256_load_##T((F *) ps_ptr->b + AVX_LANES(F) * c);                   \
+   px[c] = _mm256_load_##T((F *) ps_ptr->period_x + AVX_LANES(F) * c);           \
+   py[c] = _mm256_load_##T((F *) ps_ptr->period_y + AVX_LANES(F) * c);
+
+// One iteration of a chain (see iterate_avx); mg gets the magnitude before the iteration
+#define AVX_CHAIN_ITER_0(c, T, F, mg)                                            \
+   t[c] = _mm256_mul_##T(x[c], x[c]);                                            \
+   yy[c] = _mm256_mul_##T(y[c], y[c]);                                           \
+   mg[c] = _mm256_add_##T(t[c], yy[c]);                                          \
+   y[c] = _mm256_add_##T(_mm256_mul_##T(_mm256_add_##T(x[c], x[c]), y[c]), b[c]); \
+   x[c] = _mm256_add_##T(_mm256_sub_##T(t[c], yy[c]), a[c]);
+
+// FMA version (see iterate_avx_fma)
+#define AVX_CHAIN_ITER_1(c, T, F, mg)                                            \
+   yy[c] = _mm256_mul_##T(y[c], y[c]);                                           \
+   t[c] = _mm256_fnmadd_##T(y[c], y[c], a[c]);                                   \
+   mg[c] = _mm256_fmadd_##T(x[c], x[c], yy[c]);                                  \
+   y[c] = _mm256_fmadd_##T(_mm256_add_##T(x[c], x[c]), y[c], b[c]);              \
+   x[c] = _mm256_fmadd_##T(x[c], x[c], t[c]);
+
+// Formula version (see FORMULA_ITERATE); double precision only. Needs f in scope.
+#define AVX_CHAIN_ITER_F(c, T, F, mg)                                            \
+   FORMULA_ITERATE(256, f, x[c], y[c], a[c], b[c], mg[c], t[c], yy[c])
+
+#define AVX_CHAIN_PERIOD(c, T, F, mg)                                            \
+   per[c] = _mm256_cmp_##T(_mm256_add_##T(_mm256_andnot_##T(sign, _mm256_sub_##T(x[c], px[c])), \
+                                          _mm256_andnot_##T(sign, _mm256_sub_##T(y[c], py[c]))), tol, _CMP_LT_OQ);
+
+// Save z as the orbit point of the chain's points that are at their save count (see
+// period_save_avx): one vector of counts for the 4 doubles, two for the 8 floats
+#define AVX_CHAIN_DUE_pd(c)    period_mask_pd(due[c])
+#define AVX_CHAIN_DUE_ps(c)    period_mask_ps(due[2 * c], due[2 * c + 1])
+
+#define AVX_CHAIN_SAVE(c, T, F, mg)                                              \
+   sv = AVX_CHAIN_DUE_##T(c);                                                    \
+   px[c] = period_blend_##T(sv, x[c], px[c]);                                    \
+   py[c] = period_blend_##T(sv, y[c], py[c]);
+
+#define AVX_CHAIN_DONE(c, T, F, mg)                                              \
+   done |= _mm256_movemask_##T(_mm256_or_##T(_mm256_cmp_##T(mag[c], rad, _CMP_NLT_UQ), per[c]));
+
+#define AVX_CHAIN_STORE(c, T, F, mg)                                             \
+   _mm256_store_##T((F *) ps_ptr->x + AVX_LANES(F) * c, x[c]);                   \
+   _mm256_store_##T((F *) ps_ptr->y + AVX_LANES(F) * c, y[c]);                   \
+   _mm256_store_##T((F *) ps_ptr->mag + AVX_LANES(F) * c, mag[c]);               \
+   _mm256_store_##T((F *) ps_ptr->magprev + AVX_LANES(F) * c, magprev[c]);       \
+   _mm256_store_##T((F *) ps_ptr->period_x + AVX_LANES(F) * c, px[c]);           \
+   _mm256_store_##T((F *) ps_ptr->period_y + AVX_LANES(F) * c, py[c]);           \
+   periodic |= (unsigned) _mm256_movemask_##T(per[c]) << (AVX_LANES(F) * c);
+
+// Body of the AVX multi-chain functions: n chains of vector type V. The FMA and non-FMA
+// versions need different compile targets, so this is a macro rather than a function. fma
+// is 0, 1, or F for the formula versions.
+#define ITERATE_AVX_CHAINS(n, T, V, F, fma)                                      \
+   V x[4], y[4], t[4], yy[4], mag[4], magprev[4], a[4], b[4], px[4], py[4], per[4]; \
+   V rad, tol, sign, sv;                                                         \
+   __m128i due[8];                                                               \
+   unsigned i, iters, max, save, done, periodic;                                 \
+                                                                                 \
+   CHAINS_DO(n, AVX_CHAIN_LOAD, T, F, mag)                                       \
+   rad = _mm256_set1_##T((F) DIVERGED_THRESH);                                   \
+   tol = _mm256_set1_##T((F) ps_ptr->period_tol);                                \
+   sign = _mm256_set1_##T((F) -0.0);                                             \
+                                                                                 \
+   max = ps_ptr->cur_max_iters;                                                  \
+   iters = 0;                                                                    \
+   save = ps_ptr->period_save;                                                   \
+                                                                                 \
+   do                                                                            \
+   {                                                                             \
+      CHAINS_DO(n, AVX_CHAIN_ITER_##fma, T, F, magprev)                          \
+      CHAINS_DO(n, AVX_CHAIN_ITER_##fma, T, F, mag)                              \
+      CHAINS_DO(n, AVX_CHAIN_PERIOD, T, F, mag)                                  \
+                                                                                 \
+      iters += 2;                                                                \
+      if (iters == save)                                                         \
+      {                                                                          \
+         save = period_save_avx(ps_ptr, due, (n) * AVX_LANES(F) / 4, iters);     \
+         CHAINS_DO(n, AVX_CHAIN_SAVE, T, F, mag)                                 \
+      }                                                                          \
+      done = 0;                                                                  \
+      CHAINS_DO(n, AVX_CHAIN_DONE, T, F, mag)                                    \
+   }                                                                             \
+   while (!done && iters != max);                                                \
+                                                                                 \
+   periodic = 0;                                                                 \
+   CHAINS_DO(n, AVX_CHAIN_STORE, T, F, mag)                                      \
+   ps_ptr->periodic = periodic;                                                  \
+                                                                                 \
+   ps_ptr->period_save = save - iters;                                           \
+   ps_ptr->iterctr += iters;                                                     \
+   for (i = 0; i < (unsigned) ((n) * AVX_LANES(F)); i++)                         \
+      ps_ptr->iters[i] += iters;                                                 \
+                                                                                 \
+   return iters;
+
+// Formula versions: 8 points as two chains of 4, like iterate_avx
+TARGET_AVX static __inline unsigned iterate_avx_formula(man_pointstruct *ps_ptr, int f)
+{
+   ITERATE_AVX_CHAINS(2, pd, __m256d, double, F)
+}
+
+TARGET_AVX static unsigned iterate_avx_3chain(man_pointstruct *ps_ptr) { ITERATE_AVX_CHAINS(3, pd, __m256d, double, 0) }
+TARGET_AVX static unsigned iterate_avx_4chain(man_pointstruct *ps_ptr) { ITERATE_AVX_CHAINS(4, pd, __m256d, double, 0) }
+TARGET_AVX static unsigned iterate_avx_s_3chain(man_pointstruct *ps_ptr) { ITERATE_AVX_CHAINS(3, ps, __m256, float, 0) }
+TARGET_AVX static unsigned iterate_avx_s_4chain(man_pointstruct *ps_ptr) { ITERATE_AVX_CHAINS(4, ps, __m256, float, 0) }
+TARGET_AVX_FMA static unsigned iterate_avx_fma_3chain(man_pointstruct *ps_ptr) { ITERATE_AVX_CHAINS(3, pd, __m256d, double, 1) }
+TARGET_AVX_FMA static unsigned iterate_avx_fma_4chain(man_pointstruct *ps_ptr) { ITERATE_AVX_CHAINS(4, pd, __m256d, double, 1) }
+TARGET_AVX_FMA static unsigned iterate_avx_fma_s_3chain(man_pointstruct *ps_ptr) { ITERATE_AVX_CHAINS(3, ps, __m256, float, 1) }
+TARGET_AVX_FMA static unsigned iterate_avx_fma_s_4chain(man_pointstruct *ps_ptr) { ITERATE_AVX_CHAINS(4, ps, __m256, float, 1) }
+TARGET_AVX static unsigned iterate_avx_multibrot3(man_pointstruct *ps_ptr) { return iterate_avx_formula(ps_ptr, FORMULA_MULTIBROT3); }
+TARGET_AVX static unsigned iterate_avx_multibrot4(man_pointstruct *ps_ptr) { return iterate_avx_formula(ps_ptr, FORMULA_MULTIBROT4); }
+TARGET_AVX static unsigned iterate_avx_burning_ship(man_pointstruct *ps_ptr) { return iterate_avx_formula(ps_ptr, FORMULA_BURNING_SHIP); }
+TARGET_AVX static unsigned iterate_avx_tricorn(man_pointstruct *ps_ptr) { return iterate_avx_formula(ps_ptr, FORMULA_TRICORN); }
+
+#endif // USE_AVX_KERNELS
+
+#ifdef USE_AVX512_KERNELS
+
+// AVX-512 double precision versions: chains of 8 doubles, compares into mask registers (see
+// iterate_avx512). All AVX-512 CPUs have FMA, so fma is just a parameter here, as is the
+// formula f (FORMULA_*; no FMA for the other formulas). T is pd, F double.
+
+// One iteration of a chain (see iterate_avx512 and iterate_avx512_fma). Also used by the
+// batched queue functions. Sets mag to the magnitude before the iteration.
+#define AVX512_ITERATE(T, fma, x, y, a, b, mag, t, yy)     \
+   if (fma)                                                 \
+   {                                                        \
+      yy = _mm512_mul_##T(y, y);                            \
+      t = _mm512_fnmadd_##T(y, y, a);                       \
+      mag = _mm512_fmadd_##T(x, x, yy);                     \
+      y = _mm512_fmadd_##T(_mm512_add_##T(x, x), y, b);     \
+      x = _mm512_fmadd_##T(x, x, t);                        \
+   }                                                        \
+   else                                                     \
+   {                                                        \
+      t = _mm512_mul_##T(x, x);                             \
+      yy = _mm512_mul_##T(y, y);                            \
+      mag = _mm512_add_##T(t, yy);                          \
+      y = _mm512_add_##T(_mm512_mul_##T(_mm512_add_##T(x, x), y), b); \
+      x = _mm512_add_##T(_mm512_sub_##T(t, yy), a);         \
+   }
+
+#define AVX512_CHAIN_LOAD(c, T, F, mg)                                           \
+   x[c] = _mm512_load_pd(&ps_ptr->x[8 * c]);                                     \
+   y[c] = _mm512_load_pd(&ps_ptr->y[8 * c]);                                     \
+   a[c] = _mm512_load_pd(&ps_ptr->a[8 * c]);                                     \
+   b[c] = _mm512_load_pd(&ps_ptr->b[8 * c]);                                     \
+   px[c] = _mm512_load_pd(&ps_ptr->period_x[8 * c]);                             \
+   py[c] = _mm512_load_pd(&ps_ptr->period_y[8 * c]);
+
+#define AVX512_CHAIN_ITER(c, T, F, mg)                                           \
+   if (f)                                                                        \
+   {                                                                             \
+      FORMULA_ITERATE(512, f, x[c], y[c], a[c], b[c], mg[c], t[c], yy[c])        \
+   }                                                                             \
+   else                                                                          \
+   {                                                                             \
+      AVX512_ITERATE(pd, fma, x[c], y[c], a[c], b[c], mg[c], t[c], yy[c])        \
+   }
+
+#define AVX512_CHAIN_PERIOD(c, T, F, mg)                                         \
+   per[c] = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_abs_pd(_mm512_sub_pd(x[c], px[c])), \
+                                             _mm512_abs_pd(_mm512_sub_pd(y[c], py[c]))), tol, _CMP_LT_OQ);
+
+// Save z as the orbit point of the chain's points that are at their save count
+#define AVX512_CHAIN_SAVE(c, T, F, mg)                                           \
+   px[c] = _mm512_mask_mov_pd(px[c], (__mmask8) (due >> (8 * c)), x[c]);        \
+   py[c] = _mm512_mask_mov_pd(py[c], (__mmask8) (due >> (8 * c)), y[c]);
+
+#define AVX512_CHAIN_DONE(c, T, F, mg)                                           \
+   done |= _mm512_cmp_pd_mask(mag[c], rad, _CMP_NLT_UQ) | per[c];
+
+#define AVX512_CHAIN_STORE(c, T, F, mg)                                          \
+   _mm512_store_pd(&ps_ptr->x[8 * c], x[c]);                                     \
+   _mm512_store_pd(&ps_ptr->y[8 * c], y[c]);                                     \
+   _mm512_store_pd(&ps_ptr->mag[8 * c], mag[c]);                                 \
+   _mm512_store_pd(&ps_ptr->magprev[8 * c], magprev[c]);                         \
+   _mm512_store_pd(&ps_ptr->period_x[8 * c], px[c]);                             \
+   _mm512_store_pd(&ps_ptr->period_y[8 * c], py[c]);                             \
+   periodic |= (unsigned) per[c] << (8 * c);
+
+TARGET_AVX512 static __inline unsigned iterate_avx512_chains(man_pointstruct *ps_ptr, int n, int fma, int f)
+{
+   __m512d x[4], y[4], t[4], yy[4], mag[4], magprev[4], a[4], b[4], px[4], py[4];
+   __m512d rad, tol;
+   __m512i iters_lo, iters_hi, next_lo, next_hi, inc;
+   __mmask8 per[4];
+   unsigned i, iters, max, save, done, periodic, due;
+
+   // Zero chains 2 and 3, which may not be used, so they're never read uninitialized
+   for (i = 2; i < 4; i++)
+   {
+      x[i] = y[i] = a[i] = b[i] = px[i] = py[i] = mag[i] = magprev[i] = _mm512_setzero_pd();
+      per[i] = 0;
+   }
+
+   CHAINS_DO(n, AVX512_CHAIN_LOAD, pd, double, mag)
+   rad = _mm512_set1_pd(DIVERGED_THRESH);
+   tol = _mm512_set1_pd(ps_ptr->period_tol);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   iters_lo = _mm512_load_si512(ps_ptr->iters);   // counts and save counts (see period_save_sse2)
+   next_lo = _mm512_load_si512(ps_ptr->period_next);
+   iters_hi = n > 2 ? _mm512_load_si512(ps_ptr->iters + 16) : iters_lo;
+   next_hi = n > 2 ? _mm512_load_si512(ps_ptr->period_next + 16) : next_lo;
+   save = period_call_save_avx512(iters_lo, next_lo, iters_hi, next_hi);
+
+   do
+   {
+      CHAINS_DO(n, AVX512_CHAIN_ITER, pd, double, magprev)
+      CHAINS_DO(n, AVX512_CHAIN_ITER, pd, double, mag)
+      CHAINS_DO(n, AVX512_CHAIN_PERIOD, pd, double, mag)
+
+      iters += 2;
+      if (iters == save)
+      {
+         due = period_due_avx512(iters_lo, &next_lo, iters);
+         if (n > 2)
+            due |= (unsigned) period_due_avx512(iters_hi, &next_hi, iters) << 16;
+         else
+            next_hi = next_lo;
+         CHAINS_DO(n, AVX512_CHAIN_SAVE, pd, double, mag)
+         save = period_call_save_avx512(iters_lo, next_lo, iters_hi, next_hi);
+      }
+      done = 0;
+      CHAINS_DO(n, AVX512_CHAIN_DONE, pd, double, mag)
+   }
+   while (!done && iters != max);
+
+   periodic = 0;
+   CHAINS_DO(n, AVX512_CHAIN_STORE, pd, double, mag)
+   ps_ptr->periodic = periodic;
+   _mm512_store_si512(ps_ptr->period_next, next_lo);
+   if (n > 2)
+      _mm512_store_si512(ps_ptr->period_next + 16, next_hi);
+
+   ps_ptr->iterctr += iters;
+   inc = _mm512_set1_epi32(iters);
+   _mm512_store_si512(ps_ptr->iters, _mm512_add_epi32(_mm512_load_si512(ps_ptr->iters), inc));
+   _mm512_store_si512(ps_ptr->iters + 16, _mm512_add_epi32(_mm512_load_si512(ps_ptr->iters + 16), inc));
+
+   return iters;
+}
+
+TARGET_AVX512 static unsigned iterate_avx512_3chain(man_pointstruct *ps_ptr) { return iterate_avx512_chains(ps_ptr, 3, 0, 0); }
+TARGET_AVX512 static unsigned iterate_avx512_4chain(man_pointstruct *ps_ptr) { return iterate_avx512_chains(ps_ptr, 4, 0, 0); }
+TARGET_AVX512 static unsigned iterate_avx512_fma_3chain(man_pointstruct *ps_ptr) { return iterate_avx512_chains(ps_ptr, 3, 1, 0); }
+TARGET_AVX512 static unsigned iterate_avx512_fma_4chain(man_pointstruct *ps_ptr) { return iterate_avx512_chains(ps_ptr, 4, 1, 0); }
+
+// Formula versions: 16 points as two chains of 8, like iterate_avx512
+TARGET_AVX512 static unsigned iterate_avx512_multibrot3(man_pointstruct *ps_ptr) { return iterate_avx512_chains(ps_ptr, 2, 0, FORMULA_MULTIBROT3); }
+TARGET_AVX512 static unsigned iterate_avx512_multibrot4(man_pointstruct *ps_ptr) { return iterate_avx512_chains(ps_ptr, 2, 0, FORMULA_MULTIBROT4); }
+TARGET_AVX512 static unsigned iterate_avx512_burning_ship(man_pointstruct *ps_ptr) { return iterate_avx512_chains(ps_ptr, 2, 0, FORMULA_BURNING_SHIP); }
+TARGET_AVX512 static unsigned iterate_avx512_tricorn(man_pointstruct *ps_ptr) { return iterate_avx512_chains(ps_ptr, 2, 0, FORMULA_TRICORN); }
+
+#endif // USE_AVX512_KERNELS
+
+// Queuing functions
+
+// The queue_status field of the pointstruct structure keeps track of which point
+// queue slots are free. Each 3 bits gives a free slot.
+// Push: shift left 3, OR in free slot number.
+// Pop: slot number = low 3 bits, shift right 3.
+// Queue is full when queue_status == QUEUE_FULL.
+// Initialize with 3, 2, 1, 0 in bits 11-0, QUEUE_FULL in bits 15-12
+// Also used for single precision algorithm, to track up to 8 queue slots
+
+#define QUEUE_FULL   0xF
+
+// Condition indicating point[ind] diverged
+#define DIVERGED(p, ind)         (((int *)p->mag)[1 + (ind << 1)] >= DIV_EXP)
+
+// Condition indicating point[ind] diverged on the previous iteration
+#define DIVERGED_PREV(p, ind)    (((int *)p->magprev)[1 + (ind << 1)] >= DIV_EXP)
+
+// For single-precision (SSE) version
+#define DIVERGED_S(p, ind)       (((int *)p->mag)[ind] >= DIV_EXP_FLOAT)
+#define DIVERGED_PREV_S(p, ind)  (((int *)p->magprev)[ind] >= DIV_EXP_FLOAT)
+
+// Retire point[ind], which the kernel found periodic (see PERIOD_FIRST_SAVE). It will never
+// diverge, so store max_iters. Queue flushing dummies aren't counted.
+static __inline void retire_periodic(man_calc_struct *m, man_pointstruct *ps_ptr, unsigned ind)
+{
+   *ps_ptr->iters_ptr[ind] = m->max_iters;
+   if (ps_ptr->iters_ptr[ind] != m->iter_data_dummy)
+      ps_ptr->periodic_ctr++;
+}
+
+// Queue a point for iteration using the 4-point SSE2 algorithm. On entry, ps_ptr->ab_in
+// should contain the real and imaginary parts of the point to iterate on, and
+// iters_ptr should be the address of the point in the iteration count array.
+//
+// Can't assume all 4 point b's will be the same (pixels on the previous line may
+// still be iterating).
+
+// Rewriting this in ASM would probably save a lot of overhead (important for
+// realtime zooming and panning)
+
+static void FASTCALL queue_4point_sse2(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp
+{
+   unsigned i, iters, max, queue_status, *ptr;
+   man_calc_struct *m;
+
+   m = (man_calc_struct *) calc_struct;
+
+   queue_status = ps_ptr->queue_status;
+
+   if (queue_status == QUEUE_FULL) // If all points in use, iterate to clear at least one point first
+   {
+      m->mandel_iterate(ps_ptr);    // Returns (iters done) if any point hit max iterations, or diverged
+      max = 0;
+      for (i = 0; i < 4; i++) // compiler fully unrolls this
+      {
+         // Find which point(s) are done and retire them (store iteration count to array).
+         // Iteration counts will later be mapped to colors using the current palette.
+         // Timing test: removing array stores results in NO time savings on bmark.log.
+
+         iters = ps_ptr->iters[i];
+         if (DIVERGED(ps_ptr, i))
+         {
+            // If actually diverged on previous iteration, dec iters.
+            // *ps_ptr->iters_ptr[i] = iters - DIVERGED_PREV(ps_ptr, i);
+
+            // This is about 3% slower (with the branch and extra stores) than the old code (above).
+            // Needed to get the correct magnitude for the normalized iteration count algorithm.
+
+            ptr = ps_ptr->iters_ptr[i];
+            if (DIVERGED_PREV(ps_ptr, i))
+            {
+               *ptr = iters - 1;
+               MAG(m, ptr) = (float) ps_ptr->magprev[i];
+            }
+            else
+            {
+               *ptr = iters;
+               MAG(m, ptr) = (float) ps_ptr->mag[i];
+            }
+
+            // Push free slot. Use this form to allow compiler to use the lea instruction
+            queue_status = queue_status * 8 + i;
+         }
+         else if (ps_ptr->periodic & (1 << i)) // Orbit repeats: retire as max iters
+         {
+            retire_periodic(m, ps_ptr, i);
+            queue_status = queue_status * 8 + i;
+         }
+         // Gets here most often. See if this point has the most accumulated iterations.
+         // Also check if point reached max iters and retire if so. Definite overhead
+         // improvement to combine the max iters check with the max check- measurable with
+         // small max_iters (e.g., when realtime zooming)
+         else
+         {
+            if (iters >= max)
+            {
+               if (iters == m->max_iters)
+               {
+                  *ps_ptr->iters_ptr[i] = iters;         // don't need mag store for max_iters
+                  queue_status = queue_status * 8 + i;   // Push free slot
+               }
+               else
+                  max = iters;
+            }
+         }
+
+      }
+      // Set the maximum iterations to do next loop: max iters - iters already done.
+      // The next loop must break if the point with the most accumulated iterations (max)
+      // reaches max_iters.
+      ps_ptr->cur_max_iters = m->max_iters - max;
+
+      // Most common case: comes here with one point free. Retiring multiple points only
+      // happens about 1-5% of the time for complex images. For images with vast areas
+      // of a single color, can go to 50%.
+   }
+
+   i = queue_status & 3;                     // Get next free slot
+   ps_ptr->queue_status = queue_status >> 3; // Pop free slot
+
+   // Initialize pointstruct fields
+   set_start_point(ps_ptr, i);      // Set input point and initial conditions
+   ps_ptr->yy[i] = 0.0;
+   ps_ptr->iters[i] = 0;
+   ps_ptr->period_next[i] = PERIOD_FIRST_SAVE;
+   if (ps_ptr->period_save > PERIOD_FIRST_SAVE)
+      ps_ptr->period_save = PERIOD_FIRST_SAVE;
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+// Similar queuing function for the 8-point SSE algorithm
+static void FASTCALL queue_8point_sse(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp8
+{
+   unsigned i, iters, max, queue_status, *ptr;
+   man_calc_struct *m;
+
+   m = (man_calc_struct *) calc_struct;
+   queue_status = ps_ptr->queue_status;
+
+   if (queue_status == QUEUE_FULL)
+   {
+      m->mandel_iterate(ps_ptr);
+
+      max = 0;
+      for (i = 0; i < 8; i++)
+      {
+         iters = ps_ptr->iters[i];
+         if (DIVERGED_S(ps_ptr, i))
+         {
+            // *ps_ptr->iters_ptr[i] = iters - DIVERGED_PREV_S(ps_ptr, i);
+
+            ptr = ps_ptr->iters_ptr[i];
+            if (DIVERGED_PREV_S(ps_ptr, i))
+            {
+               *ptr = iters - 1;
+               MAG(m, ptr) = ((float *) ps_ptr->magprev)[i];
+            }
+            else
+            {
+               *ptr = iters;
+               MAG(m, ptr) = ((float *) ps_ptr->mag)[i];
+            }
+            queue_status = queue_status * 8 + i;
+         }
+         else if (ps_ptr->periodic & (1 << i))
+         {
+            retire_periodic(m, ps_ptr, i);
+            queue_status = queue_status * 8 + i;
+         }
+         else
+         {
+            if (iters >= max)
+            {
+               if (iters == m->max_iters)
+               {
+                  *ps_ptr->iters_ptr[i] = iters;
+                  queue_status = queue_status * 8 + i;
+               }
+               else
+                  max = iters;
+            }
+         }
+      }
+      ps_ptr->cur_max_iters = m->max_iters - max;
+   }
+
+   i = queue_status & 7;
+   ps_ptr->queue_status = queue_status >> 3;
+
+   // Initialize pointstruct fields as packed 32-bit floats
+   ((float *) ps_ptr->a)[i] = (float) ps_ptr->ab_in[0];  // Set input point- convert from doubles
+   ((float *) ps_ptr->b)[i] = (float) ps_ptr->ab_in[1];  // generated by the main loop
+   ((float *) ps_ptr->y)[i] = 0.0;                       // Set initial conditions
+   ((float *) ps_ptr->x)[i] = 0.0;
+   ((float *) ps_ptr->period_x)[i] = 0.0;
+   ((float *) ps_ptr->period_y)[i] = 0.0;
+   ((float *) ps_ptr->yy)[i] = 0.0;
+   ps_ptr->iters[i] = 0;
+   ps_ptr->period_next[i] = PERIOD_FIRST_SAVE;
+   if (ps_ptr->period_save > PERIOD_FIRST_SAVE)
+      ps_ptr->period_save = PERIOD_FIRST_SAVE;
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+// The 8 and 16 point queues have too many slots for the 3-bit stack above, so for these
+// queue_status is a bitmask of free slots instead (bit n set = slot n free, 0 = full).
+// Pop: slot number = lowest set bit. Push: set the bit.
+
+#define QUEUE_FREE_8    0xFF
+#define QUEUE_FREE_12   0xFFF
+#define QUEUE_FREE_16   0xFFFF
+#define QUEUE_FREE_24   0xFFFFFF
+#define QUEUE_FREE_32   0xFFFFFFFF
+
+static __inline unsigned lowest_set_bit(unsigned mask)
+{
+   #ifdef _MSC_VER
+   unsigned long ind;
+
+   _BitScanForward(&ind, mask);
+   return ind;
+   #else
+   return __builtin_ctz(mask);
+   #endif
+}
+
+#ifdef USE_AVX_KERNELS
+
+// Queuing function for the AVX (double precision) algorithms: 8 points, or 12/16 for the
+// multi-chain versions. Same as queue_4point_sse2 except for the queue status handling.
+static __inline void queue_npoint_avx(man_calc_struct *m, man_pointstruct *ps_ptr, unsigned *iters_ptr, unsigned points)
+{
+   unsigned i, iters, max, queue_status, *ptr;
+
+   queue_status = ps_ptr->queue_status;
+
+   if (!queue_status) // If all points in use, iterate to clear at least one point first
+   {
+      m->mandel_iterate(ps_ptr);
+      max = 0;
+      for (i = 0; i < points; i++)
+      {
+         iters = ps_ptr->iters[i];
+         if (DIVERGED(ps_ptr, i))
+         {
+            ptr = ps_ptr->iters_ptr[i];
+            if (DIVERGED_PREV(ps_ptr, i))
+            {
+               *ptr = iters - 1;
+               MAG(m, ptr) = (float) ps_ptr->magprev[i];
+            }
+            else
+            {
+               *ptr = iters;
+               MAG(m, ptr) = (float) ps_ptr->mag[i];
+            }
+            queue_status |= 1u << i; // Push free slot
+         }
+         else if (ps_ptr->periodic & (1u << i))
+         {
+            retire_periodic(m, ps_ptr, i);
+            queue_status |= 1u << i;
+         }
+         else
+         {
+            if (iters >= max)
+            {
+               if (iters == m->max_iters)
+               {
+                  *ps_ptr->iters_ptr[i] = iters;
+                  queue_status |= 1u << i;
+               }
+               else
+                  max = iters;
+            }
+         }
+      }
+      ps_ptr->cur_max_iters = m->max_iters - max;
+   }
+
+   i = lowest_set_bit(queue_status);               // Get next free slot
+   ps_ptr->queue_status = queue_status & ~(1u << i); // Pop free slot
+
+   set_start_point(ps_ptr, i);      // Set input point and initial conditions
+   ps_ptr->iters[i] = 0;
+   ps_ptr->period_next[i] = PERIOD_FIRST_SAVE;
+   if (ps_ptr->period_save > PERIOD_FIRST_SAVE)
+      ps_ptr->period_save = PERIOD_FIRST_SAVE;
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+
+// Single precision version: 16 points, or 24/32 for the multi-chain versions
+static __inline void queue_npoint_avx_s(man_calc_struct *m, man_pointstruct *ps_ptr, unsigned *iters_ptr, unsigned points)
+{
+   unsigned i, iters, max, queue_status, *ptr;
+
+   queue_status = ps_ptr->queue_status;
+
+   if (!queue_status)
+   {
+      m->mandel_iterate(ps_ptr);
+      max = 0;
+      for (i = 0; i < points; i++)
+      {
+         iters = ps_ptr->iters[i];
+         if (DIVERGED_S(ps_ptr, i))
+         {
+            ptr = ps_ptr->iters_ptr[i];
+            if (DIVERGED_PREV_S(ps_ptr, i))
+            {
+               *ptr = iters - 1;
+               MAG(m, ptr) = ((float *) ps_ptr->magprev)[i];
+            }
+            else
+            {
+               *ptr = iters;
+               MAG(m, ptr) = ((float *) ps_ptr->mag)[i];
+            }
+            queue_status |= 1u << i;
+         }
+         else if (ps_ptr->periodic & (1u << i))
+         {
+            retire_periodic(m, ps_ptr, i);
+            queue_status |= 1u << i;
+         }
+         else
+         {
+            if (iters >= max)
+            {
+               if (iters == m->max_iters)
+               {
+                  *ps_ptr->iters_ptr[i] = iters;
+                  queue_status |= 1u << i;
+               }
+               else
+                  max = iters;
+            }
+         }
+      }
+      ps_ptr->cur_max_iters = m->max_iters - max;
+   }
+
+   i = lowest_set_bit(queue_status);
+   ps_ptr->queue_status = queue_status & ~(1u << i);
+
+   ((float *) ps_ptr->a)[i] = (float) ps_ptr->ab_in[0];
+   ((float *) ps_ptr->b)[i] = (float) ps_ptr->ab_in[1];
+   ((float *) ps_ptr->y)[i] = 0.0;
+   ((float *) ps_ptr->x)[i] = 0.0;
+   ((float *) ps_ptr->period_x)[i] = 0.0;
+   ((float *) ps_ptr->period_y)[i] = 0.0;
+   ps_ptr->iters[i] = 0;
+   ps_ptr->period_next[i] = PERIOD_FIRST_SAVE;
+   if (ps_ptr->period_save > PERIOD_FIRST_SAVE)
+      ps_ptr->period_save = PERIOD_FIRST_SAVE;
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+
+static void FASTCALL queue_8point_avx(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp8d
+{
+   queue_npoint_avx((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 8);
+}
+
+static void FASTCALL queue_16point_avx(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp16
+{
+   queue_npoint_avx_s((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 16);
+}
+
+static void FASTCALL queue_avx_3chain(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr)
+{
+   queue_npoint_avx((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 12);
+}
+
+static void FASTCALL queue_avx_4chain(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr)
+{
+   queue_npoint_avx((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 16);
+}
+
+static void FASTCALL queue_avx_s_3chain(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr)
+{
+   queue_npoint_avx_s((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 24);
+}
+
+static void FASTCALL queue_avx_s_4chain(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr)
+{
+   queue_npoint_avx_s((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 32);
+}
+
+#endif // USE_AVX_KERNELS
+
+#ifdef USE_AVX512_KERNELS // (implies USE_AVX_KERNELS)
+
+// Queuing function for the 16-point AVX-512 (double precision) algorithm. Instead of checking
+// each point in turn, the divergence and max iters tests are done on all the points at once
+// with mask compares, and only the points that are done (set bits in the masks) are visited.
+// The max accumulated iterations of the remaining points also comes from a masked reduction.
+// The scalar loop in the other queue functions is a large part of the overhead when
+// max_iters is small (e.g., when realtime zooming).
+
+TARGET_AVX512 static void FASTCALL queue_16point_avx512(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp16d
+{
+   unsigned i, max, queue_status, diverged, diverged_prev, max_iters_done, periodic, mask, *ptr;
+   __m512d rad;
+   __m512i iters_v;
+   man_calc_struct *m;
+
+   m = (man_calc_struct *) calc_struct;
+   queue_status = ps_ptr->queue_status;
+
+   if (!queue_status) // If all points in use, iterate to clear at least one point first
+   {
+      m->mandel_iterate(ps_ptr);
+
+      rad = _mm512_set1_pd(DIVERGED_THRESH);
+      diverged = _mm512_cmp_pd_mask(_mm512_load_pd(&ps_ptr->mag[0]), rad, _CMP_NLT_UQ) |
+                 ((unsigned) _mm512_cmp_pd_mask(_mm512_load_pd(&ps_ptr->mag[8]), rad, _CMP_NLT_UQ) << 8);
+      diverged_prev = _mm512_cmp_pd_mask(_mm512_load_pd(&ps_ptr->magprev[0]), rad, _CMP_NLT_UQ) |
+                      ((unsigned) _mm512_cmp_pd_mask(_mm512_load_pd(&ps_ptr->magprev[8]), rad, _CMP_NLT_UQ) << 8);
+
+      iters_v = _mm512_load_si512(ps_ptr->iters);
+      max_iters_done = _mm512_cmpeq_epi32_mask(iters_v, _mm512_set1_epi32(m->max_iters)) & ~diverged;
+      periodic = ps_ptr->periodic & ~(diverged | max_iters_done);
+
+      // Retire diverged points. If actually diverged on the previous iteration, dec iters.
+      for (mask = diverged; mask; mask &= mask - 1)
+      {
+         i = lowest_set_bit(mask);
+         ptr = ps_ptr->iters_ptr[i];
+         if (diverged_prev & (1 << i))
+         {
+            *ptr = ps_ptr->iters[i] - 1;
+            MAG(m, ptr) = (float) ps_ptr->magprev[i];
+         }
+         else
+         {
+            *ptr = ps_ptr->iters[i];
+            MAG(m, ptr) = (float) ps_ptr->mag[i];
+         }
+      }
+
+      // Retire points that reached max iters (don't need mag store for max_iters), and
+      // points whose orbits repeat
+      for (mask = max_iters_done; mask; mask &= mask - 1)
+         *ps_ptr->iters_ptr[lowest_set_bit(mask)] = m->max_iters;
+      for (mask = periodic; mask; mask &= mask - 1)
+         retire_periodic(m, ps_ptr, lowest_set_bit(mask));
+
+      queue_status = diverged | max_iters_done | periodic;
+
+      // Next loop must break if the remaining point with the most accumulated iterations
+      // reaches max_iters. Reduction gives 0 if there are no remaining points.
+      max = _mm512_mask_reduce_max_epu32((__mmask16) ~queue_status, iters_v);
+      ps_ptr->cur_max_iters = m->max_iters - max;
+   }
+
+   i = lowest_set_bit(queue_status);               // Get next free slot
+   ps_ptr->queue_status = queue_status & ~(1 << i); // Pop free slot
+
+   set_start_point(ps_ptr, i);      // Set input point and initial conditions
+   ps_ptr->iters[i] = 0;
+   ps_ptr->period_next[i] = PERIOD_FIRST_SAVE;
+   if (ps_ptr->period_save > PERIOD_FIRST_SAVE)
+      ps_ptr->period_save = PERIOD_FIRST_SAVE;
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+// Queuing function for the 32-point AVX-512 (single precision) algorithm
+TARGET_AVX512 static void FASTCALL queue_32point_avx512(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp32
+{
+   unsigned i, max, max_gv, queue_status, diverged, diverged_prev, max_iters_done, periodic, mask, *ptr;
+   __m512 rad;
+   __m512i iters0f, itersgv, max_iters;
+   man_calc_struct *m;
+
+   m = (man_calc_struct *) calc_struct;
+   queue_status = ps_ptr->queue_status;
+
+   if (!queue_status)
+   {
+      m->mandel_iterate(ps_ptr);
+
+      rad = _mm512_set1_ps((float) DIVERGED_THRESH);
+      diverged = _mm512_cmp_ps_mask(_mm512_load_ps((float *) ps_ptr->mag), rad, _CMP_NLT_UQ) |
+                 ((unsigned) _mm512_cmp_ps_mask(_mm512_load_ps((float *) ps_ptr->mag + 16), rad, _CMP_NLT_UQ) << 16);
+      diverged_prev = _mm512_cmp_ps_mask(_mm512_load_ps((float *) ps_ptr->magprev), rad, _CMP_NLT_UQ) |
+                      ((unsigned) _mm512_cmp_ps_mask(_mm512_load_ps((float *) ps_ptr->magprev + 16), rad, _CMP_NLT_UQ) << 16);
+
+      iters0f = _mm512_load_si512(ps_ptr->iters);
+      itersgv = _mm512_load_si512(ps_ptr->iters + 16);
+      max_iters = _mm512_set1_epi32(m->max_iters);
+      max_iters_done = (_mm512_cmpeq_epi32_mask(iters0f, max_iters) |
+                        ((unsigned) _mm512_cmpeq_epi32_mask(itersgv, max_iters) << 16)) & ~diverged;
+      periodic = ps_ptr->periodic & ~(diverged | max_iters_done);
+
+      for (mask = diverged; mask; mask &= mask - 1)
+      {
+         i = lowest_set_bit(mask);
+         ptr = ps_ptr->iters_ptr[i];
+         if (diverged_prev & (1u << i))
+         {
+            *ptr = ps_ptr->iters[i] - 1;
+            MAG(m, ptr) = ((float *) ps_ptr->magprev)[i];
+         }
+         else
+         {
+            *ptr = ps_ptr->iters[i];
+            MAG(m, ptr) = ((float *) ps_ptr->mag)[i];
+         }
+      }
+
+      for (mask = max_iters_done; mask; mask &= mask - 1)
+         *ps_ptr->iters_ptr[lowest_set_bit(mask)] = m->max_iters;
+      for (mask = periodic; mask; mask &= mask - 1)
+         retire_periodic(m, ps_ptr, lowest_set_bit(mask));
+
+      queue_status = diverged | max_iters_done | periodic;
+
+      max = _mm512_mask_reduce_max_epu32((__mmask16) ~queue_status, iters0f);
+      max_gv = _mm512_mask_reduce_max_epu32((__mmask16) (~queue_status >> 16), itersgv);
+      if (max_gv > max)
+         max = max_gv;
+      ps_ptr->cur_max_iters = m->max_iters - max;
+   }
+
+   i = lowest_set_bit(queue_status);
+   ps_ptr->queue_status = queue_status & ~(1u << i);
+
+   ((float *) ps_ptr->a)[i] = (float) ps_ptr->ab_in[0];
+   ((float *) ps_ptr->b)[i] = (float) ps_ptr->ab_in[1];
+   ((float *) ps_ptr->y)[i] = 0.0;
+   ((float *) ps_ptr->x)[i] = 0.0;
+   ((float *) ps_ptr->period_x)[i] = 0.0;
+   ((float *) ps_ptr->period_y)[i] = 0.0;
+   ps_ptr->iters[i] = 0;
+   ps_ptr->period_next[i] = PERIOD_FIRST_SAVE;
+   if (ps_ptr->period_save > PERIOD_FIRST_SAVE)
+      ps_ptr->period_save = PERIOD_FIRST_SAVE;
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+// Queuing function for the multi-chain AVX-512 double precision algorithms (24 or 32 points).
+// Same as queue_16point_avx512, with the masks built a chain at a time.
+TARGET_AVX512 static __inline void queue_npoint_avx512(man_calc_struct *m, man_pointstruct *ps_ptr, unsigned *iters_ptr,
+                                                       int chains)
+{
+   unsigned i, max, max_hi, queue_status, valid, diverged, diverged_prev, max_iters_done, periodic, mask, *ptr;
+   int c;
+   __m512d rad;
+   __m512i iters_lo, iters_hi, max_iters;
+
+   queue_status = ps_ptr->queue_status;
+   valid = chains == 4 ? QUEUE_FREE_32 : QUEUE_FREE_24;
+
+   if (!queue_status)
+   {
+      m->mandel_iterate(ps_ptr);
+
+      rad = _mm512_set1_pd(DIVERGED_THRESH);
+      diverged = diverged_prev = 0;
+      for (c = 0; c < chains; c++)
+      {
+         diverged |= (unsigned) _mm512_cmp_pd_mask(_mm512_load_pd(&ps_ptr->mag[8 * c]), rad, _CMP_NLT_UQ) << (8 * c);
+         diverged_prev |= (unsigned) _mm512_cmp_pd_mask(_mm512_load_pd(&ps_ptr->magprev[8 * c]), rad, _CMP_NLT_UQ) << (8 * c);
+      }
+
+      iters_lo = _mm512_load_si512(ps_ptr->iters);
+      iters_hi = _mm512_load_si512(ps_ptr->iters + 16);
+      max_iters = _mm512_set1_epi32(m->max_iters);
+      max_iters_done = (_mm512_cmpeq_epi32_mask(iters_lo, max_iters) |
+                        ((unsigned) _mm512_cmpeq_epi32_mask(iters_hi, max_iters) << 16)) & valid & ~diverged;
+      periodic = ps_ptr->periodic & ~(diverged | max_iters_done);
+
+      for (mask = diverged; mask; mask &= mask - 1)
+      {
+         i = lowest_set_bit(mask);
+         ptr = ps_ptr->iters_ptr[i];
+         if (diverged_prev & (1u << i))
+         {
+            *ptr = ps_ptr->iters[i] - 1;
+            MAG(m, ptr) = (float) ps_ptr->magprev[i];
+         }
+         else
+         {
+            *ptr = ps_ptr->iters[i];
+            MAG(m, ptr) = (float) ps_ptr->mag[i];
+         }
+      }
+
+      for (mask = max_iters_done; mask; mask &= mask - 1)
+         *ps_ptr->iters_ptr[lowest_set_bit(mask)] = m->max_iters;
+      for (mask = periodic; mask; mask &= mask - 1)
+         retire_periodic(m, ps_ptr, lowest_set_bit(mask));
+
+      queue_status = diverged | max_iters_done | periodic;
+
+      mask = ~queue_status & valid;
+      max = _mm512_mask_reduce_max_epu32((__mmask16) mask, iters_lo);
+      max_hi = _mm512_mask_reduce_max_epu32((__mmask16) (mask >> 16), iters_hi);
+      if (max_hi > max)
+         max = max_hi;
+      ps_ptr->cur_max_iters = m->max_iters - max;
+   }
+
+   i = lowest_set_bit(queue_status);
+   ps_ptr->queue_status = queue_status & ~(1u << i);
+
+   set_start_point(ps_ptr, i);
+   ps_ptr->iters[i] = 0;
+   ps_ptr->period_next[i] = PERIOD_FIRST_SAVE;
+   if (ps_ptr->period_save > PERIOD_FIRST_SAVE)
+      ps_ptr->period_save = PERIOD_FIRST_SAVE;
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+TARGET_AVX512 static void FASTCALL queue_avx512_3chain(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr)
+{
+   queue_npoint_avx512((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 3);
+}
+
+TARGET_AVX512 static void FASTCALL queue_avx512_4chain(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr)
+{
+   queue_npoint_avx512((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 4);
+}
+
+
+// Batched queuing functions. The queue functions above return to the calculation loop after
+// every point, so each time the queue fills the kernel reloads the point states, iterates until
+// at least one point is done, and stores everything back- mostly to retire just one or two
+// points. At low max_iters (realtime zooming) this per-call overhead is a large part of the
+// time. These take a whole buffer of points (the pointstruct batch buffer, filled by
+// queue_batch_point) and keep the point states in registers until the buffer is used up:
+// finished lanes are retired and refilled from the buffer inside the iteration loop, with
+// masked loads bringing the new points into just those lanes.
+//
+// The iteration, retirement order and slot assignment are the same as with queue_point, so the
+// results are identical. Points still in flight at the end are left in the pointstruct in the
+// usual form, so queue_point can take over (e.g. for the flush at the end of the calculation).
+
+// Double precision: 16 points, or 24/32 for the multi-chain versions. The chain count and FMA
+// are constants in the wrappers below, so the compiler generates separate loops for each.
+
+#define AVX512_CHAIN_REFILL(c, T, F, mg)                                         \
+   k = (__mmask8) (refill >> (8 * c));                                           \
+   a[c] = _mm512_mask_load_pd(a[c], k, &ps_ptr->a[8 * c]);                       \
+   b[c] = _mm512_mask_load_pd(b[c], k, &ps_ptr->b[8 * c]);                       \
+   x[c] = _mm512_mask_mov_pd(x[c], k, zero);                                     \
+   y[c] = _mm512_mask_mov_pd(y[c], k, zero);                                     \
+   px[c] = _mm512_mask_mov_pd(px[c], k, zero);                                   \
+   py[c] = _mm512_mask_mov_pd(py[c], k, zero);
+
+#define AVX512_CHAIN_DIVERGED(c, T, F, mg)                                       \
+   diverged |= (unsigned) _mm512_cmp_pd_mask(mag[c], rad, _CMP_NLT_UQ) << (8 * c); \
+   periodic |= (unsigned) per[c] << (8 * c);
+
+#define AVX512_CHAIN_DIVERGED_PREV(c, T, F, mg)                                  \
+   diverged_prev |= (unsigned) _mm512_cmp_pd_mask(magprev[c], rad, _CMP_NLT_UQ) << (8 * c); \
+   _mm512_store_pd(&ps_ptr->mag[8 * c], mag[c]);                                 \
+   _mm512_store_pd(&ps_ptr->magprev[8 * c], magprev[c]);
+
+#define AVX512_CHAIN_SAVE_STATE(c, T, F, mg)                                     \
+   _mm512_store_pd(&ps_ptr->x[8 * c], x[c]);                                     \
+   _mm512_store_pd(&ps_ptr->y[8 * c], y[c]);                                     \
+   _mm512_store_pd(&ps_ptr->a[8 * c], a[c]);                                     \
+   _mm512_store_pd(&ps_ptr->b[8 * c], b[c]);                                     \
+   _mm512_store_pd(&ps_ptr->period_x[8 * c], px[c]);                             \
+   _mm512_store_pd(&ps_ptr->period_y[8 * c], py[c]);
+
+TARGET_AVX512 static __inline void queue_batch_avx512(man_calc_struct *m, man_pointstruct *ps_ptr, int chains, int fma) // sqbd
+{
+   __m512d x[4], y[4], t[4], yy[4], mag[4], magprev[4], a[4], b[4], px[4], py[4];
+   __m512d rad, tol, zero;
+   __m512i iters_lo, iters_hi, next_lo, next_hi, inc, max_iters;
+   __mmask8 per[4], k;
+   unsigned i, n, next, iters, max, max_hi, save, done, queue_status, valid, refill, diverged, diverged_prev;
+   unsigned max_iters_done, periodic, mask, due, *ptr;
+   const int f = FORMULA_MANDELBROT;   // no batch versions of the other formulas
+
+   // Zero chains 2 and 3, which may not be used, so they're never read uninitialized
+   zero = _mm512_setzero_pd();
+   for (i = 2; i < 4; i++)
+   {
+      x[i] = y[i] = a[i] = b[i] = px[i] = py[i] = mag[i] = magprev[i] = zero;
+      per[i] = 0;
+   }
+
+   CHAINS_DO(chains, AVX512_CHAIN_LOAD, pd, double, mag)   // Restore point states
+   iters_lo = _mm512_load_si512(ps_ptr->iters);
+   iters_hi = chains > 2 ? _mm512_load_si512(ps_ptr->iters + 16) : _mm512_setzero_si512(); // (points 16-31)
+   next_lo = _mm512_load_si512(ps_ptr->period_next);   // save counts (see period_save_sse2)
+   next_hi = chains > 2 ? _mm512_load_si512(ps_ptr->period_next + 16) : _mm512_setzero_si512();
+   rad = _mm512_set1_pd(DIVERGED_THRESH);
+   tol = _mm512_set1_pd(ps_ptr->period_tol);
+   max_iters = _mm512_set1_epi32(m->max_iters);
+   valid = chains == 4 ? QUEUE_FREE_32 : (1u << (8 * chains)) - 1;
+
+   queue_status = ps_ptr->queue_status;
+   n = ps_ptr->batch_n;
+   next = 0;
+
+   for (;;)
+   {
+      // Fill free slots from the batch, lowest first (same order as the queue functions)
+      for (refill = 0; queue_status && next < n; next++)
+      {
+         i = lowest_set_bit(queue_status);
+         queue_status &= queue_status - 1;
+         refill |= 1u << i;
+         ps_ptr->a[i] = ps_ptr->batch_re[next];
+         ps_ptr->b[i] = ps_ptr->batch_im[next];
+         ps_ptr->iters_ptr[i] = ps_ptr->batch_ptr[next];
+      }
+      if (refill)
+      {
+         CHAINS_DO(chains, AVX512_CHAIN_REFILL, pd, double, mag)
+         iters_lo = _mm512_mask_mov_epi32(iters_lo, (__mmask16) refill, _mm512_setzero_si512());
+         next_lo = _mm512_mask_mov_epi32(next_lo, (__mmask16) refill, _mm512_set1_epi32(PERIOD_FIRST_SAVE));
+         if (chains > 2)
+         {
+            iters_hi = _mm512_mask_mov_epi32(iters_hi, (__mmask16) (refill >> 16), _mm512_setzero_si512());
+            next_hi = _mm512_mask_mov_epi32(next_hi, (__mmask16) (refill >> 16), _mm512_set1_epi32(PERIOD_FIRST_SAVE));
+         }
+      }
+      if (queue_status) // Batch used up with slots still free: wait for more points
+         break;
+
+      // Queue is full: iterate until at least one point is done. The loop must break if the
+      // point with the most accumulated iterations reaches max_iters.
+      max = _mm512_mask_reduce_max_epu32((__mmask16) valid, iters_lo);
+      max_hi = chains > 2 ? _mm512_mask_reduce_max_epu32((__mmask16) (valid >> 16), iters_hi) : 0;
+      max = m->max_iters - (max_hi > max ? max_hi : max);
+      iters = 0;
+      save = period_call_save_avx512(iters_lo, next_lo, chains > 2 ? iters_hi : iters_lo,
+                                     chains > 2 ? next_hi : next_lo);
+      do
+      {
+         CHAINS_DO(chains, AVX512_CHAIN_ITER, pd, double, magprev)
+         CHAINS_DO(chains, AVX512_CHAIN_ITER, pd, double, mag)
+         CHAINS_DO(chains, AVX512_CHAIN_PERIOD, pd, double, mag)
+
+         iters += 2;
+         if (iters == save)
+         {
+            due = period_due_avx512(iters_lo, &next_lo, iters);
+            if (chains > 2)
+               due |= (unsigned) period_due_avx512(iters_hi, &next_hi, iters) << 16;
+            CHAINS_DO(chains, AVX512_CHAIN_SAVE, pd, double, mag)
+            save = period_call_save_avx512(iters_lo, next_lo, chains > 2 ? iters_hi : iters_lo,
+                                           chains > 2 ? next_hi : next_lo);
+         }
+         done = 0;
+         CHAINS_DO(chains, AVX512_CHAIN_DONE, pd, double, mag)
+      }
+      while (!done && iters != max);
+
+      ps_ptr->iterctr += iters;
+      inc = _mm512_set1_epi32(iters);
+      iters_lo = _mm512_add_epi32(iters_lo, inc);
+      if (chains > 2)
+         iters_hi = _mm512_add_epi32(iters_hi, inc);
+
+      // Retire finished points (see queue_16point_avx512)
+      diverged = periodic = 0;
+      CHAINS_DO(chains, AVX512_CHAIN_DIVERGED, pd, double, mag)
+      max_iters_done = _mm512_cmpeq_epi32_mask(iters_lo, max_iters);
+      if (chains > 2)
+         max_iters_done |= (unsigned) _mm512_cmpeq_epi32_mask(iters_hi, max_iters) << 16;
+      max_iters_done &= valid & ~diverged;
+      periodic &= ~(diverged | max_iters_done);
+
+      if (diverged)
+      {
+         diverged_prev = 0;
+         CHAINS_DO(chains, AVX512_CHAIN_DIVERGED_PREV, pd, double, mag)
+         _mm512_store_si512(ps_ptr->iters, iters_lo);
+         if (chains > 2)
+            _mm512_store_si512(ps_ptr->iters + 16, iters_hi);
+         for (mask = diverged; mask; mask &= mask - 1)
+         {
+            i = lowest_set_bit(mask);
+            ptr = ps_ptr->iters_ptr[i];
+            if (diverged_prev & (1u << i))
+            {
+               *ptr = ps_ptr->iters[i] - 1;
+               MAG(m, ptr) = (float) ps_ptr->magprev[i];
+            }
+            else
+            {
+               *ptr = ps_ptr->iters[i];
+               MAG(m, ptr) = (float) ps_ptr->mag[i];
+            }
+         }
+      }
+      for (mask = max_iters_done; mask; mask &= mask - 1)
+         *ps_ptr->iters_ptr[lowest_set_bit(mask)] = m->max_iters;
+      for (mask = periodic; mask; mask &= mask - 1)
+         retire_periodic(m, ps_ptr, lowest_set_bit(mask));
+
+      queue_status = diverged | max_iters_done | periodic;
+   }
+
+   CHAINS_DO(chains, AVX512_CHAIN_SAVE_STATE, pd, double, mag)   // Save point states
+   _mm512_store_si512(ps_ptr->iters, iters_lo);
+   _mm512_store_si512(ps_ptr->period_next, next_lo);
+   if (chains > 2)
+   {
+      _mm512_store_si512(ps_ptr->iters + 16, iters_hi);
+      _mm512_store_si512(ps_ptr->period_next + 16, next_hi);
+   }
+
+   mask = ~queue_status & valid;
+   max = _mm512_mask_reduce_max_epu32((__mmask16) mask, iters_lo);
+   max_hi = chains > 2 ? _mm512_mask_reduce_max_epu32((__mmask16) (mask >> 16), iters_hi) : 0;
+   ps_ptr->queue_status = queue_status;
+   ps_ptr->cur_max_iters = m->max_iters - (max_hi > max ? max_hi : max);
+   ps_ptr->batch_n = 0;
+}
+
+// Single precision (32 points)
+TARGET_AVX512 static __inline void queue_batch_32point(man_calc_struct *m, man_pointstruct *ps_ptr, int fma) // sqb32
+{
+   __m512 x0f, xgv, y0f, ygv, t0f, tgv, yy0f, yygv, mag0f, maggv, magprev0f, magprevgv;
+   __m512 a0f, agv, b0f, bgv, px0f, pxgv, py0f, pygv, rad, tol, zero;
+   __mmask16 per0f, pergv, lo, hi;
+   __m512i iters0f, itersgv, next0f, nextgv, inc, max_iters;
+   unsigned i, n, next, iters, max, max_gv, save, queue_status, refill, diverged, diverged_prev;
+   unsigned max_iters_done, periodic, mask, *ptr;
+
+   x0f = _mm512_load_ps((float *) ps_ptr->x);
+   xgv = _mm512_load_ps((float *) ps_ptr->x + 16);
+   y0f = _mm512_load_ps((float *) ps_ptr->y);
+   ygv = _mm512_load_ps((float *) ps_ptr->y + 16);
+   a0f = _mm512_load_ps((float *) ps_ptr->a);
+   agv = _mm512_load_ps((float *) ps_ptr->a + 16);
+   b0f = _mm512_load_ps((float *) ps_ptr->b);
+   bgv = _mm512_load_ps((float *) ps_ptr->b + 16);
+   px0f = _mm512_load_ps((float *) ps_ptr->period_x);
+   pxgv = _mm512_load_ps((float *) ps_ptr->period_x + 16);
+   py0f = _mm512_load_ps((float *) ps_ptr->period_y);
+   pygv = _mm512_load_ps((float *) ps_ptr->period_y + 16);
+   iters0f = _mm512_load_si512(ps_ptr->iters);
+   itersgv = _mm512_load_si512(ps_ptr->iters + 16);
+   next0f = _mm512_load_si512(ps_ptr->period_next);   // save counts (see period_save_sse2)
+   nextgv = _mm512_load_si512(ps_ptr->period_next + 16);
+   rad = _mm512_set1_ps((float) DIVERGED_THRESH);
+   tol = _mm512_set1_ps((float) ps_ptr->period_tol);
+   zero = _mm512_setzero_ps();
+   max_iters = _mm512_set1_epi32(m->max_iters);
+
+   queue_status = ps_ptr->queue_status;
+   n = ps_ptr->batch_n;
+   next = 0;
+
+   for (;;)
+   {
+      for (refill = 0; queue_status && next < n; next++)
+      {
+         i = lowest_set_bit(queue_status);
+         queue_status &= queue_status - 1;
+         refill |= 1u << i;
+         ((float *) ps_ptr->a)[i] = (float) ps_ptr->batch_re[next];
+         ((float *) ps_ptr->b)[i] = (float) ps_ptr->batch_im[next];
+         ps_ptr->iters_ptr[i] = ps_ptr->batch_ptr[next];
+      }
+      if (refill)
+      {
+         lo = (__mmask16) refill;
+         hi = (__mmask16) (refill >> 16);
+         a0f = _mm512_mask_load_ps(a0f, lo, (float *) ps_ptr->a);
+         agv = _mm512_mask_load_ps(agv, hi, (float *) ps_ptr->a + 16);
+         b0f = _mm512_mask_load_ps(b0f, lo, (float *) ps_ptr->b);
+         bgv = _mm512_mask_load_ps(bgv, hi, (float *) ps_ptr->b + 16);
+         x0f = _mm512_mask_mov_ps(x0f, lo, zero);
+         xgv = _mm512_mask_mov_ps(xgv, hi, zero);
+         y0f = _mm512_mask_mov_ps(y0f, lo, zero);
+         ygv = _mm512_mask_mov_ps(ygv, hi, zero);
+         px0f = _mm512_mask_mov_ps(px0f, lo, zero);
+         pxgv = _mm512_mask_mov_ps(pxgv, hi, zero);
+         py0f = _mm512_mask_mov_ps(py0f, lo, zero);
+         pygv = _mm512_mask_mov_ps(pygv, hi, zero);
+         iters0f = _mm512_mask_mov_epi32(iters0f, lo, _mm512_setzero_si512());
+         itersgv = _mm512_mask_mov_epi32(itersgv, hi, _mm512_setzero_si512());
+         next0f = _mm512_mask_mov_epi32(next0f, lo, _mm512_set1_epi32(PERIOD_FIRST_SAVE));
+         nextgv = _mm512_mask_mov_epi32(nextgv, hi, _mm512_set1_epi32(PERIOD_FIRST_SAVE));
+      }
+      if (queue_status)
+         break;
+
+      max = _mm512_reduce_max_epu32(iters0f);
+      max_gv = _mm512_reduce_max_epu32(itersgv);
+      max = m->max_iters - (max_gv > max ? max_gv : max);
+      iters = 0;
+      save = period_call_save_avx512(iters0f, next0f, itersgv, nextgv);
+      do
+      {
+         AVX512_ITERATE(ps, fma, x0f, y0f, a0f, b0f, magprev0f, t0f, yy0f);
+         AVX512_ITERATE(ps, fma, xgv, ygv, agv, bgv, magprevgv, tgv, yygv);
+         AVX512_ITERATE(ps, fma, x0f, y0f, a0f, b0f, mag0f, t0f, yy0f);
+         AVX512_ITERATE(ps, fma, xgv, ygv, agv, bgv, maggv, tgv, yygv);
+
+         per0f = _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_abs_ps(_mm512_sub_ps(x0f, px0f)),
+                                                  _mm512_abs_ps(_mm512_sub_ps(y0f, py0f))), tol, _CMP_LT_OQ);
+         pergv = _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_abs_ps(_mm512_sub_ps(xgv, pxgv)),
+                                                  _mm512_abs_ps(_mm512_sub_ps(ygv, pygv))), tol, _CMP_LT_OQ);
+
+         iters += 2;
+         if (iters == save)
+         {
+            lo = period_due_avx512(iters0f, &next0f, iters);
+            hi = period_due_avx512(itersgv, &nextgv, iters);
+            px0f = _mm512_mask_mov_ps(px0f, lo, x0f);
+            pxgv = _mm512_mask_mov_ps(pxgv, hi, xgv);
+            py0f = _mm512_mask_mov_ps(py0f, lo, y0f);
+            pygv = _mm512_mask_mov_ps(pygv, hi, ygv);
+            save = period_call_save_avx512(iters0f, next0f, itersgv, nextgv);
+         }
+      }
+      while (!(_mm512_cmp_ps_mask(mag0f, rad, _CMP_NLT_UQ) | _mm512_cmp_ps_mask(maggv, rad, _CMP_NLT_UQ) |
+               per0f | pergv)
+             && iters != max);
+
+      ps_ptr->iterctr += iters;
+      inc = _mm512_set1_epi32(iters);
+      iters0f = _mm512_add_epi32(iters0f, inc);
+      itersgv = _mm512_add_epi32(itersgv, inc);
+
+      diverged = _mm512_cmp_ps_mask(mag0f, rad, _CMP_NLT_UQ) |
+                 ((unsigned) _mm512_cmp_ps_mask(maggv, rad, _CMP_NLT_UQ) << 16);
+      max_iters_done = (_mm512_cmpeq_epi32_mask(iters0f, max_iters) |
+                        ((unsigned) _mm512_cmpeq_epi32_mask(itersgv, max_iters) << 16)) & ~diverged;
+      periodic = (per0f | ((unsigned) pergv << 16)) & ~(diverged | max_iters_done);
+
+      if (diverged)
+      {
+         diverged_prev = _mm512_cmp_ps_mask(magprev0f, rad, _CMP_NLT_UQ) |
+                         ((unsigned) _mm512_cmp_ps_mask(magprevgv, rad, _CMP_NLT_UQ) << 16);
+         _mm512_store_ps((float *) ps_ptr->mag, mag0f);
+         _mm512_store_ps((float *) ps_ptr->mag + 16, maggv);
+         _mm512_store_ps((float *) ps_ptr->magprev, magprev0f);
+         _mm512_store_ps((float *) ps_ptr->magprev + 16, magprevgv);
+         _mm512_store_si512(ps_ptr->iters, iters0f);
+         _mm512_store_si512(ps_ptr->iters + 16, itersgv);
+         for (mask = diverged; mask; mask &= mask - 1)
+         {
+            i = lowest_set_bit(mask);
+            ptr = ps_ptr->iters_ptr[i];
+            if (diverged_prev & (1u << i))
+            {
+               *ptr = ps_ptr->iters[i] - 1;
+               MAG(m, ptr) = ((float *) ps_ptr->magprev)[i];
+            }
+            else
+            {
+               *ptr = ps_ptr->iters[i];
+               MAG(m, ptr) = ((float *) ps_ptr->mag)[i];
+            }
+         }
+      }
+      for (mask = max_iters_done; mask; mask &= mask - 1)
+         *ps_ptr->iters_ptr[lowest_set_bit(mask)] = m->max_iters;
+      for (mask = periodic; mask; mask &= mask - 1)
+         retire_periodic(m, ps_ptr, lowest_set_bit(mask));
+
+      queue_status = diverged | max_iters_done | periodic;
+   }
+
+   _mm512_store_ps((float *) ps_ptr->x, x0f);
+   _mm512_store_ps((float *) ps_ptr->x + 16, xgv);
+   _mm512_store_ps((float *) ps_ptr->y, y0f);
+   _mm512_store_ps((float *) ps_ptr->y + 16, ygv);
+   _mm512_store_ps((float *) ps_ptr->a, a0f);
+   _mm512_store_ps((float *) ps_ptr->a + 16, agv);
+   _mm512_store_ps((float *) ps_ptr->b, b0f);
+   _mm512_store_ps((float *) ps_ptr->b + 16, bgv);
+   _mm512_store_ps((float *) ps_ptr->period_x, px0f);
+   _mm512_store_ps((float *) ps_ptr->period_x + 16, pxgv);
+   _mm512_store_ps((float *) ps_ptr->period_y, py0f);
+   _mm512_store_ps((float *) ps_ptr->period_y + 16, pygv);
+   _mm512_store_si512(ps_ptr->iters, iters0f);
+   _mm512_store_si512(ps_ptr->iters + 16, itersgv);
+   _mm512_store_si512(ps_ptr->period_next, next0f);
+   _mm512_store_si512(ps_ptr->period_next + 16, nextgv);
+
+   max = _mm512_mask_reduce_max_epu32((__mmask16) ~queue_status, iters0f);
+   max_gv = _mm512_mask_reduce_max_epu32((__mmask16) (~queue_status >> 16), itersgv);
+   ps_ptr->queue_status = queue_status;
+   ps_ptr->cur_max_iters = m->max_iters - (max_gv > max ? max_gv : max);
+   ps_ptr->batch_n = 0;
+}
+
+TARGET_AVX512 static void FASTCALL queue_batch_16point_avx512(void *calc_struct, man_pointstruct *ps_ptr)
+{
+   queue_batch_avx512((man_calc_struct *) calc_struct, ps_ptr, 2, 0);
+}
+
+TARGET_AVX512 static void FASTCALL queue_batch_16point_avx512_fma(void *calc_struct, man_pointstruct *ps_ptr)
+{
+   queue_batch_avx512((man_calc_struct *) calc_struct, ps_ptr, 2, 1);
+}
+
+TARGET_AVX512 static void FASTCALL queue_batch_avx512_3chain(void *calc_struct, man_pointstruct *ps_ptr)
+{
+   queue_batch_avx512((man_calc_struct *) calc_struct, ps_ptr, 3, 0);
+}
+
+TARGET_AVX512 static void FASTCALL queue_batch_avx512_4chain(void *calc_struct, man_pointstruct *ps_ptr)
+{
+   queue_batch_avx512((man_calc_struct *) calc_struct, ps_ptr, 4, 0);
+}
+
+TARGET_AVX512 static void FASTCALL queue_batch_avx512_fma_3chain(void *calc_struct, man_pointstruct *ps_ptr)
+{
+   queue_batch_avx512((man_calc_struct *) calc_struct, ps_ptr, 3, 1);
+}
+
+TARGET_AVX512 static void FASTCALL queue_batch_avx512_fma_4chain(void *calc_struct, man_pointstruct *ps_ptr)
+{
+   queue_batch_avx512((man_calc_struct *) calc_struct, ps_ptr, 4, 1);
+}
+
+TARGET_AVX512 static void FASTCALL queue_batch_32point_avx512(void *calc_struct, man_pointstruct *ps_ptr)
+{
+   queue_batch_32point((man_calc_struct *) calc_struct, ps_ptr, 0);
+}
+
+TARGET_AVX512 static void FASTCALL queue_batch_32point_avx512_fma(void *calc_struct, man_pointstruct *ps_ptr)
+{
+   queue_batch_32point((man_calc_struct *) calc_struct, ps_ptr, 1);
+}
+
+#endif // USE_AVX512_KERNELS
+
+// ----------------------- Perturbation iteration functions -----------------------------------
+
+// For deep images (see perturb.c). The points iterate the delta dz from the reference orbit
+// instead of z, with a and b holding the delta dc from the reference point:
+//
+//    dz = (2 * Z + dz) * dz + dc        z = Z + dz
+//
+// Each point's iteration count is also its index into the reference orbit. The points in the
+// queue are at different iterations, so the SIMD versions gather Z from the orbit arrays
+// (AVX2 or AVX-512 needed). Only one iteration is done per loop, so mag gets |z|^2 after
+// the last iteration and magprev gets the glitch threshold for it (instead of the previous
+// magnitude). The loop breaks when any point diverges or glitches.
+
+// Condition indicating point[ind] glitched. Checked before divergence, because the glitch
+// threshold is infinite past the end of the reference orbit.
+#define GLITCHED(p, ind)      ((p)->mag[ind] < (p)->magprev[ind])
+
+// A glitched point stores this in the magnitude array instead of its magnitude: how far into
+// the glitch it got (0 past the end of the reference orbit). Used to pick new references.
+#define GLITCH_DEPTH(p, ind)  ((float) ((p)->mag[ind] / (p)->magprev[ind]))
+
+// Flops per iteration for the perturbation functions (the 2 extra adds for z are included)
+#define PERTURB_FLOPS_PER_ITER   17
+
+// Get the starting delta and iteration for a new point (ab_in), from the series approximation
+// if there is one (see perturb_series_calc). Otherwise the point starts at 0. For the floatexp
+// versions (e not NULL), the delta is (x, y) * 2^e.
+static __inline unsigned series_start(const man_pointstruct *ps_ptr, double *x, double *y, double *e)
+{
+   const perturb_series *s;
+   double ux, uy, tx, ty, ex, ey;
+
+   s = ps_ptr->series;
+   if (s == NULL || !s->iters)
+   {
+      *x = *y = 0.0;
+      if (e != NULL)
+         *e = ps_ptr->delta_exp;
+      return 0;
+   }
+
+   // dz = ((c * u + b) * u + a) * u
+   ux = ps_ptr->ab_in[0] * s->inv_scale;
+   uy = ps_ptr->ab_in[1] * s->inv_scale;
+   tx = s->c[0] * ux - s->c[1] * uy + s->b[0];
+   ty = s->c[0] * uy + s->c[1] * ux + s->b[1];
+   ex = tx * ux - ty * uy + s->a[0];
+   ey = tx * uy + ty * ux + s->a[1];
+   *x = ex * ux - ey * uy;
+   *y = ex * uy + ey * ux;
+   if (e != NULL)
+      *e = s->exp;
+   else if (s->exp)
+   {
+      *x = ldexp(*x, s->exp);
+      *y = ldexp(*y, s->exp);
+   }
+   return s->iters;
+}
+
+// C version, for CPUs without gather. Does one point at a time, like iterate_c. The starting
+// delta and iteration are in x[0], y[0], and iters[0] (set by queue_point_perturb_c).
+static unsigned iterate_perturb_c(man_pointstruct *ps_ptr)
+{
+   const perturb_ref *ref;
+   double a, b, x, y, tx, ty, zx, zy, mag;
+   unsigned n, iter_ct;
+
+   ref = ps_ptr->ref;
+   a = ps_ptr->ab_in[0];
+   b = ps_ptr->ab_in[1];
+   x = ps_ptr->x[0];
+   y = ps_ptr->y[0];
+   n = ps_ptr->iters[0];
+   zx = ref->x[n];
+   zy = ref->y[n];
+   mag = 0.0;
+   iter_ct = ps_ptr->cur_max_iters;
+
+   do
+   {
+      tx = zx + zx + x;
+      ty = zy + zy + y;
+      zx = tx * x - ty * y + a;  // use zx for tmp storage
+      y = tx * y + ty * x + b;
+      x = zx;
+      n++;
+      zx = ref->x[n];
+      zy = ref->y[n];
+      mag = (zx + x) * (zx + x) + (zy + y) * (zy + y);
+      if (mag < ref->thresh[n] || mag >= DIVERGED_THRESH)
+         break;
+   }
+   while (--iter_ct);
+
+   ps_ptr->mag[0] = mag;
+   ps_ptr->magprev[0] = ref->thresh[n];
+
+   return n;
+}
+
+// Floatexp (PERTURB_FLOATEXP) versions, for deltas past the double range. Each point's delta is
+// (x, y) * 2^e, with its own exponent e (kept in yy; these don't use it otherwise), and dc is
+// (a, b) * 2^delta_exp. With S = 2^e, the iteration becomes
+//
+//    w = (2 * Z + S * w) * w + dc / S        z = Z + S * w
+//
+// and w is rescaled (exactly, by a power of 2) when it drifts far from 1. While the delta is
+// negligible next to Z, S * w underflows to 0, which is what it should do. S * w is reused for
+// the next iteration, so there are only 4 more flops per iteration than the double versions.
+
+#define PERTURB_FE_FLOPS_PER_ITER   21
+#define FE_RESCALE                  18446744073709551616.0 // 2^64
+
+// C version
+static unsigned iterate_perturb_fe_c(man_pointstruct *ps_ptr)
+{
+   const perturb_ref *ref;
+   double a, b, x, y, tx, ty, zx, zy, sx, sy, sc, cs, mag;
+   unsigned n, iter_ct;
+   int e, k;
+
+   ref = ps_ptr->ref;
+   a = ps_ptr->ab_in[0];
+   b = ps_ptr->ab_in[1];
+   x = ps_ptr->x[0];
+   y = ps_ptr->y[0];
+   e = (int) ps_ptr->yy[0];
+   sc = ldexp(1.0, e);
+   cs = ldexp(1.0, ps_ptr->delta_exp - e);
+   sx = x * sc;
+   sy = y * sc;
+   n = ps_ptr->iters[0];
+   zx = ref->x[n];
+   zy = ref->y[n];
+   mag = 0.0;
+   iter_ct = ps_ptr->cur_max_iters;
+
+   do
+   {
+      tx = zx + zx + sx;
+      ty = zy + zy + sy;
+      zx = tx * x - ty * y + a * cs;  // use zx for tmp storage
+      y = tx * y + ty * x + b * cs;
+      x = zx;
+
+      mag = fabs(x) + fabs(y);
+      if (mag > FE_RESCALE || (mag < 1.0 / FE_RESCALE && mag != 0.0))
+      {
+         k = ilogb(mag);
+         x = ldexp(x, -k);
+         y = ldexp(y, -k);
+         e += k;
+         sc = ldexp(1.0, e);
+         cs = ldexp(1.0, ps_ptr->delta_exp - e);
+      }
+      sx = x * sc;
+      sy = y * sc;
+
+      n++;
+      zx = ref->x[n];
+      zy = ref->y[n];
+      mag = (zx + sx) * (zx + sx) + (zy + sy) * (zy + sy);
+      if (mag < ref->thresh[n] || mag >= DIVERGED_THRESH)
+         break;
+   }
+   while (--iter_ct);
+
+   ps_ptr->mag[0] = mag;
+   ps_ptr->magprev[0] = ref->thresh[n];
+
+   return n;
+}
+
+// Queue a point for the C perturbation functions (no queuing- iterates it right away)
+static void FASTCALL queue_point_perturb_c(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr)
+{
+   man_calc_struct *m;
+   unsigned iters;
+
+   m = (man_calc_struct *) calc_struct;
+
+   ps_ptr->iters[0] = series_start(ps_ptr, &ps_ptr->x[0], &ps_ptr->y[0],
+                                   m->perturb == PERTURB_FLOATEXP ? &ps_ptr->yy[0] : NULL);
+   ps_ptr->cur_max_iters = m->max_iters - ps_ptr->iters[0];
+   iters = m->mandel_iterate(ps_ptr);
+   ps_ptr->iterctr += iters - ps_ptr->iters[0];
+   if (GLITCHED(ps_ptr, 0))
+   {
+      *iters_ptr = iters | ITERS_GLITCHED;
+      MAG(m, iters_ptr) = GLITCH_DEPTH(ps_ptr, 0);
+      return;
+   }
+   if (iters != m->max_iters)  // match iteration offset of the other versions
+      iters++;
+
+   *iters_ptr = iters;
+   MAG(m, iters_ptr) = (float) ps_ptr->mag[0];
+}
+
+#ifdef USE_AVX_KERNELS
+
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// AVX2 version: 8 points as two chains of 4
+TARGET_AVX2 static unsigned iterate_perturb_avx2(man_pointstruct *ps_ptr) // sip8p
+{
+   __m256d x03, x47, y03, y47, a03, a47, b03, b47, zx03, zx47, zy03, zy47, th03, th47;
+   __m256d tx03, tx47, ty03, ty47, mag03, mag47, rad;
+   __m128i n03, n47, one;
+   const double *ref_x, *ref_y, *ref_th;
+   unsigned i, iters, max;
+
+   ref_x = ps_ptr->ref->x;
+   ref_y = ps_ptr->ref->y;
+   ref_th = ps_ptr->ref->thresh;
+
+   x03 = _mm256_load_pd(&ps_ptr->x[0]);   // Restore point states
+   x47 = _mm256_load_pd(&ps_ptr->x[4]);
+   y03 = _mm256_load_pd(&ps_ptr->y[0]);
+   y47 = _mm256_load_pd(&ps_ptr->y[4]);
+   a03 = _mm256_load_pd(&ps_ptr->a[0]);
+   a47 = _mm256_load_pd(&ps_ptr->a[4]);
+   b03 = _mm256_load_pd(&ps_ptr->b[0]);
+   b47 = _mm256_load_pd(&ps_ptr->b[4]);
+   n03 = _mm_load_si128((__m128i *) &ps_ptr->iters[0]);  // orbit indices
+   n47 = _mm_load_si128((__m128i *) &ps_ptr->iters[4]);
+   one = _mm_set1_epi32(1);
+   rad = _mm256_set1_pd(DIVERGED_THRESH);
+
+   zx03 = _mm256_i32gather_pd(ref_x, n03, 8);
+   zx47 = _mm256_i32gather_pd(ref_x, n47, 8);
+   zy03 = _mm256_i32gather_pd(ref_y, n03, 8);
+   zy47 = _mm256_i32gather_pd(ref_y, n47, 8);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+
+   do
+   {
+      tx03 = _mm256_add_pd(_mm256_add_pd(zx03, zx03), x03);
+      tx47 = _mm256_add_pd(_mm256_add_pd(zx47, zx47), x47);
+      ty03 = _mm256_add_pd(_mm256_add_pd(zy03, zy03), y03);
+      ty47 = _mm256_add_pd(_mm256_add_pd(zy47, zy47), y47);
+      zx03 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(tx03, x03), _mm256_mul_pd(ty03, y03)), a03);
+      zx47 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(tx47, x47), _mm256_mul_pd(ty47, y47)), a47);
+      y03 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(tx03, y03), _mm256_mul_pd(ty03, x03)), b03);
+      y47 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(tx47, y47), _mm256_mul_pd(ty47, x47)), b47);
+      x03 = zx03;
+      x47 = zx47;
+
+      n03 = _mm_add_epi32(n03, one);
+      n47 = _mm_add_epi32(n47, one);
+      zx03 = _mm256_i32gather_pd(ref_x, n03, 8);
+      zx47 = _mm256_i32gather_pd(ref_x, n47, 8);
+      zy03 = _mm256_i32gather_pd(ref_y, n03, 8);
+      zy47 = _mm256_i32gather_pd(ref_y, n47, 8);
+      th03 = _mm256_i32gather_pd(ref_th, n03, 8);
+      th47 = _mm256_i32gather_pd(ref_th, n47, 8);
+
+      tx03 = _mm256_add_pd(zx03, x03);        // full z
+      tx47 = _mm256_add_pd(zx47, x47);
+      ty03 = _mm256_add_pd(zy03, y03);
+      ty47 = _mm256_add_pd(zy47, y47);
+      mag03 = _mm256_add_pd(_mm256_mul_pd(tx03, tx03), _mm256_mul_pd(ty03, ty03));
+      mag47 = _mm256_add_pd(_mm256_mul_pd(tx47, tx47), _mm256_mul_pd(ty47, ty47));
+
+      iters++;
+   }
+   while (!(_mm256_movemask_pd(_mm256_cmp_pd(mag03, rad, _CMP_NLT_UQ)) |
+            _mm256_movemask_pd(_mm256_cmp_pd(mag47, rad, _CMP_NLT_UQ)) |
+            _mm256_movemask_pd(_mm256_cmp_pd(mag03, th03, _CMP_LT_OQ)) |
+            _mm256_movemask_pd(_mm256_cmp_pd(mag47, th47, _CMP_LT_OQ)))
+          && iters != max);
+
+   _mm256_store_pd(&ps_ptr->x[0], x03);   // Save point states, magnitudes, and glitch thresholds
+   _mm256_store_pd(&ps_ptr->x[4], x47);
+   _mm256_store_pd(&ps_ptr->y[0], y03);
+   _mm256_store_pd(&ps_ptr->y[4], y47);
+   _mm256_store_pd(&ps_ptr->mag[0], mag03);
+   _mm256_store_pd(&ps_ptr->mag[4], mag47);
+   _mm256_store_pd(&ps_ptr->magprev[0], th03);
+   _mm256_store_pd(&ps_ptr->magprev[4], th47);
+
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 8; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+#ifdef USE_AVX512_KERNELS
+
+// AVX-512 version: 16 points as two chains of 8
+TARGET_AVX512 static unsigned iterate_perturb_avx512(man_pointstruct *ps_ptr) // sip16p
+{
+   __m512d x07, x8f, y07, y8f, a07, a8f, b07, b8f, zx07, zx8f, zy07, zy8f, th07, th8f;
+   __m512d tx07, tx8f, ty07, ty8f, mag07, mag8f, rad;
+   __m256i n07, n8f, one;
+   const double *ref_x, *ref_y, *ref_th;
+   unsigned i, iters, max;
+
+   ref_x = ps_ptr->ref->x;
+   ref_y = ps_ptr->ref->y;
+   ref_th = ps_ptr->ref->thresh;
+
+   x07 = _mm512_load_pd(&ps_ptr->x[0]);
+   x8f = _mm512_load_pd(&ps_ptr->x[8]);
+   y07 = _mm512_load_pd(&ps_ptr->y[0]);
+   y8f = _mm512_load_pd(&ps_ptr->y[8]);
+   a07 = _mm512_load_pd(&ps_ptr->a[0]);
+   a8f = _mm512_load_pd(&ps_ptr->a[8]);
+   b07 = _mm512_load_pd(&ps_ptr->b[0]);
+   b8f = _mm512_load_pd(&ps_ptr->b[8]);
+   n07 = _mm256_load_si256((__m256i *) &ps_ptr->iters[0]);
+   n8f = _mm256_load_si256((__m256i *) &ps_ptr->iters[8]);
+   one = _mm256_set1_epi32(1);
+   rad = _mm512_set1_pd(DIVERGED_THRESH);
+
+   zx07 = _mm512_i32gather_pd(n07, ref_x, 8);
+   zx8f = _mm512_i32gather_pd(n8f, ref_x, 8);
+   zy07 = _mm512_i32gather_pd(n07, ref_y, 8);
+   zy8f = _mm512_i32gather_pd(n8f, ref_y, 8);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+
+   do
+   {
+      tx07 = _mm512_add_pd(_mm512_add_pd(zx07, zx07), x07);
+      tx8f = _mm512_add_pd(_mm512_add_pd(zx8f, zx8f), x8f);
+      ty07 = _mm512_add_pd(_mm512_add_pd(zy07, zy07), y07);
+      ty8f = _mm512_add_pd(_mm512_add_pd(zy8f, zy8f), y8f);
+      zx07 = _mm512_add_pd(_mm512_sub_pd(_mm512_mul_pd(tx07, x07), _mm512_mul_pd(ty07, y07)), a07);
+      zx8f = _mm512_add_pd(_mm512_sub_pd(_mm512_mul_pd(tx8f, x8f), _mm512_mul_pd(ty8f, y8f)), a8f);
+      y07 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(tx07, y07), _mm512_mul_pd(ty07, x07)), b07);
+      y8f = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(tx8f, y8f), _mm512_mul_pd(ty8f, x8f)), b8f);
+      x07 = zx07;
+      x8f = zx8f;
+
+      n07 = _mm256_add_epi32(n07, one);   // (AVX2 integer add; all AVX-512 CPUs have it)
+      n8f = _mm256_add_epi32(n8f, one);
+      zx07 = _mm512_i32gather_pd(n07, ref_x, 8);
+      zx8f = _mm512_i32gather_pd(n8f, ref_x, 8);
+      zy07 = _mm512_i32gather_pd(n07, ref_y, 8);
+      zy8f = _mm512_i32gather_pd(n8f, ref_y, 8);
+      th07 = _mm512_i32gather_pd(n07, ref_th, 8);
+      th8f = _mm512_i32gather_pd(n8f, ref_th, 8);
+
+      tx07 = _mm512_add_pd(zx07, x07);
+      tx8f = _mm512_add_pd(zx8f, x8f);
+      ty07 = _mm512_add_pd(zy07, y07);
+      ty8f = _mm512_add_pd(zy8f, y8f);
+      mag07 = _mm512_add_pd(_mm512_mul_pd(tx07, tx07), _mm512_mul_pd(ty07, ty07));
+      mag8f = _mm512_add_pd(_mm512_mul_pd(tx8f, tx8f), _mm512_mul_pd(ty8f, ty8f));
+
+      iters++;
+   }
+   while (!(_mm512_cmp_pd_mask(mag07, rad, _CMP_NLT_UQ) | _mm512_cmp_pd_mask(mag8f, rad, _CMP_NLT_UQ) |
+            _mm512_cmp_pd_mask(mag07, th07, _CMP_LT_OQ) | _mm512_cmp_pd_mask(mag8f, th8f, _CMP_LT_OQ))
+          && iters != max);
+
+   _mm512_store_pd(&ps_ptr->x[0], x07);
+   _mm512_store_pd(&ps_ptr->x[8], x8f);
+   _mm512_store_pd(&ps_ptr->y[0], y07);
+   _mm512_store_pd(&ps_ptr->y[8], y8f);
+   _mm512_store_pd(&ps_ptr->mag[0], mag07);
+   _mm512_store_pd(&ps_ptr->mag[8], mag8f);
+   _mm512_store_pd(&ps_ptr->magprev[0], th07);
+   _mm512_store_pd(&ps_ptr->magprev[8], th8f);
+
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 16; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+// Floatexp version (see iterate_perturb_fe_c): 16 points as two chains of 8. The exponents are
+// kept as doubles, for scalef. Rescaling is rare, so it's skipped unless a point needs it.
+
+#define FE_RESCALE_512(s)                                                                    \
+   t##s = _mm512_add_pd(_mm512_abs_pd(x##s), _mm512_abs_pd(y##s));                           \
+   k##s = _mm512_cmp_pd_mask(t##s, big, _CMP_GT_OQ) |                                         \
+          (_mm512_cmp_pd_mask(t##s, small, _CMP_LT_OQ) & _mm512_cmp_pd_mask(t##s, zero, _CMP_NEQ_UQ)); \
+   if (k##s)                                                                                 \
+   {                                                                                         \
+      t##s = _mm512_maskz_getexp_pd(k##s, t##s);                                             \
+      x##s = _mm512_scalef_pd(x##s, _mm512_sub_pd(zero, t##s));                              \
+      y##s = _mm512_scalef_pd(y##s, _mm512_sub_pd(zero, t##s));                              \
+      e##s = _mm512_add_pd(e##s, t##s);                                                      \
+      sc##s = _mm512_scalef_pd(one, e##s);                                                   \
+      cs##s = _mm512_scalef_pd(one, _mm512_sub_pd(de, e##s));                                \
+   }
+
+TARGET_AVX512 static unsigned iterate_perturb_fe_avx512(man_pointstruct *ps_ptr) // sip16pf
+{
+   __m512d x07, x8f, y07, y8f, a07, a8f, b07, b8f, zx07, zx8f, zy07, zy8f, th07, th8f;
+   __m512d e07, e8f, sc07, sc8f, cs07, cs8f, sx07, sx8f, sy07, sy8f, t07, t8f;
+   __m512d tx07, tx8f, ty07, ty8f, mag07, mag8f, rad, one, zero, big, small, de;
+   __m256i n07, n8f, inc;
+   __mmask8 k07, k8f;
+   const double *ref_x, *ref_y, *ref_th;
+   unsigned i, iters, max;
+
+   ref_x = ps_ptr->ref->x;
+   ref_y = ps_ptr->ref->y;
+   ref_th = ps_ptr->ref->thresh;
+
+   x07 = _mm512_load_pd(&ps_ptr->x[0]);
+   x8f = _mm512_load_pd(&ps_ptr->x[8]);
+   y07 = _mm512_load_pd(&ps_ptr->y[0]);
+   y8f = _mm512_load_pd(&ps_ptr->y[8]);
+   e07 = _mm512_load_pd(&ps_ptr->yy[0]);
+   e8f = _mm512_load_pd(&ps_ptr->yy[8]);
+   a07 = _mm512_load_pd(&ps_ptr->a[0]);
+   a8f = _mm512_load_pd(&ps_ptr->a[8]);
+   b07 = _mm512_load_pd(&ps_ptr->b[0]);
+   b8f = _mm512_load_pd(&ps_ptr->b[8]);
+   n07 = _mm256_load_si256((__m256i *) &ps_ptr->iters[0]);
+   n8f = _mm256_load_si256((__m256i *) &ps_ptr->iters[8]);
+   inc = _mm256_set1_epi32(1);
+   rad = _mm512_set1_pd(DIVERGED_THRESH);
+   one = _mm512_set1_pd(1.0);
+   zero = _mm512_setzero_pd();
+   big = _mm512_set1_pd(FE_RESCALE);
+   small = _mm512_set1_pd(1.0 / FE_RESCALE);
+   de = _mm512_set1_pd((double) ps_ptr->delta_exp);
+
+   sc07 = _mm512_scalef_pd(one, e07);
+   sc8f = _mm512_scalef_pd(one, e8f);
+   cs07 = _mm512_scalef_pd(one, _mm512_sub_pd(de, e07));
+   cs8f = _mm512_scalef_pd(one, _mm512_sub_pd(de, e8f));
+   sx07 = _mm512_mul_pd(x07, sc07);
+   sx8f = _mm512_mul_pd(x8f, sc8f);
+   sy07 = _mm512_mul_pd(y07, sc07);
+   sy8f = _mm512_mul_pd(y8f, sc8f);
+
+   zx07 = _mm512_i32gather_pd(n07, ref_x, 8);
+   zx8f = _mm512_i32gather_pd(n8f, ref_x, 8);
+   zy07 = _mm512_i32gather_pd(n07, ref_y, 8);
+   zy8f = _mm512_i32gather_pd(n8f, ref_y, 8);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+
+   do
+   {
+      tx07 = _mm512_add_pd(_mm512_add_pd(zx07, zx07), sx07);
+      tx8f = _mm512_add_pd(_mm512_add_pd(zx8f, zx8f), sx8f);
+      ty07 = _mm512_add_pd(_mm512_add_pd(zy07, zy07), sy07);
+      ty8f = _mm512_add_pd(_mm512_add_pd(zy8f, zy8f), sy8f);
+      zx07 = _mm512_add_pd(_mm512_sub_pd(_mm512_mul_pd(tx07, x07), _mm512_mul_pd(ty07, y07)), _mm512_mul_pd(a07, cs07));
+      zx8f = _mm512_add_pd(_mm512_sub_pd(_mm512_mul_pd(tx8f, x8f), _mm512_mul_pd(ty8f, y8f)), _mm512_mul_pd(a8f, cs8f));
+      y07 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(tx07, y07), _mm512_mul_pd(ty07, x07)), _mm512_mul_pd(b07, cs07));
+      y8f = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(tx8f, y8f), _mm512_mul_pd(ty8f, x8f)), _mm512_mul_pd(b8f, cs8f));
+      x07 = zx07;
+      x8f = zx8f;
+
+      FE_RESCALE_512(07)
+      FE_RESCALE_512(8f)
+      sx07 = _mm512_mul_pd(x07, sc07);
+      sx8f = _mm512_mul_pd(x8f, sc8f);
+      sy07 = _mm512_mul_pd(y07, sc07);
+      sy8f = _mm512_mul_pd(y8f, sc8f);
+
+      n07 = _mm256_add_epi32(n07, inc);
+      n8f = _mm256_add_epi32(n8f, inc);
+      zx07 = _mm512_i32gather_pd(n07, ref_x, 8);
+      zx8f = _mm512_i32gather_pd(n8f, ref_x, 8);
+      zy07 = _mm512_i32gather_pd(n07, ref_y, 8);
+      zy8f = _mm512_i32gather_pd(n8f, ref_y, 8);
+      th07 = _mm512_i32gather_pd(n07, ref_th, 8);
+      th8f = _mm512_i32gather_pd(n8f, ref_th, 8);
+
+      tx07 = _mm512_add_pd(zx07, sx07);
+      tx8f = _mm512_add_pd(zx8f, sx8f);
+      ty07 = _mm512_add_pd(zy07, sy07);
+      ty8f = _mm512_add_pd(zy8f, sy8f);
+      mag07 = _mm512_add_pd(_mm512_mul_pd(tx07, tx07), _mm512_mul_pd(ty07, ty07));
+      mag8f = _mm512_add_pd(_mm512_mul_pd(tx8f, tx8f), _mm512_mul_pd(ty8f, ty8f));
+
+      iters++;
+   }
+   while (!(_mm512_cmp_pd_mask(mag07, rad, _CMP_NLT_UQ) | _mm512_cmp_pd_mask(mag8f, rad, _CMP_NLT_UQ) |
+            _mm512_cmp_pd_mask(mag07, th07, _CMP_LT_OQ) | _mm512_cmp_pd_mask(mag8f, th8f, _CMP_LT_OQ))
+          && iters != max);
+
+   _mm512_store_pd(&ps_ptr->x[0], x07);
+   _mm512_store_pd(&ps_ptr->x[8], x8f);
+   _mm512_store_pd(&ps_ptr->y[0], y07);
+   _mm512_store_pd(&ps_ptr->y[8], y8f);
+   _mm512_store_pd(&ps_ptr->yy[0], e07);
+   _mm512_store_pd(&ps_ptr->yy[8], e8f);
+   _mm512_store_pd(&ps_ptr->mag[0], mag07);
+   _mm512_store_pd(&ps_ptr->mag[8], mag8f);
+   _mm512_store_pd(&ps_ptr->magprev[0], th07);
+   _mm512_store_pd(&ps_ptr->magprev[8], th8f);
+
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 16; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+#endif // USE_AVX512_KERNELS
+
+// Queuing function for the perturbation algorithms, with free slot bitmask (see queue_8point_avx).
+// A point that glitched is stored with the ITERS_GLITCHED flag, to be recalculated from another
+// reference. Points at max iters are also done: they were checked for glitches on the last
+// iteration, like every other iteration.
+static __inline void queue_perturb(man_calc_struct *m, man_pointstruct *ps_ptr, unsigned *iters_ptr, unsigned points,
+                                   int fe)
+{
+   unsigned i, iters, max, queue_status, *ptr;
+
+   queue_status = ps_ptr->queue_status;
+
+   if (!queue_status) // If all points in use, iterate to clear at least one point first
+   {
+      m->mandel_iterate(ps_ptr);
+      max = (ps_ptr->series != NULL) ? ps_ptr->series->iters : 0; // the new point starts here
+      for (i = 0; i < points; i++)
+      {
+         iters = ps_ptr->iters[i];
+         ptr = ps_ptr->iters_ptr[i];
+         if (GLITCHED(ps_ptr, i))
+         {
+            *ptr = iters | ITERS_GLITCHED;
+            MAG(m, ptr) = GLITCH_DEPTH(ps_ptr, i);
+            queue_status |= 1 << i;
+         }
+         else if (ps_ptr->mag[i] >= DIVERGED_THRESH || iters == m->max_iters)
+         {
+            *ptr = (iters == m->max_iters) ? iters : iters + 1; // match iteration offset of the other versions
+            MAG(m, ptr) = (float) ps_ptr->mag[i];
+            queue_status |= 1 << i;
+         }
+         else if (iters > max)
+            max = iters;
+      }
+      ps_ptr->cur_max_iters = m->max_iters - max;
+   }
+
+   i = lowest_set_bit(queue_status);               // Get next free slot
+   ps_ptr->queue_status = queue_status & ~(1 << i); // Pop free slot
+
+   ps_ptr->a[i] = ps_ptr->ab_in[0]; // Set input point (delta from the reference)
+   ps_ptr->b[i] = ps_ptr->ab_in[1];
+   ps_ptr->iters[i] = series_start(ps_ptr, &ps_ptr->x[i], &ps_ptr->y[i], // Set initial conditions
+                                   fe ? &ps_ptr->yy[i] : NULL);
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+static void FASTCALL queue_8point_perturb(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp8p
+{
+   queue_perturb((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 8, 0);
+}
+
+static void FASTCALL queue_16point_perturb(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp16p
+{
+   queue_perturb((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 16, 0);
+}
+
+#ifdef USE_AVX512_KERNELS
+
+static void FASTCALL queue_16point_perturb_fe(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp16pf
+{
+   queue_perturb((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 16, 1);
+}
+
+#endif
+
+#endif // USE_AVX_KERNELS
+
+// Flush the perturbation queues at the end of a calculation. The dummy points normally used
+// (see man_calculate_threaded) have dc = 0, so they follow the reference orbit, which can
+// diverge. Then they'd be retired before the real points. Instead keep queueing dummies until
+// none of the real points are left.
+static void flush_perturb_queue(man_calc_struct *m, man_pointstruct *ps_ptr)
+{
+   unsigned i;
+
+   for (;;)
+   {
+      for (i = 0; i < m->iters_per_tick; i++)
+         if (!(ps_ptr->queue_status & (1 << i)) && ps_ptr->iters_ptr[i] != m->iter_data_dummy)
+            break;
+      if (i == m->iters_per_tick)
+         break;
+      m->queue_point(m, ps_ptr, m->iter_data_dummy);
+   }
+}
+
+// ----------------------- Double-double iteration functions -----------------------------------
+
+// For PRECISION_EXTENDED. Each value is an unevaluated sum of two doubles, hi + lo (|lo| at most
+// half an ulp of hi), for about 106 bits of mantissa. That's good up to magnifications of around
+// 1e20, less with more iterations (see set_dd_coords), without the reference orbit and glitch
+// handling of the perturbation engine.
+//
+// The products are the exact product of the high parts (the error term comes from an FMA, or
+// Dekker's splitting in the C version) plus the cross terms; lo * lo is below the precision.
+// The adds are the "sloppy" double-double add, which is accurate relative to the operands rather
+// than the result. That's good enough here: everything is relative to |z|^2, which is bounded
+// by the divergence radius.
+//
+// Like the perturbation functions, these do one iteration per loop, and mag gets |z|^2 (from
+// the high parts) after the last iteration.
+
+#define DD_FLOPS_PER_ITER  55
+
+// Exact error of the product p = a * b (Dekker)
+static __inline double dd_prod_err(double a, double b, double p)
+{
+   double ah, al, bh, bl, t;
+
+   t = a * 134217729.0; // 2^27 + 1: split into high and low 26 bits
+   ah = t - (t - a);
+   al = a - ah;
+   t = b * 134217729.0;
+   bh = t - (t - b);
+   bl = b - bh;
+   return ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+}
+
+// (rh, rl) = (ah, al) + (bh, bl), or - if sub is set
+static __inline void dd_add(double *rh, double *rl, double ah, double al, double bh, double bl, int sub)
+{
+   double s, v, e;
+
+   if (sub)
+   {
+      bh = -bh;
+      bl = -bl;
+   }
+   s = ah + bh;
+   v = s - ah;
+   e = (ah - (s - v)) + (bh - v) + (al + bl);
+   *rh = s + e;
+   *rl = e - (*rh - s);
+}
+
+// C version: one point at a time, like iterate_c. The low parts of the point are in ab_lo.
+static unsigned iterate_dd_c(man_pointstruct *ps_ptr)
+{
+   double ah, al, bh, bl, xh, xl, yh, yl, xxh, xxl, yyh, yyl, xyh, xyl;
+   unsigned iters, iter_ct;
+
+   iters = 0;
+   iter_ct = ps_ptr->cur_max_iters;
+
+   ah = ps_ptr->ab_in[0];
+   al = ps_ptr->ab_lo[0];
+   bh = ps_ptr->ab_in[1];
+   bl = ps_ptr->ab_lo[1];
+   xh = xl = yh = yl = xxh = xxl = yyh = yyl = 0.0;
+
+   do
+   {
+      xyh = xh * yh;
+      xyl = dd_prod_err(xh, yh, xyh) + (xh * yl + xl * yh);
+      dd_add(&yh, &yl, xyh + xyh, xyl + xyl, bh, bl, 0);  // y = 2xy + b
+      dd_add(&xh, &xl, xxh, xxl, yyh, yyl, 1);            // x = xx - yy + a
+      dd_add(&xh, &xl, xh, xl, ah, al, 0);
+      xxh = xh * xh;
+      xxl = dd_prod_err(xh, xh, xxh) + (xh + xh) * xl;
+      yyh = yh * yh;
+      yyl = dd_prod_err(yh, yh, yyh) + (yh + yh) * yl;
+      iters++;
+      if ((xxh + yyh) >= DIVERGED_THRESH)
+         break;
+   }
+   while (--iter_ct);
+
+   ps_ptr->mag[0] = xxh + yyh;
+
+   return iters;
+}
+
+#ifdef USE_AVX_KERNELS
+
+// Double-double operations on W-bit vectors (W = 256 or 512). R can be the same as A (but not B);
+// for DD_SQR and DD_MUL, r can't be the same as any input. Need temporaries t0 - t2.
+
+#define DD_ADD(W, rh, rl, ah, al, bh, bl)                                                    \
+   t0 = _mm##W##_add_pd(ah, bh);                                                             \
+   t1 = _mm##W##_sub_pd(t0, ah);                                                             \
+   t2 = _mm##W##_add_pd(_mm##W##_sub_pd(ah, _mm##W##_sub_pd(t0, t1)), _mm##W##_sub_pd(bh, t1)); \
+   t2 = _mm##W##_add_pd(t2, _mm##W##_add_pd(al, bl));                                        \
+   rh = _mm##W##_add_pd(t0, t2);                                                             \
+   rl = _mm##W##_sub_pd(t2, _mm##W##_sub_pd(rh, t0));
+
+#define DD_SUB(W, rh, rl, ah, al, bh, bl)                                                    \
+   t0 = _mm##W##_sub_pd(ah, bh);                                                             \
+   t1 = _mm##W##_sub_pd(t0, ah);                                                             \
+   t2 = _mm##W##_sub_pd(_mm##W##_sub_pd(ah, _mm##W##_sub_pd(t0, t1)), _mm##W##_add_pd(bh, t1)); \
+   t2 = _mm##W##_add_pd(t2, _mm##W##_sub_pd(al, bl));                                        \
+   rh = _mm##W##_add_pd(t0, t2);                                                             \
+   rl = _mm##W##_sub_pd(t2, _mm##W##_sub_pd(rh, t0));
+
+#define DD_SQR(W, rh, rl, xh, xl)                                                            \
+   rh = _mm##W##_mul_pd(xh, xh);                                                             \
+   rl = _mm##W##_fmadd_pd(_mm##W##_add_pd(xh, xh), xl, _mm##W##_fmsub_pd(xh, xh, rh));
+
+#define DD_MUL(W, rh, rl, xh, xl, yh, yl)                                                    \
+   rh = _mm##W##_mul_pd(xh, yh);                                                             \
+   rl = _mm##W##_add_pd(_mm##W##_fmsub_pd(xh, yh, rh), _mm##W##_fmadd_pd(xh, yl, _mm##W##_mul_pd(xl, yh)));
+
+// One iteration of the points in the vectors with suffix s (x = xx - yy + a, y = 2xy + b)
+#define DD_ITERATE(W, s)                                                                     \
+   DD_MUL(W, xyh##s, xyl##s, xh##s, xl##s, yh##s, yl##s)                                     \
+   xyh##s = _mm##W##_add_pd(xyh##s, xyh##s);                                                 \
+   xyl##s = _mm##W##_add_pd(xyl##s, xyl##s);                                                 \
+   DD_ADD(W, yh##s, yl##s, xyh##s, xyl##s, bh##s, bl##s)                                     \
+   DD_SUB(W, xh##s, xl##s, xxh##s, xxl##s, yyh##s, yyl##s)                                   \
+   DD_ADD(W, xh##s, xl##s, xh##s, xl##s, ah##s, al##s)                                       \
+   DD_SQR(W, xxh##s, xxl##s, xh##s, xl##s)                                                   \
+   DD_SQR(W, yyh##s, yyl##s, yh##s, yl##s)
+
+// AVX version: 8 points as two chains of 4. Needs FMA for the products.
+TARGET_AVX_FMA static unsigned iterate_dd_avx(man_pointstruct *ps_ptr) // sip8dd
+{
+   __m256d xh03, xl03, yh03, yl03, ah03, al03, bh03, bl03, xxh03, xxl03, yyh03, yyl03, xyh03, xyl03;
+   __m256d xh47, xl47, yh47, yl47, ah47, al47, bh47, bl47, xxh47, xxl47, yyh47, yyl47, xyh47, xyl47;
+   __m256d mag03, mag47, rad, t0, t1, t2;
+   unsigned i, iters, max;
+
+   xh03 = _mm256_load_pd(&ps_ptr->x[0]);  // Restore point states (high parts in 0-7, low in 8-15)
+   xh47 = _mm256_load_pd(&ps_ptr->x[4]);
+   xl03 = _mm256_load_pd(&ps_ptr->x[8]);
+   xl47 = _mm256_load_pd(&ps_ptr->x[12]);
+   yh03 = _mm256_load_pd(&ps_ptr->y[0]);
+   yh47 = _mm256_load_pd(&ps_ptr->y[4]);
+   yl03 = _mm256_load_pd(&ps_ptr->y[8]);
+   yl47 = _mm256_load_pd(&ps_ptr->y[12]);
+   ah03 = _mm256_load_pd(&ps_ptr->a[0]);
+   ah47 = _mm256_load_pd(&ps_ptr->a[4]);
+   al03 = _mm256_load_pd(&ps_ptr->a[8]);
+   al47 = _mm256_load_pd(&ps_ptr->a[12]);
+   bh03 = _mm256_load_pd(&ps_ptr->b[0]);
+   bh47 = _mm256_load_pd(&ps_ptr->b[4]);
+   bl03 = _mm256_load_pd(&ps_ptr->b[8]);
+   bl47 = _mm256_load_pd(&ps_ptr->b[12]);
+   rad = _mm256_set1_pd(DIVERGED_THRESH);
+
+   DD_SQR(256, xxh03, xxl03, xh03, xl03)
+   DD_SQR(256, xxh47, xxl47, xh47, xl47)
+   DD_SQR(256, yyh03, yyl03, yh03, yl03)
+   DD_SQR(256, yyh47, yyl47, yh47, yl47)
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+
+   do
+   {
+      DD_ITERATE(256, 03)
+      DD_ITERATE(256, 47)
+      mag03 = _mm256_add_pd(xxh03, yyh03);
+      mag47 = _mm256_add_pd(xxh47, yyh47);
+      iters++;
+   }
+   while (!(_mm256_movemask_pd(_mm256_cmp_pd(mag03, rad, _CMP_NLT_UQ)) |
+            _mm256_movemask_pd(_mm256_cmp_pd(mag47, rad, _CMP_NLT_UQ)))
+          && iters != max);
+
+   _mm256_store_pd(&ps_ptr->x[0], xh03);  // Save point states and magnitudes
+   _mm256_store_pd(&ps_ptr->x[4], xh47);
+   _mm256_store_pd(&ps_ptr->x[8], xl03);
+   _mm256_store_pd(&ps_ptr->x[12], xl47);
+   _mm256_store_pd(&ps_ptr->y[0], yh03);
+   _mm256_store_pd(&ps_ptr->y[4], yh47);
+   _mm256_store_pd(&ps_ptr->y[8], yl03);
+   _mm256_store_pd(&ps_ptr->y[12], yl47);
+   _mm256_store_pd(&ps_ptr->mag[0], mag03);
+   _mm256_store_pd(&ps_ptr->mag[4], mag47);
+
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 8; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+#ifdef USE_AVX512_KERNELS
+
+// AVX-512 version: 8 points in one chain (the point structure only has room for 8 double-double points)
+TARGET_AVX512 static unsigned iterate_dd_avx512(man_pointstruct *ps_ptr) // sip8dd5
+{
+   __m512d xh07, xl07, yh07, yl07, ah07, al07, bh07, bl07, xxh07, xxl07, yyh07, yyl07, xyh07, xyl07;
+   __m512d mag07, rad, t0, t1, t2;
+   unsigned i, iters, max;
+
+   xh07 = _mm512_load_pd(&ps_ptr->x[0]);
+   xl07 = _mm512_load_pd(&ps_ptr->x[8]);
+   yh07 = _mm512_load_pd(&ps_ptr->y[0]);
+   yl07 = _mm512_load_pd(&ps_ptr->y[8]);
+   ah07 = _mm512_load_pd(&ps_ptr->a[0]);
+   al07 = _mm512_load_pd(&ps_ptr->a[8]);
+   bh07 = _mm512_load_pd(&ps_ptr->b[0]);
+   bl07 = _mm512_load_pd(&ps_ptr->b[8]);
+   rad = _mm512_set1_pd(DIVERGED_THRESH);
+
+   DD_SQR(512, xxh07, xxl07, xh07, xl07)
+   DD_SQR(512, yyh07, yyl07, yh07, yl07)
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+
+   do
+   {
+      DD_ITERATE(512, 07)
+      mag07 = _mm512_add_pd(xxh07, yyh07);
+      iters++;
+   }
+   while (!_mm512_cmp_pd_mask(mag07, rad, _CMP_NLT_UQ) && iters != max);
+
+   _mm512_store_pd(&ps_ptr->x[0], xh07);
+   _mm512_store_pd(&ps_ptr->x[8], xl07);
+   _mm512_store_pd(&ps_ptr->y[0], yh07);
+   _mm512_store_pd(&ps_ptr->y[8], yl07);
+   _mm512_store_pd(&ps_ptr->mag[0], mag07);
+
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 8; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+#endif // USE_AVX512_KERNELS
+
+// Queuing function for the double-double algorithms, with free slot bitmask (see queue_8point_avx).
+// Since these do one iteration per loop, mag always has the magnitude for the iteration count.
+static void FASTCALL queue_8point_dd(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp8dd
+{
+   unsigned i, iters, max, queue_status, *ptr;
+   man_calc_struct *m;
+
+   m = (man_calc_struct *) calc_struct;
+   queue_status = ps_ptr->queue_status;
+
+   if (!queue_status) // If all points in use, iterate to clear at least one point first
+   {
+      m->mandel_iterate(ps_ptr);
+      max = 0;
+      for (i = 0; i < 8; i++)
+      {
+         iters = ps_ptr->iters[i];
+         if (ps_ptr->mag[i] >= DIVERGED_THRESH || iters == m->max_iters)
+         {
+            ptr = ps_ptr->iters_ptr[i];
+            *ptr = (iters == m->max_iters) ? iters : iters + 1; // match iteration offset of the other versions
+            MAG(m, ptr) = (float) ps_ptr->mag[i];
+            queue_status |= 1 << i;
+         }
+         else if (iters > max)
+            max = iters;
+      }
+      ps_ptr->cur_max_iters = m->max_iters - max;
+   }
+
+   i = lowest_set_bit(queue_status);               // Get next free slot
+   ps_ptr->queue_status = queue_status & ~(1 << i); // Pop free slot
+
+   ps_ptr->a[i] = ps_ptr->ab_in[0]; // Set input point, high and low parts
+   ps_ptr->a[i + 8] = ps_ptr->ab_lo[0];
+   ps_ptr->b[i] = ps_ptr->ab_in[1];
+   ps_ptr->b[i + 8] = ps_ptr->ab_lo[1];
+   ps_ptr->x[i] = ps_ptr->x[i + 8] = 0.0; // Set initial conditions
+   ps_ptr->y[i] = ps_ptr->y[i + 8] = 0.0;
+   ps_ptr->iters[i] = 0;
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+#endif // USE_AVX_KERNELS
+
+// ----------------------- Fixed point iteration functions -----------------------------------
+
+// For PRECISION_FIXED: the iteration in two's complement integer fixed point, as an alternative
+// to double-double past the double range (and to double past the float range). The products come
+// from 64 x 64 -> 128-bit multiplies (mul/umulh), so the speed depends on the CPU's wide integer
+// multiply throughput rather than on its vector units; qmrender -prec 4 measures it.
+//
+// Values have FIXED_INT_BITS integer bits, so 57 fraction bits for the 64-bit kernel and 121 for
+// the 128-bit one (the 64-bit format is the high word of the 128-bit one). The 64-bit kernel runs
+// until it loses precision, a little past double at magnifications around 1e15; then the 128-bit
+// one runs to around 1e34, past double-double (see check_precision_loss_fixed). Products are
+// truncated magnitudes, so rounding is symmetric around 0.
+//
+// While a point hasn't diverged, |x|, |y| < 4 and xx + yy < 16, so the next x and y are < 18 in
+// magnitude. The squares are only taken if |x| and |y| are still < 4 (else the point diverged),
+// so nothing overflows. Mag is converted to double for the queue function.
+//
+// The C versions iterate FIXED_POINTS points at once, one iteration per loop like the
+// double-double kernels. The points are independent, so their multiplies overlap.
+
+#define FIXED_FRAC_BITS       (64 - FIXED_INT_BITS)   // of the high word
+#define FIXED_ONE             (1LL << FIXED_FRAC_BITS)
+#define FIXED_FLOPS_PER_ITER  9                       // equivalent double flops, for the Gflops figure
+#define FIXED_QUEUE_INIT      ((1 << FIXED_POINTS) - 1)
+
+// 64 x 64 -> 128-bit unsigned multiply. Returns the low 64 bits; the high 64 go to *hi.
+static __inline unsigned long long umul64(unsigned long long a, unsigned long long b, unsigned long long *hi)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+   return _umul128(a, b, hi);
+#elif defined(__SIZEOF_INT128__)
+   unsigned __int128 p;
+
+   p = (unsigned __int128) a * b;
+   *hi = (unsigned long long) (p >> 64);
+   return (unsigned long long) p;
+#else
+   unsigned long long p00, p01, p10, mid;
+
+   p00 = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+   p01 = (a & 0xFFFFFFFF) * (b >> 32);
+   p10 = (a >> 32) * (b & 0xFFFFFFFF);
+   mid = (p00 >> 32) + (p01 & 0xFFFFFFFF) + (p10 & 0xFFFFFFFF);
+   *hi = (a >> 32) * (b >> 32) + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+   return (mid << 32) | (p00 & 0xFFFFFFFF);
+#endif
+}
+
+// 64-bit fixed point product. Done on magnitudes; neg gives the sign of the result.
+static __inline long long fixed64_mul(unsigned long long a, unsigned long long b, int neg)
+{
+   unsigned long long hi, lo;
+
+   lo = umul64(a, b, &hi);
+   lo = (hi << FIXED_INT_BITS) | (lo >> FIXED_FRAC_BITS);
+   return (long long) (neg ? 0 - lo : lo);
+}
+
+static __inline unsigned long long fixed64_abs(long long a)
+{
+   return a < 0 ? 0 - (unsigned long long) a : (unsigned long long) a;
+}
+
+static __inline fixed_num fixed_add(fixed_num a, fixed_num b)
+{
+   fixed_num r;
+
+   r.lo = a.lo + b.lo;
+   r.hi = (long long) ((unsigned long long) a.hi + b.hi + (r.lo < a.lo));
+   return r;
+}
+
+static __inline fixed_num fixed_sub(fixed_num a, fixed_num b)
+{
+   fixed_num r;
+
+   r.lo = a.lo - b.lo;
+   r.hi = (long long) ((unsigned long long) a.hi - b.hi - (a.lo < b.lo));
+   return r;
+}
+
+static __inline fixed_num fixed_neg(fixed_num a)
+{
+   a.lo = 0 - a.lo;
+   a.hi = (long long) (~(unsigned long long) a.hi + (a.lo == 0));
+   return a;
+}
+
+static __inline fixed_num fixed_abs(fixed_num a)
+{
+   return a.hi < 0 ? fixed_neg(a) : a;
+}
+
+// 128-bit fixed point product of magnitudes a and b; neg gives the sign of the result. The
+// 256-bit product is shifted right by the fraction bits. The low word of al * bl is below the
+// result's lsb, so only its high word is needed.
+static __inline fixed_num fixed_mul(fixed_num a, fixed_num b, int neg)
+{
+   unsigned long long w1, w2, w3, lo, hi, ah, bh;
+   fixed_num r;
+
+   ah = (unsigned long long) a.hi;
+   bh = (unsigned long long) b.hi;
+   w2 = umul64(ah, bh, &w3);        // weight 2^128
+   umul64(a.lo, b.lo, &w1);         // 2^64
+   lo = umul64(ah, b.lo, &hi);      // 2^64 (cross terms)
+   w1 += lo;
+   hi += w1 < lo;
+   w2 += hi;
+   w3 += w2 < hi;
+   lo = umul64(a.lo, bh, &hi);
+   w1 += lo;
+   hi += w1 < lo;
+   w2 += hi;
+   w3 += w2 < hi;
+
+   r.lo = (w2 << FIXED_INT_BITS) | (w1 >> FIXED_FRAC_BITS);
+   r.hi = (long long) ((w3 << FIXED_INT_BITS) | (w2 >> FIXED_FRAC_BITS));
+   return neg ? fixed_neg(r) : r;
+}
+
+// Square of magnitude a. Same as fixed_mul(a, a, 0), but the cross term only needs one multiply.
+static __inline fixed_num fixed_sqr(fixed_num a)
+{
+   unsigned long long w1, w2, w3, lo, hi, ah, c_lo, c_hi;
+   fixed_num r;
+
+   ah = (unsigned long long) a.hi;
+   w2 = umul64(ah, ah, &w3);
+   umul64(a.lo, a.lo, &w1);
+   c_lo = umul64(ah, a.lo, &c_hi);
+   lo = c_lo << 1;                  // 2 * cross term (a.hi < 2^63, so it fits in 128 bits)
+   hi = (c_hi << 1) | (c_lo >> 63);
+   w1 += lo;
+   hi += w1 < lo;
+   w2 += hi;
+   w3 += w2 < hi;
+
+   r.lo = (w2 << FIXED_INT_BITS) | (w1 >> FIXED_FRAC_BITS);
+   r.hi = (long long) ((w3 << FIXED_INT_BITS) | (w2 >> FIXED_FRAC_BITS));
+   return r;
+}
+
+// Double to fixed point. The integer part wraps around past FIXED_INT_BITS (exactly), like
+// hp_to_fixed, so a sum of wrapped values is right if it's in range.
+static fixed_num fixed_from_double(double d)
+{
+   fixed_num r;
+   double t, h;
+
+   d = fmod(d, (double) (1 << FIXED_INT_BITS));
+   if (d >= (double) (1 << (FIXED_INT_BITS - 1)))
+      d -= (double) (1 << FIXED_INT_BITS);
+   else if (d < -(double) (1 << (FIXED_INT_BITS - 1)))
+      d += (double) (1 << FIXED_INT_BITS);
+
+   t = ldexp(d, FIXED_FRAC_BITS);
+   h = floor(t);
+   r.hi = (long long) h;
+   r.lo = (unsigned long long) ldexp(t - h, 64);
+   return r;
+}
+
+// Magnitude of a point as a double, for the queue function. If |x| or |y| >= 4 the point
+// diverged before the squares were taken, so get it from x and y; else it's mag (xx + yy).
+static __inline double fixed_mag(long long x, long long y, long long mag)
+{
+   double dx, dy;
+
+   if (fixed64_abs(x) >= 4 * FIXED_ONE || fixed64_abs(y) >= 4 * FIXED_ONE)
+   {
+      dx = (double) x * (1.0 / FIXED_ONE);
+      dy = (double) y * (1.0 / FIXED_ONE);
+      return dx * dx + dy * dy;
+   }
+   return (double) mag * (1.0 / FIXED_ONE);
+}
+
+// 64-bit version. Only the high words of the point states are used.
+static unsigned iterate_fixed64(man_pointstruct *ps_ptr)
+{
+   long long x[FIXED_POINTS], y[FIXED_POINTS], xx[FIXED_POINTS], yy[FIXED_POINTS];
+   long long a[FIXED_POINTS], b[FIXED_POINTS];
+   unsigned long long ax, ay;
+   unsigned i, iters, max, diverged;
+
+   for (i = 0; i < FIXED_POINTS; i++)
+   {
+      x[i] = ps_ptr->fx[i].hi;
+      y[i] = ps_ptr->fy[i].hi;
+      xx[i] = ps_ptr->fxx[i].hi;
+      yy[i] = ps_ptr->fyy[i].hi;
+      a[i] = ps_ptr->fa[i].hi;
+      b[i] = ps_ptr->fb[i].hi;
+   }
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   diverged = 0;
+
+   do
+   {
+      for (i = 0; i < FIXED_POINTS; i++)
+      {
+         ax = fixed64_abs(x[i]);
+         ay = fixed64_abs(y[i]);
+         y[i] = fixed64_mul(ax, ay, (x[i] ^ y[i]) < 0) * 2 + b[i]; // y = 2xy + b
+         x[i] = xx[i] - yy[i] + a[i];                              // x = xx - yy + a
+         ax = fixed64_abs(x[i]);
+         ay = fixed64_abs(y[i]);
+         if (ax >= 4 * FIXED_ONE || ay >= 4 * FIXED_ONE)
+            diverged = 1;
+         else
+         {
+            xx[i] = fixed64_mul(ax, ax, 0);
+            yy[i] = fixed64_mul(ay, ay, 0);
+            diverged |= xx[i] + yy[i] >= 16 * FIXED_ONE;
+         }
+      }
+      iters++;
+   }
+   while (!diverged && iters != max);
+
+   for (i = 0; i < FIXED_POINTS; i++)
+   {
+      ps_ptr->fx[i].hi = x[i];
+      ps_ptr->fy[i].hi = y[i];
+      ps_ptr->fxx[i].hi = xx[i];
+      ps_ptr->fyy[i].hi = yy[i];
+      ps_ptr->mag[i] = fixed_mag(x[i], y[i], xx[i] + yy[i]);
+      ps_ptr->iters[i] += iters;
+   }
+   ps_ptr->iterctr += iters;
+
+   return iters;
+}
+
+// 128-bit version
+static unsigned iterate_fixed128(man_pointstruct *ps_ptr)
+{
+   fixed_num x[FIXED_POINTS], y[FIXED_POINTS], xx[FIXED_POINTS], yy[FIXED_POINTS], ax, ay, t;
+   unsigned i, iters, max, diverged;
+
+   for (i = 0; i < FIXED_POINTS; i++)
+   {
+      x[i] = ps_ptr->fx[i];
+      y[i] = ps_ptr->fy[i];
+      xx[i] = ps_ptr->fxx[i];
+      yy[i] = ps_ptr->fyy[i];
+   }
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+   diverged = 0;
+
+   do
+   {
+      for (i = 0; i < FIXED_POINTS; i++)
+      {
+         t = fixed_mul(fixed_abs(x[i]), fixed_abs(y[i]), (x[i].hi ^ y[i].hi) < 0);
+         y[i] = fixed_add(fixed_add(t, t), ps_ptr->fb[i]);
+         x[i] = fixed_add(fixed_sub(xx[i], yy[i]), ps_ptr->fa[i]);
+         ax = fixed_abs(x[i]);
+         ay = fixed_abs(y[i]);
+         if ((unsigned long long) ax.hi >= 4 * FIXED_ONE || (unsigned long long) ay.hi >= 4 * FIXED_ONE)
+            diverged = 1;
+         else
+         {
+            xx[i] = fixed_sqr(ax);
+            yy[i] = fixed_sqr(ay);
+            diverged |= fixed_add(xx[i], yy[i]).hi >= 16 * FIXED_ONE;
+         }
+      }
+      iters++;
+   }
+   while (!diverged && iters != max);
+
+   for (i = 0; i < FIXED_POINTS; i++)
+   {
+      ps_ptr->fx[i] = x[i];
+      ps_ptr->fy[i] = y[i];
+      ps_ptr->fxx[i] = xx[i];
+      ps_ptr->fyy[i] = yy[i];
+      ps_ptr->mag[i] = fixed_mag(x[i].hi, y[i].hi, fixed_add(xx[i], yy[i]).hi);
+      ps_ptr->iters[i] += iters;
+   }
+   ps_ptr->iterctr += iters;
+
+   return iters;
+}
+
+// Queuing function for the fixed point algorithms, with free slot bitmask (see queue_8point_dd).
+// The point's coordinates are re/im (m->fixed_re/fixed_im) plus the offsets in ab_lo (see
+// set_fixed_coords). Points at 8 or more in either coordinate (only in zoomed out images) are
+// clamped to 8; they diverge on the first iteration either way. The dummy points at the end of
+// the calculation have c = 0.
+static void FASTCALL queue_4point_fixed(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp4f
+{
+   unsigned i, iters, max, queue_status, *ptr;
+   man_calc_struct *m;
+   fixed_num zero;
+
+   m = (man_calc_struct *) calc_struct;
+   queue_status = ps_ptr->queue_status;
+
+   if (!queue_status) // If all points in use, iterate to clear at least one point first
+   {
+      m->mandel_iterate(ps_ptr);
+      max = 0;
+      for (i = 0; i < FIXED_POINTS; i++)
+      {
+         iters = ps_ptr->iters[i];
+         if (ps_ptr->mag[i] >= DIVERGED_THRESH || iters == m->max_iters)
+         {
+            ptr = ps_ptr->iters_ptr[i];
+            *ptr = (iters == m->max_iters) ? iters : iters + 1; // match iteration offset of the other versions
+            MAG(m, ptr) = (float) ps_ptr->mag[i];
+            queue_status |= 1 << i;
+         }
+         else if (iters > max)
+            max = iters;
+      }
+      ps_ptr->cur_max_iters = m->max_iters - max;
+   }
+
+   i = lowest_set_bit(queue_status);               // Get next free slot
+   ps_ptr->queue_status = queue_status & ~(1 << i); // Pop free slot
+
+   zero.lo = 0;
+   zero.hi = 0;
+   if (iters_ptr == m->iter_data_dummy)
+      ps_ptr->fa[i] = ps_ptr->fb[i] = zero;
+   else
+   {
+      ps_ptr->fa[i] = (fabs(ps_ptr->ab_in[0]) >= 8.0) ? fixed_from_double(ps_ptr->ab_in[0] < 0.0 ? -8.0 : 8.0) :
+                      fixed_add(m->fixed_re, fixed_from_double(ps_ptr->ab_lo[0]));
+      ps_ptr->fb[i] = (fabs(ps_ptr->ab_in[1]) >= 8.0) ? fixed_from_double(ps_ptr->ab_in[1] < 0.0 ? -8.0 : 8.0) :
+                      fixed_add(m->fixed_im, fixed_from_double(ps_ptr->ab_lo[1]));
+   }
+   ps_ptr->fx[i] = ps_ptr->fy[i] = ps_ptr->fxx[i] = ps_ptr->fyy[i] = zero; // Set initial conditions
+   ps_ptr->iters[i] = 0;
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+// ----------------------- Distance estimation iteration functions -----------------------------------
+
+// Double precision kernels that also iterate dz/dc (see de_estimate). One iteration per loop
+// and no periodicity checking, so mag always has the magnitude for the iteration count (as with
+// the double-double kernels) and the counts match the exact non-FMA kernels. xx and yy are
+// recalculated from x and y on entry.
+
+#ifdef USE_AVX_KERNELS
+
+// One iteration of the points in the vectors with suffix s (dz = 2 * z * dz + 1 first, from the old z)
+#define DE_ITERATE(W, s)                                                                     \
+   t##s = _mm##W##_sub_pd(_mm##W##_mul_pd(x##s, dx##s), _mm##W##_mul_pd(y##s, dy##s));        \
+   dy##s = _mm##W##_mul_pd(_mm##W##_add_pd(_mm##W##_mul_pd(x##s, dy##s),                     \
+                                           _mm##W##_mul_pd(y##s, dx##s)), two);              \
+   dx##s = _mm##W##_add_pd(_mm##W##_add_pd(t##s, t##s), one);                                \
+   y##s = _mm##W##_add_pd(_mm##W##_mul_pd(_mm##W##_add_pd(x##s, x##s), y##s), b##s);         \
+   x##s = _mm##W##_add_pd(_mm##W##_sub_pd(xx##s, yy##s), a##s);                              \
+   xx##s = _mm##W##_mul_pd(x##s, x##s);                                                      \
+   yy##s = _mm##W##_mul_pd(y##s, y##s);                                                      \
+   mag##s = _mm##W##_add_pd(xx##s, yy##s);
+
+// AVX version: 8 points as two chains of 4
+TARGET_AVX static unsigned iterate_de_avx(man_pointstruct *ps_ptr) // sip8de
+{
+   __m256d x03, x47, y03, y47, xx03, xx47, yy03, yy47, dx03, dx47, dy03, dy47, t03, t47;
+   __m256d a03, a47, b03, b47, mag03, mag47, rad, one, two;
+   unsigned i, iters, max;
+
+   x03 = _mm256_load_pd(&ps_ptr->x[0]);   // Restore point states
+   x47 = _mm256_load_pd(&ps_ptr->x[4]);
+   y03 = _mm256_load_pd(&ps_ptr->y[0]);
+   y47 = _mm256_load_pd(&ps_ptr->y[4]);
+   dx03 = _mm256_load_pd(&ps_ptr->dx[0]);
+   dx47 = _mm256_load_pd(&ps_ptr->dx[4]);
+   dy03 = _mm256_load_pd(&ps_ptr->dy[0]);
+   dy47 = _mm256_load_pd(&ps_ptr->dy[4]);
+   a03 = _mm256_load_pd(&ps_ptr->a[0]);
+   a47 = _mm256_load_pd(&ps_ptr->a[4]);
+   b03 = _mm256_load_pd(&ps_ptr->b[0]);
+   b47 = _mm256_load_pd(&ps_ptr->b[4]);
+   xx03 = _mm256_mul_pd(x03, x03);
+   xx47 = _mm256_mul_pd(x47, x47);
+   yy03 = _mm256_mul_pd(y03, y03);
+   yy47 = _mm256_mul_pd(y47, y47);
+   rad = _mm256_set1_pd(DIVERGED_THRESH);
+   one = _mm256_set1_pd(1.0);
+   two = _mm256_set1_pd(2.0);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+
+   do
+   {
+      DE_ITERATE(256, 03)
+      DE_ITERATE(256, 47)
+      iters++;
+   }
+   while (!(_mm256_movemask_pd(_mm256_cmp_pd(mag03, rad, _CMP_NLT_UQ)) |
+            _mm256_movemask_pd(_mm256_cmp_pd(mag47, rad, _CMP_NLT_UQ)))
+          && iters != max);
+
+   _mm256_store_pd(&ps_ptr->x[0], x03);   // Save point states, derivatives and magnitudes
+   _mm256_store_pd(&ps_ptr->x[4], x47);
+   _mm256_store_pd(&ps_ptr->y[0], y03);
+   _mm256_store_pd(&ps_ptr->y[4], y47);
+   _mm256_store_pd(&ps_ptr->dx[0], dx03);
+   _mm256_store_pd(&ps_ptr->dx[4], dx47);
+   _mm256_store_pd(&ps_ptr->dy[0], dy03);
+   _mm256_store_pd(&ps_ptr->dy[4], dy47);
+   _mm256_store_pd(&ps_ptr->mag[0], mag03);
+   _mm256_store_pd(&ps_ptr->mag[4], mag47);
+
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 8; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+#ifdef USE_AVX512_KERNELS
+
+// AVX-512 version: 16 points as two chains of 8
+TARGET_AVX512 static unsigned iterate_de_avx512(man_pointstruct *ps_ptr) // sip16de
+{
+   __m512d x07, x8f, y07, y8f, xx07, xx8f, yy07, yy8f, dx07, dx8f, dy07, dy8f, t07, t8f;
+   __m512d a07, a8f, b07, b8f, mag07, mag8f, rad, one, two;
+   unsigned i, iters, max;
+
+   x07 = _mm512_load_pd(&ps_ptr->x[0]);
+   x8f = _mm512_load_pd(&ps_ptr->x[8]);
+   y07 = _mm512_load_pd(&ps_ptr->y[0]);
+   y8f = _mm512_load_pd(&ps_ptr->y[8]);
+   dx07 = _mm512_load_pd(&ps_ptr->dx[0]);
+   dx8f = _mm512_load_pd(&ps_ptr->dx[8]);
+   dy07 = _mm512_load_pd(&ps_ptr->dy[0]);
+   dy8f = _mm512_load_pd(&ps_ptr->dy[8]);
+   a07 = _mm512_load_pd(&ps_ptr->a[0]);
+   a8f = _mm512_load_pd(&ps_ptr->a[8]);
+   b07 = _mm512_load_pd(&ps_ptr->b[0]);
+   b8f = _mm512_load_pd(&ps_ptr->b[8]);
+   xx07 = _mm512_mul_pd(x07, x07);
+   xx8f = _mm512_mul_pd(x8f, x8f);
+   yy07 = _mm512_mul_pd(y07, y07);
+   yy8f = _mm512_mul_pd(y8f, y8f);
+   rad = _mm512_set1_pd(DIVERGED_THRESH);
+   one = _mm512_set1_pd(1.0);
+   two = _mm512_set1_pd(2.0);
+
+   max = ps_ptr->cur_max_iters;
+   iters = 0;
+
+   do
+   {
+      DE_ITERATE(512, 07)
+      DE_ITERATE(512, 8f)
+      iters++;
+   }
+   while (!(_mm512_cmp_pd_mask(mag07, rad, _CMP_NLT_UQ) | _mm512_cmp_pd_mask(mag8f, rad, _CMP_NLT_UQ))
+          && iters != max);
+
+   _mm512_store_pd(&ps_ptr->x[0], x07);
+   _mm512_store_pd(&ps_ptr->x[8], x8f);
+   _mm512_store_pd(&ps_ptr->y[0], y07);
+   _mm512_store_pd(&ps_ptr->y[8], y8f);
+   _mm512_store_pd(&ps_ptr->dx[0], dx07);
+   _mm512_store_pd(&ps_ptr->dx[8], dx8f);
+   _mm512_store_pd(&ps_ptr->dy[0], dy07);
+   _mm512_store_pd(&ps_ptr->dy[8], dy8f);
+   _mm512_store_pd(&ps_ptr->mag[0], mag07);
+   _mm512_store_pd(&ps_ptr->mag[8], mag8f);
+
+   ps_ptr->iterctr += iters;
+   for (i = 0; i < 16; i++)
+      ps_ptr->iters[i] += iters;
+
+   return iters;
+}
+
+#endif // USE_AVX512_KERNELS
+
+// Queuing function for the DE kernels, with free slot bitmask (see queue_8point_dd). Stores the
+// distance estimate along with the count and magnitude.
+static __inline void queue_de(man_calc_struct *m, man_pointstruct *ps_ptr, unsigned *iters_ptr, unsigned points)
+{
+   unsigned i, iters, max, queue_status, *ptr;
+
+   queue_status = ps_ptr->queue_status;
+
+   if (!queue_status) // If all points in use, iterate to clear at least one point first
+   {
+      m->mandel_iterate(ps_ptr);
+      max = 0;
+      for (i = 0; i < points; i++)
+      {
+         iters = ps_ptr->iters[i];
+         if (ps_ptr->mag[i] >= DIVERGED_THRESH || iters == m->max_iters)
+         {
+            ptr = ps_ptr->iters_ptr[i];
+            if (iters == m->max_iters)
+            {
+               *ptr = iters;
+               DE(m, ptr) = 0.0f;
+            }
+            else
+            {
+               *ptr = iters + 1; // match iteration offset of the other versions
+               DE(m, ptr) = de_estimate(m, ps_ptr->mag[i], ps_ptr->dx[i], ps_ptr->dy[i]);
+            }
+            MAG(m, ptr) = (float) ps_ptr->mag[i];
+            queue_status |= 1 << i;
+         }
+         else if (iters > max)
+            max = iters;
+      }
+      ps_ptr->cur_max_iters = m->max_iters - max;
+   }
+
+   i = lowest_set_bit(queue_status);               // Get next free slot
+   ps_ptr->queue_status = queue_status & ~(1 << i); // Pop free slot
+
+   ps_ptr->a[i] = ps_ptr->ab_in[0];
+   ps_ptr->b[i] = ps_ptr->ab_in[1];
+   ps_ptr->x[i] = ps_ptr->y[i] = 0.0; // Set initial conditions
+   ps_ptr->dx[i] = ps_ptr->dy[i] = 0.0;
+   ps_ptr->iters[i] = 0;
+   ps_ptr->iters_ptr[i] = iters_ptr;
+}
+
+static void FASTCALL queue_8point_de(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp8de
+{
+   queue_de((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 8);
+}
+
+#ifdef USE_AVX512_KERNELS
+static void FASTCALL queue_16point_de(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp16de
+{
+   queue_de((man_calc_struct *) calc_struct, ps_ptr, iters_ptr, 16);
+}
+#endif
+
+#endif // USE_AVX_KERNELS
+
+// ----------------------- Interior pre-pass -----------------------------------
+
+// Points inside the main cardioid or the period-2 bulb never diverge, and both have a closed
+// form test, so these points get max_iters without being queued at all. Most of the home image
+// and of shallow views is in these two regions. With c = x + iy:
+//
+//    cardioid:  q * (q + (x - 1/4)) <= y^2 / 4,  where q = (x - 1/4)^2 + y^2
+//    bulb:      (x + 1)^2 + y^2 <= 1/16
+//
+// The test is done on a block of up to 64 consecutive points of a line at a time, giving a
+// bitmask the calculation loops check before queuing each point (see is_interior). Only used
+// for single and double precision; img_re/img_im are deltas for perturbation, and the test
+// isn't exact enough at double-double or fixed point magnifications.
+
+#define INTERIOR_BLOCK     64       // points per mask (bits in an unsigned long long)
+#define INTERIOR_RE_MIN    -1.25    // bounding box of the cardioid and bulb
+#define INTERIOR_RE_MAX    0.25
+#define INTERIOR_IM_MAX    0.65     // cardioid max |im| is 3 * sqrt(3) / 8 = 0.6495
+
+static unsigned long long interior_mask_c(const double *re, double im, int n)
+{
+   double x, q, yy;
+   unsigned long long mask;
+   int i;
+
+   yy = im * im;
+   mask = 0;
+   for (i = 0; i < n; i++)
+   {
+      x = re[i] - 0.25;
+      q = x * x + yy;
+      if (q * (q + x) <= 0.25 * yy || (x + 1.25) * (x + 1.25) + yy <= 0.0625)
+         mask |= 1ULL << i;
+   }
+   return mask;
+}
+
+#ifdef USE_AVX_KERNELS
+
+// 4 points per compare. Can read up to 3 values past re[n - 1] (img_re has 4 extra at the end);
+// their bits get masked off.
+TARGET_AVX static unsigned long long interior_mask_avx(const double *re, double im, int n)
+{
+   __m256d x, q, t, yy, yy4, quarter, five_quarters, sixteenth;
+   unsigned long long mask;
+   int i;
+
+   yy = _mm256_set1_pd(im * im);
+   yy4 = _mm256_set1_pd(0.25 * im * im);
+   quarter = _mm256_set1_pd(0.25);
+   five_quarters = _mm256_set1_pd(1.25);
+   sixteenth = _mm256_set1_pd(0.0625);
+
+   mask = 0;
+   for (i = 0; i < n; i += 4)
+   {
+      x = _mm256_sub_pd(_mm256_loadu_pd(&re[i]), quarter);
+      q = _mm256_add_pd(_mm256_mul_pd(x, x), yy);
+      t = _mm256_add_pd(x, five_quarters);
+      mask |= (unsigned long long)
+              _mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(_mm256_mul_pd(q, _mm256_add_pd(q, x)), yy4, _CMP_LE_OQ),
+                                              _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(t, t), yy), sixteenth, _CMP_LE_OQ)))
+              << i;
+   }
+   return n < INTERIOR_BLOCK ? mask & ((1ULL << n) - 1) : mask;
+}
+
+#endif // USE_AVX_KERNELS
+
+// Returns nonzero if line y of the stripe from xstart to xend could have points in the cardioid
+// or bulb. Most lines of deep images can't, so the calculation loops skip the check for them.
+static __inline int interior_line(man_calc_struct *m, int y, int xstart, int xend)
+{
+   return m->interior_mask != NULL && fabs(m->img_im[y]) <= INTERIOR_IM_MAX &&
+          m->img_re[xstart] <= INTERIOR_RE_MAX && m->img_re[xend] >= INTERIOR_RE_MIN;
+}
+
+// Returns nonzero if point x on line y is inside the cardioid or bulb. Gets a new mask from
+// m->interior_mask when x leaves the block in *mask (start each line with *block = -1).
+static __inline int is_interior(man_calc_struct *m, unsigned long long *mask, int *block, int x, int y)
+{
+   int n;
+
+   if ((x & ~(INTERIOR_BLOCK - 1)) != *block)
+   {
+      *block = x & ~(INTERIOR_BLOCK - 1);
+      if ((n = m->xsize - *block) > INTERIOR_BLOCK)
+         n = INTERIOR_BLOCK;
+      *mask = m->interior_mask(&m->img_re[*block], m->img_im[y], n);
+   }
+   return (int) (*mask >> (x & (INTERIOR_BLOCK - 1))) & 1;
+}
+
+// Queue the point in ps_ptr->ab_in for the calculation loops. If the kernel has a batched
+// queue function (see queue_batch_avx512), the point goes into the batch buffer, which gets
+// queued when it fills; otherwise it goes straight to queue_point.
+static __inline void queue_batch_point(man_calc_struct *m, man_pointstruct *ps_ptr, unsigned *iters_ptr)
+{
+   unsigned n;
+
+   if (m->queue_batch == NULL)
+   {
+      m->queue_point(m, ps_ptr, iters_ptr);
+      return;
+   }
+   n = ps_ptr->batch_n;
+   ps_ptr->batch_re[n] = ps_ptr->ab_in[0];
+   ps_ptr->batch_im[n] = ps_ptr->ab_in[1];
+   ps_ptr->batch_ptr[n] = iters_ptr;
+   if ((ps_ptr->batch_n = n + 1) == BATCH_POINTS)
+      m->queue_batch(m, ps_ptr);
+}
+
+// Queue any points left in the batch buffer
+static __inline void flush_batch(man_calc_struct *m, man_pointstruct *ps_ptr)
+{
+   if (ps_ptr->batch_n)
+      m->queue_batch(m, ps_ptr);
+}
+
+// Returns nonzero if the calculation in progress has been cancelled (see cancel_calc). Checked
+// between tiles and lines. Thread 0 is the thread that called man_calculate (see run_pool), so
+// it also does the caller's cancel_poll, e.g. to check for input on a GUI thread.
+static __inline int calc_cancelled(man_calc_struct *m, thread_state *t)
+{
+   if (!t->thread_num && m->cancel_poll != NULL && m->cancel_gen == m->calc_gen &&
+       m->cancel_poll(m->cancel_param))
+      cancel_calc(m);
+   return m->cancel_gen != m->calc_gen;
+}
+
+// Store the points left in the queue. Up to 4 points could be left in the queue (or 8 for SSE,
+// etc). Queue non-diverging dummy points to flush them out. This is tricky. Be careful changing
+// it... can cause corrupted pixel bugs.
+// Turns out that one more point per queue slot must always be queued. They could be stored
+// to the dummy value if all points left in the queue still have max_iters remaining.
+
+static void flush_queue(man_calc_struct *m, man_pointstruct *ps_ptr)
+{
+   int i;
+
+   ps_ptr->ab_in[0] = 0.0;
+   ps_ptr->ab_in[1] = 0.0;
+   ps_ptr->ab_lo[0] = 0.0;
+   ps_ptr->ab_lo[1] = 0.0;
+
+   // Add some extra logic here to get the exact iteration count (i.e, exclude dummy iterations).
+   // It's actually pretty tough to calculate
+   // The dummies (c = 0) are periodic, so they can retire before the points left in the queue;
+   // keep queuing them until every slot holds one. In Julia mode too (z = 0 and c = 0 rather
+   // than the Julia c, whose orbit might not be caught by the periodicity check).
+   if (m->perturb)
+      flush_perturb_queue(m, ps_ptr);
+   else
+   {
+      ps_ptr->julia = 0;
+      for (i = 0; i < (int) m->iters_per_tick;) // queue size
+         if (ps_ptr->iters_ptr[i] != m->iter_data_dummy)
+         {
+            m->queue_point(m, ps_ptr, m->iter_data_dummy);
+            i = 0;
+         }
+         else
+            i++;
+      ps_ptr->julia = m->julia;
+   }
+}
+
+// Palette map the point at iters_ptr (see set_fused_palette)
+static void map_point(man_calc_struct *m, unsigned *iters_ptr)
+{
+   stripe s;
+   int offs;
+
+   offs = (int) (iters_ptr - m->iter_data);
+   s.xstart = s.xend = offs % m->iter_data_line_size;
+   s.ystart = s.yend = offs / m->iter_data_line_size;
+   map_palette_tile(m, &s);
+}
+
+// Make room for N entries in a thread's list (see thread_state), of SIZE entries now. Returns
+// 0 if it couldn't be grown.
+static int grow_list(void **list, int *size, int n, size_t elem_size)
+{
+   void *p;
+   int new_size;
+
+   if (n <= *size)
+      return 1;
+   new_size = *size ? *size * 2 : 256;
+   if (new_size < n)
+      new_size = n;
+   if ((p = realloc(*list, new_size * elem_size)) == NULL)
+      return 0;
+   *list = p;
+   *size = new_size;
+   return 1;
+}
+
+// Store the points left in the queue, and start over with an empty queue, as man_setup leaves it
+static void drain_queue(man_calc_struct *m, man_pointstruct *ps_ptr)
+{
+   flush_batch(m, ps_ptr);
+   flush_queue(m, ps_ptr);
+   ps_ptr->queue_status = m->queue_init;
+   ps_ptr->cur_max_iters = m->max_iters - m->series.iters;
+   ps_ptr->periodic = 0;
+   ps_ptr->period_save = PERIOD_FIRST_SAVE;
+}
+
+// Deferred guesses for the fast algorithm. A point whose neighbors are all the same gets
+// their value, but a neighbor still in the queue doesn't have one yet. Which neighbors are
+// still there depends on what else is in the queue: with more than one thread, on which tiles
+// the thread did before (see get_tile). So rather than iterating the point then, it's put on
+// the thread's deferred list and decided once its neighbors are stored. Every point then comes
+// out the same however the tiles were shared out. The neighbors are all in the tile (see the
+// wave loop), so a tile doesn't depend on the others either.
+
+// Returns nonzero if the guess from neighbors P0 - P3 depends on ones that aren't stored yet:
+// the ones that are stored are all the same. If any two differ, there's no guess anyway.
+static __inline int guess_pending(unsigned p0, unsigned p1, unsigned p2, unsigned p3)
+{
+   unsigned v;
+
+   v = p0 != ITERS_NONE ? p0 : p1 != ITERS_NONE ? p1 : p2 != ITERS_NONE ? p2 : p3;
+   return (p0 == ITERS_NONE || p1 == ITERS_NONE || p2 == ITERS_NONE || p3 == ITERS_NONE) &&
+          (p0 == ITERS_NONE || p0 == v) && (p1 == ITERS_NONE || p1 == v) &&
+          (p2 == ITERS_NONE || p2 == v) && (p3 == ITERS_NONE || p3 == v);
+}
+
+// Decide the guess for point P of wave WAVE: guess it, or iterate it if its neighbors differ.
+// Returns 1 if it was guessed, 0 if it was queued (or is in the cardioid or bulb), or -1 if it
+// depends on neighbors that aren't stored yet.
+static int guess_point(man_calc_struct *m, thread_state *t, unsigned *p, int wave)
+{
+   int x, y, offs, block, *o;
+   unsigned p0;
+   unsigned long long mask;
+   double ab_in[2], ab_lo[2];
+   man_pointstruct *ps_ptr;
+
+   o = m->wave_ptr_offs[wave];
+   if (guess_pending(p0 = p[o[0]], p[o[1]], p[o[2]], p[o[3]]))
+      return -1;
+   if (p0 == p[o[1]] && p0 == p[o[2]] && p0 == p[o[3]])
+   {
+      *p = p0;
+      MAG(m, p) = MAG(m, &p[o[2]]); // as in the wave loop
+      if (m->de)
+         DE(m, p) = DE(m, &p[o[2]]);
+      return 1;
+   }
+
+   offs = (int) (p - m->iter_data);
+   x = offs % m->iter_data_line_size;
+   y = offs / m->iter_data_line_size;
+   block = -1;
+   if (interior_line(m, y, x, x) && is_interior(m, &mask, &block, x, y))
+   {
+      *p = m->max_iters;
+      return 0;
+   }
+
+   // The wave loop has the coordinates of its own line in the point structure
+   ps_ptr = t->ps_ptr;
+   ab_in[0] = ps_ptr->ab_in[0];
+   ab_in[1] = ps_ptr->ab_in[1];
+   ab_lo[0] = ps_ptr->ab_lo[0];
+   ab_lo[1] = ps_ptr->ab_lo[1];
+   ps_ptr->ab_in[0] = m->img_re[x];
+   ps_ptr->ab_lo[0] = m->img_re_lo[x];
+   ps_ptr->ab_in[1] = m->img_im[y];
+   ps_ptr->ab_lo[1] = m->img_im_lo[y];
+   queue_batch_point(m, ps_ptr, p);
+   ps_ptr->ab_in[0] = ab_in[0];
+   ps_ptr->ab_in[1] = ab_in[1];
+   ps_ptr->ab_lo[0] = ab_lo[0];
+   ps_ptr->ab_lo[1] = ab_lo[1];
+   return 0;
+}
+
+// Decide the deferred guesses whose neighbors are stored now, in the order they were deferred
+// (a point only depends on points deferred before it). Returns the number guessed.
+static int resolve_deferred(man_calc_struct *m, thread_state *t)
+{
+   int i, n, r, guessed;
+   deferred_point *d;
+
+   for (i = n = guessed = 0; i < t->num_deferred; i++)
+   {
+      d = &t->deferred[i];
+      if ((r = guess_point(m, t, d->ptr, d->wave)) < 0)
+         t->deferred[n++] = *d;
+      else
+         guessed += r;
+   }
+   t->num_deferred = n;
+   flush_batch(m, t->ps_ptr);
+   return guessed;
+}
+
+// Decide all the deferred guesses, storing the points in the queue as needed (the last ones
+// decided can still be in the queue). Each round decides at least the first one left. Returns
+// the number guessed.
+static int finish_deferred(man_calc_struct *m, thread_state *t)
+{
+   int guessed;
+
+   for (guessed = 0; t->num_deferred; )
+   {
+      drain_queue(m, t->ps_ptr);
+      guessed += resolve_deferred(m, t);
+   }
+   return guessed;
+}
+
+// Defer the guess for point P of wave WAVE (see above). If the list can't be grown, decides
+// the deferred guesses and this one now. Adds the points guessed to *GUESSED.
+static void defer_guess(man_calc_struct *m, thread_state *t, unsigned *p, int wave, int *guessed)
+{
+   if (grow_list((void **) &t->deferred, &t->deferred_size, t->num_deferred + 1, sizeof(deferred_point)))
+   {
+      t->deferred[t->num_deferred].ptr = p;
+      t->deferred[t->num_deferred++].wave = wave;
+      return;
+   }
+   *guessed += finish_deferred(m, t);
+   drain_queue(m, t->ps_ptr);
+   if (guess_point(m, t, p, wave) > 0)
+      (*guessed)++;
+}
+
+static int cmp_ptr(const void *a, const void *b)
+{
+   unsigned *p = *(unsigned **) a, *q = *(unsigned **) b;
+
+   return p < q ? -1 : p > q;
+}
+
+// Skip point P in fused palette mapping (see map_tile_fused). Returns 0 if it can't be
+// skipped; then the image is mapped at the end instead.
+static int skip_fused(man_calc_struct *m, thread_state *t, unsigned *p)
+{
+   if (!grow_list((void **) &t->fused_skip, &t->fused_skip_size, t->fused_skips + 1, sizeof(unsigned *)))
+   {
+      m->fused = 0; // see man_calculate
+      return 0;
+   }
+   t->fused_skip[t->fused_skips++] = p;
+   return 1;
+}
+
+// Fused palette mapping of tile S, just calculated by thread T (see set_fused_palette). The
+// points still in the queue, and the deferred guesses, haven't been stored yet, so they're
+// skipped, and mapped once they're done: after a later tile, or at the end (see
+// man_calculate_threaded). Flushing the queue instead would stall the iteration until the
+// slowest point in it was done. The queue slots keep the pointers of retired points too,
+// which just delays those a bit.
+
+static void map_tile_fused(man_calc_struct *m, thread_state *t, stripe *s)
+{
+   int i, j, n, x, y, offs, first, line_size;
+   unsigned *p, **skip;
+   man_pointstruct *ps_ptr;
+   stripe r;
+
+   ps_ptr = t->ps_ptr;
+   line_size = m->iter_data_line_size;
+
+   // Map the points skipped before that are done now
+   for (i = n = 0; i < t->fused_skips; i++)
+   {
+      p = t->fused_skip[i];
+      for (j = 0; j < (int) m->iters_per_tick && ps_ptr->iters_ptr[j] != p; j++)
+         ;
+      if (j < (int) m->iters_per_tick || *p == ITERS_NONE)
+         t->fused_skip[n++] = p;
+      else
+         map_point(m, p);
+   }
+   t->fused_skips = n;
+
+   // Add the tile's points in the queue, and its deferred guesses, sorted by address
+   first = n;
+   for (i = 0; i < (int) m->iters_per_tick + t->num_deferred; i++)
+   {
+      p = i < (int) m->iters_per_tick ? ps_ptr->iters_ptr[i] : t->deferred[i - m->iters_per_tick].ptr;
+      if (p == NULL || p < m->iter_data || p >= m->iter_data + m->ysize * line_size)
+         continue;
+      offs = (int) (p - m->iter_data);
+      x = offs % line_size;
+      y = offs / line_size;
+      if (x >= s->xstart && x <= s->xend && y >= s->ystart && y <= s->yend && !skip_fused(m, t, p))
+         return;
+   }
+   skip = &t->fused_skip[first];
+   n = t->fused_skips - first;
+   qsort(skip, n, sizeof(skip[0]), cmp_ptr);
+   for (i = j = 0; i < n; i++)   // stale pointers can be in more than one slot
+      if (!j || skip[i] != skip[j - 1])
+         skip[j++] = skip[i];
+   n = j;
+   t->fused_skips = first + n;
+
+   // Map the lines without skipped points as rectangles, and the others around the points
+   r = *s;
+   for (i = 0; i < n; )
+   {
+      y = (int) (skip[i] - m->iter_data) / line_size;
+      if (y > r.ystart)
+      {
+         r.xstart = s->xstart;
+         r.xend = s->xend;
+         r.yend = y - 1;
+         map_palette_tile(m, &r);
+      }
+      r.ystart = r.yend = y;
+      r.xstart = s->xstart;
+      for (; i < n && (int) (skip[i] - m->iter_data) / line_size == y; i++)
+      {
+         r.xend = (int) (skip[i] - m->iter_data) % line_size - 1;
+         if (r.xend >= r.xstart)
+            map_palette_tile(m, &r);
+         r.xstart = r.xend + 2;
+      }
+      r.xend = s->xend;
+      if (r.xend >= r.xstart)
+         map_palette_tile(m, &r);
+      r.ystart = y + 1;
+   }
+   if (r.ystart <= s->yend)
+   {
+      r.xstart = s->xstart;
+      r.xend = s->xend;
+      r.yend = s->yend;
+      map_palette_tile(m, &r);
+   }
+}
+
+// Calculate the image, using the currently set precision and algorithm. Calculations in here are
+// always done in double (or extended) precision, regardless of the iteration algorithm's precision.
+
+// Now called from multiple threads (see run_pool). Calculates tiles from the thread's deque,
+// then steals them from the other threads until there are none left. See man_calculate().
+
+static void man_calculate_threaded(void *calc_struct, thread_state *t) // smc
+{
+   int i, x, y, xstart, xend, ystart, yend, line_size, points_guessed, check, block, exact;
+   unsigned *iters_ptr;
+   unsigned long long start_iterctr, interior;
+   man_pointstruct *ps_ptr;
+   stripe *s;
+   man_calc_struct *m;
+
+   m = (man_calc_struct *) calc_struct;
+   ps_ptr = t->ps_ptr;
+
+   line_size = m->iter_data_line_size;
+   points_guessed = 0;
+   interior = 0;                     // set by is_interior (block -1 on each line forces it)
+   start_iterctr = ps_ptr->iterctr;  // nonzero on perturbation glitch passes
+
+   // Calculate tiles until they're all taken (or the calculation is cancelled). Some threads
+   // might not get any
+   while ((s = get_tile(m, t)) != NULL && !calc_cancelled(m, t))
+   {
+      xstart = s->xstart;
+      xend = s->xend;
+      ystart = s->ystart;
+      yend = s->yend;
+
+      // Optimization for panning: set alg to exact mode for very thin regions. Due to the
+      // Fast algorithm's 4x4 cell size it often computes more pixels than Exact for these
+      // regions. Effect is most apparent with high iter count images.
+
+      // The switch is per tile (exact), since the other threads are doing other tiles; cur_alg
+      // is just for the GUI status line.
+
+      #define FE_SWITCHOVER_THRESH  2 // only do it for 1-pixel wide regions for now. best value TBD...
+
+      exact = (m->alg & ALG_EXACT) || (xend - xstart) < FE_SWITCHOVER_THRESH ||
+              (yend - ystart) < FE_SWITCHOVER_THRESH;
+      m->cur_alg = exact ? m->alg | ALG_EXACT : m->alg;
+
+      // Main loop. Queue each point in the image for iteration. Queue_point will return
+      // immediately if its queue isn't full (needs 4 points for the asm version), otherwise
+      // it will iterate on all the points in the queue.
+
+      if (m->glitch_pass) // Perturbation glitch correction: recalculate only the glitched points
+      {
+         for (y = ystart; y <= yend && !calc_cancelled(m, t); y++)
+         {
+            ps_ptr->ab_in[1] = m->img_im[y];
+            iters_ptr = m->iter_data + y * line_size + xstart;
+            for (x = xstart; x <= xend; x++, iters_ptr++)
+               if (*iters_ptr & ITERS_GLITCHED)
+               {
+                  ps_ptr->ab_in[0] = m->img_re[x];
+                  m->queue_point(m, ps_ptr, iters_ptr);
+               }
+         }
+      }
+      else if (exact) // Exact algorithm: calculates every pixel
+      {
+         y = ystart;
+         do
+         {
+            x = xstart;
+            ps_ptr->ab_in[1] = m->img_im[y];    // Load IM coordinate from the array
+            ps_ptr->ab_lo[1] = m->img_im_lo[y]; // (low part, for double-double)
+            iters_ptr = m->iter_data + y * line_size + x;
+            check = interior_line(m, y, xstart, xend);
+            block = -1;
+            do
+            {
+               if (check && is_interior(m, &interior, &block, x, y)) // in cardioid or bulb: no need to iterate
+                  *iters_ptr = m->max_iters;
+               else
+               {
+                  ps_ptr->ab_in[0] = m->img_re[x]; // Load RE coordinate from the array
+                  ps_ptr->ab_lo[0] = m->img_re_lo[x];
+                  queue_batch_point(m, ps_ptr, iters_ptr);
+               }
+               iters_ptr++;
+            }
+            while (++x <= xend);
+         }
+         while (++y <= yend && !calc_cancelled(m, t));
+         flush_batch(m, ps_ptr);
+      }
+      else // Fast "wave" algorithm from old code: guesses pixels.
+      {
+         int wave, xoffs, inc, d, gx0, gx1, p0, p1, p2, p3, offs0, offs1, offs2, offs3;
+
+         // Doing the full calculation (all waves) on horizontal chunks to improve cache locality
+         // gives no speedup (tested before realtime zooming was implemented- maybe should test again).
+
+         for (wave = 0; wave < 7 && !calc_cancelled(m, t); wave++)
+         {
+            inc = wave_inc[wave];
+            y = wave_ystart[wave] + ystart;
+
+            // Special case for wave 0 (always calculates all pixels). Makes realtime
+            // zooming measurably faster. X starts at xstart for wave 0, so can use do-while.
+            // For Y, need to calculate all waves even if out of range, because subsequent
+            // waves look forward to pixels calculated in previous waves (wave 0 starts at y = 3)
+
+            if (!wave) // it's faster with the special case inside the wave loop than outside
+            {
+               do
+               {
+                  x = xstart;
+                  ps_ptr->ab_in[1] = m->img_im[y];    // Load IM coordinate from the array
+                  ps_ptr->ab_lo[1] = m->img_im_lo[y];
+                  iters_ptr = m->iter_data + y * line_size + x; // adding a line to the ptr every y loop is slower
+                  check = interior_line(m, y, xstart, xend);
+                  block = -1;
+                  do
+                  {
+                     if (check && is_interior(m, &interior, &block, x, y))
+                        *iters_ptr = m->max_iters;
+                     else
+                     {
+                        ps_ptr->ab_in[0] = m->img_re[x]; // Load RE coordinate from the array
+                        ps_ptr->ab_lo[0] = m->img_re_lo[x];
+                        queue_batch_point(m, ps_ptr, iters_ptr);
+                     }
+                     iters_ptr += inc;
+                     x += inc;
+                  }
+                  while (x <= xend);
+               }
+               while ((y += inc) <= yend && !calc_cancelled(m, t));
+            }
+            else  // waves 1-6 check neighboring pixels
+            {
+               offs0 = m->wave_ptr_offs[wave][0]; // pointer offsets of neighboring pixels
+               offs1 = m->wave_ptr_offs[wave][1];
+               offs2 = m->wave_ptr_offs[wave][2];
+               offs3 = m->wave_ptr_offs[wave][3];
+
+               xoffs = wave_xstart[wave] + xstart;
+               d = inc >> 1; // neighbors are up to d pixels away (see wave_xoffs)
+
+               do
+               {
+                  x = xoffs;
+                  ps_ptr->ab_in[1] = m->img_im[y];
+                  ps_ptr->ab_lo[1] = m->img_im_lo[y];
+                  iters_ptr = m->iter_data + y * line_size + x;
+                  check = interior_line(m, y, xstart, xend);
+                  block = -1;
+
+                  // Only guess from neighbors in the tile (x from gx0 to gx1), so the result
+                  // doesn't depend on how far the threads doing the adjacent tiles have got.
+                  gx0 = xstart + d;
+                  gx1 = (y - d >= ystart && y + d <= yend) ? xend - d : gx0 - 1;
+
+                  // No faster to have a special case for waves 1 and 4 that loads only 2 pixels/loop
+                  while (x <= xend)
+                  {
+                     // If all 4 neighboring pixels (p0 - p3) are the same, set this pixel to
+                     // their value, else iterate.
+
+                     p0 = iters_ptr[offs0];
+                     p1 = iters_ptr[offs1];
+                     p2 = iters_ptr[offs2];
+                     p3 = iters_ptr[offs3];
+
+                     if (x >= gx0 && x <= gx1 && p0 == p1 && p0 == p2 && p0 == p3 && p0 != ITERS_NONE) // can't use sum compares here (causes corrupted pixels)
+                     {
+                        // aargh... compiler (or AMD CPU) generates different performance on
+                        // zoomtest depending on which point is stored here. They're all the same...
+                        // p3: 18.5s  p2: 18.3s  p1: 18.7s  p0: 19.2s  (+/- 0.1s repeatability)
+
+                        *iters_ptr = p2;
+
+                        // This works suprisingly well- degradation is really only noticeable
+                        // at high frequency transitions (e.g. with striped palettes).
+                        // Maybe average the mags at the 4 offsets to make it better
+
+                        // The mag store causes about a 7.5% slowdown on zoomtest.
+                        MAG(m, iters_ptr) = MAG(m, &iters_ptr[offs2]);
+                        if (m->de)
+                           DE(m, iters_ptr) = DE(m, &iters_ptr[offs2]);
+
+                        points_guessed++; // this adds no measureable overhead
+                     }
+                     // Neighbors still in the queue: decide later (see guess_point)
+                     else if (x >= gx0 && x <= gx1 && guess_pending(p0, p1, p2, p3))
+                        defer_guess(m, t, iters_ptr, wave, &points_guessed);
+                     else if (check && is_interior(m, &interior, &block, x, y))
+                        *iters_ptr = m->max_iters;
+                     else
+                     {
+                        ps_ptr->ab_in[0] = m->img_re[x]; // Load RE coordinate from the array
+                        ps_ptr->ab_lo[0] = m->img_re_lo[x];
+                        queue_batch_point(m, ps_ptr, iters_ptr);
+                     }
+                     iters_ptr += inc;
+                     x += inc;
+                  }
+               }
+               while ((y += inc) <= yend && !calc_cancelled(m, t));
+            }
+            // Later waves look at the points from this one, so don't leave any in the batch
+            // buffer. Really should flush the queue too, but any errors should have no visual effect
+            flush_batch(m, ps_ptr);
+         }  // end of wave loop
+
+         points_guessed += resolve_deferred(m, t); // the rest are done at the end
+      }
+
+      // Fused palette mapping: map the tile while it's still in the cache (see map_tile_fused)
+      if (m->fused && !calc_cancelled(m, t))
+         map_tile_fused(m, t, s);
+   }        // end of tile loop
+
+   if (!calc_cancelled(m, t))
+      points_guessed += finish_deferred(m, t);
+   t->num_deferred = 0;
+
+   t->total_iters += ps_ptr->iterctr - start_iterctr; // accumulate iters, for thread load balance measurement
+   if (!m->glitch_pass)
+      t->points_guessed = points_guessed;
+
+   flush_queue(m, ps_ptr);
+
+   // The points fused palette mapping skipped are all stored now (if cancelled, man_calculate
+   // maps the image)
+   if (m->fused && !calc_cancelled(m, t))
+      for (i = 0; i < t->fused_skips; i++)
+         map_point(m, t->fused_skip[i]);
+   t->fused_skips = 0;
+}
+
+// Kernel dispatch table. Each entry is an iteration function with its queuing function and
+// the CPU features it needs, widest first. detect_cpu_features copies the entries the CPU
+// supports to kernel_table at startup, and man_setup uses the first one that matches the
+// precision and algorithm (and the kernel override, if any). The C version isn't in the table;
+// it's used if nothing else matches.
+
+typedef struct
+{
+   char *name;
+   int level;                    // KERNEL_* level, for the override
+   unsigned features;            // required CPU_* features
+   int precision;                // PRECISION_SINGLE, PRECISION_DOUBLE or PRECISION_EXTENDED (the
+                                 // fixed point kernels are C only, so aren't in the table)
+   int fma;                      // 1 if this is an FMA version (for ALG_FMA)
+   int perturb;                  // PERTURB_* if this is a perturbation version (deep images)
+   int de;                       // 1 if this is a distance estimation version (see de_estimate)
+   int formula;                  // FORMULA_* iterated (see FORMULA_ITERATE)
+   int chains;                   // independent vector chains in the loop (0 for the perturbation,
+                                 // double-double and DE kernels). See the multi-chain iteration functions.
+   unsigned points;              // points iterated in parallel (queue size)
+   unsigned flops_per_iter;      // see man_calc_struct
+   unsigned queue_init;          // initial queue_status
+   unsigned (*iterate)(man_pointstruct *ps_ptr);
+   unsigned (*iterate_intel)(man_pointstruct *ps_ptr); // for ALG_INTEL; NULL if same as iterate
+   void (FASTCALL *queue_point)(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr);
+   void (FASTCALL *queue_batch)(void *calc_struct, man_pointstruct *ps_ptr); // NULL if none
+}
+kernel_entry;
+
+#define QUEUE_INIT_4 ((QUEUE_FULL << 12) | (3 << 9) | (2 << 6) | (1 << 3) | 0)
+#define QUEUE_INIT_8 ((QUEUE_FULL << 24) | (7 << 21) | (6 << 18) | (5 << 15) | \
+                                           (4 << 12) | (3 << 9) | (2 << 6) | (1 << 3) | 0)
+
+static const kernel_entry all_kernels[] =
+{
+   #ifdef USE_AVX512_KERNELS
+   {"AVX-512 floatexp perturbation", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 0, PERTURB_FLOATEXP, 0, 0, 0, 16,
+    PERTURB_FE_FLOPS_PER_ITER, QUEUE_FREE_16, iterate_perturb_fe_avx512, NULL, queue_16point_perturb_fe, NULL},
+   {"AVX-512 perturbation", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 0, PERTURB_DOUBLE, 0, 0, 0, 16, PERTURB_FLOPS_PER_ITER,
+    QUEUE_FREE_16, iterate_perturb_avx512, NULL, queue_16point_perturb, NULL},
+   {"AVX-512 double-double", KERNEL_AVX512, CPU_AVX512, PRECISION_EXTENDED, 0, 0, 0, 0, 0, 8, DD_FLOPS_PER_ITER,
+    QUEUE_FREE_8, iterate_dd_avx512, NULL, queue_8point_dd, NULL},
+   {"AVX-512 DE", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 0, 0, 1, 0, 0, 16, DE_FLOPS_PER_ITER,
+    QUEUE_FREE_16, iterate_de_avx512, NULL, queue_16point_de, NULL},
+   {"AVX-512 FMA", KERNEL_AVX512, CPU_AVX512, PRECISION_SINGLE, 1, 0, 0, 0, 2, 32, 10, QUEUE_FREE_32,
+    iterate_avx512_fma_s, NULL, queue_32point_avx512, queue_batch_32point_avx512_fma},
+   {"AVX-512 FMA", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 1, 0, 0, 0, 2, 16, 10, QUEUE_FREE_16,
+    iterate_avx512_fma, NULL, queue_16point_avx512, queue_batch_16point_avx512_fma},
+   {"AVX-512 FMA (4 chains)", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 1, 0, 0, 0, 4, 32, 10, QUEUE_FREE_32,
+    iterate_avx512_fma_4chain, NULL, queue_avx512_4chain, queue_batch_avx512_fma_4chain},
+   {"AVX-512 FMA (3 chains)", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 1, 0, 0, 0, 3, 24, 10, QUEUE_FREE_24,
+    iterate_avx512_fma_3chain, NULL, queue_avx512_3chain, queue_batch_avx512_fma_3chain},
+   {"AVX-512", KERNEL_AVX512, CPU_AVX512, PRECISION_SINGLE, 0, 0, 0, 0, 2, 32, 9, QUEUE_FREE_32,
+    iterate_avx512_s, NULL, queue_32point_avx512, queue_batch_32point_avx512},
+   {"AVX-512", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 0, 0, 0, 0, 2, 16, 9, QUEUE_FREE_16,
+    iterate_avx512, NULL, queue_16point_avx512, queue_batch_16point_avx512},
+   {"AVX-512 (4 chains)", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 0, 0, 0, 0, 4, 32, 9, QUEUE_FREE_32,
+    iterate_avx512_4chain, NULL, queue_avx512_4chain, queue_batch_avx512_4chain},
+   {"AVX-512 (3 chains)", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 0, 0, 0, 0, 3, 24, 9, QUEUE_FREE_24,
+    iterate_avx512_3chain, NULL, queue_avx512_3chain, queue_batch_avx512_3chain},
+   {"AVX-512 Multibrot z^3", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 0, 0, 0, FORMULA_MULTIBROT3, 2, 16, 11, QUEUE_FREE_16,
+    iterate_avx512_multibrot3, NULL, queue_16point_avx512, NULL},
+   {"AVX-512 Multibrot z^4", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 0, 0, 0, FORMULA_MULTIBROT4, 2, 16, 12, QUEUE_FREE_16,
+    iterate_avx512_multibrot4, NULL, queue_16point_avx512, NULL},
+   {"AVX-512 Burning Ship", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 0, 0, 0, FORMULA_BURNING_SHIP, 2, 16, 10, QUEUE_FREE_16,
+    iterate_avx512_burning_ship, NULL, queue_16point_avx512, NULL},
+   {"AVX-512 Tricorn", KERNEL_AVX512, CPU_AVX512, PRECISION_DOUBLE, 0, 0, 0, FORMULA_TRICORN, 2, 16, 9, QUEUE_FREE_16,
+    iterate_avx512_tricorn, NULL, queue_16point_avx512, NULL},
+   #endif
+   #ifdef USE_AVX_KERNELS
+   {"AVX2 perturbation", KERNEL_AVX, CPU_AVX2, PRECISION_DOUBLE, 0, PERTURB_DOUBLE, 0, 0, 0, 8, PERTURB_FLOPS_PER_ITER,
+    QUEUE_FREE_8, iterate_perturb_avx2, NULL, queue_8point_perturb, NULL},
+   {"AVX double-double", KERNEL_AVX, CPU_AVX | CPU_FMA, PRECISION_EXTENDED, 0, 0, 0, 0, 0, 8, DD_FLOPS_PER_ITER,
+    QUEUE_FREE_8, iterate_dd_avx, NULL, queue_8point_dd, NULL},
+   {"AVX DE", KERNEL_AVX, CPU_AVX, PRECISION_DOUBLE, 0, 0, 1, 0, 0, 8, DE_FLOPS_PER_ITER,
+    QUEUE_FREE_8, iterate_de_avx, NULL, queue_8point_de, NULL},
+   {"AVX FMA", KERNEL_AVX, CPU_AVX | CPU_FMA, PRECISION_SINGLE, 1, 0, 0, 0, 2, 16, 10, QUEUE_FREE_16,
+    iterate_avx_fma_s, NULL, queue_16point_avx, NULL},
+   {"AVX FMA (4 chains)", KERNEL_AVX, CPU_AVX | CPU_FMA, PRECISION_SINGLE, 1, 0, 0, 0, 4, 32, 10, QUEUE_FREE_32,
+    iterate_avx_fma_s_4chain, NULL, queue_avx_s_4chain, NULL},
+   {"AVX FMA (3 chains)", KERNEL_AVX, CPU_AVX | CPU_FMA, PRECISION_SINGLE, 1, 0, 0, 0, 3, 24, 10, QUEUE_FREE_24,
+    iterate_avx_fma_s_3chain, NULL, queue_avx_s_3chain, NULL},
+   {"AVX FMA", KERNEL_AVX, CPU_AVX | CPU_FMA, PRECISION_DOUBLE, 1, 0, 0, 0, 2, 8, 10, QUEUE_FREE_8,
+    iterate_avx_fma, NULL, queue_8point_avx, NULL},
+   {"AVX FMA (4 chains)", KERNEL_AVX, CPU_AVX | CPU_FMA, PRECISION_DOUBLE, 1, 0, 0, 0, 4, 16, 10, QUEUE_FREE_16,
+    iterate_avx_fma_4chain, NULL, queue_avx_4chain, NULL},
+   {"AVX FMA (3 chains)", KERNEL_AVX, CPU_AVX | CPU_FMA, PRECISION_DOUBLE, 1, 0, 0, 0, 3, 12, 10, QUEUE_FREE_12,
+    iterate_avx_fma_3chain, NULL, queue_avx_3chain, NULL},
+   {"AVX", KERNEL_AVX, CPU_AVX, PRECISION_SINGLE, 0, 0, 0, 0, 2, 16, 9, QUEUE_FREE_16,
+    iterate_avx_s, NULL, queue_16point_avx, NULL},
+   {"AVX (4 chains)", KERNEL_AVX, CPU_AVX, PRECISION_SINGLE, 0, 0, 0, 0, 4, 32, 9, QUEUE_FREE_32,
+    iterate_avx_s_4chain, NULL, queue_avx_s_4chain, NULL},
+   {"AVX (3 chains)", KERNEL_AVX, CPU_AVX, PRECISION_SINGLE, 0, 0, 0, 0, 3, 24, 9, QUEUE_FREE_24,
+    iterate_avx_s_3chain, NULL, queue_avx_s_3chain, NULL},
+   {"AVX", KERNEL_AVX, CPU_AVX, PRECISION_DOUBLE, 0, 0, 0, 0, 2, 8, 9, QUEUE_FREE_8,
+    iterate_avx, NULL, queue_8point_avx, NULL},
+   {"AVX (4 chains)", KERNEL_AVX, CPU_AVX, PRECISION_DOUBLE, 0, 0, 0, 0, 4, 16, 9, QUEUE_FREE_16,
+    iterate_avx_4chain, NULL, queue_avx_4chain, NULL},
+   {"AVX (3 chains)", KERNEL_AVX, CPU_AVX, PRECISION_DOUBLE, 0, 0, 0, 0, 3, 12, 9, QUEUE_FREE_12,
+    iterate_avx_3chain, NULL, queue_avx_3chain, NULL},
+   {"AVX Multibrot z^3", KERNEL_AVX, CPU_AVX, PRECISION_DOUBLE, 0, 0, 0, FORMULA_MULTIBROT3, 2, 8, 11, QUEUE_FREE_8,
+    iterate_avx_multibrot3, NULL, queue_8point_avx, NULL},
+   {"AVX Multibrot z^4", KERNEL_AVX, CPU_AVX, PRECISION_DOUBLE, 0, 0, 0, FORMULA_MULTIBROT4, 2, 8, 12, QUEUE_FREE_8,
+    iterate_avx_multibrot4, NULL, queue_8point_avx, NULL},
+   {"AVX Burning Ship", KERNEL_AVX, CPU_AVX, PRECISION_DOUBLE, 0, 0, 0, FORMULA_BURNING_SHIP, 2, 8, 10, QUEUE_FREE_8,
+    iterate_avx_burning_ship, NULL, queue_8point_avx, NULL},
+   {"AVX Tricorn", KERNEL_AVX, CPU_AVX, PRECISION_DOUBLE, 0, 0, 0, FORMULA_TRICORN, 2, 8, 9, QUEUE_FREE_8,
+    iterate_avx_tricorn, NULL, queue_8point_avx, NULL},
+   #endif
+   #ifdef USE_ASM_ITERATE
+   {"SSE", KERNEL_SSE, CPU_SSE, PRECISION_SINGLE, 0, 0, 0, 0, 2, 8, 9, QUEUE_INIT_8,
+    iterate_amd_sse, iterate_intel_sse, queue_8point_sse, NULL},
+   {"SSE2", KERNEL_SSE, CPU_SSE2, PRECISION_DOUBLE, 0, 0, 0, 0, 2, 4, 9, QUEUE_INIT_4,
+    iterate_amd_sse2, iterate_intel_sse2, queue_4point_sse2, NULL},
+   #else
+   {"SSE", KERNEL_SSE, CPU_SSE, PRECISION_SINGLE, 0, 0, 0, 0, 2, 8, 9, QUEUE_INIT_8,
+    iterate_sse, NULL, queue_8point_sse, NULL},
+   {"SSE2", KERNEL_SSE, CPU_SSE2, PRECISION_DOUBLE, 0, 0, 0, 0, 2, 4, 9, QUEUE_INIT_4,
+    iterate_sse2, NULL, queue_4point_sse2, NULL},
+   #endif
+   {"SSE2 Multibrot z^3", KERNEL_SSE, CPU_SSE2, PRECISION_DOUBLE, 0, 0, 0, FORMULA_MULTIBROT3, 2, 4, 11, QUEUE_INIT_4,
+    iterate_sse2_multibrot3, NULL, queue_4point_sse2, NULL},
+   {"SSE2 Multibrot z^4", KERNEL_SSE, CPU_SSE2, PRECISION_DOUBLE, 0, 0, 0, FORMULA_MULTIBROT4, 2, 4, 12, QUEUE_INIT_4,
+    iterate_sse2_multibrot4, NULL, queue_4point_sse2, NULL},
+   {"SSE2 Burning Ship", KERNEL_SSE, CPU_SSE2, PRECISION_DOUBLE, 0, 0, 0, FORMULA_BURNING_SHIP, 2, 4, 10, QUEUE_INIT_4,
+    iterate_sse2_burning_ship, NULL, queue_4point_sse2, NULL},
+   {"SSE2 Tricorn", KERNEL_SSE, CPU_SSE2, PRECISION_DOUBLE, 0, 0, 0, FORMULA_TRICORN, 2, 4, 9, QUEUE_INIT_4,
+    iterate_sse2_tricorn, NULL, queue_4point_sse2, NULL},
+};
+
+static const kernel_entry *kernel_table[NUM_ELEM(all_kernels)];   // entries the CPU supports
+static int num_kernels = 0;
+
+// Find the kernel to use for the given precision, fma, perturbation and distance estimation
+// flags, formula, and max KERNEL_* level. Returns NULL if there's none (use C). If chains is
+// nonzero, prefers the version with that many chains at the level found (falls back to the
+// first one if there's none).
+static const kernel_entry *find_kernel(int precision, int fma, int perturb, int de, int formula,
+                                       int max_level, int chains)
+{
+   int i;
+   const kernel_entry *k, *first;
+
+   first = NULL;
+   for (i = 0; i < num_kernels; i++)
+   {
+      k = kernel_table[i];
+      if (k->precision == precision && k->fma == fma && k->perturb == perturb && k->de == de &&
+          k->formula == formula && k->level <= max_level)
+      {
+         if (first == NULL)
+            first = k;
+         else if (k->level != first->level)
+            break;
+         if (!chains || k->chains == chains)
+            return k;
+      }
+   }
+   return first;
+}
+
+// Check for precision loss- occurs if the two doubles (or converted floats)
+// in ptest are equal to each other. Returns PLOSS_FLOAT for float loss,
+// PLOSS_DOUBLE for double loss, etc. or 0 for no loss.
+
+// New more conservative version demands that bits beyond the lsb should also
+// differ. If only the lsb differs, bound to get degradation during iteration.
+
+#define PLOSS_FIXED128  16
+#define PLOSS_FIXED64   8
+#define PLOSS_EXTENDED  4
+#define PLOSS_DOUBLE    2
+#define PLOSS_FLOAT     1
+
+int check_precision_loss(double *ptest)
+{
+   float f[2];
+   int i0[2], i1[2];
+
+   // Check double loss
+   i0[0] = *((int *) &ptest[0]) & ~1;  // get low dword of 1st double; mask off lsb
+   i0[1] = *((int *) &ptest[0] + 1);   // get high dword
+
+   i1[0] = *((int *) &ptest[1]) & ~1;  // get low dword of 2nd double; mask off lsb
+   i1[1] = *((int *) &ptest[1] + 1);   // get high dword
+
+   if ((i0[1] == i1[1]) && (i0[0] == i1[0]))
+      return PLOSS_DOUBLE | PLOSS_FLOAT; // double loss is also float loss
+
+   // Check float loss
+   f[0] = (float) ptest[0];            // convert doubles to floats
+   f[1] = (float) ptest[1];
+
+   i0[0] = *((int *) &f[0]) & ~1;      // get 1st float; mask off lsb
+   i1[0] = *((int *) &f[1]) & ~1;      // get 2nd float; mask off lsb
+
+   if (i0[0] == i1[0])
+      return PLOSS_FLOAT;
+
+   return 0;
+}
+
+// Double-double version. There's no lsb to mask off, so demand that consecutive values differ
+// by more than rel relative. The rounding errors build up over the iterations (much faster than
+// the pixel differences near minibrots), so the caller scales rel with max_iters.
+static int check_precision_loss_dd(double *hi, double *lo, double rel)
+{
+   double d;
+
+   d = (hi[1] - hi[0]) + (lo[1] - lo[0]);
+   if (fabs(d) <= fabs(hi[0]) * rel)
+      return PLOSS_EXTENDED;
+   return 0;
+}
+
+// Fixed point version. The values are evenly spaced, so it only depends on the pixel spacing:
+// like the above, demand that it's more than the lsb (2 lsbs or more). Returns PLOSS_FIXED64 if
+// the 64-bit kernel would lose precision, plus PLOSS_FIXED128 if the 128-bit one would too.
+static int check_precision_loss_fixed(double spacing)
+{
+   if (spacing < ldexp(2.0, -FIXED_FRAC_BITS - 64))
+      return PLOSS_FIXED128 | PLOSS_FIXED64;
+   if (spacing < ldexp(2.0, -FIXED_FRAC_BITS))
+      return PLOSS_FIXED64;
+   return 0;
+}
+
+// Set the re/im arrays (and their low parts) to double-double coordinates, for the extended
+// precision kernels. The center comes from the high precision re/im; each offset is added with
+// an exact two-sum. Returns any extended precision loss (not checked if saving).
+//
+// The loss threshold is 2^-82 * max_iters relative. A fixed 2^-100 left about 5% of the pixels
+// wrong at mag 1e25 with 6750 iters near a minibrot; compared against the 128-bit fixed point
+// kernel, double-double stops beating perturbation at around 3e19 there, which is where this
+// switches.
+static int set_dd_coords(man_calc_struct *m, int xstart, int xend, int ystart, int yend)
+{
+   int x, y, ploss, check;
+   long long step;
+   double ch, cl, d, s, v, e, rel;
+
+   ploss = 0;
+   check = !(m->flags & FLAG_IS_SAVE);
+   rel = ldexp((double) m->max_iters, -82);
+
+   if (m->flags & FLAG_CALC_RE_ARRAY)
+   {
+      hp_to_dd(&m->re_hp, &ch, &cl);
+      step = -(m->xsize >> 1) + xstart + m->pan_xoffs;
+      for (x = xstart; x <= xend; x++)
+      {
+         d = get_re_im_offs(m, step++);
+         s = ch + d;
+         v = s - ch;
+         e = (ch - (s - v)) + (d - v) + cl;
+         m->img_re[x] = s + e;
+         m->img_re_lo[x] = e - (m->img_re[x] - s);
+         if (check && x > xstart)
+            ploss |= check_precision_loss_dd(&m->img_re[x - 1], &m->img_re_lo[x - 1], rel);
+      }
+   }
+
+   hp_to_dd(&m->im_hp, &ch, &cl);
+   step = -(m->ysize >> 1) + ystart + m->pan_yoffs;
+   for (y = ystart; y <= yend; y++)
+   {
+      d = -get_re_im_offs(m, step++);
+      s = ch + d;
+      v = s - ch;
+      e = (ch - (s - v)) + (d - v) + cl;
+      m->img_im[y] = s + e;
+      m->img_im_lo[y] = e - (m->img_im[y] - s);
+      if (check && y > ystart)
+         ploss |= check_precision_loss_dd(&m->img_im[y - 1], &m->img_im_lo[y - 1], rel);
+   }
+   return ploss;
+}
+
+// Set up the fixed point coordinates: m->fixed_re/fixed_im get the high precision re/im, and
+// the low part arrays get the offset of each pixel from them (the queue function adds the
+// two). Returns any fixed point precision loss (not checked if saving).
+static int set_fixed_coords(man_calc_struct *m, int xstart, int xend, int ystart, int yend)
+{
+   int x, y;
+   long long step;
+
+   hp_to_fixed(&m->re_hp, &m->fixed_re);
+   hp_to_fixed(&m->im_hp, &m->fixed_im);
+
+   if (m->flags & FLAG_CALC_RE_ARRAY)
+   {
+      step = -(m->xsize >> 1) + xstart + m->pan_xoffs;
+      for (x = xstart; x <= xend; x++)
+         m->img_re_lo[x] = get_re_im_offs(m, step++);
+   }
+
+   step = -(m->ysize >> 1) + ystart + m->pan_yoffs;
+   for (y = ystart; y <= yend; y++)
+      m->img_im_lo[y] = -get_re_im_offs(m, step++);
+
+   return (m->flags & FLAG_IS_SAVE) ? 0 : check_precision_loss_fixed(get_re_im_offs(m, 1));
+}
+
+// Smallest pixel delta for the double perturbation kernels. Past this (magnification around
+// 1e290) the deltas would underflow, so the floatexp kernels take over.
+#define PERTURB_MIN_DELTA  1e-290
+
+// Set the re/im arrays to the deltas of each point from a perturbation reference point, which is
+// at pixel offset (ref_xoffs, ref_yoffs) from re/im. The offsets are in the same units as the
+// steps used for the arrays in man_setup (i.e., include the pan offsets). For the floatexp
+// kernels, the arrays get the deltas times 2^-delta_exp.
+static void set_perturb_deltas(man_calc_struct *m, int xstart, int xend, int ystart, int yend,
+                               long long ref_xoffs, long long ref_yoffs)
+{
+   int x, y;
+   long long step;
+
+   step = -(m->xsize >> 1) + xstart + m->pan_xoffs - ref_xoffs;
+   for (x = xstart; x <= xend; x++)
+      m->img_re[x] = (m->perturb == PERTURB_FLOATEXP) ? get_re_im_offs_fe(m, step++).val :
+                                                        get_re_im_offs(m, step++);
+
+   step = -(m->ysize >> 1) + ystart + m->pan_yoffs - ref_yoffs;
+   for (y = ystart; y <= yend; y++)
+      m->img_im[y] = (m->perturb == PERTURB_FLOATEXP) ? -get_re_im_offs_fe(m, step++).val :
+                                                        -get_re_im_offs(m, step++);
+}
+
+// Exponent of the deltas from set_perturb_deltas
+static int get_delta_exp(man_calc_struct *m)
+{
+   return (m->perturb == PERTURB_FLOATEXP) ? get_re_im_offs_fe(m, 1).exp : 0;
+}
+
+// Set iteration and queue_point function pointers and the initial queue status, from the widest
+// kernel available (up to the override level). The FMA algs fall back to the non-FMA
+// versions if the CPU doesn't support FMA. Alg will always be C if there's no SSE support
+// (no SSE2 support for double).
+// Should change algorithm in dialog box if it's reset to C here. Uses the DE kernels if m->de
+// is set (see man_setup), and the formula kernels for the other formulas. Julia mode uses the
+// same kernels as the Mandelbrot set (the queue functions set the starting z).
+static void set_kernel(man_calc_struct *m)
+{
+   int max_level, chains, prec, intel;
+   const kernel_entry *k;
+
+   // Use the autotuned kernel level and chains unless the kernel is overridden (see autotune).
+   // The chains were timed at the tuned level only. Not for the perturbation kernels, which
+   // only some levels have.
+   max_level = m->kernel ? m->kernel : KERNEL_MAX;
+   chains = m->chains;
+   prec = m->de ? PRECISION_DOUBLE : m->precision;
+   if (!m->perturb && !m->kernel && prec >= PRECISION_SINGLE && prec <= PRECISION_EXTENDED &&
+       TUNED_KERNEL(kernel_tuning, prec))
+   {
+      max_level = TUNED_KERNEL(kernel_tuning, prec);
+      if (!chains)
+         chains = TUNED_CHAINS(kernel_tuning, prec);
+   }
+   intel = ALG_TYPE(m->alg) == ALG_INTEL || (ALG_TYPE(m->alg) == ALG_AMD && (kernel_tuning & TUNED_INTEL));
+
+   k = NULL;
+   if (ALG_TYPE(m->alg) != ALG_C && max_level > KERNEL_C)
+   {
+      if (m->de)
+         k = find_kernel(PRECISION_DOUBLE, 0, 0, 1, 0, max_level, 0);
+      else if (m->formula)
+         k = find_kernel(PRECISION_DOUBLE, 0, 0, 0, m->formula, max_level, 0);
+      else
+      {
+         if (ALG_TYPE(m->alg) == ALG_FMA)
+            k = find_kernel(m->perturb ? PRECISION_DOUBLE : m->precision, 1, m->perturb, 0, 0, max_level, chains);
+         if (k == NULL)
+            k = find_kernel(m->perturb ? PRECISION_DOUBLE : m->precision, 0, m->perturb, 0, 0, max_level, chains);
+      }
+   }
+
+   // The ASM kernels keep the point states in a different form, so can't start from z in
+   // Julia mode (see set_start_point). The batch queues always start from z = 0.
+   #ifdef USE_ASM_ITERATE
+   if (m->julia && k != NULL && k->iterate_intel != NULL)
+      k = NULL;
+   #endif
+
+   m->queue_batch = NULL;
+   if (k == NULL && m->perturb)
+   {
+      m->queue_point = queue_point_perturb_c;
+      m->iters_per_tick = 1;
+      m->queue_init = 1; // no queue; slot 0 always free (see flush_perturb_queue)
+      if (m->perturb == PERTURB_FLOATEXP)
+      {
+         m->mandel_iterate = iterate_perturb_fe_c;
+         m->flops_per_iter = PERTURB_FE_FLOPS_PER_ITER;
+         m->kernel_name = "C floatexp perturbation";
+      }
+      else
+      {
+         m->mandel_iterate = iterate_perturb_c;
+         m->flops_per_iter = PERTURB_FLOPS_PER_ITER;
+         m->kernel_name = "C perturbation";
+      }
+   }
+   else if (k == NULL && m->de)
+   {
+      m->queue_point = queue_point_c;
+      m->mandel_iterate = iterate_de_c;
+      m->iters_per_tick = 1;
+      m->flops_per_iter = DE_FLOPS_PER_ITER;
+      m->kernel_name = "C DE";
+      m->queue_init = 0;
+   }
+   else if (k == NULL && m->formula)
+   {
+      m->queue_point = queue_point_c;
+      m->mandel_iterate = formula_c[m->formula];
+      m->iters_per_tick = 1;
+      m->flops_per_iter = formula_flops[m->formula];
+      m->kernel_name = formula_c_names[m->formula];
+      m->queue_init = 0;
+   }
+   else if (k == NULL && m->precision == PRECISION_FIXED)
+   {
+      m->queue_point = queue_4point_fixed;
+      m->mandel_iterate = (m->fixed_bits == 128) ? iterate_fixed128 : iterate_fixed64;
+      m->iters_per_tick = FIXED_POINTS;
+      m->flops_per_iter = FIXED_FLOPS_PER_ITER;
+      m->kernel_name = (m->fixed_bits == 128) ? "C 128-bit fixed point" : "C 64-bit fixed point";
+      m->queue_init = FIXED_QUEUE_INIT;
+   }
+   else if (k == NULL && m->precision == PRECISION_EXTENDED)
+   {
+      m->queue_point = queue_point_c;
+      m->mandel_iterate = iterate_dd_c;
+      m->iters_per_tick = 1;
+      m->flops_per_iter = DD_FLOPS_PER_ITER;
+      m->kernel_name = "C double-double";
+      m->queue_init = 0;
+   }
+   else if (k == NULL)
+   {
+      m->queue_point = queue_point_c;
+      m->mandel_iterate = iterate_c; // Unoptimized C algorithm
+      m->iters_per_tick = 1;
+      m->flops_per_iter = 9;
+      m->kernel_name = "C";
+      m->queue_init = 0;
+   }
+   else
+   {
+      m->queue_point = k->queue_point;
+      m->queue_batch = m->julia ? NULL : k->queue_batch;
+      m->mandel_iterate = (intel && k->iterate_intel != NULL) ? k->iterate_intel : k->iterate;
+      m->iters_per_tick = k->points;
+      m->flops_per_iter = k->flops_per_iter;
+      m->kernel_name = k->name;
+      m->queue_init = k->queue_init;
+   }
+   m->kernel_single = k != NULL && k->precision == PRECISION_SINGLE;
+}
+
+// Calculate the real and imaginary arrays for the current rectangle, set precision/algorithm,
+// and do other misc setup operations. Call before starting mandelbrot calculation.
+
+// Panning is now tracked as an offset from re/im, so the current rectangle is offset from
+// re/im by pan_xoffs + xstart / 2 and pan_yoffs + ystart / 2.
+
+void man_setup(man_calc_struct *m, int xstart, int xend, int ystart, int yend) // sms
+{
+   int i, x, y, xsize, ysize, ploss, max_level;
+   long long step;
+   double tol, min_tol;
+   unsigned flags;
+   man_pointstruct *ps_ptr;
+
+   m->max_iters &= ~1;     // make max iters even- required by optimized alg
+   normalize_mag(m);
+   xsize = m->xsize;
+   ysize = m->ysize;
+   flags = m->flags;
+
+   sync_re_im_hp(m);
+
+   // Make re/im arrays, to avoid doing xsize * ysize flops in the main loop.
+   // Also check for precision loss (two consecutive values equal or differing only in the lsb)
+
+   // Cut overhead by only going from start to end - not whole image size
+   // Need to do more than 1 point to detect precision loss... otherwise auto mode won't work.
+   // To be safe use at least 4 (allocate 4 extra).
+
+   // Updated to use offsets (pan_xoffs and pan_yoffs) for panning, rather than updating re/im
+   // on every pan. These are added in below. See comments at top (bug fix)
+
+   // If saving, don't check precision loss, and don't recalculate the re array
+   // after the first row.
+
+   if (!(flags & FLAG_IS_SAVE))
+   {
+      xend += 4;  // only need these for non-save (precision loss checking)
+      yend += 4;
+   }
+
+   ploss = 0;
+   if (flags & FLAG_CALC_RE_ARRAY) // this flag should be 1 for main calculation
+   {
+      x = xstart;
+      step = -(xsize >> 1) + xstart + m->pan_xoffs;
+      do
+      {
+         m->img_re[x] = m->re + get_re_im_offs(m, step++);
+         if (!(flags & FLAG_IS_SAVE) && x > xstart)
+            ploss |= check_precision_loss(&m->img_re[x - 1]);
+      }
+      while (++x <= xend);
+   }
+
+   step = -(ysize >> 1) + ystart + m->pan_yoffs;
+   y = ystart;
+   do
+   {
+      m->img_im[y] = m->im - get_re_im_offs(m, step++);
+      if (!(flags & FLAG_IS_SAVE) && y > ystart)
+         ploss |= check_precision_loss(&m->img_im[y - 1]);
+   }
+   while (++y <= yend);
+
+   if (!(flags & FLAG_IS_SAVE)) // only do auto precision if not saving
+   {
+      m->precision_loss = 0;
+      m->perturb = 0;
+      m->glitches = 0;
+
+      // Set precision loss flag. If in auto precision mode, set single, double, or extended
+      // calculation precision based on loss detection (or fixed point past single, if auto_fixed
+      // is set). Double precision switches to the perturbation engine instead of losing
+      // precision; extended and fixed point do too (below), once they run out.
+      i = m->precision;
+      switch (m->precision)
+      {
+         case PRECISION_AUTO:
+            m->precision = PRECISION_SINGLE;
+            if (ploss & PLOSS_FLOAT)
+               m->precision = m->auto_fixed ? PRECISION_FIXED : PRECISION_DOUBLE;
+            if ((ploss & PLOSS_DOUBLE) && !m->auto_fixed)
+               m->precision = PRECISION_EXTENDED;
+            break;
+         case PRECISION_DOUBLE:
+            if (ploss & PLOSS_DOUBLE)
+               m->perturb = PERTURB_DOUBLE;
+            break;
+         case PRECISION_SINGLE:
+            if (ploss & PLOSS_FLOAT)
+               m->precision_loss = 1;
+            break;
+         default:
+            break;
+      }
+
+      // The other formulas only have double precision kernels (single uses them too). Julia
+      // mode is double precision only too (no perturbation: there's no reference orbit
+      // that works for all the starting z's).
+      if (m->formula != FORMULA_MANDELBROT || m->julia)
+      {
+         m->precision = PRECISION_DOUBLE;
+         m->precision_loss = (ploss & PLOSS_DOUBLE) != 0;
+         m->perturb = 0;
+      }
+
+      if (m->precision == PRECISION_EXTENDED &&
+          (set_dd_coords(m, xstart, xend, ystart, yend) & PLOSS_EXTENDED))
+      {
+         m->perturb = PERTURB_DOUBLE;
+         if (i == PRECISION_AUTO)
+            m->precision = PRECISION_DOUBLE;
+      }
+
+      // Fixed point: 64-bit until it loses precision, then 128-bit
+      if (m->precision == PRECISION_FIXED)
+      {
+         ploss = set_fixed_coords(m, xstart, xend, ystart, yend);
+         m->fixed_bits = (ploss & PLOSS_FIXED64) ? 128 : 64;
+         if (ploss & PLOSS_FIXED128)
+         {
+            m->perturb = PERTURB_DOUBLE;
+            if (i == PRECISION_AUTO)
+               m->precision = PRECISION_DOUBLE;
+         }
+      }
+   }
+   else if (m->precision == PRECISION_EXTENDED && !m->perturb)
+      set_dd_coords(m, xstart, xend, ystart, yend);
+   else if (m->precision == PRECISION_FIXED && !m->perturb)
+      set_fixed_coords(m, xstart, xend, ystart, yend);
+
+   // Perturbation: calculate the reference orbit for the image center (if it changed), and
+   // make the re/im arrays hold the deltas from it. The deltas are exact at any magnification
+   // (past the double range, they're floatexps). The limit is the high precision re/im.
+   if (m->perturb)
+   {
+      m->perturb = (get_re_im_offs(m, 1) < PERTURB_MIN_DELTA) ? PERTURB_FLOATEXP : PERTURB_DOUBLE;
+
+      i = hp_limbs_for_mag(m->mag, m->mag_exp);
+      if (i > HP_LIMBS || !perturb_ref_calc(&m->ref[0], &m->re_hp, &m->im_hp, m->max_iters, i))
+      {
+         m->perturb = 0;
+         m->precision_loss = 1;
+      }
+      else
+      {
+         // Skip the iterations where all the points can be approximated by a series
+         set_perturb_deltas(m, xstart, xend, ystart, yend, 0, 0);
+         perturb_series_calc(&m->series, &m->ref[0], m->img_re[xstart], m->img_re[xend],
+                             m->img_im[ystart], m->img_im[yend], get_delta_exp(m));
+      }
+   }
+   if (!m->perturb)
+      m->series.iters = 0;
+
+   // Distance estimates are needed for DE shading. The DE kernels are double precision only
+   // (used for single too), and not for deep images, the other formulas or Julia mode.
+   m->de = !m->perturb && m->formula == FORMULA_MANDELBROT && !m->julia &&
+           (m->precision == PRECISION_SINGLE || m->precision == PRECISION_DOUBLE) &&
+           m->rendering_alg == RALG_DE;
+   m->de_scale = 1.0 / get_re_im_offs(m, 1);
+   set_kernel(m);
+
+   max_level = m->kernel ? m->kernel : KERNEL_MAX;
+
+   // Interior pre-pass (see interior_mask_c). Mandelbrot set only
+   m->interior_mask = NULL;
+   if (!m->perturb && m->formula == FORMULA_MANDELBROT && !m->julia && m->precision != PRECISION_EXTENDED && m->precision != PRECISION_FIXED)
+   {
+      m->interior_mask = interior_mask_c;
+      #ifdef USE_AVX_KERNELS
+      if ((cpu_features & CPU_AVX) && ALG_TYPE(m->alg) != ALG_C && max_level >= KERNEL_AVX)
+         m->interior_mask = interior_mask_avx;
+      #endif
+   }
+
+   // Periodicity tolerance, for the kernels that check (see PERIOD_FIRST_SAVE)
+   tol = get_re_im_offs(m, 1) * PERIOD_TOL_SCALE;
+   min_tol = m->kernel_single ? PERIOD_TOL_MIN_FLOAT : PERIOD_TOL_MIN_DOUBLE;
+   if (tol < min_tol)
+      tol = min_tol;
+
+   // Set pointstruct initial values
+   for (i = 0; i < m->num_threads; i++)
+   {
+      ps_ptr = m->thread_states[i].ps_ptr;
+      ps_ptr->queue_status = m->queue_init;
+      ps_ptr->cur_max_iters = m->max_iters - m->series.iters;
+      ps_ptr->iterctr = 0;
+      ps_ptr->ref = &m->ref[0];
+      ps_ptr->series = &m->series;
+      ps_ptr->delta_exp = get_delta_exp(m);
+      ps_ptr->periodic = 0;
+      ps_ptr->period_save = PERIOD_FIRST_SAVE;
+      ps_ptr->periodic_ctr = 0;
+      ps_ptr->period_tol = tol;
+      ps_ptr->batch_n = 0;
+      ps_ptr->julia = m->julia;
+      ps_ptr->julia_c[0] = m->julia_re;
+      ps_ptr->julia_c[1] = m->julia_im;
+   }
+}
+
+// Thread pool. Each calculation structure has its own persistent threads (so saving can run in
+// parallel with the main calculation), started the first time they're needed. Between runs
+// they wait on their start events.
+//
+// Thread function overhead, benchmarks on an Athlon 64 4000+ 2.4 GHz:
+//                                                                                   Equivalent SSE2
+// Functions (tested with 4 threads)                             uS   Clock Cycles   iters (per core)
+// --------------------------------------------------------------------------------------------------
+// 4 CreateThread + WaitForMultipleObjects + 4 CloseHandle     173.0     415200      83040
+// 4 _beginthreadex + WaitForMultipleObjects + 4 CloseHandle   224.0     537600      107520
+// 4 QueueUserWorkItem + 4 SetEvent + WaitForMultipleObjects     7.6      18240      3648
+// 4 SetEvent                                                    1.0       2400      480
+// 4 Null (loop overhead + mandel function call only)            0.01        24      4
+//
+// Creating threads per calculation is on par with the iteration time while panning, negating
+// any multi-core advantage. Waking persistent threads costs about the same as the old
+// QueueUserWorkItem method, without needing a Windows (or emulated) system pool.
+//
+// On NUMA machines, the threads can be pinned to CPUs and given point structures in their own
+// node's memory (see numa_policy). The OS puts a page on the node of the thread that touches it
+// first, so the structure is copied in the thread.
+
+// Called by each pool thread when it's done with its part of a run (or with starting or
+// exiting). The last one to finish wakes the calling thread.
+static void pool_thread_done(man_calc_struct *m)
+{
+   if (!atomic_dec(&m->pool_pending))
+      SetEvent(m->pool_done_event);
+}
+
+static unsigned __stdcall pool_thread(LPVOID param)
+{
+   thread_state *t;
+   man_calc_struct *m;
+   man_pointstruct *ps_ptr;
+
+   t = (thread_state *) param;
+   m = (man_calc_struct *) t->calc_struct;
+
+   if (numa_policy >= NUMA_PIN)
+      pin_thread(t->thread_num);
+   if (numa_policy >= NUMA_LOCAL &&
+       (ps_ptr = (man_pointstruct *) aligned_malloc(sizeof(man_pointstruct), 4096)) != NULL)
+   {
+      memcpy(ps_ptr, t->ps_ptr, sizeof(man_pointstruct)); // has the constants
+      aligned_free(t->ps_ptr);
+      t->ps_ptr = ps_ptr;
+   }
+   pool_thread_done(m); // started (see start_pool)
+
+   for (;;)
+   {
+      WaitForMultipleObjects(1, &t->start_event, TRUE, INFINITE);
+      if (m->pool_func == NULL) // exiting (see stop_pool)
+         break;
+      m->pool_func(m, t);
+      pool_thread_done(m);
+   }
+
+   pool_thread_done(m);
+   return 0;
+}
+
+// Start any pool threads that aren't running yet, up to the given number (including the
+// calling thread), and wait till they're set up. Needs to be done before the point structures
+// are initialized (see pool_thread). Returns the number of threads running.
+static int start_pool(man_calc_struct *m, int threads)
+{
+   int i, n;
+
+   if (!m->pool_threads)
+      m->pool_threads = 1;
+   if ((n = m->pool_threads) >= threads)
+      return n;
+
+   m->pool_pending = threads - n;
+   for (i = n; i < threads; i++)
+      if (!start_thread(pool_thread, &m->thread_states[i]))
+         break;
+   m->pool_threads = i;
+   for (; i < threads; i++) // count off the ones that didn't start
+      pool_thread_done(m);
+   WaitForMultipleObjects(1, &m->pool_done_event, TRUE, INFINITE);
+   return m->pool_threads;
+}
+
+// Run func in the given number of threads (at most m->max_threads), and wait till they're all
+// done. The calling thread does thread 0's part, which saves some overhead and doesn't use
+// any other threads at all if there's only one. If a thread can't be started, the others do
+// its work (by stealing its tiles).
+void run_pool(man_calc_struct *m, void (*func)(void *calc_struct, thread_state *t), int threads)
+{
+   int i;
+
+   if ((i = start_pool(m, threads)) < threads)
+      threads = i;
+   m->pool_func = func;
+   m->pool_pending = threads - 1;
+   for (i = 1; i < threads; i++)
+      SetEvent(m->thread_states[i].start_event);
+
+   func(m, &m->thread_states[0]);
+
+   if (threads > 1)
+      WaitForMultipleObjects(1, &m->pool_done_event, TRUE, INFINITE);
+}
+
+// Make the pool threads exit (before freeing the structure or moving the thread states)
+static void stop_pool(man_calc_struct *m)
+{
+   int i;
+
+   if (m->pool_threads <= 1)
+      return;
+   m->pool_func = NULL;
+   m->pool_pending = m->pool_threads - 1;
+   for (i = 1; i < m->pool_threads; i++)
+      SetEvent(m->thread_states[i].start_event);
+   WaitForMultipleObjects(1, &m->pool_done_event, TRUE, INFINITE);
+   m->pool_threads = 1;
+}
+
+// Allocate the thread states (with their point structures and start events) for N threads,
+// and the tile arrays for them. The thread count isn't limited by any fixed-size arrays in the
+// calculation structure, so there's one thread per core on any machine. The pool threads are
+// stopped first, since they point into the thread states, which can move. Returns 0 on failure;
+// max_threads is the number of thread states that are usable in any case.
+
+static int alloc_threads(man_calc_struct *m, int n)
+{
+   thread_state *t;
+   man_pointstruct *ps_ptr;
+   void *p;
+   int i;
+
+   stop_pool(m);
+
+   if ((p = realloc(m->thread_states, n * sizeof(thread_state))) == NULL)
+      return 0;
+   m->thread_states = (thread_state *) p;
+
+   // Tile arrays (see make_tiles): the tiles, the same in image order, and the band and
+   // column boundaries. For T target tiles, make_tiles can make up to 2T - 1 (rounding up the
+   // columns per band), with T + 1 band and 3T + 1 column boundaries.
+   if ((p = realloc(m->tiles, 2 * n * TILES_PER_THREAD * sizeof(stripe))) == NULL)
+      return 0;
+   m->tiles = (stripe *) p;
+   if ((p = realloc(m->tile_grid, 2 * n * TILES_PER_THREAD * sizeof(stripe))) == NULL)
+      return 0;
+   m->tile_grid = (stripe *) p;
+   if ((p = realloc(m->tile_bounds, (4 * n * TILES_PER_THREAD + 2) * sizeof(int))) == NULL)
+      return 0;
+   m->tile_bounds = (int *) p;
+
+   for (i = m->max_threads; i < n; i++, m->max_threads++)
+   {
+      t = &m->thread_states[i];
+      memset(t, 0, sizeof(thread_state));
+      t->thread_num = i;
+      t->calc_struct = m;
+
+      // Point structure (needs 64-byte alignment; see man_pointstruct), and a start event for
+      // the pool thread (see run_pool)
+      if ((ps_ptr = (man_pointstruct *) aligned_malloc(sizeof(man_pointstruct), 64)) == NULL)
+         return 0;
+      if ((t->start_event = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL)
+      {
+         aligned_free(ps_ptr);
+         return 0;
+      }
+      memset(ps_ptr, 0, sizeof(man_pointstruct));
+      t->ps_ptr = ps_ptr;
+
+      // Init 64-bit double and 32-bit float fields with divergence radius and constant 2.0
+      ps_ptr->two_d[1] = ps_ptr->two_d[0] = 2.0;
+      ps_ptr->two_f[3] = ps_ptr->two_f[2] = ps_ptr->two_f[1] = ps_ptr->two_f[0] = 2.0;
+
+      ps_ptr->rad_d[1] = ps_ptr->rad_d[0] = DIVERGED_THRESH;
+      ps_ptr->rad_f[3] = ps_ptr->rad_f[2] = ps_ptr->rad_f[1] = ps_ptr->rad_f[0] = DIVERGED_THRESH;
+   }
+   return 1;
+}
+
+// Free the thread states and tile arrays (after stop_pool)
+static void free_threads(man_calc_struct *m)
+{
+   int i;
+
+   for (i = 0; i < m->max_threads; i++)
+   {
+      aligned_free(m->thread_states[i].ps_ptr);
+      CloseHandle(m->thread_states[i].start_event);
+      free(m->thread_states[i].deferred);
+      free(m->thread_states[i].fused_skip);
+   }
+   free(m->thread_states);
+   free(m->tiles);
+   free(m->tile_grid);
+   free(m->tile_bounds);
+   m->thread_states = NULL;
+   m->tiles = m->tile_grid = NULL;
+   m->tile_bounds = NULL;
+   m->max_threads = m->num_threads = 0;
+}
+
+// Set the number of threads the structure's calculations use: num_threads, if the thread states
+// for that many can be allocated. Needs to be done before starting a calculation.
+static void set_calc_threads(man_calc_struct *m)
+{
+   if (num_threads > m->max_threads)
+      alloc_threads(m, num_threads);
+   m->num_threads = num_threads < m->max_threads ? num_threads : m->max_threads;
+}
+
+// Split the rectangle into tiles and deal them to the given number of threads. There are about
+// TILES_PER_THREAD per thread (one in all if there's only one thread), so that no thread gets
+// stuck with much more work than the others at the end. Tiles are horizontal stripes, at least
+// TILE_MIN_HEIGHT high; with too few of those, the stripes are also divided along x, down to
+// TILE_MIN_WIDTH. Thin rectangles (as often found in panning) can still be divided.
+//
+// Each thread's deque gets every Nth tile (N = threads), so the threads start out with similar
+// regions and have less stealing to do. The deques are ranges of m->tiles (see get_tile).
+
+#define TILE_RANGE(first, end)   ((unsigned long long) (first) | ((unsigned long long) (end) << 32))
+
+// Set each thread's deque to the tiles dealt to it by make_tiles (every Nth one)
+static void deal_tiles(man_calc_struct *m)
+{
+   int i, first, n;
+
+   for (i = first = 0; i < m->tile_threads; i++)
+   {
+      n = (m->num_tiles - i + m->tile_threads - 1) / m->tile_threads;
+      m->thread_states[i].tiles = TILE_RANGE(first, first + n);
+      first += n;
+   }
+}
+
+// Cost prediction for make_tiles. During realtime zooming (or any recalculation of the same
+// rectangle), each frame's iteration counts are a good guide to where the next frame's work is.
+// The counts are sampled on a TILE_SAMPLE grid (cost_sample), and the band and column
+// boundaries are placed so that each tile gets an equal share of the predicted cost.
+//
+// A sample's cost is its count plus TILE_POINT_COST for the per-pixel overhead. Only the stored
+// counts are used, not the iterations the previous calculation actually did (the pointstruct
+// iterctrs include whatever the queues happened to be padded with, which depends on timing):
+// the tiles have to come out the same every time, as guesses depend on where their edges are
+// (see make_tiles). Only the relative costs matter anyway. Returns 0 if there's nothing to
+// predict from (e.g. a new image).
+
+#define TILE_SAMPLE     4  // fast alg cell size: the first wave iterates one point per cell
+#define TILE_POINT_COST 8  // per-pixel overhead, in iterations
+
+static int predict_tiles(man_calc_struct *m, int xstart, int xend, int ystart, int yend,
+                         int *rows, int cols, int *row_bounds, int *col_bounds)
+{
+   int r, c, g, x, y, num_groups, min_size;
+   unsigned *iters_ptr;
+   double total, acc, *cost;
+
+   if (!m->last_valid || m->last_rect.xstart != xstart || m->last_rect.xend != xend ||
+       m->last_rect.ystart != ystart || m->last_rect.yend != yend)
+      return 0;
+
+   // Band costs: sum of the samples in each group of TILE_SAMPLE lines
+   cost = m->tile_cost;
+   num_groups = (yend - ystart) / TILE_SAMPLE + 1;
+   total = 0.0;
+   for (g = 0; g < num_groups; g++)
+   {
+      iters_ptr = m->iter_data + (ystart + g * TILE_SAMPLE) * m->iter_data_line_size;
+      cost[g] = 0.0;
+      for (x = xstart; x <= xend; x += TILE_SAMPLE)
+         cost[g] += (double) iters_ptr[x] + TILE_POINT_COST;
+      total += cost[g];
+   }
+
+   // Cut a new band whenever the running cost passes the next equal share, keeping the bands
+   // at least TILE_MIN_HEIGHT high (so there may be fewer bands than asked for)
+   min_size = TILE_MIN_HEIGHT;
+   row_bounds[0] = ystart;
+   for (g = 0, r = 1, acc = 0.0; g < num_groups - 1 && r < *rows; g++)
+   {
+      acc += cost[g];
+      y = ystart + (g + 1) * TILE_SAMPLE;
+      if (acc >= total * r / *rows && y - row_bounds[r - 1] >= min_size && yend + 1 - y >= min_size)
+         row_bounds[r++] = y;
+   }
+   row_bounds[*rows = r] = yend + 1;
+
+   // Same for the columns of each band, from the samples in the band
+   if (cols > 1)
+   {
+      num_groups = (xend - xstart) / TILE_SAMPLE + 1;
+      min_size = TILE_MIN_WIDTH;
+      for (r = 0; r < *rows; r++)
+      {
+         for (g = 0; g < num_groups; g++)
+            cost[g] = 0.0;
+         for (y = row_bounds[r]; y < row_bounds[r + 1]; y += TILE_SAMPLE)
+         {
+            iters_ptr = m->iter_data + y * m->iter_data_line_size + xstart;
+            for (g = 0; g < num_groups; g++)
+               cost[g] += (double) iters_ptr[g * TILE_SAMPLE] + TILE_POINT_COST;
+         }
+         for (g = 0, total = 0.0; g < num_groups; g++)
+            total += cost[g];
+
+         col_bounds[0] = xstart;
+         for (g = 0, c = 1, acc = 0.0; g < num_groups - 1 && c < cols; g++)
+         {
+            acc += cost[g];
+            x = xstart + (g + 1) * TILE_SAMPLE;
+            if (acc >= total * c / cols && x - col_bounds[c - 1] >= min_size && xend + 1 - x >= min_size)
+               col_bounds[c++] = x;
+         }
+         for (; c <= cols; c++)  // any missing columns are empty (skipped by make_tiles)
+            col_bounds[c] = xend + 1;
+         col_bounds += cols + 1;
+      }
+   }
+   else
+      for (r = 0; r < *rows; r++, col_bounds += 2)
+      {
+         col_bounds[0] = xstart;
+         col_bounds[1] = xend + 1;
+      }
+   return 1;
+}
+
+// If PREDICT is nonzero, the tiles are sized by the cost predicted from the iteration counts
+// already in the rectangle, if they're from a calculation of the same rectangle (see
+// predict_tiles). Otherwise they're all the same size.
+//
+// Which thread gets which tile depends on timing (see get_tile), so nothing a tile calculates
+// may depend on the other tiles or on what the thread did before: the fast algorithm only
+// guesses from neighbors in the tile, and decides guesses only from stored values (see
+// guess_point). The tiles themselves depend on the thread count, though, so the fast algorithm
+// can give a few different pixels for different thread counts; only the exact algorithm gives
+// the same image for any count. For a given count, and the same previous calculation to
+// predict from, the tiles are always the same.
+
+void make_tiles(man_calc_struct *m, int xstart, int xend, int ystart, int yend, int threads, int predict)
+{
+   int i, k, n, r, c, rows, cols, xsize, ysize;
+   int *row_bounds, *col_bounds;
+   stripe *grid, *s;
+
+   xsize = xend - xstart + 1;
+   ysize = yend - ystart + 1;
+
+   if (threads > m->max_threads)
+      threads = m->max_threads;
+   n = threads > 1 ? threads * TILES_PER_THREAD : 1;
+
+   // Work arrays (see alloc_threads)
+   row_bounds = m->tile_bounds;
+   col_bounds = m->tile_bounds + n + 1; // (cols + 1) per band
+   grid = m->tile_grid;
+   if ((rows = ysize / TILE_MIN_HEIGHT) > n)
+      rows = n;
+   if (rows < 1)
+      rows = 1;
+   if ((cols = (n + rows - 1) / rows) > xsize / TILE_MIN_WIDTH)
+      cols = xsize / TILE_MIN_WIDTH;
+   if (cols < 1)
+      cols = 1;
+
+   if (n == 1 || !predict || !predict_tiles(m, xstart, xend, ystart, yend, &rows, cols, row_bounds, col_bounds))
+      for (r = 0; r <= rows; r++)
+      {
+         row_bounds[r] = ystart + r * ysize / rows;
+         for (c = 0; c <= cols; c++)
+            col_bounds[r * (cols + 1) + c] = xstart + c * xsize / cols;
+      }
+
+   // Tiles in image order, skipping any empty columns
+   for (r = n = 0; r < rows; r++)
+      for (c = 0; c < cols; c++)
+         if (col_bounds[r * (cols + 1) + c + 1] > col_bounds[r * (cols + 1) + c])
+         {
+            grid[n].xstart = col_bounds[r * (cols + 1) + c];
+            grid[n].xend = col_bounds[r * (cols + 1) + c + 1] - 1;
+            grid[n].ystart = row_bounds[r];
+            grid[n].yend = row_bounds[r + 1] - 1;
+            n++;
+         }
+
+   m->num_tiles = n;
+   m->tile_threads = threads;
+
+   s = m->tiles;
+   for (i = 0; i < threads; i++)
+      for (k = i; k < n; k += threads)
+         *s++ = grid[k];
+   deal_tiles(m);
+}
+
+// Get the next tile for thread t to work on, or NULL if there are none left. Takes tiles from
+// the front of the thread's deque, then steals from the back of the deque with the most tiles
+// left (where its owner will get to last). Each deque is packed into 64 bits so it can be
+// updated with a compare and swap. The fronts only increase and the backs only decrease, so a
+// deque never has the same value twice (no ABA problem).
+
+stripe *get_tile(man_calc_struct *m, thread_state *t)
+{
+   unsigned long long r;
+   unsigned first, end, n, most;
+   thread_state *v;
+   int i;
+
+   for (;;)
+   {
+      r = t->tiles;
+      first = (unsigned) r;
+      end = (unsigned) (r >> 32);
+      if (first >= end)
+         break;
+      if (atomic_cas64(&t->tiles, r, TILE_RANGE(first + 1, end)) == r)
+         return &m->tiles[first];
+   }
+
+   for (;;)
+   {
+      v = NULL;
+      most = 0;
+      for (i = 0; i < m->tile_threads; i++)
+      {
+         r = m->thread_states[i].tiles;
+         if ((n = (unsigned) (r >> 32) - (unsigned) r) > most && (unsigned) r < (unsigned) (r >> 32))
+         {
+            most = n;
+            v = &m->thread_states[i];
+         }
+      }
+      if (v == NULL)
+         return NULL;
+
+      r = v->tiles;
+      first = (unsigned) r;
+      end = (unsigned) (r >> 32);
+      if (first < end && atomic_cas64(&v->tiles, r, TILE_RANGE(first, end - 1)) == r)
+         return &m->tiles[end - 1];
+   }
+}
+
+// Set the iteration counts of the tiles to ITERS_NONE (see man_calculate)
+static void clear_tiles_threaded(void *calc_struct, thread_state *t)
+{
+   int y;
+   stripe *s;
+   man_calc_struct *m;
+
+   m = (man_calc_struct *) calc_struct;
+   while ((s = get_tile(m, t)) != NULL)
+      for (y = s->ystart; y <= s->yend; y++)
+         memset(m->iter_data + y * m->iter_data_line_size + s->xstart, ITERS_NONE,
+                (s->xend - s->xstart + 1) * sizeof(m->iter_data[0]));
+}
+
+// Calculate the tiles set up by man_calculate() in the pool threads. The tiles are dealt again
+// each time, since the glitch correction passes reuse them.
+static void run_calc_threads(man_calc_struct *m)
+{
+   deal_tiles(m);
+   run_pool(m, man_calculate_threaded, m->tile_threads);
+}
+
+// Perturbation glitch correction. Picks one of the glitched points in the rectangle as a new
+// reference and recalculates all the glitched points from it (on the same tiles as the
+// main calculation). Glitched points tend to be in blobs that all need about the same reference,
+// one near the center of the blob, where the point came closest to 0. So the point that went
+// deepest into its glitch (see GLITCH_DEPTH) is used, or the middle one (in scan order) of
+// those tied for deepest. Repeats until there are no more glitched points, up to
+// MAX_GLITCH_PASSES. Any left over keep their (inaccurate) iteration counts.
+
+#define MAX_GLITCH_PASSES  64
+
+static void fix_glitches(man_calc_struct *m, int xstart, int xend, int ystart, int yend)
+{
+   int i, x, y, pass, line_size;
+   unsigned count, n, *iters_ptr;
+   float depth, min_depth;
+   long long ref_xoffs, ref_yoffs;
+   hp_num re, im;
+   man_pointstruct *ps_ptr;
+
+   line_size = m->iter_data_line_size;
+
+   for (pass = 0; ; pass++)
+   {
+      count = 0;
+      n = 0;
+      min_depth = 1.0f;
+      for (y = ystart; y <= yend; y++)
+      {
+         iters_ptr = m->iter_data + y * line_size;
+         for (x = xstart; x <= xend; x++)
+            if (iters_ptr[x] & ITERS_GLITCHED)
+            {
+               count++;
+               depth = MAG(m, &iters_ptr[x]);
+               if (depth < min_depth)
+               {
+                  min_depth = depth;
+                  n = 0;
+               }
+               if (depth == min_depth)
+                  n++;
+            }
+      }
+      if (!count || pass == MAX_GLITCH_PASSES || m->cancel_gen != m->calc_gen)
+         break;
+
+      // Find the middle one of the deepest glitched points, and get its offset from re/im
+      n >>= 1;
+      for (y = ystart; y <= yend; y++)
+      {
+         iters_ptr = m->iter_data + y * line_size;
+         for (x = xstart; x <= xend; x++)
+            if ((iters_ptr[x] & ITERS_GLITCHED) && MAG(m, &iters_ptr[x]) == min_depth && !n--)
+               break;
+         if (x <= xend)
+            break;
+      }
+      ref_xoffs = -(m->xsize >> 1) + x + m->pan_xoffs;
+      ref_yoffs = -(m->ysize >> 1) + y + m->pan_yoffs;
+
+      re = m->re_hp;
+      im = m->im_hp;
+      add_re_im_offs(m, &re, &im, ref_xoffs, ref_yoffs);
+      if (!perturb_ref_calc(&m->ref[1], &re, &im, m->max_iters, m->ref[0].limbs))
+         break;
+
+      set_perturb_deltas(m, xstart, xend, ystart, yend, ref_xoffs, ref_yoffs);
+      for (i = 0; i < m->num_threads; i++)
+      {
+         ps_ptr = m->thread_states[i].ps_ptr;
+         ps_ptr->queue_status = m->queue_init;
+         ps_ptr->cur_max_iters = m->max_iters;
+         ps_ptr->ref = &m->ref[1];
+         ps_ptr->series = NULL; // no series approximation for these references
+      }
+
+      m->glitch_pass = 1;
+      run_calc_threads(m);
+      m->glitch_pass = 0;
+   }
+
+   // Clear the flag on any points still glitched, and restore the main reference
+   m->glitches = count;
+   if (count)
+      for (y = ystart; y <= yend; y++)
+      {
+         iters_ptr = m->iter_data + y * line_size;
+         for (x = xstart; x <= xend; x++)
+            iters_ptr[x] &= ~ITERS_GLITCHED;
+      }
+
+   if (pass)
+   {
+      set_perturb_deltas(m, xstart, xend, ystart, yend, 0, 0);
+      for (i = 0; i < m->num_threads; i++)
+      {
+         m->thread_states[i].ps_ptr->ref = &m->ref[0];
+         m->thread_states[i].ps_ptr->series = &m->series;
+      }
+   }
+}
+
+// After a cancel (see cancel_calc): the points the calculation didn't get to can still be
+// ITERS_NONE, or hold counts from an earlier calculation with a higher max_iters (or garbage, in
+// new buffers), which would index past the palette tables. Set those to max_iters, so they show
+// as the set in the preview.
+static void clear_unfinished(man_calc_struct *m, int xstart, int xend, int ystart, int yend)
+{
+   int x, y;
+   unsigned *iters_ptr;
+
+   for (y = ystart; y <= yend; y++)
+   {
+      iters_ptr = m->iter_data + y * m->iter_data_line_size;
+      for (x = xstart; x <= xend; x++)
+         if (iters_ptr[x] == ITERS_NONE || iters_ptr[x] > m->max_iters)
+            iters_ptr[x] = m->max_iters;
+   }
+}
+
+// Man_calculate() splits the calculation up into multiple threads, each calling
+// the man_calculate_threaded() function.
+//
+// Current alg: divide the calculation rectangle into about TILES_PER_THREAD tiles per thread
+// (see make_tiles). Each thread starts on its own share of the tiles, and when it runs out,
+// steals tiles from the threads with the most left (see get_tile). So the threads stay busy
+// until the whole rectangle is done, however unevenly the iterations are spread over it, and
+// there's no per-machine tuning of the number of stripes (the old "spt" setting). When the
+// same rectangle was calculated last time (e.g. realtime zooming), the tiles are sized for equal
+// predicted work instead of equal area (see predict_tiles), so the tiles on the set boundary
+// don't finish last.
+//
+// Example, image rectangle and tiles for two threads (four tiles per thread):
+//
+//  +----------------+
+//  |   T0 tile 0    |
+//  |----------------|
+//  |   T1 tile 0    |
+//  |----------------|
+//  |   T0 tile 1    |
+//  |----------------|
+//  |      ...       |
+//  |----------------|
+//  |   T1 tile 3    |   <- stolen by T0 if T1 is still busy with its earlier tiles
+//  +----------------+
+//
+// Horizontal stripes are preferred because x is done in the inner loop, and memory access is
+// better. Rectangles too short for enough stripes of TILE_MIN_HEIGHT get divided along x too,
+// so that 1-pixel high rectangles (as often found in panning) can still be divided.
+//
+// The calculation can be cancelled from another thread, or by the caller's cancel_poll function
+// (see cancel_calc). The threads then stop at their next line or tile, so a new calculation can
+// start within milliseconds, however slow the image is.
+//
+// Returns the time taken to do the calculation.
+
+double man_calculate(man_calc_struct *m, int xstart, int xend, int ystart, int yend) // smc
+{
+   TIME_UNIT start_time;
+   int fused;
+
+   m->calc_gen = m->cancel_gen; // earlier cancel_calc calls don't affect this calculation
+   set_calc_threads(m);
+   start_pool(m, m->num_threads); // before man_setup (see pool_thread)
+   man_setup(m, xstart, xend, ystart, yend);
+
+   // Fused palette mapping (see set_fused_palette). Points of perturbation images can change
+   // until the glitches are fixed, so those get mapped at the end instead.
+   if ((fused = m->fused))
+      init_pal_work(m, m->pal_work.dest, m->iter_data, m->xsize, m->ysize);
+   if (m->perturb)
+      m->fused = 0;
+   make_tiles(m, xstart, xend, ystart, yend, m->num_threads, 1);
+
+   start_time = get_timer();
+
+   // The fast algorithm guesses points from their neighbors, which can still be in the queue.
+   // Clear the rectangle so those aren't used (see ITERS_NONE).
+   if (!(m->alg & ALG_EXACT))
+   {
+      deal_tiles(m);
+      run_pool(m, clear_tiles_threaded, m->tile_threads);
+   }
+
+   run_calc_threads(m);
+
+   // Recalculate any points that glitched in the perturbation engine from new references
+   if (m->perturb)
+      fix_glitches(m, xstart, xend, ystart, yend);
+
+   // A cancelled calculation still makes a usable preview, once the points it didn't get to are
+   // cleared, but is no good for cost prediction. Otherwise save the rectangle, for the next
+   // calculation's cost prediction (see predict_tiles)
+   m->last_valid = 0;
+   if ((m->cancelled = (m->cancel_gen != m->calc_gen)))
+      clear_unfinished(m, xstart, xend, ystart, yend);
+   else
+   {
+      m->last_rect.xstart = xstart;
+      m->last_rect.xend = xend;
+      m->last_rect.ystart = ystart;
+      m->last_rect.yend = yend;
+      m->last_valid = 1;
+   }
+
+   // Tiles not mapped by the threads (see above), or maybe only partly done (cancelled)
+   if (fused && (!m->fused || m->cancelled))
+      apply_palette(m, m->pal_work.dest + ystart * m->xsize + xstart,
+                    m->iter_data + ystart * m->iter_data_line_size + xstart, xend - xstart + 1, yend - ystart + 1);
+   m->fused = 0;
+
+   return get_seconds_elapsed(start_time);
+}
+
+// Cancel the calculation in progress, if any. Can be called from any thread (e.g. when a new view
+// is requested); man_calculate then returns early, with m->cancelled set. Calculations started
+// after the call aren't affected.
+void cancel_calc(man_calc_struct *m)
+{
+   atomic_inc(&m->cancel_gen);
+}
+
+// ----------------------- Memory functions -----------------------------------
+
+// Touch the image buffers in the tiles (see alloc_man_mem)
+static void touch_tiles_threaded(void *calc_struct, thread_state *t)
+{
+   int y, offs;
+   size_t n;
+   stripe *s;
+   man_calc_struct *m;
+
+   m = (man_calc_struct *) calc_struct;
+   while ((s = get_tile(m, t)) != NULL)
+      for (y = s->ystart; y <= s->yend; y++)
+      {
+         offs = y * m->iter_data_line_size + s->xstart;
+         n = (s->xend - s->xstart + 1) * sizeof(m->iter_data[0]);
+         memset(m->iter_data + offs, 0, n);
+         memset(m->mag_data + offs, 0, n); // same layout as iter_data (see mag_data_offs)
+         memset(m->de_data + offs, 0, n);
+      }
+}
+
+// Allocate all the memory needed by the calculation engine. This needs to be called
+// (after freeing the previous mem) whenever the image size changes. 
+int alloc_man_mem(man_calc_struct *m, int width, int height)
+{
+   int i, j, n;
+
+   m->iter_data_line_size = width + 2;
+   m->image_size = width * height; // new image size
+
+   // Because the fast algorithm checks offsets from the current pixel location, iter_data needs dummy
+   // lines to accomodate off-screen checks. Needs one line at y = -1, and 6 at y = ysize. Also needs
+   // two dummy pixels at the end of each line.
+
+   // Need separate pointer to be able to free later
+
+   m->iter_data_start = (unsigned *) malloc(n = m->iter_data_line_size * (height + 7) * sizeof(m->iter_data_start[0]));
+
+   m->iter_data = m->iter_data_start + m->iter_data_line_size; // create dummy lines at y = -1 for fast alg
+
+   // Queue flushing dummy points go in the last dummy value, which the fast algorithm never checks.
+   // (Used to be iter_data + image_size, which is inside the image because of the 2 dummy pixels
+   // per line, so one pixel near the bottom could get overwritten.)
+   m->iter_data_dummy = m->iter_data + (height + 6) * m->iter_data_line_size - 1;
+
+   // Create a corresponding array for the magnitudes. Don't really need the dummy lines but this
+   // allows using a fixed offset from iter_data
+   m->mag_data = (float *) malloc(m->iter_data_line_size * (height + 7) * sizeof(m->mag_data[0]));
+
+   m->mag_data_offs = (char *) m->mag_data - (char *) m->iter_data;
+
+   // Same for the distance estimates
+   m->de_data = (float *) malloc(m->iter_data_line_size * (height + 7) * sizeof(m->de_data[0]));
+   m->de_data_offs = (char *) m->de_data - (char *) m->iter_data;
+
+   // These two need 4 extra dummy values
+   m->img_re = (double *) malloc((width + 4) * sizeof(m->img_re[0]));
+   m->img_im = (double *) malloc((height + 4) * sizeof(m->img_im[0]));
+   m->img_re_lo = (double *) calloc(width + 4, sizeof(m->img_re_lo[0])); // low parts, for extended
+   m->img_im_lo = (double *) calloc(height + 4, sizeof(m->img_im_lo[0]));
+
+   // Work array for the tile cost prediction (one value per TILE_SAMPLE lines or columns)
+   m->tile_cost = (double *) malloc(((width > height ? width : height) / TILE_SAMPLE + 1) * sizeof(m->tile_cost[0]));
+   m->last_valid = 0;
+
+   // Precalculate pointer offsets of neighboring pixels for the fast "wave" algorithm
+   // (these only change when image width changes)
+   for (j = 1; j < 7; j++)
+      for (i = 0; i < 4; i++)
+         m->wave_ptr_offs[j][i] = wave_yoffs[j][i] * m->iter_data_line_size + wave_xoffs[j][i];
+
+   // Buffer for PNG save (not needed for main calculation). 4 bytes per pixel
+   if (m->flags & FLAG_IS_SAVE)
+   {
+      m->png_buffer = (unsigned char *) malloc((width << 2) * height * sizeof(unsigned char));
+      if (m->png_buffer == NULL)
+         return 0;
+   }
+
+   if (m->iter_data_start == NULL || m->mag_data == NULL || m->de_data == NULL || m->img_re == NULL || m->img_im == NULL ||
+       m->img_re_lo == NULL || m->img_im_lo == NULL || m->tile_cost == NULL)
+      return 0;
+
+   // NUMA: have each thread touch the tiles it gets for palette mapping (and initially for the
+   // calculation; see make_tiles) first, so they go in its node's memory. Then clear everything
+   // (including the dummy lines).
+   if (numa_policy >= NUMA_LOCAL)
+   {
+      set_calc_threads(m);
+      make_tiles(m, 0, width - 1, 0, height - 1, m->num_threads, 0);
+      run_pool(m, touch_tiles_threaded, m->num_threads);
+   }
+   memset(m->iter_data_start, 0, n);
+   return 1;
+}
+
+// Free all memory allocated above
+void free_man_mem(man_calc_struct *m)
+{
+   if (m->iter_data_start != NULL)
+   {
+      free(m->iter_data_start);
+      free(m->mag_data);
+      free(m->de_data);
+      free(m->img_re);
+      free(m->img_im);
+      free(m->img_re_lo);
+      free(m->img_im_lo);
+      free(m->tile_cost);
+      if (m->png_buffer != NULL)
+         free(m->png_buffer);
+      m->iter_data_start = NULL;
+      m->png_buffer = NULL;
+   }
+}
+
+// ----------------------- Initialization -----------------------------------
+
+// Initialize the values in a calculation structure that never change: the pool done event,
+// and the state for the first thread (the rest are allocated as needed; see set_calc_threads).
+// Call once per structure, before anything else. Returns 0 on failure.
+
+int init_man_calc_struct(man_calc_struct *m, unsigned flags)
+{
+   m->flags = flags;
+   m->pool_threads = 1;
+   m->prev_pal = 0xFFFFFFFF;  // force palette lookup table calculation on first use
+
+   // Auto-reset event the last pool thread sets when done (see run_pool)
+   if ((m->pool_done_event = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL)
+      return 0;
+
+   if (!alloc_threads(m, 1))
+   {
+      free_threads(m);
+      CloseHandle(m->pool_done_event);
+      return 0;
+   }
+   m->num_threads = 1;
+   return 1;
+}
+
+// Detect which SIMD instruction sets the CPU (and OS) supports, and build the kernel table
+// from the iteration functions that can run. Call once at startup. If VENDOR is not NULL,
+// also returns the 12-char vendor string in it (needs 13 chars).
+
+#define FEATURE_SSE     0x02000000  // cpuid 1 edx
+#define FEATURE_SSE2    0x04000000
+#define FEATURE_CMOV    0x00008000
+#define FEATURE_FMA     0x00001000  // cpuid 1 ecx
+#define FEATURE_OSXSAVE 0x08000000
+#define FEATURE_AVX     0x10000000
+#define FEATURE_AVX2    0x00000020  // cpuid 7 ebx
+#define FEATURE_AVX512F 0x00010000
+
+#define XCR0_SSE_AVX    0x6         // OS saves xmm and ymm registers
+#define XCR0_AVX512     0xE0        // OS saves mask and zmm registers
+
+static void get_cpuid(unsigned leaf, unsigned *regs) // regs: eax, ebx, ecx, edx
+{
+   #ifdef _MSC_VER
+   __cpuidex((int *) regs, leaf, 0);
+   #else
+   __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+   #endif
+}
+
+// Get the low dword of extended control register 0 (which register states the OS saves).
+// Only call if the OSXSAVE feature bit is set.
+static unsigned get_xcr0(void)
+{
+   #ifdef _MSC_VER
+   return (unsigned) _xgetbv(0);
+   #else
+   unsigned eax, edx;
+
+   __asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+   return eax;
+   #endif
+}
+
+void detect_cpu_features(char *vendor)
+{
+   unsigned regs[4], features, features_ecx, max_leaf;
+   int i;
+
+   get_cpuid(0, regs);  // get vendor
+   max_leaf = regs[0];
+   if (vendor != NULL)
+   {
+      memcpy(vendor, &regs[1], 4);
+      memcpy(vendor + 4, &regs[3], 4);
+      memcpy(vendor + 8, &regs[2], 4);
+      vendor[12] = 0;
+   }
+
+   get_cpuid(1, regs);  // get features
+   features = regs[3];
+   features_ecx = regs[2];
+
+   cpu_features = 0;
+   if ((features & (FEATURE_SSE | FEATURE_CMOV)) == (FEATURE_SSE | FEATURE_CMOV))
+      cpu_features |= CPU_SSE;
+   if ((features & (FEATURE_SSE2 | FEATURE_CMOV)) == (FEATURE_SSE2 | FEATURE_CMOV))
+      cpu_features |= CPU_SSE2;
+
+   // The AVX instruction sets need the CPU feature bits, and the OS must save the ymm (zmm,
+   // mask) registers on context switches. FMA3 is VEX-encoded, so it needs the ymm state too.
+   if ((cpu_features & CPU_SSE2) &&
+       (features_ecx & (FEATURE_OSXSAVE | FEATURE_AVX)) == (FEATURE_OSXSAVE | FEATURE_AVX) &&
+       (get_xcr0() & XCR0_SSE_AVX) == XCR0_SSE_AVX)
+   {
+      cpu_features |= CPU_AVX;
+      if (features_ecx & FEATURE_FMA)
+         cpu_features |= CPU_FMA;
+
+      if (max_leaf >= 7)
+      {
+         get_cpuid(7, regs);
+         if (regs[1] & FEATURE_AVX2)
+            cpu_features |= CPU_AVX2;
+         if ((regs[1] & FEATURE_AVX512F) && (get_xcr0() & XCR0_AVX512) == XCR0_AVX512)
+            cpu_features |= CPU_AVX512;
+      }
+   }
+
+   num_kernels = 0;
+   for (i = 0; i < (int) NUM_ELEM(all_kernels); i++)
+      if ((all_kernels[i].features & cpu_features) == all_kernels[i].features)
+         kernel_table[num_kernels++] = &all_kernels[i];
+}
+
+// Get the widest kernel level the CPU supports (KERNEL_*)
+int get_max_kernel(void)
+{
+   return num_kernels ? kernel_table[0]->level : KERNEL_C;
+}
+
+// Set the number of calculation threads (1 to MAX_THREADS). Any number can be used; the
+// calculation structures allocate the thread states for it when they next calculate.
+void set_num_threads(int n)
+{
+   if (n < 1)
+      n = 1;
+   if (n > MAX_THREADS)
+      n = MAX_THREADS;
+   num_threads = n;
+}
+
+// ----------------------- Headless interface -----------------------------------
+
+// For using the engine without the GUI. Call init_engine once, then allocate a calculation
+// structure and call man_render with each view to calculate:
+//
+// init_engine(0);
+// m = alloc_man_calc_struct(FLAG_CALC_RE_ARRAY);
+// man_render(m, &view, rgb);
+// get_man_data(m, iters, mags);    // optional
+// free_man_calc_struct(m);
+
+// Detect CPU features, set the number of threads (0 = one per core), and initialize the
+// palettes. Returns the number of builtin palettes, or 0 on failure.
+int init_engine(int threads)
+{
+   detect_cpu_features(NULL);
+   set_num_threads(threads > 0 ? threads : get_num_processors());
+   return init_palettes(DIVERGED_THRESH);
+}
+
+// Allocate and initialize a calculation structure. Image memory is allocated by man_render. Returns NULL on failure.
+man_calc_struct *alloc_man_calc_struct(unsigned flags)
+{
+   man_calc_struct *m;
+
+   if ((m = (man_calc_struct *) aligned_malloc(sizeof(man_calc_struct), 64)) == NULL)
+      return NULL;
+   memset(m, 0, sizeof(man_calc_struct));
+
+   if (!init_man_calc_struct(m, flags))
+   {
+      aligned_free(m);
+      return NULL;
+   }
+   return m;
+}
+
+void free_man_calc_struct(man_calc_struct *m)
+{
+   stop_pool(m);
+   free_threads(m);
+   CloseHandle(m->pool_done_event);
+   free_man_mem(m);
+   perturb_ref_free(&m->ref[0]);
+   perturb_ref_free(&m->ref[1]);
+   aligned_free(m);
+}
+
+// Calculate the image for view V and palette-map it to RGB (xsize * ysize 32-bit RGB values,
+// can be NULL to skip palette mapping). Reallocates the image memory if the size changed.
+// Returns the iteration time in seconds, or a negative value if memory couldn't be allocated.
+
+double man_render(man_calc_struct *m, man_view *v, unsigned *rgb)
+{
+   floatexp f;
+   double t;
+
+   if (v->xsize < MIN_SIZE || v->ysize < MIN_SIZE)
+      return -1.0;
+
+   if (m->iter_data_start == NULL || v->xsize != m->xsize || v->ysize != m->ysize)
+   {
+      free_man_mem(m);
+      if (!alloc_man_mem(m, v->xsize, v->ysize))
+         return -1.0;
+      m->xsize = v->xsize;
+      m->ysize = v->ysize;
+      m->min_dimension = (v->xsize < v->ysize) ? v->xsize : v->ysize;
+   }
+
+   m->re = v->re;
+   m->im = v->im;
+   if (v->re_str != NULL) // more precise center for deep images
+   {
+      hp_from_string(&m->re_hp, v->re_str);
+      m->re = hp_to_double(&m->re_hp);
+   }
+   if (v->im_str != NULL)
+   {
+      hp_from_string(&m->im_hp, v->im_str);
+      m->im = hp_to_double(&m->im_hp);
+   }
+   m->mag = v->mag;
+   m->mag_exp = 0;
+   if (v->mag_str != NULL) // can be past the double range
+   {
+      fe_from_string(&f, v->mag_str);
+      m->mag = f.val;
+      m->mag_exp = f.exp;
+   }
+   normalize_mag(m);
+   m->pan_xoffs = 0;
+   m->pan_yoffs = 0;
+
+   m->max_iters = v->max_iters;
+   if (m->max_iters < MIN_ITERS)
+      m->max_iters = MIN_ITERS;
+   if (m->max_iters > MAX_ITERS)
+      m->max_iters = MAX_ITERS;
+
+   m->alg = v->alg;
+   m->kernel = v->kernel;
+   m->chains = v->chains;
+   m->auto_fixed = v->auto_fixed;
+   m->formula = v->formula;
+   m->julia = v->julia;
+   m->julia_re = v->julia_re;
+   m->julia_im = v->julia_im;
+   m->precision = v->precision;
+   m->palette = v->palette;
+   m->rendering_alg = v->rendering_alg;
+   m->pal_xor = v->pal_xor;
+   m->max_iters_color = v->max_iters_color;
+
+   if (rgb != NULL && fused_palette)
+      set_fused_palette(m, rgb);
+   t = man_calculate(m, 0, m->xsize - 1, 0, m->ysize - 1);
+   v->precision = m->precision;
+
+   if (rgb != NULL && !fused_palette)
+      apply_palette(m, rgb, m->iter_data, m->xsize, m->ysize);
+   m->max_iters_last = m->max_iters;
+
+   return t;
+}
+
+// Render a low resolution preview of the Julia set for c = (v->julia_re, v->julia_im), e.g. for
+// the point under the cursor, into rgb (v->xsize * v->ysize). Uses the home view with v's
+// palette and formula; v->max_iters is an upper limit. To stay within budget seconds, the max
+// iterations are adjusted from the time the previous preview in m took (they start low and
+// double while there's time to spare), so the caller can preview every frame without
+// stalling. Returns the calculation time, or < 0 on error.
+
+#define JULIA_PREVIEW_START_ITERS   256
+
+double julia_preview(man_calc_struct *m, man_view *v, unsigned *rgb, double budget)
+{
+   man_view p;
+   double t;
+
+   p = *v;
+   p.re = p.im = 0.0;
+   p.re_str = p.im_str = p.mag_str = NULL;
+   p.mag = HOME_MAG;
+   p.julia = 1;
+   p.precision = PRECISION_DOUBLE;
+   p.alg = v->alg & ~ALG_EXACT;   // fast version of the same alg
+   if (p.rendering_alg == RALG_DE)
+      p.rendering_alg = RALG_STANDARD;
+
+   if (!m->preview_iters)
+      m->preview_iters = JULIA_PREVIEW_START_ITERS;
+   if (m->preview_iters > v->max_iters)
+      m->preview_iters = v->max_iters;
+   p.max_iters = m->preview_iters;
+
+   if ((t = man_render(m, &p, rgb)) < 0.0)
+      return t;
+
+   // Scale down if over budget, with some margin since the time per iteration varies with c
+   if (t > budget)
+      m->preview_iters = (unsigned) (m->preview_iters * 0.75 * budget / t);
+   else if (t < 0.5 * budget)
+      m->preview_iters *= 2;
+   if (m->preview_iters < MIN_ITERS)
+      m->preview_iters = MIN_ITERS;
+
+   return t;
+}
+
+// Time every kernel variant the CPU supports (level, chain count, and the Intel versions of
+// the ASM kernels) at each SIMD precision on a fixed set of views, and return the fastest ones
+// as a TUNED_* bitfield, e.g. for the "tuned" setting in quickman.cfg (set kernel_tuning to use
+// it). The time for a variant is the sum over the views of the best of repeat runs. If results
+// isn't NULL, it gets each variant's time (up to MAX_TUNE_RESULTS), and *num_results the count.
+//
+// The fast non-FMA algorithm is timed. The FMA kernels have the same structure as the others,
+// so they use the same choice.
+
+static const struct
+{
+   double re, im, mag;
+   unsigned max_iters;
+}
+tune_views[] =
+{
+   {HOME_RE, HOME_IM, HOME_MAG, 1000},                   // home image
+   {-0.7453, 0.1127, 300.0, 2000},                       // seahorse valley
+   {-0.743643887037151, 0.13182590420533, 1e10, 5000},   // deep (for double precision)
+};
+
+#define TUNE_XSIZE   640
+#define TUNE_YSIZE   480
+
+unsigned autotune(man_calc_struct *m, tune_result *results, int *num_results, int repeat)
+{
+   man_view v;
+   tune_result r, best;
+   const kernel_entry *k;
+   unsigned tuned, saved_tuning;
+   int i, j, n;
+   double t, best_t;
+
+   saved_tuning = kernel_tuning;   // time the variants as given, not as tuned
+   kernel_tuning = 0;
+   tuned = 0;
+   n = 0;
+
+   memset(&v, 0, sizeof(v));
+   v.xsize = TUNE_XSIZE;
+   v.ysize = TUNE_YSIZE;
+   v.palette = DEFAULT_PAL;
+   v.rendering_alg = RALG_STANDARD;
+   v.formula = FORMULA_MANDELBROT;
+
+   for (r.precision = PRECISION_SINGLE; r.precision <= PRECISION_EXTENDED; r.precision++)
+   {
+      best.time = 0.0;
+      for (r.kernel = KERNEL_SSE; r.kernel <= KERNEL_MAX; r.kernel++)
+         for (r.chains = 0; r.chains <= 4; r.chains++)
+            for (r.intel = 0; r.intel <= 1; r.intel++)
+            {
+               // Skip the variants that don't exist (find_kernel would give another one)
+               k = find_kernel(r.precision, 0, 0, 0, 0, r.kernel, r.chains);
+               if (k == NULL || k->level != r.kernel || k->chains != r.chains ||
+                   (r.intel && k->iterate_intel == NULL))
+                  continue;
+
+               v.kernel = r.kernel;
+               v.chains = r.chains;
+               v.alg = r.intel ? ALG_FAST_ASM_INTEL : ALG_FAST_ASM_AMD;
+               r.name = k->name;
+               r.time = 0.0;
+               for (i = 0; i < (int) NUM_ELEM(tune_views); i++)
+               {
+                  v.re = tune_views[i].re;
+                  v.im = tune_views[i].im;
+                  v.mag = tune_views[i].mag;
+                  v.max_iters = tune_views[i].max_iters;
+                  best_t = 1e10;
+                  for (j = 0; j < repeat; j++)
+                  {
+                     v.precision = r.precision; // man_render returns the precision used here
+                     if ((t = man_render(m, &v, NULL)) < 0.0)
+                     {
+                        kernel_tuning = saved_tuning;
+                        return saved_tuning;
+                     }
+                     if (t < best_t)
+                        best_t = t;
+                  }
+                  r.time += best_t;
+               }
+
+               if (results != NULL && n < MAX_TUNE_RESULTS)
+                  results[n++] = r;
+               if (best.time == 0.0 || r.time < best.time)
+                  best = r;
+            }
+
+      if (best.time > 0.0)
+      {
+         tuned |= TUNED(r.precision, best.kernel, best.chains);
+         if (r.precision == PRECISION_DOUBLE && best.intel)
+            tuned |= TUNED_INTEL;
+      }
+   }
+
+   if (num_results != NULL)
+      *num_results = n;
+   kernel_tuning = saved_tuning;
+   return tuned;
+}
+
+// Copy the iteration counts and magnitudes (squared) of the last image calculated to
+// ITERS and MAGS (xsize * ysize values each, without the dummy pixels). Either can be NULL.
+void get_man_data(man_calc_struct *m, unsigned *iters, float *mags)
+{
+   int y;
+   unsigned *src;
+
+   for (y = 0; y < m->ysize; y++)
+   {
+      src = m->iter_data + y * m->iter_data_line_size;
+      if (iters != NULL)
+         memcpy(iters + y * m->xsize, src, m->xsize * sizeof(iters[0]));
+      if (mags != NULL)
+         memcpy(mags + y * m->xsize, &MAG(m, src), m->xsize * sizeof(mags[0]));
+   }
+}
+
+// ----------------------- Frame pipeline -----------------------------------
+
+// For animations (realtime zooming, or frame sequences from qmrender). Presenting a frame
+// (palette mapping setup, blit, file write) is mostly single threaded, so with the frames done
+// one after the other the calculation threads sit idle for part of each one. With the pipeline,
+// the next frame is calculated (iterated and palette mapped) in its own thread while the caller
+// presents the previous one. Its view has to be known a frame early, which is fine for zooming.
+//
+// pipe_init(&p, calc, present, param, 0);
+// for each frame:
+//    pipe_wait(&p);    // wait for the frame in flight, so its calculation state can be changed
+//    ...               // set up the next frame
+//    pipe_frame(&p);   // start calculating it, and present the previous one meanwhile
+// pipe_flush(&p);      // present the last frame
+// pipe_free(&p);
+
+static unsigned __stdcall pipe_thread(LPVOID param)
+{
+   frame_pipe *p;
+
+   p = (frame_pipe *) param;
+   for (;;)
+   {
+      WaitForMultipleObjects(1, &p->start_event, TRUE, INFINITE);
+      if (p->exit)
+         break;
+      p->calc(p->param, p->buf);
+      SetEvent(p->done_event);
+   }
+   SetEvent(p->done_event);
+   return 0;
+}
+
+// Set up a pipeline with the given callbacks. If SERIAL is nonzero (or the pipeline thread
+// can't be started), frames are calculated in the caller's thread, and presented right after.
+// Returns 0 if the events couldn't be created.
+int pipe_init(frame_pipe *p, void (*calc)(void *param, int buf), void (*present)(void *param, int buf),
+              void *param, int serial)
+{
+   memset(p, 0, sizeof(frame_pipe));
+   p->calc = calc;
+   p->present = present;
+   p->param = param;
+   p->serial = serial;
+
+   if ((p->start_event = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL)
+      return 0;
+   if ((p->done_event = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL)
+   {
+      CloseHandle(p->start_event);
+      return 0;
+   }
+   if (!serial && !start_thread(pipe_thread, p))
+      p->serial = 1;
+   return 1;
+}
+
+// Wait for the frame in flight (if any) to finish. It stays in p->buf till it's presented.
+void pipe_wait(frame_pipe *p)
+{
+   if (p->busy)
+   {
+      WaitForMultipleObjects(1, &p->done_event, TRUE, INFINITE);
+      p->busy = 0;
+      p->ready = 1;
+   }
+}
+
+// Start calculating the next frame into the other buffer, then present the one that finished
+// (if any) while it calculates
+void pipe_frame(frame_pipe *p)
+{
+   int prev;
+
+   pipe_wait(p);
+   prev = p->ready ? p->buf : -1;
+   p->ready = 0;
+   p->buf ^= 1;
+
+   if (p->serial)
+   {
+      p->calc(p->param, p->buf);
+      p->ready = 1;
+      pipe_flush(p);
+      return;
+   }
+
+   p->busy = 1;
+   SetEvent(p->start_event);
+   if (prev >= 0)
+      p->present(p->param, prev);
+}
+
+// Finish and present the frame in flight, if there's one (at the end of an animation)
+void pipe_flush(frame_pipe *p)
+{
+   pipe_wait(p);
+   if (p->ready)
+   {
+      p->ready = 0;
+      p->present(p->param, p->buf);
+   }
+}
+
+// Make the pipeline thread exit and close the events. Any frame still in flight is finished
+// but not presented.
+void pipe_free(frame_pipe *p)
+{
+   pipe_wait(p);
+   p->ready = 0;
+   if (!p->serial)
+   {
+      p->exit = 1;
+      SetEvent(p->start_event);
+      WaitForMultipleObjects(1, &p->done_event, TRUE, INFINITE);
+      p->serial = 1; // freed
+   }
+   if (p->start_event != NULL)
+   {
+      CloseHandle(p->start_event);
+      CloseHandle(p->done_event);
+      p->start_event = p->done_event = NULL;
+   }
+}
@@ -29,20 +29,13 @@
 #define WIN32_LEAN_AND_MEAN
 #define _WIN32_WINNT 0x501    // Windows XP
 
-#include <windows.h>
+#include "port.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <process.h>
 #include <math.h>
 
 #include "quickman.h"
 
-// Main and save calculation structures
-extern __declspec(align(64)) man_calc_struct main_man_calc_struct; // used for normal calculation
-extern __declspec(align(64)) man_calc_struct save_man_calc_struct; // used for saving images
-
-extern int num_threads;
-
 #define NUM_PALETTES 14
 
 // v1.05: replaced the old Ugly palette with this nice monochrome. Could
@@ -742,9 +735,7 @@ int load_palette(FILE *fp)
 {
    char str[512];
    unsigned n, rgb, *p;
-   man_calc_struct *m;
 
-   m = &main_man_calc_struct;
    p = palettes[NUM_PALETTES].rgb;
 
    // Set user palette to invalid by default (if valid, num_valid_palettes will be set to NUM_PALETTES + 1)
@@ -779,11 +770,9 @@ int load_palette(FILE *fp)
    }
 
    // Need at least 2 entries: one for max iters and one for diverging values.
+   // Caller must tell apply_palette that the user palette changed (set prev_pal to 0xFFFFFFFF).
    if (n >= 2)
    {
-      // Tell apply_palette that user palette changed. Only applies to main calc struct.
-      // Save function will reset this value for its own structure
-      m->prev_pal = 0xFFFFFFFF;
       num_valid_palettes = NUM_PALETTES + 1;
       palettes[NUM_PALETTES].size = n;
       return NUM_PALETTES;   // succesfully loaded palette
@@ -804,10 +793,6 @@ int load_palette_from_bmp(FILE *fp)
    BITMAPINFOHEADER info;
    unsigned i, n;
 
-   man_calc_struct *m;
-
-   m = &main_man_calc_struct;
-
    // Set user palette to invalid by default (if valid, num_valid_palettes will be NUM_PALETTES + 1)
    num_valid_palettes = NUM_PALETTES;
 
@@ -840,7 +825,6 @@ int load_palette_from_bmp(FILE *fp)
          if (!fread(&palettes[NUM_PALETTES].rgb[i], 3, 1, fp)) // High byte is a don't care. Assumes little endian
             return 0;
 
-      m->prev_pal = 0xFFFFFFFF; // tell apply_palette that user palette changed
       num_valid_palettes = NUM_PALETTES + 1;
       palettes[NUM_PALETTES].size = n;
 
@@ -857,16 +841,18 @@ int load_palette_from_bmp(FILE *fp)
 
 // Higher values for MAGSQ_SCALE_FACTOR give better color interpolation accuracy and more lookup
 // table elements for the normalized algorithm. Would have to increase if DIVERGED_THRESH
-// decreases, to get the same quality. Can be fractional.
+// decreases, to get the same quality. Can be fractional: it's set in quarters, so the table
+// size below stays an integer constant.
 
-#define MAGSQ_SCALE_FACTOR    2.0
+#define MAGSQ_SCALE_QUARTERS  8
+#define MAGSQ_SCALE_FACTOR    (MAGSQ_SCALE_QUARTERS / 4.0)
 
 static double magsq_scale_factor = MAGSQ_SCALE_FACTOR; // for ease of use in ASM
 
 typedef unsigned INTERP_TABLE_ENTRY; // zoomtest 25.7s
 //typedef unsigned short INTERP_TABLE_ENTRY; // zoomtest 25.9s
 
-static INTERP_TABLE_ENTRY interp_table[(int)(DIVERGED_THRESH_SQ * MAGSQ_SCALE_FACTOR)];
+static INTERP_TABLE_ENTRY interp_table[DIVERGED_THRESH_SQ * MAGSQ_SCALE_QUARTERS / 4];
 
 // Minimum number of pixels to be mapped for which multithreading is used
 #define MIN_THREADED_PAL_MAP 200000
@@ -875,10 +861,6 @@ int init_palettes(double diverged_thresh)
 {
    double pal_k1, pal_k2, scale;
    int i;
-   man_calc_struct *m, *s;
-
-   m = &main_man_calc_struct;
-   s = &save_man_calc_struct;
 
    // To start with, allocate a user palette of USER_PALETTE_SIZE entries. If this ever turns
    // out to be too small, it will be reallocated.
@@ -902,11 +884,6 @@ int init_palettes(double diverged_thresh)
       interp_table[i] = (INTERP_TABLE_ENTRY) (scale * 256.0 + 0.49); // round to nearest
    }
 
-   for (i = 1; i < MAX_THREADS; i++) // 0 is the master thread
-      if ( (m->pal_events[i] = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL ||
-           (s->pal_events[i] = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL )
-         return 0;
-
    return num_valid_palettes = NUM_PALETTES;
 }
 
@@ -972,12 +949,16 @@ unsigned get_normalized_color(man_calc_struct *m, unsigned iters, double magsq)
    // ASM version that's similar to the above without all the painful x87 control
    // word manipulation to set truncation mode. Would actually rather have rounding here.
 
+   #ifdef USE_ASM_KERNELS
    __asm  // zoomtest 25.7s
    {
       fld   magsq
       fmul  magsq_scale_factor
       fistp ind
    }
+   #else
+   ind = (unsigned) lrint(magsq * magsq_scale_factor); // same thing: convert with rounding
+   #endif
 
    // Rare to get a magnitude >= the table size (i.e., the point magsq was more than
    // diverged_thresh^2) so this branch should be predicted correctly most of the time
@@ -1017,12 +998,16 @@ unsigned get_normalized_color_nolookup(unsigned iters, unsigned *pal, unsigned p
    c2 = pal[iters % pal_size_m1 + 1];
 
    //ind = (unsigned) (magsq * MAGSQ_SCALE_FACTOR);
+   #ifdef USE_ASM_KERNELS
    __asm
    {
       fld   magsq
       fmul  magsq_scale_factor
       fistp ind
    }
+   #else
+   ind = (unsigned) lrint(magsq * magsq_scale_factor);
+   #endif
 
    if (ind >= NUM_ELEM(interp_table))
       ind = NUM_ELEM(interp_table) - 1;
@@ -1037,10 +1022,26 @@ unsigned get_normalized_color_nolookup(unsigned iters, unsigned *pal, unsigned p
    return ((r & 0xFF000000) | (g & 0x00FF0000) | b) >> 8;
 }
 
-// New threaded palette mapping function. Called from apply_palette (the interface to
-// the rest of the code).
+// DE shading (RALG_DE): darken color C for points within DE_SHADE_PIXELS of the set, by the
+// square root of the distance estimate DE (in pixels). Brings out the filaments that are too
+// thin for the iteration bands to show.
 
-unsigned __stdcall apply_palette_threaded(pal_work *p)
+#define DE_SHADE_PIXELS 2.0f
+
+static unsigned get_de_shaded_color(unsigned c, float de)
+{
+   unsigned s;
+
+   if (de >= DE_SHADE_PIXELS)
+      return c;
+   s = (unsigned) (sqrtf(de * (1.0f / DE_SHADE_PIXELS)) * 256.0f); // 0 - 256
+
+   return ((((c & 0xFF00FF) * s) >> 8) & 0xFF00FF) | ((((c & 0x00FF00) * s) >> 8) & 0x00FF00);
+}
+
+// Palette map one rectangle, described by P. Called from map_palette_tile.
+
+static void map_palette(pal_work *p)
 {
    unsigned iters, prev_iters, prev, x, y, bmp_line, iter_line, bmp_ind, iter_ind, pal_xor, max_iters;
    unsigned *dest, *src, iter_line_size, bmp_line_size, xsize, ysize, *pal, n, max_iters_color, ralg;
@@ -1061,6 +1062,8 @@ unsigned __stdcall apply_palette_threaded(pal_work *p)
    bmp_line_size = m->xsize; // this xsize is the size of the whole mandelbrot image
    iter_line_size = m->iter_data_line_size;
    ralg = m->rendering_alg;
+   if (ralg == RALG_DE && !m->de) // no distance estimates (e.g. deep image): plain standard
+      ralg = RALG_STANDARD;
    pal_xor = m->pal_xor;
    max_iters = m->max_iters;
 
@@ -1078,6 +1081,15 @@ unsigned __stdcall apply_palette_threaded(pal_work *p)
             do
                dest[bmp_ind++] = m->pal_lookup[src[iter_ind++]] ^ pal_xor;
             while (--x);
+         else if (ralg == RALG_DE) // standard, DE shaded
+            do
+            {
+               iters = src[iter_ind];
+               dest[bmp_ind++] = (iters == max_iters) ? m->pal_lookup[iters] ^ pal_xor :
+                                 get_de_shaded_color(m->pal_lookup[iters] ^ pal_xor, DE(m, &src[iter_ind]));
+               iter_ind++;
+            }
+            while (--x);
          else       // normalized
             do
             {
@@ -1094,6 +1106,7 @@ unsigned __stdcall apply_palette_threaded(pal_work *p)
    else // Max iters too big: calculate on the fly
    {
       prev_iters = 0xFFFFFFFF; // non-occurring value
+      prev = 0;
       bmp_line = 0;
       iter_line = 0;
       for (y = 0; y < ysize; y++)
@@ -1116,6 +1129,11 @@ unsigned __stdcall apply_palette_threaded(pal_work *p)
                      dest[bmp_ind] = prev = max_iters_color; // max iters color is not xored
                }
             }
+            else if (ralg == RALG_DE) // or with DE shading
+               if (iters != max_iters)
+                  dest[bmp_ind] = get_de_shaded_color(pal[iters % n + 1] ^ pal_xor, DE(m, &src[iter_ind]));
+               else
+                  dest[bmp_ind] = max_iters_color;
             else  // can't use the prev optimization with normalized version
                if (iters != max_iters)
                   dest[bmp_ind] = get_normalized_color_nolookup(src[iter_ind], pal, n,
@@ -1130,32 +1148,41 @@ unsigned __stdcall apply_palette_threaded(pal_work *p)
          iter_line += iter_line_size;
       }
    }
-   // Tell the master thread we're done. Thread 0 is the master thread, so doesn't need to signal
-   if (p->thread_num > 0)
-      SetEvent(m->pal_events[p->thread_num]);
-   return 0;
 }
 
-// Create an RGB image in DEST from the iteration counts in SRC, using m->palette.
-// XSIZE and YSIZE are the sizes of the rectangle to map (each must be at least 1).
-// Caller must set DEST and SRC based on the upper left coordinates of the rectangle.
-//
-// Iteration counts must not be more than m->max_iters. SRC and DEST should not be the same.
-//
-// Optimized to use direct lookup from array for m->max_iters <= PAL_LOOKUP_MAX.
-//
-// Timings, 1600 x 1140
-// Old algorithm (calculate on the fly):
-// 12ms (simple image)
-// 24ms (complex image)
-// 10ms (simple no-mod AND 0xFF method)
-//
-// New algorithm (direct lookup, max_iters < PAL_LOOKUP_MAX):
-// 9ms (all images)
+// Palette map tile S of the rectangle in m->pal_work (S is relative to its upper left)
+void map_palette_tile(man_calc_struct *m, stripe *s)
+{
+   pal_work w;
+
+   w = m->pal_work;
+   w.dest += s->ystart * m->xsize + s->xstart; // bitmap line_size
+   w.src += s->ystart * m->iter_data_line_size + s->xstart;
+   w.xsize = s->xend - s->xstart + 1;
+   w.ysize = s->yend - s->ystart + 1;
+   map_palette(&w);
+}
 
-void apply_palette(man_calc_struct *m, unsigned *dest, unsigned *src, unsigned xsize, unsigned ysize)
+// New threaded palette mapping function: maps tiles of the rectangle in m->pal_work until
+// there are none left (see get_tile). Called from apply_palette (the interface to the rest
+// of the code) through run_pool.
+
+static void apply_palette_threaded(void *calc_struct, thread_state *t)
+{
+   man_calc_struct *m;
+   stripe *s;
+
+   m = (man_calc_struct *) calc_struct;
+   while ((s = get_tile(m, t)) != NULL)
+      map_palette_tile(m, s);
+}
+
+// Set up m->pal_work to map SRC to DEST with m->palette, making a new color lookup table if
+// needed (see apply_palette)
+
+void init_pal_work(man_calc_struct *m, unsigned *dest, unsigned *src, unsigned xsize, unsigned ysize)
 {
-   unsigned n, *pal, i, mod, step, nt, mi_color, palette_num, max_iters;
+   unsigned n, *pal, i, mod, mi_color, palette_num, max_iters;
    pal_work *p;
 
    // NUM_PALETTES is the index used for the user palette.
@@ -1195,45 +1222,59 @@ void apply_palette(man_calc_struct *m, unsigned *dest, unsigned *src, unsigned x
       m->pal_lookup[max_iters] = mi_color;
    }
 
+   p = &m->pal_work;
+   p->calc_struct = (void *) m;
+   p->dest = dest;
+   p->src = src;
+   p->xsize = xsize;
+   p->ysize = ysize;
+   p->pal = pal;
+   p->pal_size = n;
+   p->max_iters_color = mi_color;
+}
+
+// Create an RGB image in DEST from the iteration counts in SRC, using m->palette.
+// XSIZE and YSIZE are the sizes of the rectangle to map (each must be at least 1).
+// Caller must set DEST and SRC based on the upper left coordinates of the rectangle.
+//
+// Iteration counts must not be more than m->max_iters. SRC and DEST should not be the same.
+//
+// Optimized to use direct lookup from array for m->max_iters <= PAL_LOOKUP_MAX.
+//
+// Timings, 1600 x 1140
+// Old algorithm (calculate on the fly):
+// 12ms (simple image)
+// 24ms (complex image)
+// 10ms (simple no-mod AND 0xFF method)
+//
+// New algorithm (direct lookup, max_iters < PAL_LOOKUP_MAX):
+// 9ms (all images)
+
+void apply_palette(man_calc_struct *m, unsigned *dest, unsigned *src, unsigned xsize, unsigned ysize)
+{
+   unsigned nt;
+
+   init_pal_work(m, dest, src, xsize, ysize);
+
    // Multithread the palette mapping if the number of pixels to be done is > some minimum.
    // Otherwise use a single thread, since threading overhead would dominate the time.
 
-   nt = num_threads;
+   nt = m->num_threads;
    if (xsize * ysize < MIN_THREADED_PAL_MAP)
       nt = 1;
 
-   p = m->pal_work_array;
-
-   step = ysize / nt;         // always stripe along y axis
-   for (i = 0; i < nt; i++)
-   {
-      if (i == nt - 1)        // add any remainder onto last thread
-         step += ysize - (step * nt);
-
-      p->calc_struct = (void *) m;
-      p->dest = dest;
-      p->src = src;
-      p->xsize = xsize;
-      p->ysize = step;
-      p->pal = pal;
-      p->pal_size = n;
-      p->max_iters_color = mi_color;
-      p->thread_num = i;
-
-      dest += step * m->xsize; // bitmap line_size
-      src += step * m->iter_data_line_size;
-      p++;
-   }
-
-   // If more than one thread, spawn new threads
-   for (i = 1; i < nt; i++)
-      QueueUserWorkItem(apply_palette_threaded, &m->pal_work_array[i],
-                        WT_EXECUTELONGFUNCTION | (MAX_QUEUE_THREADS << 16));
-
-   // Do some (or all) of the work here in the master thread
-   apply_palette_threaded(&m->pal_work_array[0]);
+   // Split the rectangle into tiles for the threads, and map them. With one thread all the
+   // work is done here in the master thread
+   make_tiles(m, 0, xsize - 1, 0, ysize - 1, nt, 0);
+   run_pool(m, apply_palette_threaded, nt);
+}
 
-   // Wait till all threads are done
-   if (nt > 1)
-      WaitForMultipleObjects(nt - 1, &m->pal_events[1], TRUE, INFINITE);
+// Fused palette mapping: map the next man_calculate() on M into DEST (an RGB image of the whole
+// of M, m->xsize wide) as it goes. The threads map their tiles as they finish them, while the
+// iteration data is still in the cache, instead of making another pass over the image after.
+// Man_calculate sets up the rest of m->pal_work, once max_iters is final (see man_setup).
+void set_fused_palette(man_calc_struct *m, unsigned *dest)
+{
+   m->pal_work.dest = dest;
+   m->fused = 1;
 }
@@ -0,0 +1,591 @@
+// -------------------------------------------------------------------------------------
+// Perturb.c -- High precision arithmetic and reference orbits for the QuickMAN perturbation engine
+// Copyright (C) 2006-2008 Paul Gentieu (paul.gentieu@yahoo.com)
+//
+// This file is part of QuickMAN.
+//
+// QuickMAN is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+//
+// Project Page: http://quickman.sourceforge.net
+//
+// -------------------------------------------------------------------------------------
+//
+// Past a magnification of about 1e13, neighboring pixel coordinates are no longer distinct
+// doubles (see check_precision_loss). The perturbation engine gets around this by
+// calculating one reference point C (the image center) at high precision, and every pixel
+// c = C + dc as a small double delta from it:
+//
+//    z_n = Z_n + dz_n,   dz_n+1 = 2 * Z_n * dz_n + dz_n^2 + dc
+//
+// Only the reference orbit Z_n needs the high precision; it's rounded to doubles and the
+// per-pixel deltas are iterated by the SIMD kernels in engine.c. When dz gets large relative
+// to Z (|Z + dz| << |Z|) the delta loses its precision and the point is "glitched"; these
+// points are recalculated from a new reference (see man_calculate).
+//
+// The deltas of all the points also follow the reference closely for the first part of the
+// orbit, where they can be approximated by a series in dc. That part is skipped for every
+// point at once (see perturb_series_calc).
+//
+// The high precision numbers are sign-magnitude fixed point, with 32-bit limbs. Limb 0 is
+// the integer part and the rest are the fraction, most significant first. All the values
+// involved stay well under 2^32 in magnitude, so one integer limb is plenty.
+
+#define STRICT
+#define WIN32_LEAN_AND_MEAN
+
+#include "port.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "quickman.h"
+
+#define LIMB_SCALE      4294967296.0   // 2^32
+
+// Glitch threshold: a point is glitched if |Z + dz|^2 < GLITCH_TOL * |Z|^2 (Pauldelbrot's criterion)
+#define GLITCH_TOL      1e-6
+
+// Set h to the double d (exact)
+void hp_from_double(hp_num *h, double d)
+{
+   int i;
+
+   h->neg = d < 0.0;
+   d = fabs(d);
+   for (i = 0; i < HP_LIMBS; i++)
+   {
+      h->limb[i] = (unsigned) d;
+      d = (d - (double) h->limb[i]) * LIMB_SCALE;
+   }
+}
+
+// Get h rounded to a double. Only the first n limbs are used.
+static double hp_to_double_n(const hp_num *h, int n)
+{
+   double d;
+   int i;
+
+   d = 0.0;
+   for (i = n - 1; i >= 0; i--)
+      d = d * (1.0 / LIMB_SCALE) + (double) h->limb[i];
+   return h->neg ? -d : d;
+}
+
+double hp_to_double(const hp_num *h)
+{
+   return hp_to_double_n(h, HP_LIMBS);
+}
+
+// Compare the magnitudes of a and b (first n limbs). Returns < 0, 0, or > 0.
+static int hp_cmp_mag(const hp_num *a, const hp_num *b, int n)
+{
+   int i;
+
+   for (i = 0; i < n; i++)
+      if (a->limb[i] != b->limb[i])
+         return a->limb[i] < b->limb[i] ? -1 : 1;
+   return 0;
+}
+
+// r = a + b, or a - b if sub is set (first n limbs). R can be the same as a or b.
+static void hp_add_sub(hp_num *r, const hp_num *a, const hp_num *b, int sub, int n)
+{
+   const hp_num *t;
+   unsigned long long acc;
+   unsigned carry;
+   int i, neg, bneg;
+
+   bneg = b->neg ^ sub;
+   if (a->neg == bneg) // same signs: add magnitudes
+   {
+      neg = a->neg;
+      carry = 0;
+      for (i = n - 1; i >= 0; i--)
+      {
+         acc = (unsigned long long) a->limb[i] + b->limb[i] + carry;
+         r->limb[i] = (unsigned) acc;
+         carry = (unsigned) (acc >> 32);
+      }
+   }
+   else // different signs: subtract the smaller magnitude from the larger
+   {
+      neg = a->neg;
+      if (hp_cmp_mag(a, b, n) < 0)
+      {
+         t = a;
+         a = b;
+         b = t;
+         neg = bneg;
+      }
+      carry = 0; // borrow
+      for (i = n - 1; i >= 0; i--)
+      {
+         acc = (unsigned long long) a->limb[i] - b->limb[i] - carry;
+         r->limb[i] = (unsigned) acc;
+         carry = (unsigned) (acc >> 63);
+      }
+   }
+   r->neg = neg;
+}
+
+// r = a * b (first n limbs; the product is truncated to n limbs). R can be the same as a or b:
+// the columns are done from least to most significant, and column k only reads limbs <= k.
+static void hp_mul(hp_num *r, const hp_num *a, const hp_num *b, int n)
+{
+   unsigned long long acc, prod;
+   unsigned acc_hi;
+   int i, k, neg;
+
+   neg = a->neg ^ b->neg;
+   acc = 0;
+   acc_hi = 0;
+   for (k = 2 * n - 2; k >= 0; k--)
+   {
+      for (i = (k >= n) ? k - n + 1 : 0; i <= k && i < n; i++)
+      {
+         prod = (unsigned long long) a->limb[i] * b->limb[k - i];
+         acc += prod;
+         if (acc < prod)
+            acc_hi++;
+      }
+      if (k < n)
+         r->limb[k] = (unsigned) acc;
+      acc = (acc >> 32) | ((unsigned long long) acc_hi << 32);
+      acc_hi = 0;
+   }
+   r->neg = neg;
+}
+
+// h += f. Used for moving the center by pixel offsets, which are always exact floatexps. The
+// value is converted at a whole number of limbs from its exponent, so it can't underflow.
+void hp_add_fe(hp_num *h, floatexp f)
+{
+   hp_num t;
+   int i, k;
+
+   k = 0;
+   if (f.exp < 0)
+   {
+      k = -f.exp >> 5;           // whole limbs to shift right
+      f.val = ldexp(f.val, -(-f.exp & 31));
+      if (k >= HP_LIMBS)
+         return;
+   }
+   else
+      f.val = ldexp(f.val, f.exp);
+
+   hp_from_double(&t, f.val);
+   for (i = HP_LIMBS - 1; i >= k; i--)
+      t.limb[i] = t.limb[i - k];
+   for (; i >= 0; i--)
+      t.limb[i] = 0;
+   hp_add_sub(h, h, &t, 0, HP_LIMBS);
+}
+
+// Get h as a double-double: hi is h rounded to a double, and lo is the remainder rounded.
+void hp_to_dd(const hp_num *h, double *hi, double *lo)
+{
+   hp_num t;
+
+   *hi = hp_to_double(h);
+   hp_from_double(&t, *hi);
+   hp_add_sub(&t, h, &t, 1, HP_LIMBS);
+   *lo = hp_to_double(&t);
+}
+
+// Get h as a 128-bit fixed point number (see fixed_num), truncated. The integer part wraps
+// around past FIXED_INT_BITS, like the fixed point kernels' arithmetic.
+void hp_to_fixed(const hp_num *h, fixed_num *f)
+{
+   unsigned long long hi, lo;
+   int shift;
+
+   shift = 64 - FIXED_INT_BITS; // hi holds limb 0 from this bit up, then the fraction limbs
+   hi = ((unsigned long long) h->limb[0] << shift) | ((unsigned long long) h->limb[1] << (shift - 32)) |
+        (h->limb[2] >> (64 - shift));
+   lo = ((unsigned long long) h->limb[2] << shift) | ((unsigned long long) h->limb[3] << (shift - 32)) |
+        (h->limb[4] >> (64 - shift));
+   if (h->neg) // two's complement negate
+   {
+      lo = 0 - lo;
+      hi = ~hi + (lo == 0);
+   }
+   f->lo = lo;
+   f->hi = (long long) hi;
+}
+
+// Set h from a decimal string (optional sign, digits, optional fraction). Reads up to the
+// first character that isn't part of the number. Returns 0 if there were no digits.
+int hp_from_string(hp_num *h, const char *s)
+{
+   const char *frac, *end;
+   unsigned long long acc;
+   unsigned ipart;
+   int i, neg, digits;
+
+   memset(h, 0, sizeof(hp_num));
+
+   while (*s == ' ' || *s == '\t' || *s == '\"')
+      s++;
+   neg = 0;
+   if (*s == '-' || *s == '+')
+      neg = *s++ == '-';
+
+   digits = 0;
+   ipart = 0;
+   for (; *s >= '0' && *s <= '9'; s++, digits++)
+      ipart = ipart * 10 + (*s - '0');
+
+   frac = end = s;
+   if (*s == '.')
+      for (frac = end = s + 1; *end >= '0' && *end <= '9'; end++, digits++)
+         ;
+
+   // Fraction: going from the last digit to the first, add the digit to the integer
+   // limb and divide the whole thing by 10.
+   while (end > frac)
+   {
+      h->limb[0] = *--end - '0';
+      acc = 0;
+      for (i = 0; i < HP_LIMBS; i++)
+      {
+         acc = (acc << 32) | h->limb[i];
+         h->limb[i] = (unsigned) (acc / 10);
+         acc %= 10;
+      }
+   }
+   h->limb[0] = ipart;
+   h->neg = neg;
+   return digits != 0;
+}
+
+// Write h to s (size chars) as a decimal string with the given number of fraction digits
+// (truncated, not rounded).
+void hp_to_string(const hp_num *h, char *s, int size, int digits)
+{
+   hp_num f;
+   unsigned long long acc;
+   unsigned ipart;
+   char tmp[12];
+   int i, n;
+
+   n = 0;
+   if (h->neg)
+      s[n++] = '-';
+   i = 0;
+   ipart = h->limb[0];
+   do
+      tmp[i++] = (char) ('0' + ipart % 10);
+   while (ipart /= 10);
+   while (i && n < size - 2)
+      s[n++] = tmp[--i];
+   s[n++] = '.';
+
+   f = *h;
+   for (; digits > 0 && n < size - 1; digits--)
+   {
+      // Multiply the fraction by 10; the digit ends up in the integer limb
+      acc = 0;
+      for (i = HP_LIMBS - 1; i > 0; i--)
+      {
+         acc += (unsigned long long) f.limb[i] * 10;
+         f.limb[i] = (unsigned) acc;
+         acc >>= 32;
+      }
+      s[n++] = (char) ('0' + acc);
+   }
+   s[n] = 0;
+}
+
+// Get the number of limbs needed for the reference orbit at magnification mag * 2^mag_exp:
+// enough for the pixel spacing, plus 64 bits of headroom for the errors accumulated in the
+// iteration. Returns more than HP_LIMBS if the magnification is too deep.
+int hp_limbs_for_mag(double mag, int mag_exp)
+{
+   return 1 + (int) ((log(mag > 1.0 ? mag : 1.0) * (1.0 / log(2.0)) + mag_exp + 64.0 + 31.0) / 32.0);
+}
+
+// Set f from a decimal string in the usual floating point format. The exponent can be past the
+// double range. Values that fit in a double come out the same as atof, with exp = 0.
+void fe_from_string(floatexp *f, const char *s)
+{
+   char buf[64];
+   const char *e;
+   double l;
+   int n, exp10;
+
+   f->val = atof(s);
+   f->exp = 0;
+   if (f->val != 0.0 && fabs(f->val) >= DBL_MIN && fabs(f->val) <= DBL_MAX)
+      return;
+
+   // Out of range: separate the decimal exponent, and convert 10^exp10 to a power of 2
+   if ((e = strpbrk(s, "eE")) == NULL || (n = (int) (e - s)) >= (int) sizeof(buf))
+      return;
+   memcpy(buf, s, n);
+   buf[n] = 0;
+   exp10 = atoi(e + 1);
+
+   l = exp10 * (log(10.0) / log(2.0));
+   f->exp = (int) floor(l);
+   f->val = atof(buf) * pow(2.0, l - f->exp);
+}
+
+// Write f to s in %g-style scientific format, with 16 significant digits
+void fe_to_string(floatexp f, char *s, int size)
+{
+   double l, m;
+   int exp10;
+
+   if (f.val == 0.0)
+   {
+      sprintf_s(s, size, "0");
+      return;
+   }
+   l = log10(fabs(f.val)) + f.exp * (log(2.0) / log(10.0));
+   exp10 = (int) floor(l);
+   m = pow(10.0, l - exp10);
+   if (m >= 9.9999999999999995) // rounding would print 10.000...
+   {
+      m /= 10.0;
+      exp10++;
+   }
+   sprintf_s(s, size, "%s%.15fe%+d", f.val < 0.0 ? "-" : "", m, exp10);
+}
+
+// Calculate the reference orbit for the point (re, im) up to max_iters, at n limbs of
+// precision. Entries past the end of the orbit (reference diverged) get Z = 0 and an
+// infinite glitch threshold, so any point still iterating there is flagged as glitched.
+// Returns 0 if the orbit arrays couldn't be allocated.
+
+int perturb_ref_calc(perturb_ref *ref, const hp_num *re, const hp_num *im, unsigned max_iters, int n)
+{
+   hp_num x, y, xx, yy, xy;
+   double zx, zy, mag;
+   unsigned i, size;
+
+   // Reuse the orbit if it's already there. The center is compared at full precision.
+   if (ref->x != NULL && ref->max_iters == max_iters && ref->limbs == n &&
+       !memcmp(&ref->re, re, sizeof(hp_num)) && !memcmp(&ref->im, im, sizeof(hp_num)))
+      return 1;
+
+   // Kernels can look one entry past max_iters (next Z); allocate a couple extra
+   size = max_iters + 2;
+   if (size > ref->size)
+   {
+      perturb_ref_free(ref);
+      ref->x = (double *) malloc(size * sizeof(double));
+      ref->y = (double *) malloc(size * sizeof(double));
+      ref->thresh = (double *) malloc(size * sizeof(double));
+      if (ref->x == NULL || ref->y == NULL || ref->thresh == NULL)
+      {
+         perturb_ref_free(ref);
+         return 0;
+      }
+      ref->size = size;
+   }
+
+   memset(&x, 0, sizeof(x));
+   memset(&y, 0, sizeof(y));
+
+   for (i = 0; i <= max_iters; i++)
+   {
+      zx = hp_to_double_n(&x, n);
+      zy = hp_to_double_n(&y, n);
+      ref->x[i] = zx;
+      ref->y[i] = zy;
+      mag = zx * zx + zy * zy;
+      ref->thresh[i] = GLITCH_TOL * mag;
+      if (mag >= DIVERGED_THRESH)
+         break;
+
+      hp_mul(&xx, &x, &x, n);
+      hp_mul(&yy, &y, &y, n);
+      hp_mul(&xy, &x, &y, n);
+      hp_add_sub(&y, &xy, &xy, 0, n);  // y = 2xy + im
+      hp_add_sub(&y, &y, im, 0, n);
+      hp_add_sub(&x, &xx, &yy, 1, n);  // x = xx - yy + re
+      hp_add_sub(&x, &x, re, 0, n);
+   }
+   ref->len = (i > max_iters) ? max_iters : i;
+
+   for (i = ref->len + 1; i < size; i++)
+   {
+      ref->x[i] = ref->y[i] = 0.0;
+      ref->thresh[i] = HUGE_VAL;
+   }
+
+   ref->re = *re;
+   ref->im = *im;
+   ref->max_iters = max_iters;
+   ref->limbs = n;
+   return 1;
+}
+
+void perturb_ref_free(perturb_ref *ref)
+{
+   free(ref->x);
+   free(ref->y);
+   free(ref->thresh);
+   ref->x = ref->y = ref->thresh = NULL;
+   ref->size = 0;
+}
+
+// Series approximation. For small dc, the deltas are dz_n = A_n * dc + B_n * dc^2 + C_n * dc^3 + ...
+// Substituting this into the delta iteration gives
+//
+//    A_n+1 = 2 * Z_n * A_n + 1
+//    B_n+1 = 2 * Z_n * B_n + A_n^2
+//    C_n+1 = 2 * Z_n * C_n + 2 * A_n * B_n
+//
+// The coefficients grow like |dz / dc|^k, which overflows on deep images, so they're kept
+// scaled by powers of the largest |dc| (see perturb_series). The approximation is good until
+// the dropped terms become significant. The error is an analytic function of dc, so it's
+// largest on the edge of the rectangle: probe points on the edge are iterated normally and the
+// series stops at the first iteration where it's off by more than SERIES_TOL for any of them
+// (or where a probe would glitch or diverge).
+//
+// The deltas can be past the double exponent range (see PERTURB_FLOATEXP), so the coefficients
+// and the probe deltas are all kept times 2^-exp, with exp adjusted to keep a near 1. The
+// nonlinear terms get multiplied by 2^exp; they underflow to 0 while they're negligible.
+
+#define SERIES_TOL      1e-12
+#define SERIES_PROBES   8
+#define SERIES_RESCALE  18446744073709551616.0 // 2^64
+
+// Probe positions, as fractions of the rectangle: corners and midpoints of the edges
+static const double probe_fx[SERIES_PROBES] = {0.0, 0.5, 1.0, 1.0, 1.0, 0.5, 0.0, 0.0};
+static const double probe_fy[SERIES_PROBES] = {0.0, 0.0, 0.0, 0.5, 1.0, 1.0, 1.0, 0.5};
+
+// Calculate the series approximation for the rectangle of deltas from re0 to re1 and im0 to
+// im1 (times 2^delta_exp) around the reference. Sets s->iters to 0 if no iterations can be skipped.
+void perturb_series_calc(perturb_series *s, const perturb_ref *ref, double re0, double re1, double im0, double im1,
+                         int delta_exp)
+{
+   double px[SERIES_PROBES], py[SERIES_PROBES], dx[SERIES_PROBES], dy[SERIES_PROBES];
+   double ax, ay, bx, by, cx, cy, nax, nay, nbx, nby, ncx, ncy;
+   double zx, zy, tx, ty, ux, uy, ex, ey, mag, scale, sc, pscale;
+   unsigned n;
+   int i, k, ok;
+
+   memset(s, 0, sizeof(perturb_series));
+
+   scale = 0.0;
+   for (i = 0; i < SERIES_PROBES; i++)
+   {
+      px[i] = re0 + probe_fx[i] * (re1 - re0);
+      py[i] = im0 + probe_fy[i] * (im1 - im0);
+      dx[i] = dy[i] = 0.0;
+      mag = px[i] * px[i] + py[i] * py[i];
+      if (mag > scale)
+         scale = mag;
+   }
+   if (scale == 0.0)
+      return;
+   scale = sqrt(scale);
+   s->inv_scale = 1.0 / scale;
+
+   ax = ay = bx = by = cx = cy = 0.0;
+   s->exp = delta_exp;
+   sc = ldexp(1.0, s->exp);      // 2^exp, for the nonlinear terms
+   pscale = 1.0;                 // 2^(delta_exp - exp), for dc
+
+   // Never skip to the end of the orbit: the points need at least one iteration
+   for (n = 0; n + 1 < ref->len; n++)
+   {
+      zx = ref->x[n];
+      zy = ref->y[n];
+
+      // Scaled coefficients for iteration n + 1
+      nax = 2.0 * (zx * ax - zy * ay) + scale * pscale;
+      nay = 2.0 * (zx * ay + zy * ax);
+      nbx = 2.0 * (zx * bx - zy * by) + ax * ax * sc - ay * ay * sc;
+      nby = 2.0 * (zx * by + zy * bx) + 2.0 * ax * ay * sc;
+      ncx = 2.0 * (zx * cx - zy * cy) + 2.0 * (ax * bx - ay * by) * sc;
+      ncy = 2.0 * (zx * cy + zy * cx) + 2.0 * (ax * by + ay * bx) * sc;
+
+      ok = 1;
+      for (i = 0; i < SERIES_PROBES; i++)
+      {
+         tx = zx + zx + dx[i] * sc;
+         ty = zy + zy + dy[i] * sc;
+         ex = tx * dx[i] - ty * dy[i] + px[i] * pscale;
+         dy[i] = tx * dy[i] + ty * dx[i] + py[i] * pscale;
+         dx[i] = ex;
+
+         // Series value at the probe: ((c * u + b) * u + a) * u
+         ux = px[i] * s->inv_scale;
+         uy = py[i] * s->inv_scale;
+         tx = ncx * ux - ncy * uy + nbx;
+         ty = ncx * uy + ncy * ux + nby;
+         ex = tx * ux - ty * uy + nax;
+         ey = tx * uy + ty * ux + nay;
+         tx = ex * ux - ey * uy;
+         ty = ex * uy + ey * ux;
+
+         ex = tx - dx[i];
+         ey = ty - dy[i];
+         mag = dx[i] * dx[i] + dy[i] * dy[i];
+         if (ex * ex + ey * ey > SERIES_TOL * SERIES_TOL * mag)
+            ok = 0;
+
+         tx = ref->x[n + 1] + dx[i] * sc;
+         ty = ref->y[n + 1] + dy[i] * sc;
+         mag = tx * tx + ty * ty;
+         if (mag < ref->thresh[n + 1] || mag >= DIVERGED_THRESH)
+            ok = 0;
+      }
+      if (!ok)
+         break;
+
+      ax = nax;
+      ay = nay;
+      bx = nbx;
+      by = nby;
+      cx = ncx;
+      cy = ncy;
+      s->iters = n + 1;
+
+      // Rescale (exactly) if a drifts far from 1
+      mag = fabs(ax) + fabs(ay);
+      if (mag > SERIES_RESCALE || (mag < 1.0 / SERIES_RESCALE && mag != 0.0))
+      {
+         k = ilogb(mag);
+         ax = ldexp(ax, -k);
+         ay = ldexp(ay, -k);
+         bx = ldexp(bx, -k);
+         by = ldexp(by, -k);
+         cx = ldexp(cx, -k);
+         cy = ldexp(cy, -k);
+         for (i = 0; i < SERIES_PROBES; i++)
+         {
+            dx[i] = ldexp(dx[i], -k);
+            dy[i] = ldexp(dy[i], -k);
+         }
+         s->exp += k;
+         sc = ldexp(1.0, s->exp);
+         pscale = ldexp(1.0, delta_exp - s->exp);
+      }
+   }
+
+   s->a[0] = ax;
+   s->a[1] = ay;
+   s->b[0] = bx;
+   s->b[1] = by;
+   s->c[0] = cx;
+   s->c[1] = cy;
+}
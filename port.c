@@ -0,0 +1,265 @@
+// -------------------------------------------------------------------------------------
+// Port.c -- Win32 emulation for building the QuickMAN calculation engine on POSIX systems
+// Copyright (C) 2006-2008 Paul Gentieu (paul.gentieu@yahoo.com)
+//
+// This file is part of QuickMAN.
+//
+// QuickMAN is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+//
+// Project Page: http://quickman.sourceforge.net
+//
+// -------------------------------------------------------------------------------------
+//
+// See port.h. The engine only needs a few Win32 calls: auto-reset events that worker
+// threads wait on and set when done, and waits on those events. The worker
+// threads themselves are started with start_thread, on both platforms (see run_pool).
+
+#ifdef _WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0601 // Windows 7, for the processor group functions
+#endif
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "port.h"
+
+#ifdef _WIN32
+
+// Start a detached thread. Returns 0 on failure
+int start_thread(thread_func func, void *param)
+{
+   HANDLE h;
+
+   if ((h = (HANDLE) _beginthreadex(NULL, 0, func, param, 0, NULL)) == 0)
+      return 0;
+   CloseHandle(h);
+   return 1;
+}
+
+// Pin the calling thread to a logical CPU (modulo the number of CPUs). Returns 0 on failure.
+// Windows puts CPUs in processor groups of up to 64, and a thread only runs in one group at a
+// time. CPU numbers here count across all the groups.
+int pin_thread(int cpu)
+{
+   GROUP_AFFINITY affinity;
+   WORD group, num_groups;
+
+   cpu %= get_num_processors();
+   num_groups = GetActiveProcessorGroupCount();
+   for (group = 0; group < num_groups - 1 && cpu >= (int) GetActiveProcessorCount(group); group++)
+      cpu -= GetActiveProcessorCount(group);
+
+   memset(&affinity, 0, sizeof(affinity));
+   affinity.Group = group;
+   affinity.Mask = (KAFFINITY) 1 << cpu;
+   return SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL) != 0;
+}
+
+// All the CPUs, not just the ones in this process's processor group (GetSystemInfo only
+// reports those, so at most 64)
+int get_num_processors(void)
+{
+   DWORD n;
+
+   n = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+   return n > 0 ? (int) n : 1;
+}
+
+void *aligned_malloc(size_t size, size_t align)
+{
+   return _aligned_malloc(size, align);
+}
+
+void aligned_free(void *p)
+{
+   _aligned_free(p);
+}
+
+#else // POSIX
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+// Auto-reset event
+typedef struct
+{
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+   int signaled;
+}
+port_event;
+
+HANDLE CreateEvent(void *attr, BOOL manual_reset, BOOL initial_state, char *name)
+{
+   port_event *e;
+
+   (void) attr;            // always auto-reset and unnamed
+   (void) manual_reset;
+   (void) name;
+   if ((e = (port_event *) malloc(sizeof(port_event))) == NULL)
+      return NULL;
+   pthread_mutex_init(&e->lock, NULL);
+   pthread_cond_init(&e->cond, NULL);
+   e->signaled = initial_state;
+   return e;
+}
+
+// Destroy an event. Nothing can be waiting on it
+BOOL CloseHandle(HANDLE h)
+{
+   port_event *e = (port_event *) h;
+
+   pthread_mutex_destroy(&e->lock);
+   pthread_cond_destroy(&e->cond);
+   free(e);
+   return TRUE;
+}
+
+BOOL SetEvent(HANDLE h)
+{
+   port_event *e = (port_event *) h;
+
+   pthread_mutex_lock(&e->lock);
+   e->signaled = 1;
+   pthread_cond_signal(&e->cond);
+   pthread_mutex_unlock(&e->lock);
+   return TRUE;
+}
+
+// Wait for all n events, resetting each one (auto-reset) as it's consumed
+DWORD WaitForMultipleObjects(DWORD n, HANDLE *events, BOOL wait_all, DWORD ms)
+{
+   DWORD i;
+   port_event *e;
+
+   (void) wait_all;        // always waits for all, with no timeout
+   (void) ms;
+   for (i = 0; i < n; i++)
+   {
+      e = (port_event *) events[i];
+      pthread_mutex_lock(&e->lock);
+      while (!e->signaled)
+         pthread_cond_wait(&e->cond, &e->lock);
+      e->signaled = 0;
+      pthread_mutex_unlock(&e->lock);
+   }
+   return 0;
+}
+
+// Thread start parameters, for the pthreads start routine (which has a different type)
+typedef struct
+{
+   thread_func func;
+   void *param;
+}
+thread_start;
+
+static void *thread_start_routine(void *param)
+{
+   thread_start start;
+
+   start = *(thread_start *) param;
+   free(param);
+   start.func(start.param);
+   return NULL;
+}
+
+// Start a detached thread. Returns 0 on failure
+int start_thread(thread_func func, void *param)
+{
+   pthread_t thread;
+   thread_start *start;
+
+   if ((start = (thread_start *) malloc(sizeof(thread_start))) == NULL)
+      return 0;
+   start->func = func;
+   start->param = param;
+   if (pthread_create(&thread, NULL, thread_start_routine, start))
+   {
+      free(start);
+      return 0;
+   }
+   pthread_detach(thread);
+   return 1;
+}
+
+// Pin the calling thread to a logical CPU. Returns 0 on failure (or where there's no
+// affinity call, e.g. outside Linux)
+int pin_thread(int cpu)
+{
+   #ifdef __linux__
+   cpu_set_t set;
+
+   CPU_ZERO(&set);
+   CPU_SET(cpu % CPU_SETSIZE, &set);
+   return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+   #else
+   return 0;
+   #endif
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER *t)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   t->QuadPart = (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+   return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *f)
+{
+   f->QuadPart = 1000000000LL; // counter is in nanoseconds
+   return TRUE;
+}
+
+void Sleep(DWORD ms)
+{
+   struct timespec ts;
+
+   ts.tv_sec = ms / 1000;
+   ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+   nanosleep(&ts, NULL);
+}
+
+int get_num_processors(void)
+{
+   long n;
+
+   n = sysconf(_SC_NPROCESSORS_ONLN);
+   return n > 0 ? (int) n : 1;
+}
+
+void *aligned_malloc(size_t size, size_t align)
+{
+   void *p;
+
+   if (posix_memalign(&p, align, size))
+      return NULL;
+   return p;
+}
+
+void aligned_free(void *p)
+{
+   free(p);
+}
+
+#endif // _WIN32
@@ -0,0 +1,142 @@
+// -------------------------------------------------------------------------------------
+// Port.h -- Portability definitions for the QuickMAN calculation engine
+// Copyright (C) 2006-2008 Paul Gentieu (paul.gentieu@yahoo.com)
+//
+// This file is part of QuickMAN.
+//
+// QuickMAN is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+//
+// Project Page: http://quickman.sourceforge.net
+//
+// -------------------------------------------------------------------------------------
+//
+// Lets the calculation engine (engine.c, palettes.c) build without the Windows headers.
+// On Windows this just pulls in windows.h. Elsewhere it supplies the few Win32 types
+// and calls the engine uses (auto-reset events and the performance counter), emulated
+// with pthreads in port.c.
+
+#ifndef PORT_H
+#define PORT_H
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <process.h>  // for threading functions
+
+// Microsoft syntax for forcing 64-byte alignment
+#define ALIGN64 __declspec(align(64))
+
+// Atomic 64-bit compare and swap: sets *p to new_val if it equals old_val. Returns the old *p
+#define atomic_cas64(p, old_val, new_val) \
+   InterlockedCompareExchange64((volatile LONGLONG *) (p), (new_val), (old_val))
+
+// Atomic increment/decrement of a LONG. Return the new value
+#define atomic_inc(p) InterlockedIncrement((volatile LONG *) (p))
+#define atomic_dec(p) InterlockedDecrement((volatile LONG *) (p))
+
+#else // POSIX
+
+#include <stddef.h>
+#include <strings.h>
+
+typedef void *HANDLE;
+typedef void *LPVOID;
+typedef unsigned DWORD;
+typedef unsigned short WORD;
+typedef int LONG;
+typedef int BOOL;
+
+typedef union
+{
+   long long QuadPart;
+}
+LARGE_INTEGER;
+
+#define TRUE                     1
+#define FALSE                    0
+#define INFINITE                 0xFFFFFFFF
+
+#define __stdcall
+#define __fastcall
+
+#define ALIGN64 __attribute__((aligned(64)))
+
+#define atomic_cas64(p, old_val, new_val) __sync_val_compare_and_swap((p), (old_val), (new_val))
+#define atomic_inc(p) __sync_add_and_fetch((p), 1)
+#define atomic_dec(p) __sync_sub_and_fetch((p), 1)
+
+// Microsoft CRT functions used by the engine and qmrender
+#define sprintf_s snprintf
+#define _strnicmp strncasecmp
+
+// No timeGetTime() here, and clock_gettime() doesn't have the dual-core problem
+// described at get_timer(), so always use the (emulated) performance counter.
+#define USE_PERFORMANCE_COUNTER
+
+// Bitmap file structures, for loading palettes from BMP files
+#pragma pack(push, 2)
+typedef struct
+{
+   WORD  bfType;
+   DWORD bfSize;
+   WORD  bfReserved1;
+   WORD  bfReserved2;
+   DWORD bfOffBits;
+}
+BITMAPFILEHEADER;
+#pragma pack(pop)
+
+typedef struct
+{
+   DWORD biSize;
+   LONG  biWidth;
+   LONG  biHeight;
+   WORD  biPlanes;
+   WORD  biBitCount;
+   DWORD biCompression;
+   DWORD biSizeImage;
+   LONG  biXPelsPerMeter;
+   LONG  biYPelsPerMeter;
+   DWORD biClrUsed;
+   DWORD biClrImportant;
+}
+BITMAPINFOHEADER;
+
+#define BI_RGB 0
+
+// From port.c. Only the subset of the Win32 behavior used by the engine is implemented:
+// events are always auto-reset and unsignaled initially, and WaitForMultipleObjects
+// always waits for all the events with no timeout.
+
+HANDLE CreateEvent(void *attr, BOOL manual_reset, BOOL initial_state, char *name);
+BOOL SetEvent(HANDLE e);
+BOOL CloseHandle(HANDLE e);
+DWORD WaitForMultipleObjects(DWORD n, HANDLE *events, BOOL wait_all, DWORD ms);
+BOOL QueryPerformanceCounter(LARGE_INTEGER *t);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *f);
+void Sleep(DWORD ms);
+
+#endif // _WIN32
+
+// From port.c, for both platforms
+typedef unsigned (__stdcall *thread_func)(void *param);
+
+int start_thread(thread_func func, void *param);
+int pin_thread(int cpu);
+int get_num_processors(void);
+void *aligned_malloc(size_t size, size_t align);
+void aligned_free(void *p);
+
+#endif // PORT_H
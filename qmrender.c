@@ -0,0 +1,642 @@
+// -------------------------------------------------------------------------------------
+// QMrender.c -- Command line (headless) renderer for the QuickMAN calculation engine
+// Copyright (C) 2006-2008 Paul Gentieu (paul.gentieu@yahoo.com)
+//
+// This file is part of QuickMAN.
+//
+// QuickMAN is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+//
+// Project Page: http://quickman.sourceforge.net
+//
+// -------------------------------------------------------------------------------------
+//
+// Renders one view with man_render() and writes it as a binary PPM file. Also prints the
+// calculation time and iteration rate, so it doubles as a benchmark for the engine. Can also
+// render a zoom sequence through the frame pipeline (see pipe_frame), as QuickMAN's realtime
+// zoom does.
+//
+// Usage: qmrender [options]
+//
+//   -re <val> -im <val>     image center (default: home image). Any number of digits can be
+//                           given, for deep images
+//   -mag <val>              magnification. Can be past the double range (e.g. 1e400)
+//   -iters <n>              max iterations
+//   -size <w>x<h>           image size (default 640x480)
+//   -alg <n>                algorithm (ALG_* value; default 0 = fast, 7 = exact FMA)
+//   -prec <n>               precision (PRECISION_* value; default 0 = auto, 4 = fixed point)
+//   -autofixed              auto precision uses fixed point instead of double past single
+//   -pal <n>                palette number
+//   -norm                   normalized rendering
+//   -de                     DE shaded rendering (darkens the exterior near the set)
+//   -formula <n>            formula (FORMULA_* value; 0 = Mandelbrot, 3 = Burning Ship)
+//   -julia <re> <im>        Julia set for c = re + im * i (the image center is then a z;
+//                           default 0)
+//   -threads <n>            number of threads (default: one per core). The tiles depend on the
+//                           number, and the fast algorithms only guess inside a tile, so their
+//                           images can differ in a few pixels for different numbers. The
+//                           exact algorithms give the same image for any number (see make_tiles)
+//   -numa <n>               thread and memory placement (NUMA_* value; 0 = OS default, 1 = pin
+//                           threads, 2 = also node-local buffers)
+//   -fused <n>              1 = palette map the tiles as they're calculated (default), 0 = map
+//                           the whole image after (see set_fused_palette)
+//   -kernel <n>             widest kernel to use (KERNEL_* value; default 0 = widest available)
+//   -chains <n>             kernel chains to use (2-4; default 0 = the kernel table default)
+//   -chainbench             time each chain count and report the best one for this CPU
+//   -autotune               time each kernel variant and store the fastest ones as the "tuned"
+//                           setting in quickman.cfg (also used by QuickMAN)
+//   -tuned <n>              kernel tuning bitfield (TUNED_* value; default: from quickman.cfg)
+//   -repeat <n>             calculate n times and report the best time
+//   -frames <n>             render a zoom sequence of n frames, starting at the view
+//   -zoom <val>             magnification factor per frame (default 1.1)
+//   -serial                 render the frames one after the other (no pipelining)
+//   -cancel <ms>            cancel the render after ms milliseconds (see cancel_calc), and report
+//                           how long the engine took to stop. The partly done image is written
+//   -o <file>               output file (PPM). No file written if not given. For a frame
+//                           sequence, the frame number goes before the extension
+//   -iterfile <file>        also write raw iteration counts (32-bit, xsize * ysize)
+
+#include "port.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "quickman.h"
+
+static char *precision_strs[] = { "Auto", "Single", "Double", "Extended", "Fixed"};
+
+static void usage(void)
+{
+   printf("Usage: qmrender [-re val] [-im val] [-mag val] [-iters n] [-size WxH] [-alg n]\n"
+          "                [-prec n] [-autofixed] [-pal n] [-norm] [-de] [-formula n]\n"
+          "                [-julia re im] [-threads n] [-numa n] [-fused n] [-kernel n] [-chains n]\n"
+          "                [-chainbench] [-autotune] [-tuned n] [-repeat n] [-frames n]\n"
+          "                [-zoom val] [-serial] [-cancel ms] [-o file.ppm] [-iterfile file]\n");
+   exit(1);
+}
+
+// Write RGB data (32-bit values, RGB in bits 23-0) as a binary PPM file
+static int write_ppm(char *file, unsigned *rgb, int xsize, int ysize)
+{
+   FILE *fp;
+   int i, n;
+   unsigned char *line;
+
+   if ((fp = fopen(file, "wb")) == NULL)
+      return 0;
+   if ((line = (unsigned char *) malloc(xsize * 3)) == NULL)
+   {
+      fclose(fp);
+      return 0;
+   }
+
+   fprintf(fp, "P6\n%d %d\n255\n", xsize, ysize);
+   for (n = 0; n < ysize; n++)
+   {
+      for (i = 0; i < xsize; i++)
+      {
+         line[i * 3 + 0] = (unsigned char) (rgb[i] >> 16);
+         line[i * 3 + 1] = (unsigned char) (rgb[i] >> 8);
+         line[i * 3 + 2] = (unsigned char) rgb[i];
+      }
+      fwrite(line, 3, xsize, fp);
+      rgb += xsize;
+   }
+   free(line);
+   fclose(fp);
+   return 1;
+}
+
+// Make the file name for frame N of a sequence: the frame number goes before the extension
+static void get_frame_file(char *file, int n, char *s, int size)
+{
+   char *ext;
+
+   if ((ext = strrchr(file, '.')) == NULL || strchr(ext, '/') != NULL || strchr(ext, '\\') != NULL)
+      ext = file + strlen(file);
+   sprintf_s(s, size, "%.*s%04d%s", (int) (ext - file), file, n, ext);
+}
+
+// Return the "tuned" setting from quickman.cfg (0 if there isn't one)
+static unsigned read_tuning(void)
+{
+   FILE *fp;
+   char line[256];
+   unsigned tuned;
+
+   tuned = 0;
+   if ((fp = fopen(CFG_FILE, "rt")) == NULL)
+      return 0;
+   while (fgets(line, sizeof(line), fp) != NULL)
+      if (!_strnicmp(line, "tuned", 5))
+         tuned = (unsigned) strtoul(line + 5, NULL, 0);
+   fclose(fp);
+   return tuned;
+}
+
+// Set the "tuned" setting in quickman.cfg, replacing any existing one. The rest of the
+// file is kept as is.
+static int write_tuning(unsigned tuned)
+{
+   FILE *fp;
+   char line[256], *buf, *p;
+   size_t len, size;
+   int ok;
+
+   // Read the old file (if any) minus its tuned lines
+   buf = NULL;
+   len = size = 0;
+   if ((fp = fopen(CFG_FILE, "rt")) != NULL)
+   {
+      while (fgets(line, sizeof(line), fp) != NULL)
+      {
+         if (!_strnicmp(line, "tuned", 5))
+            continue;
+         if (len + strlen(line) + 1 > size)
+         {
+            size = 2 * size + sizeof(line);
+            if ((p = (char *) realloc(buf, size)) == NULL)
+            {
+               free(buf);
+               fclose(fp);
+               return 0;
+            }
+            buf = p;
+         }
+         strcpy(buf + len, line);
+         len += strlen(line);
+      }
+      fclose(fp);
+   }
+
+   if ((fp = fopen(CFG_FILE, "wt")) == NULL)
+   {
+      free(buf);
+      return 0;
+   }
+   if (len)
+   {
+      fwrite(buf, 1, len, fp);
+      if (buf[len - 1] != '\n')
+         fputc('\n', fp);
+   }
+   ok = fprintf(fp, "tuned 0x%X // kernel choices from qmrender -autotune\n", tuned) > 0;
+   fclose(fp);
+   free(buf);
+   return ok;
+}
+
+// Render the view repeat times and return the best time (< 0 on error). Auto precision gets
+// replaced by the precision actually used, so it's reset to precision before each render.
+static double render(man_calc_struct *m, man_view *v, unsigned *rgb, int precision, int repeat)
+{
+   double t, best_t;
+   int i;
+
+   best_t = 1e10;
+   for (i = 0; i < repeat; i++)
+   {
+      v->precision = precision;
+      if ((t = man_render(m, v, rgb)) < 0.0)
+         return t;
+      if (t < best_t)
+         best_t = t;
+   }
+   return best_t;
+}
+
+// Cancel timer: cancels the render after a delay (see -cancel)
+typedef struct
+{
+   man_calc_struct *m;
+   int ms;
+   TIME_UNIT cancel_time;  // when the render was cancelled
+   volatile int done;
+}
+cancel_timer;
+
+static unsigned __stdcall cancel_thread(void *param)
+{
+   cancel_timer *c;
+
+   c = (cancel_timer *) param;
+   Sleep(c->ms);
+   c->cancel_time = get_timer();
+   cancel_calc(c->m);
+   c->done = 1;
+   return 0;
+}
+
+// Zoom sequence state, for the frame pipeline callbacks
+typedef struct
+{
+   man_calc_struct *m;
+   man_view v;             // view of the frame being calculated
+   int precision;          // precision asked for (auto gets replaced; see render)
+   unsigned *rgb[2];       // frame buffers
+   double iter_time[2];    // iteration time of the frame in each buffer (< 0 on error)
+   double total_iter_time;
+   int frames;             // frames presented
+   int err;
+   char *outfile;
+}
+zoom_anim;
+
+// Calculate a frame (pipeline thread)
+static void calc_frame(void *param, int buf)
+{
+   zoom_anim *a;
+
+   a = (zoom_anim *) param;
+   a->v.precision = a->precision;
+   a->iter_time[buf] = man_render(a->m, &a->v, a->rgb[buf]);
+}
+
+// Present a frame: write it out, if there's an output file
+static void present_frame(void *param, int buf)
+{
+   zoom_anim *a;
+   char file[1024];
+
+   a = (zoom_anim *) param;
+   if (a->iter_time[buf] < 0.0)
+   {
+      a->err = 1;
+      return;
+   }
+   a->total_iter_time += a->iter_time[buf];
+   if (a->outfile != NULL)
+   {
+      get_frame_file(a->outfile, a->frames, file, sizeof(file));
+      if (!write_ppm(file, a->rgb[buf], a->v.xsize, a->v.ysize))
+         a->err = 1;
+   }
+   a->frames++;
+}
+
+// Render a zoom sequence of N frames starting at view V, multiplying the magnification by
+// ZOOM each frame. Prints the frame rate and the iteration percentage (iteration time / total
+// time, as shown by QuickMAN while zooming). Returns 0 on error.
+static int render_frames(man_calc_struct *m, man_view *v, int n, double zoom, int serial, char *outfile)
+{
+   zoom_anim a;
+   frame_pipe p;
+   TIME_UNIT start_time;
+   double t;
+   int i;
+
+   memset(&a, 0, sizeof(a));
+   a.m = m;
+   a.v = *v;
+   a.v.mag_str = NULL; // mag gets multiplied below
+   a.precision = v->precision;
+   a.outfile = outfile;
+   a.rgb[0] = (unsigned *) malloc(v->xsize * v->ysize * sizeof(a.rgb[0][0]));
+   a.rgb[1] = (unsigned *) malloc(v->xsize * v->ysize * sizeof(a.rgb[1][0]));
+   if (a.rgb[0] == NULL || a.rgb[1] == NULL || !pipe_init(&p, calc_frame, present_frame, &a, serial))
+   {
+      free(a.rgb[0]);
+      free(a.rgb[1]);
+      return 0;
+   }
+
+   start_time = get_timer();
+   for (i = 0; i < n && !a.err; i++)
+   {
+      pipe_wait(&p);
+      if (i)
+         a.v.mag *= zoom;
+      pipe_frame(&p);
+   }
+   pipe_flush(&p);
+   t = get_seconds_elapsed(start_time);
+
+   printf("%d frames%s, %.4fs, %.2f fps, iteration %.1f%%\n", a.frames, p.serial ? " (serial)" : "", t,
+          a.frames / t, 100.0 * a.total_iter_time / t);
+   pipe_free(&p);
+   if (a.err)
+      printf("Error rendering or writing frame %d\n", a.frames);
+
+   free(a.rgb[0]);
+   free(a.rgb[1]);
+   return !a.err;
+}
+
+int main(int argc, char **argv)
+{
+   man_view v;
+   man_calc_struct *m;
+   unsigned *rgb, *iters;
+   unsigned long long total_iters, max_thread_iters;
+   unsigned periodic;
+   double t, best_t;
+   int i, n, threads, repeat, chainbench, best_chains, tune, have_tuning, frames, serial, cancel_ms;
+   double zoom;
+   unsigned tuning;
+   tune_result results[MAX_TUNE_RESULTS];
+   cancel_timer cancel;
+   char *outfile, *iterfile, mag_str[64];
+   FILE *fp;
+
+   v.re = HOME_RE;
+   v.im = HOME_IM;
+   v.mag = HOME_MAG;
+   v.max_iters = HOME_MAX_ITERS;
+   v.xsize = 640;
+   v.ysize = 480;
+   v.alg = ALG_FAST_ASM_AMD;
+   v.precision = PRECISION_AUTO;
+   v.palette = DEFAULT_PAL;
+   v.rendering_alg = RALG_STANDARD;
+   v.pal_xor = 0;
+   v.max_iters_color = 0;
+   v.kernel = KERNEL_AUTO;
+   v.chains = 0;
+   v.auto_fixed = 0;
+   v.formula = FORMULA_MANDELBROT;
+   v.julia = 0;
+   v.julia_re = v.julia_im = 0.0;
+   v.re_str = v.im_str = v.mag_str = NULL;
+
+   threads = 0;
+   repeat = 1;
+   chainbench = 0;
+   tune = have_tuning = 0;
+   tuning = 0;
+   frames = serial = 0;
+   cancel_ms = -1;
+   zoom = 1.1;
+   outfile = iterfile = NULL;
+
+   for (i = 1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "-norm"))
+      {
+         v.rendering_alg = RALG_NORMALIZED;
+         continue;
+      }
+      if (!strcmp(argv[i], "-de"))
+      {
+         v.rendering_alg = RALG_DE;
+         continue;
+      }
+      if (!strcmp(argv[i], "-chainbench"))
+      {
+         chainbench = 1;
+         continue;
+      }
+      if (!strcmp(argv[i], "-autotune"))
+      {
+         tune = 1;
+         continue;
+      }
+      if (!strcmp(argv[i], "-autofixed"))
+      {
+         v.auto_fixed = 1;
+         continue;
+      }
+      if (!strcmp(argv[i], "-serial"))
+      {
+         serial = 1;
+         continue;
+      }
+      if (i + 1 >= argc)
+         usage();
+      if (!strcmp(argv[i], "-re"))
+         v.re = atof(v.re_str = argv[++i]);
+      else if (!strcmp(argv[i], "-im"))
+         v.im = atof(v.im_str = argv[++i]);
+      else if (!strcmp(argv[i], "-mag"))
+         v.mag = atof(v.mag_str = argv[++i]);
+      else if (!strcmp(argv[i], "-iters"))
+         v.max_iters = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-size"))
+      {
+         if (sscanf(argv[++i], "%dx%d", &v.xsize, &v.ysize) != 2)
+            usage();
+      }
+      else if (!strcmp(argv[i], "-alg"))
+         v.alg = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-prec"))
+         v.precision = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-pal"))
+         v.palette = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-kernel"))
+         v.kernel = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-formula"))
+         v.formula = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-julia"))
+      {
+         if (i + 2 >= argc)
+            usage();
+         v.julia = 1;
+         v.julia_re = atof(argv[++i]);
+         v.julia_im = atof(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-chains"))
+         v.chains = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-tuned"))
+      {
+         tuning = (unsigned) strtoul(argv[++i], NULL, 0);
+         have_tuning = 1;
+      }
+      else if (!strcmp(argv[i], "-threads"))
+      {
+         threads = atoi(argv[++i]);
+         if (threads < 1 || threads > MAX_THREADS)
+            usage();
+      }
+      else if (!strcmp(argv[i], "-numa"))
+         numa_policy = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-fused"))
+         fused_palette = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-repeat"))
+         repeat = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-frames"))
+         frames = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-zoom"))
+         zoom = atof(argv[++i]);
+      else if (!strcmp(argv[i], "-cancel"))
+         cancel_ms = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-o"))
+         outfile = argv[++i];
+      else if (!strcmp(argv[i], "-iterfile"))
+         iterfile = argv[++i];
+      else
+         usage();
+   }
+
+   if (v.xsize < MIN_SIZE || v.ysize < MIN_SIZE || repeat < 1)
+      usage();
+
+   // Julia sets are centered on 0 (unless a center is given)
+   if (v.julia && v.re_str == NULL)
+      v.re = 0.0;
+   if (v.julia && v.im_str == NULL)
+      v.im = 0.0;
+
+   if (!init_engine(threads) || (m = alloc_man_calc_struct(FLAG_CALC_RE_ARRAY)) == NULL)
+   {
+      printf("Error initializing engine.\n");
+      return 1;
+   }
+
+   rgb = (unsigned *) malloc(v.xsize * v.ysize * sizeof(rgb[0]));
+   iters = (unsigned *) malloc(v.xsize * v.ysize * sizeof(iters[0]));
+   if (rgb == NULL || iters == NULL)
+   {
+      printf("Error allocating image.\n");
+      return 1;
+   }
+
+   // Autotune: time the variants and store the best ones in quickman.cfg, then use them below
+   if (tune)
+   {
+      tuning = autotune(m, results, &n, repeat);
+      for (i = 0; i < n; i++)
+         printf("%-8s %-24s%s %.4fs\n", precision_strs[results[i].precision], results[i].name,
+                results[i].intel ? " (Intel)" : "        ", results[i].time);
+      for (i = PRECISION_SINGLE; i <= PRECISION_EXTENDED; i++)
+         if (TUNED_KERNEL(tuning, i))
+            printf("Best %s: kernel %d, %d chains\n", precision_strs[i], TUNED_KERNEL(tuning, i),
+                   TUNED_CHAINS(tuning, i));
+      if (write_tuning(tuning))
+         printf("Wrote tuned 0x%X to %s\n\n", tuning, CFG_FILE);
+      else
+         printf("Error writing %s\n\n", CFG_FILE);
+      have_tuning = 1;
+   }
+   kernel_tuning = have_tuning ? tuning : read_tuning();
+
+   // Auto precision mode gets replaced by the precision actually used, so latch it
+   n = v.precision;
+   total_iters = 0;
+
+   // Chain count benchmark: time each count. Counts the kernel in use doesn't have fall back to
+   // its default (see find_kernel), so the kernel names are shown too. Leaves the best count
+   // set for the report below.
+   if (chainbench)
+   {
+      best_t = 1e10;
+      best_chains = 0;
+      for (v.chains = 2; v.chains <= 4; v.chains++)
+      {
+         if ((t = render(m, &v, rgb, n, repeat)) < 0.0)
+            break;
+         printf("%d chains: %.4fs (%s)\n", v.chains, t, m->kernel_name);
+         if (t < best_t)
+         {
+            best_t = t;
+            best_chains = v.chains;
+         }
+      }
+      printf("Best: %d chains\n\n", best_chains);
+      v.chains = best_chains;
+   }
+
+   // Zoom sequence: just report the frame rate
+   if (frames > 0)
+   {
+      i = render_frames(m, &v, frames, zoom, serial, outfile);
+      free(rgb);
+      free(iters);
+      free_man_calc_struct(m);
+      return !i;
+   }
+
+   // Cancel test: one render, cancelled from another thread partway through
+   if (cancel_ms >= 0)
+   {
+      cancel.m = m;
+      cancel.ms = cancel_ms;
+      cancel.done = 0;
+      repeat = 1;
+      if (!start_thread(cancel_thread, &cancel))
+      {
+         printf("Error starting cancel thread.\n");
+         return 1;
+      }
+   }
+
+   if ((best_t = render(m, &v, rgb, n, repeat)) < 0.0)
+   {
+      printf("Error allocating image.\n");
+      return 1;
+   }
+
+   if (cancel_ms >= 0)
+   {
+      if (m->cancelled)
+         printf("Cancelled after %dms, returned %.2fms later\n", cancel_ms,
+                1000.0 * get_seconds_elapsed(cancel.cancel_time));
+      else
+         printf("Finished before the cancel\n");
+      while (!cancel.done) // it still has m
+         Sleep(1);
+   }
+
+   // Iterations done (including queue flushing dummies) and points retired early by periodicity
+   // checking, from the thread point structures. The busiest thread gives the load balance
+   // efficiency (100% if all threads did the same number of iterations), as in QuickMAN.
+   periodic = 0;
+   max_thread_iters = 0;
+   for (i = 0; i < m->num_threads; i++)
+   {
+      total_iters += m->thread_states[i].ps_ptr->iterctr;
+      periodic += m->thread_states[i].ps_ptr->periodic_ctr;
+      if (m->thread_states[i].ps_ptr->iterctr > max_thread_iters)
+         max_thread_iters = m->thread_states[i].ps_ptr->iterctr;
+   }
+   max_thread_iters *= m->iters_per_tick;
+   total_iters *= m->iters_per_tick;
+
+   if (m->mag_exp)
+      get_mag_str(m, mag_str, sizeof(mag_str));
+   else
+      sprintf_s(mag_str, sizeof(mag_str), "%g", v.mag);
+   printf("Re %.17g Im %.17g Mag %s Iters %u Size %dx%d\n", v.re, v.im, mag_str, m->max_iters, v.xsize, v.ysize);
+   if (v.julia)
+      printf("Julia set for c = %.17g %+.17gi\n", v.julia_re, v.julia_im);
+   printf("Precision %s%s%s, alg %d, kernel %s, %d threads\n", precision_strs[v.precision],
+          m->precision_loss ? " [Prec Loss]" : "", m->perturb ? " [Perturbation]" : "",
+          v.alg, m->kernel_name, m->num_threads);
+   if (m->series.iters)
+      printf("Series approximation skipped %u iterations\n", m->series.iters);
+   if (m->glitches)
+      printf("%u points left glitched\n", m->glitches);
+   if (periodic)
+      printf("%u points found periodic (retired before max iters)\n", periodic);
+   printf("Time %.4fs, %.2f Miters/s, %.2f GFlops\n", best_t, (double) total_iters * 1e-6 / best_t,
+          (double) total_iters * m->flops_per_iter * 1e-9 / best_t);
+   if (m->num_threads > 1 && max_thread_iters)
+      printf("Thread efficiency %.1f%%\n", 100.0 * total_iters / ((double) m->num_threads * max_thread_iters));
+
+   if (outfile != NULL && !write_ppm(outfile, rgb, v.xsize, v.ysize))
+      printf("Error writing %s\n", outfile);
+
+   if (iterfile != NULL)
+   {
+      get_man_data(m, iters, NULL);
+      if ((fp = fopen(iterfile, "wb")) == NULL ||
+          fwrite(iters, sizeof(iters[0]), v.xsize * v.ysize, fp) != (size_t) (v.xsize * v.ysize))
+         printf("Error writing %s\n", iterfile);
+      if (fp != NULL)
+         fclose(fp);
+   }
+
+   free(rgb);
+   free(iters);
+   free_man_calc_struct(m);
+   return 0;
+}
@@ -69,15 +69,17 @@
 #include <process.h>  // for threading functions
 #include <math.h>
 
+#include "port.h"
 #include "resource.h"
 #include "quickman.h"
 
 // Combo box initialization strings/defines. String order should correspond
 // to the above #define order for PRECISION_* and ALG_*.
-static char *precision_strs[] = { "Auto", "Single", "Double", "Extended"};
+static char *precision_strs[] = { "Auto", "Single", "Double", "Extended", "Fixed"};
 static char *alg_strs[] =       { "Fast, AMD",   "Exact, AMD",
                                   "Fast, Intel", "Exact, Intel",
-                                  "Fast, C",     "Exact, C" };
+                                  "Fast, C",     "Exact, C",
+                                  "Fast, FMA",   "Exact, FMA" };
                                   //"Fast error" };
 
 // Striped, Flaming+, and Plantlike are marked for replacement- rarely used.
@@ -86,10 +88,17 @@ static char *palette_strs[] = { "Monochrome", "Striped", "Loud", "Muted", "Purpl
                                 "Earthy", "Smoky", "Acid", "Flaming", "Metallic",
                                 "Angry", "Dreamy", "Flaming+", "Plantlike" };
 
-static char *rendering_strs[] = { "Standard", "Normalized" };
+static char *rendering_strs[] = { "Standard", "Normalized", "DE shaded" };
 
-// Not all of these will be used
-static char *num_threads_strs[] = { "1", "2", "4", "8", "16", "32", "64", "128", "256" };
+// Number of threads choices: the powers of 2 below the number of cores, then the number of
+// cores (see init_num_threads_strs). Enough for MAX_THREADS
+#define MAX_THREADS_CHOICES   16
+static char num_threads_buf[MAX_THREADS_CHOICES][8];
+static char *num_threads_strs[MAX_THREADS_CHOICES];
+static int num_threads_choices;
+
+// Per-thread load lines shown in the info area (the efficiency figure covers all the threads)
+#define MAX_INFO_THREADS      64
 
 static const char help_text[] =
 {
@@ -114,18 +123,17 @@ static const char help_text[] =
    "H or Home button: go to the home image\n\n"
    "L: lock the current palette (ignore logfile palettes)\n\n"
    "I: invert the current palette\n\n"
+   "J: switch to the Julia set for the point under the mouse, and back\n\n"
    "F1: show this message"
 };
 
 // Global mandelbrot parameters
-static int num_threads_ind = 0;        // number of threads string index
-int num_threads = 1;                   // number of calculation threads. Limited to values that make sense: 1, 2, 4, 8, 16...
 static int prev_xsize;                 // previous sizes, for restoring window
 static int prev_ysize;
-static double mouse_re;                // re/im coordinates of the mouse position
-static double mouse_im;
+static hp_num mouse_re;                // re/im coordinates of the mouse position (high precision,
+static hp_num mouse_im;                // for deep images)
 static double zoom_start_mag;          // starting magnification, for zoom button
-static int precision_loss = 0;         // 1 if precision loss detected on most recent calculation
+static int zoom_start_mag_exp;
 static unsigned num_builtin_palettes;  // number of builtin palettes
 static unsigned num_palettes;          // total number of palettes
 static char palette_file[256];         // filename of current user palette file
@@ -148,9 +156,8 @@ static unsigned interval_frames = 0;    // frames per interval
 static double file_tot_time = 0.0;      // total calculation time since file opened
 static int all_recalculated = 0;        // flag indicating a recalculation of the whole image happened
 static TIME_UNIT zoom_start_time;       // for zoom button benchmarking (helps measure overhead)
-
-// Idicates whether processor supports SSE/SSE2 and CMOV instructions
-static int sse_support = 0; // 1 for SSE, 2 for SSE and SSE2
+static frame_pipe zoom_pipe;            // realtime zoom frame pipeline (see start_zoom_frame)
+static double zoom_iter_time[2];        // iteration time of the frame in each zoom buffer
 
 // Mouse position: index 0 is position on initial button press; index 1 is current position
 static int mouse_x[2], mouse_y[2];
@@ -264,30 +271,11 @@ static quadrant quad[4];
 
 static int screen_xpos, screen_ypos; // position of screen (in above coordinate system)
 
-// Constants and variables used in the fast "wave" algorithm
-
-// Starting values for x and y. Now seems faster to have these as static globals
-static const int wave_ystart[7]   = {3, 1, 3, 1, 0, 1, 0};   // calculates y = 0, needs dummy line at y = -1 (set to 0's)
-static const int wave_xstart[7]   = {0, 2, 2, 0, 1, 1, 0};
-
-// X and Y increments for each wave
-static const int wave_inc[7]      = {4, 4, 4, 4, 2, 2, 2};
-
-// Offsets from current pixel location. If all 4 pixels there are equal, set the current pixel
-// to that value (not used for wave 0). Stored in increasing pointer order
-
-static const int wave_xoffs[7][4] = {{ 0, 0, 0,  0}, {-2, 2, -2, 2}, {0, -2, 2, 0}, {0, -2, 2, 0},
-                                     {-1, 1, -1, 1}, { 0, -1, 1, 0}, {0, -1, 1, 0}};
-static const int wave_yoffs[7][4] = {{ 0,  0, 0, 0}, {-2, -2, 2, 2}, {-2, 0, 0, 2}, {-2, 0, 0, 2},
-                                     {-1, -1, 1, 1}, {-1,  0, 0, 1}, {-1, 0, 0, 1}};
-
-static int wave_ptr_offs[7][4];  // Pointer offsets into bitmap, precalculated from above values
+// Force 64-byte alignment (used for aligning pointstruct arrays in the man_calc_structs).
 
-// Microsoft syntax for forcing 64-byte alignment (used for aligning pointstruct
-// arrays in the man_calc_structs).
-
-__declspec(align(64)) man_calc_struct main_man_calc_struct; // used for normal calculation
-__declspec(align(64)) man_calc_struct save_man_calc_struct; // used for saving images
+ALIGN64 man_calc_struct main_man_calc_struct; // used for normal calculation
+ALIGN64 man_calc_struct save_man_calc_struct; // used for saving images
+ALIGN64 man_calc_struct preview_man_calc_struct; // used for the Julia preview
 
 // ----------------------- File/misc functions -----------------------------------
 
@@ -307,10 +295,17 @@ static settings cfg_settings = // scfs
    {"Maxiters_color", 0, 0, 0, 0xFFFFFF},  // max doesn't really matter, but this only uses 24 bits; autoreset.
    {"Pal_xor", 0, 0, 0, 0xFFFFFF},         // ditto
    {"options", OPTIONS_DEFAULT, OPTIONS_DEFAULT, 0, 0xFFFF}, // bitfield; max doesn't matter
-   {"spt", SPT_DEFAULT, SPT_DEFAULT, 0, 0xFFFFFF}, // bitfield; have to do an external min/max check on this one
+   {"spt", 0, 0, 0, 0xFFFFFF},             // no longer used (see man_calculate); still accepted
    {"bst", 16, 16, 1, 0xFFFFFF},           // blit stripe thickness; max doesn't matter
    {"pfcmin", 150, 150, 1, 10000},         // 10000 * real value
    {"pfcmax", 300, 300, 1, 10000},         // 10000 * real value
+   {"Kernel", KERNEL_AUTO, KERNEL_AUTO, KERNEL_AUTO, KERNEL_MAX}, // autoreset (so logfile entries can override)
+   {"Chains", 0, 0, 0, 4},                 // 0 = default; autoreset
+   {"autofixed", 0, 0, 0, 1},              // see man_setup
+   {"formula", FORMULA_MANDELBROT, FORMULA_MANDELBROT, FORMULA_MANDELBROT, NUM_FORMULAS - 1}, // FORMULA_* (see FORMULA_ITERATE)
+   {"tuned", 0, 0, 0, 0x1FFFFFF},          // bitfield (see TUNED); written by qmrender -autotune
+   {"numa", NUMA_OFF, NUMA_OFF, NUMA_OFF, NUMA_LOCAL}, // NUMA_* (see numa_policy); only read at startup
+   {"fused", 1, 1, 0, 1},                  // palette map tiles as they're calculated (see set_fused_palette)
 };
 
 static log_entry *log_entries = NULL;
@@ -369,9 +364,10 @@ static settings cur_file_settings;
 int log_read_entry(log_entry *entry, FILE *fp)
 {
    double vals[5];
+   floatexp mag;
    int i, j, n, ind, val;
    setting *s, *f;
-   unsigned char strs[5][256], *str, c;
+   unsigned char strs[5][CENTER_STR_SIZE + 16], *str, *val_strs[5], c; // long enough for deep re/im
 
    // Initialize cur file settings structure to all invalid (no change)
    invalidate_settings(&cur_file_settings);
@@ -435,6 +431,7 @@ int log_read_entry(log_entry *entry, FILE *fp)
          // Got something that looks like a number or a " if we get here. Any bad
          // values will be set to 0.0 (ok). J is long lived (see below)
          vals[i] = atof(&str[j]);
+         val_strs[i] = &str[j];  // re/im are also read at full precision below
          i++; // look for next entry
       }
    }
@@ -445,7 +442,11 @@ int log_read_entry(log_entry *entry, FILE *fp)
       // Fill in the entry, including optional fields (if they're still at -1, nothing will happen later).
       entry->re = vals[0];
       entry->im = vals[1];
-      entry->mag = vals[2];
+      hp_from_string(&entry->re_hp, (char *) val_strs[0]);
+      hp_from_string(&entry->im_hp, (char *) val_strs[1]);
+      fe_from_string(&mag, (char *) val_strs[2]); // can be past the double range
+      entry->mag = mag.val;
+      entry->mag_exp = mag.exp;
       entry->max_iters = (unsigned) vals[3];
       entry->palette = (unsigned) vals[4];
 
@@ -533,10 +534,39 @@ int log_read(char *file, char *msg, int init_pos)
    return 1;
 }
 
+// Get the image center (including the pan offsets) as strings, for the logfile and image info.
+// Deep images need more digits than a double has, so these come from the high precision re/im.
+// Strings need CENTER_STR_SIZE chars.
+
+void get_center_strs(man_calc_struct *m, char *re_str, char *im_str)
+{
+   hp_num re, im;
+   int digits;
+
+   sync_re_im_hp(m);
+   re = m->re_hp;
+   im = m->im_hp;
+   add_re_im_offs(m, &re, &im, m->pan_xoffs, m->pan_yoffs);
+
+   // Enough for the pixel spacing, plus some extra
+   digits = (int) (log10(m->mag) + m->mag_exp * 0.30102999566398120) + 20;
+   if (digits <= 16)
+   {
+      sprintf_s(re_str, CENTER_STR_SIZE, "%-16.16lf", hp_to_double(&re));
+      sprintf_s(im_str, CENTER_STR_SIZE, "%-16.16lf", hp_to_double(&im));
+   }
+   else
+   {
+      hp_to_string(&re, re_str, CENTER_STR_SIZE, digits);
+      hp_to_string(&im, im_str, CENTER_STR_SIZE, digits);
+   }
+}
+
 // Open the logfile for appending and add the current image. Reset position if reset_pos is 1.
 int log_update(char *file, int reset_pos)
 {
-   char s[512], p[256];
+   char s[1024 + 2 * CENTER_STR_SIZE], p[256], re_str[CENTER_STR_SIZE], im_str[CENTER_STR_SIZE];
+   char mag_str[64];
    FILE *fp;
    man_calc_struct *m;
 
@@ -561,13 +591,15 @@ int log_update(char *file, int reset_pos)
       fputs(s, fp);
    }
    // Logfile read function ignores any leading items
+   get_center_strs(m, re_str, im_str);
+   get_mag_str(m, mag_str, sizeof(mag_str));
    sprintf_s(s, sizeof(s),
-              "\nReal     %-16.16lf\n"
-              "Imag     %-16.16lf\n"
-              "Mag      %-16lf\n"
+              "\nReal     %s\n"
+              "Imag     %s\n"
+              "Mag      %s\n"
               "Iters    %d\n"
               "Palette  %s\n",
-              m->re, m->im, m->mag, m->max_iters, p);
+              re_str, im_str, mag_str, m->max_iters, p);
 
    fputs(s, fp);
    fclose(fp);
@@ -601,9 +633,12 @@ log_entry *log_get(int next_prevn)
 
    e = &log_entries[log_pos];
 
-   m->re = e->re;
-   m->im = e->im;
+   m->re_hp = e->re_hp;
+   m->im_hp = e->im_hp;
+   m->re = hp_to_double(&m->re_hp);
+   m->im = hp_to_double(&m->im_hp);
    m->mag = e->mag;
+   m->mag_exp = e->mag_exp;
    m->max_iters = e->max_iters;
    if (!(status & STAT_PALETTE_LOCKED))
       m->palette = e->palette;
@@ -630,6 +665,10 @@ void read_cfg_file(void)
 
    copy_changed_settings(&cfg_settings, &cur_file_settings, 1); // 1 = copy to default_val also
 
+   kernel_tuning = cfg_settings.tuned.val;
+   numa_policy = cfg_settings.numa.val;
+   fused_palette = cfg_settings.fused.val;
+
    // maybe eliminate these separate variables later
    m->xsize = prev_xsize = cfg_settings.xsize.val;
    m->ysize = prev_ysize = cfg_settings.ysize.val;
@@ -660,41 +699,6 @@ void add_user_palettes_and_logfiles(void)
          SendDlgItemMessage(h, IDC_LOGFILE, CB_DELETESTRING, (WPARAM) ind, 0);
 }
 
-// Timer function: returns current time in TIME_UNITs (changed from previous versions).
-// Can use two different methods based on #define: QueryPerformanceCounter is more
-// precise, but has a bug when running on dual-core CPUs. Randomly selects one or
-// the other core to read the number from, and gets bogus results if it reads the wrong one.
-
-TIME_UNIT get_timer(void)
-{
-   #ifdef USE_PERFORMANCE_COUNTER
-   TIME_UNIT t;
-   QueryPerformanceCounter(&t);
-   return t;
-   #else
-   return timeGetTime();
-   #endif
-}
-
-// Get the number of seconds elapsed since start_time.
-double get_seconds_elapsed(TIME_UNIT start_time)
-{
-   TIME_UNIT t;
-   #ifdef USE_PERFORMANCE_COUNTER
-   QueryPerformanceFrequency(&f);
-   QueryPerformanceCounter(&t);
-   t.QuadPart -= start_time.QuadPart;
-   if (f.QuadPart)
-      return (double) t.QuadPart / (double) f.QuadPart;
-   return 1e10;
-   #else
-   // Need to use TIME_UNIT (dword) to avoid wrapping issues with timeGetTime().
-   // Can subtract in DWORD domain, but not double.
-   t = timeGetTime() - start_time;
-   return 1e-3 * (double) t;
-   #endif
-}
-
 // For GetAsyncKeyState: if this bit is set in return value, key is down (MSB of SHORT)
 #define KEYDOWN_BIT     0x8000
 #define KEY_LEFT        1
@@ -725,1540 +729,81 @@ int get_keys_pressed(void)
 void reset_thread_load_counters(void)
 {
    int i;
-   man_calc_struct *m;
-
-   m = &main_man_calc_struct;
-   for (i = 0; i < MAX_THREADS; i++)
-      m->thread_states[i].total_iters = 0;
-}
-
-// Reset frames/sec timing values
-void reset_fps_values(void)
-{
-   total_frames = 0;
-   interval_frames = 0;
-   calc_interval_time = 0.0;
-   calc_total_time = 0.0;
-   interval_time = 0.0;
-   total_time = 0.0;
-}
-
-// Get the real or imaginary coordinate delta based on the pixel delta (offs) from
-// the image center, the image smaller dimension, and the magnification.
-
-// Returns value on ST(0), so there should be no precision loss from calling a function
-// as opposed to doing a macro.
-double get_re_im_offs(man_calc_struct *m, long long offs)
-{
-  return (((double) offs * 4.0) / (double) m->min_dimension) / m->mag;
-}
-
-// Update the image center coordinates (re/im) based on xoffs and yoffs (pixels from current center).
-// Any time this is done, the pan offsets need to be reset to 0.
-
-// Also, call this with pan_xoffs and pan_yoffs to calculate a new re/im from the current
-// pan offsets (and then reset the offsets).
-
-void update_re_im(man_calc_struct *m, long long xoffs, long long yoffs)
-{
-   m->re += get_re_im_offs(m, xoffs);
-   m->im -= get_re_im_offs(m, yoffs);
-   m->pan_xoffs = 0;
-   m->pan_yoffs = 0;
-}
-
-// Set the new point and magnification based on x0, x1, y0, y1. If zoom_box is 0,
-// multiplies/divides the magnification by a fixed value. If zoom_box is 1, calculates
-// the new zoom from the ratio of the zoom box size (defined by x0, x1, y0, y1)
-// to the window size. Recenters the image on x0, y0 (if no zoom box) or the center
-// of the zoom box.
-
-// Re/im should be updated with the current pan offsets before calling this (this is
-// done on buttondown events in the window function).
-
-void update_re_im_mag(int zoom_box, int in_outn, int x0, int y0, int x1, int y1)
-{
-   double tmp_mag, xz, yz;
-   int x, y;
-   man_calc_struct *m;
-
-   m = &main_man_calc_struct;
-
-   tmp_mag = m->mag;
-
-   if (!zoom_box) // just zoom in or out
-   {
-      x = x0;     // point center
-      y = y0;
-      if (in_outn)
-         tmp_mag *= MAG_ZOOM_FACTOR;
-      else
-         tmp_mag *= (1.0 / MAG_ZOOM_FACTOR);
-   }
-   // Zoom based on box. For zooming in, uses the box size and center to set the
-   // new point and magnification
-   else
-   {
-      x = abs(x0 - x1);
-      y = abs(y0 - y1);
-
-      // Get smaller of xzoom and yzoom
-      xz = (double) m->xsize / (double) x;
-      yz = (double) m->ysize / (double) y;
-
-      if (xz < yz)
-         tmp_mag *= xz;
-      else
-         tmp_mag *= yz;
-
-      x = (x0 + x1) >> 1; // new point center:
-      y = (y0 + y1) >> 1; // center of zoom box
-   }
-
-   // Get new point center, based on x, y
-
-   //if (in_outn) // uncomment to not center when zooming out
-   update_re_im(m, x - (m->xsize >> 1), y - (m->ysize >> 1)); // re/im already updated with any pan offsets here
-
-   // Update mag
-   if (tmp_mag >= MAG_MIN) // preserve closest min, to allow
-      m->mag = tmp_mag;       // zooming back to original mag
-}
-
-// ----------------------- Iteration functions -----------------------------------
-
-// Lame unoptimized C iteration function. Just does one point at a time, using point 0
-// in the point structure.
-
-static unsigned iterate_c(man_pointstruct *ps_ptr)
-{
-   double a, b, x, y, xx, yy, rad;
-   unsigned iters, iter_ct;
-
-   iters = 0;
-   iter_ct = ps_ptr->cur_max_iters;
-
-   a = ps_ptr->ab_in[0];
-   b = ps_ptr->ab_in[1];
-   rad = DIVERGED_THRESH;
-   x = y = xx = yy = 0.0;
-
-   do
-   {
-      y = (x + x) * y + b;
-      x = xx - yy + a;
-      yy = y * y;
-      xx = x * x;
-      iters++;
-      if ((xx + yy) >= rad)
-         break;
-   }
-   while (--iter_ct);
-
-   // Store final count and magnitude (squared)
-
-   ps_ptr->mag[0] = xx + yy;  // use this for tmp storage (mag stored to array below)
-
-   return iters;
-}
-
-// Queue a point to be iterated, for the C iteration function
-static void FASTCALL queue_point_c(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr)
-{
-   man_calc_struct *m;
-   unsigned iters;
-
-   m = (man_calc_struct *) calc_struct;
-
-   //-------
-   FILE* fp;
-   static int fileNo = 0;
-   static int currLines = 0;
-   char szFilename[1024];
-   if (currLines >= 1000000)
-   {
-	   currLines = 0;
-	   fileNo++;
-   }
-   sprintf_s(szFilename, 1024, "oversample_debug.%d.csv", fileNo);
-   fopen_s(&fp, szFilename, "a");
-   double center_re = ps_ptr->ab_in[0];
-   double center_im = ps_ptr->ab_in[1];
-   double im_width = m->img_im[0] - m->img_im[1];
-   double re_width = m->img_re[1] - m->img_re[0];
-
-   int max_iters_reached = 0;
-   #define SQUARE_SIZE		1
-   int iters_log[SQUARE_SIZE];
-   int log_ended_early = 0;
-   for (int i = 0; i < SQUARE_SIZE; i++)
-   {
-	   memset(iters_log, 0, sizeof(iters_log));
-	   for (int j = 0; !max_iters_reached && j < SQUARE_SIZE; j++)
-	   {
-		   ps_ptr->ab_in[0] = center_re - re_width / 2 + re_width * (1.0 * j / SQUARE_SIZE);
-		   ps_ptr->ab_in[1] = center_im - im_width / 2 + im_width * (1.0 * i / SQUARE_SIZE);
-		   iters = m->mandel_iterate(ps_ptr);
-		   iters_log[j] = iters;
-
-		   //sprintf_s(szFileLine, 1024, "%16.16lf,%16.16lf,%d,%d,%d\n", center_re, center_im, i + 1, j + 1, iters);
-		   //sprintf_s(szFileLine, 1024, "%16.16lf,%16.16lf,%16.16lf,%16.16lf,%d\r\n", center_re, center_im, ps_ptr->ab_in[0], ps_ptr->ab_in[1], iters);
-		   //fputs(szFileLine, fp);
-		   if (iters == m->max_iters)
-		   {
-			   //max_iters_reached = 1;
-		   }
-	   }
-
-	   char szFileLine[1024];
-	   memset(szFileLine, 0, sizeof(szFileLine));
-	   char szTmp[1024];
-	   if (i == 0)
-	   {
-		   sprintf_s(szTmp, sizeof(szTmp), "%16.16lf,%16.16lf",
-						center_re - re_width / 2,
-						center_im - im_width / 2
-		   );
-		   strcat_s(szFileLine, sizeof(szFileLine), szTmp);
-	   }
-	   else if (i == SQUARE_SIZE - 1)
-	   {
-		   sprintf_s(szTmp, sizeof(szTmp), "%16.16lf,%16.16lf",
-			   center_re + re_width / 2,
-			   center_im + im_width / 2
-			   );
-		   strcat_s(szFileLine, sizeof(szFileLine), szTmp);
-	   }
-	   else
-	   {
-		   strcat_s(szFileLine, sizeof(szFileLine), ",");
-	   }
-	   for (int i = 0; i < SQUARE_SIZE; i++)
-	   {
-		   if (!log_ended_early)
-		   {
-			   sprintf_s(szTmp, sizeof(szTmp), ",%d", iters_log[i]);
-			   strcat_s(szFileLine, sizeof(szFileLine), szTmp);
-			   if (iters_log[i] == m->max_iters)
-			   {
-				   log_ended_early = 1;
-				   log_ended_early = 0;
-			   }
-		   }
-		   else
-		   {
-			   strcat_s(szFileLine, sizeof(szFileLine), ",");
-		   }
-	   }
-	   strcat_s(szFileLine, sizeof(szFileLine), "\n");
-	   currLines++;
-	   if (i > 1 && i == SQUARE_SIZE - 1)
-	   {
-		   strcat_s(szFileLine, sizeof(szFileLine), "\n");
-		   currLines++;
-	   }
-	   fputs(szFileLine, fp);
-   }
-   fclose(fp);
-   //-------
-
-   ps_ptr->ab_in[0] = center_re;
-   ps_ptr->ab_in[1] = center_im;
-   if (!max_iters_reached)
-   {
-	   iters = m->mandel_iterate(ps_ptr);  // No queuing- just iterate 1 point
-	   if (iters != m->max_iters)          // do this just to match iteration offset of ASM versions
-		   iters++;
-   }
-
-   ps_ptr->iters_ptr[0] = iters_ptr;   // Store iters and mag
-   *ps_ptr->iters_ptr[0] = iters;
-   ps_ptr->iterctr += iters;
-
-   MAG(m, ps_ptr->iters_ptr[0]) = (float) ps_ptr->mag[0];
-}
-
-// Code for ASM iteration functions.
-
-// XMM registers for the SSE2 algorithms
-#define xmm_x01   xmm0
-#define xmm_y01   xmm1
-#define xmm_yy01  xmm2
-#define xmm_mag   xmm3
-#define xmm_x23   xmm4
-#define xmm_y23   xmm5
-#define xmm_yy23  xmm6
-#define xmm_two   xmm7
-
-// XMM registers for the SSE algorithms
-#define xmm_x03   xmm0
-#define xmm_y03   xmm1
-#define xmm_yy03  xmm2
-#define xmm_x47   xmm4
-#define xmm_y47   xmm5
-#define xmm_yy47  xmm6
-
-// Optimized SSE2 (double precision) ASM algorithm that iterates 4 points at a time. The point
-// 2,3 calculations are about a half-iteration behind the point 0,1 calculations, to allow
-// improved interleaving of multiplies and adds. Additionally, the loop is unrolled twice and
-// divergence detection is done only every 2nd iteration. After the loop finishes, the code
-// backs out to check if the points actually diverged during the previous iteration.
-//
-// The divergence detection is done using integer comparisons on the magnitude exponents
-// (the divergence threshold should be a power of two).
-//
-// 8 total iterations (4 points * 2x unroll) are done per loop. It consists
-// of independent, interleaved iteration blocks:
-//
-// do
-// {
-// // Points 0,1     Points 2,3
-//    y += b;        y *= x;
-//    mag += yy;     x *= x;
-//    x += a;        y *= 2;
-//    yy = y;        mag = x;
-//    yy *= yy;      x -= yy;
-//    y *= x;        y += b;
-//    x *= x;        mag += yy;
-//    y *= 2;        x += a;
-//    mag = x;       yy = y;
-//    x -= yy;       yy *= yy;
-//
-//    [2nd iter: repeat above blocks]
-//
-//    if (any 2nd iter mag diverged)
-//       break;
-// }
-// while (--cur_max_iters);
-//
-// Initial conditions: x = y = yy = 0.0
-//
-// Note: The mags in the first half of the loop are not actually calculated in
-// the loop, but are determined afterwards in the backout calculations from
-// stored intermediate values.
-//
-// From timing measurements, the 53-instruction loop takes ~41 clocks on an Athlon 64 4000+ 2.4 GHz.
-//
-// Very slow on a Pentium 4 (~100 clocks) due to blocked store fowarding; see Intel code.
-
-static unsigned iterate_amd_sse2(man_pointstruct *ps_ptr) // sip4
-{
-   __asm
-   {
-   // Tried getting rid of the xmm save/restore by having queue_point load directly into
-   // the xmm registers (see qhold_load_xmm.c): overhead reduction is negligible.
-
-   mov      ebx,           ps_ptr      // Get pointstruct pointer. PS4_ macros below reference [ebx + offset]
-   movapd   xmm_x23,       PS4_X23     // Restore point states
-   movapd   xmm_x01,       PS4_X01
-   movapd   xmm_two,       PS4_TWO
-   movapd   xmm_y23,       PS4_Y23
-   movapd   xmm_y01,       PS4_Y01
-   movapd   xmm_yy23,      PS4_YY23
-
-   mov      edx,           DIV_EXP           // Exp for magnitude exponent comparison. Slower to compare to const directly
-   mov      ecx,           PS4_CUR_MAX_ITERS // max iters to do this call; always even
-   mov      eax,           0                 // iteration counter (for each of the 4 points)
-   jmp      skip_top                         // Jump past 1st 2 movapds for loop entry, eliminating
-   nop                                       // need to restore yy01- lower overhead
-   nop
-   nop                                       // Achieve the magic alignment (see below)
-   nop
-   nop
-   nop
-
-   // Found that it's important for the end-of-loop branch to be on a 16-byte boundary
-   // (code is slower if not). Choose instructions above to cause this.
-   //
-   // v1.0 update: The above no longer holds. Now the magic alignment seems random...
-   // the number of nops above must be determined by trial and error.
-
-iter_loop:
-   movapd   PS4_YY01,      xmm_yy01    // save yy01 for mag backout checking
-   movapd   PS4_X01,       xmm_x01     // save x01 for mag backout checking; contains xx01 - yy01 here
-skip_top:
-   addpd    xmm_y01,       PS4_B01     // y01 += b01; faster at top of loop. Initial y01 = 0
-   mulpd    xmm_y23,       xmm_x23     // y23 *= x23; faster at top of loop.
-   add      eax,           2           // update iteration counter; faster here than 2 insts below
-   mulpd    xmm_x23,       xmm_x23     // x23 *= x23
-   addpd    xmm_x01,       PS4_A01     // x01 += a01
-   addpd    xmm_y23,       xmm_y23     // y23 *= 2; faster here than mulpd xmm_y23, xmm_two
-   movapd   xmm_yy01,      xmm_y01     // yy01 = y01
-   movapd   PS4_X23,       xmm_x23     // save xx23 for magnitude backout checking
-   mulpd    xmm_yy01,      xmm_yy01    // yy01 *= yy01
-   subpd    xmm_x23,       xmm_yy23    // x23 -= yy23
-   mulpd    xmm_y01,       xmm_x01     // y01 *= x01
-   addpd    xmm_y23,       PS4_B23     // y23 += b23
-   mulpd    xmm_x01,       xmm_x01     // x01 *= x01
-   movapd   PS4_YY23,      xmm_yy23    // save yy23 for magnitude backout checking
-   mulpd    xmm_y01,       xmm_two     // y01 *= 2; add slower here; bb stall
-   addpd    xmm_x23,       PS4_A23     // x23 += a23
-   movapd   xmm_mag,       xmm_x01     // mag01 = x01
-   movapd   xmm_yy23,      xmm_y23     // yy23 = y23
-   subpd    xmm_x01,       xmm_yy01    // x01 -= yy01
-   mulpd    xmm_yy23,      xmm_yy23    // yy23 *= yy23
-   addpd    xmm_y01,       PS4_B01     // y01 += b01
-   mulpd    xmm_y23,       xmm_x23     // y23 *= x23
-   // ----- Start of 2nd iteration block ------
-   addpd    xmm_mag,       xmm_yy01
-   mulpd    xmm_x23,       xmm_x23
-   addpd    xmm_x01,       PS4_A01
-   movapd   xmm_yy01,      xmm_y01     // these 2 instrs: faster in this order than reversed (fixes y23 dep?)
-   mulpd    xmm_y23,       xmm_two     // (yy01 is apparently just "marked" to get y01 here; doesn't cause a dep delay)
-   movapd   PS4_MAG01,     xmm_mag     // save point 0,1 magnitudes for comparison
-   movapd   xmm_mag,       xmm_x23
-   mulpd    xmm_yy01,      xmm_yy01
-   subpd    xmm_x23,       xmm_yy23
-   mulpd    xmm_y01,       xmm_x01
-   addpd    xmm_y23,       PS4_B23
-   mulpd    xmm_x01,       xmm_x01
-   addpd    xmm_mag,       xmm_yy23
-   movapd   PS4_MAG23,     xmm_mag     // Save point 2,3 magnitudes. Best here, despite dep
-   cmp      PS4_MEXP0,     edx         // Compare the magnitude exponents of points 0 and 1
-   cmovge   ecx,           eax         // to the divergence threshold. AMD doesn't seem to mind
-   cmp      PS4_MEXP1,     edx         // the store fowarding issue, but Intel does.
-   cmovge   ecx,           eax         // Conditional moves set ecx to eax on divergence,
-   mulpd    xmm_y01,       xmm_two     // breaking the loop.
-   addpd    xmm_x23,       PS4_A23     // add y, y and mul y, two seem equal speed here
-   movapd   xmm_yy23,      xmm_y23
-   subpd    xmm_x01,       xmm_yy01
-   mulpd    xmm_yy23,      xmm_yy23
-   cmp      PS4_MEXP2,     edx         // Compare the magnitude exponents of points 2 and 3.
-   cmovge   ecx,           eax
-   cmp      PS4_MEXP3,     edx
-   cmovge   ecx,           eax
-   cmp      ecx,           eax         // Continue iterating until max iters reached for this call,
-   jne      iter_loop                  // or one of the points diverged.
-
-   // Exited loop: save iterating point states, and update point iteration counts. Because
-   // divergence detection is only done every 2 iterations, need to "back out" and see if
-   // a point diverged the previous iteration. Calculate previous magnitudes from stored
-   // values and save in expp. Caller can then use DIVERGED and DIVERGED_PREV macros
-   // to detect if/when the point diverged.
-
-   // Structure contents here: PS4.x = xx01 - yy01;  PS4.yy = yy01; PS4.x + 16 = xx23; PS4.yy + 16 = yy23
-   // Order here seems fastest, despite dependencies
-   // Really only need to calculate prev mags for points that diverged... could save overhead
-
-   movapd   PS4_Y01,       xmm_y01     // save y01 state
-   movapd   PS4_Y23,       xmm_y23     // save y23 state
-
-   mulpd    xmm_two,       PS4_YY01    // Use xmm_two for tmp var; tmp1 = 2 * yy01
-   movapd   xmm_mag,       PS4_X23     // tmp2 = xx23
-   addpd    xmm_two,       PS4_X01     // get mag01 = xx01 - yy01 + 2 * yy01 = xx01 + yy01
-   addpd    xmm_mag,       PS4_YY23    // get mag23 = xx23 + yy23
-   movapd   PS4_MAGPREV01, xmm_two     // store prev_mag 01
-   movapd   PS4_MAGPREV23, xmm_mag     // store prev_mag 23
-
-   xor      ecx,           ecx         // Get a 0
-   add      PS4_ITERCTR_L, eax         // Update iteration counter. Multiply by 36 to get effective flops.
-   adc      PS4_ITERCTR_H, ecx         // Update iterctr high dword
-
-   movapd   PS4_YY01,      xmm_yy01    // save yy01 state
-   movapd   PS4_X23,       xmm_x23     // save x23 state
-   movapd   PS4_X01,       xmm_x01     // save x01 state
-   movapd   PS4_YY23,      xmm_yy23    // save yy23 state
-
-   add      PS4_ITERS0,    eax         // update point iteration counts
-   add      PS4_ITERS1,    eax
-   add      PS4_ITERS2,    eax
-   add      PS4_ITERS3,    eax
-
-   // return value (iters done per point) is in eax
-
-   // 0xF3 prefix for AMD single byte return fix: does seem to make a difference
-   // Don't put any code between here and ret. Watch for compiler-inserted pops if
-   // using extra registers.
-
-   //pop      ebx        // compiler pushes ebx, ebp on entry
-   //pop      ebp        // accessing ebp gives compiler warning
-   //__emit(0xF3);
-   //ret
-   }
-}
-
-// Intel version. Basically the same as the AMD version, but doesn't do magnitude
-// comparison in the INT domain because this causes a blocked store-forwarding
-// penalty (from XMM store to INT load) of 40-50 clock cycles. Uses cmppd/movmskpd instead.
-//
-// Changed to use same initial conditions as AMD code. No consistent speed difference
-// vs. old version. Appears to be about 0.3% slower on the home benchmark, but
-// 0.5% faster on bmark.log.
-
-// From timing measurements, the loop takes 50 clocks on a Pentium D 820 2.8 GHz.
-
-static unsigned iterate_intel_sse2(man_pointstruct *ps_ptr) // sip4
-{
-   __asm
-   {
-   mov      ebx,           ps_ptr      // Get pointstruct pointer
-   movapd   xmm_yy01,      PS4_YY01    // Restore point states
-   movapd   xmm_y01,       PS4_Y01
-   movapd   xmm_x23,       PS4_X23
-   movapd   xmm_x01,       PS4_X01
-   movapd   xmm_two,       PS4_TWO
-   movapd   xmm_y23,       PS4_Y23
-   movapd   xmm_yy23,      PS4_YY23
-   addpd    xmm_y01,       PS4_B01     // pre-add y01 to get correct initial condition
-
-   mov      eax,           2           // iteration counter (for each of the 4 points)
-   jmp      skip_top
-
-iter_loop:                             // alignment doesn't seem to matter on Intel
-   movapd   PS4_YY01,      xmm_yy01    // save yy01 for mag backout checking
-   movapd   PS4_X01,       xmm_x01     // save x01 for mag backout checking; contains xx01 - yy01 here
-   add      eax,           2           // update iteration counter
-skip_top:
-   mulpd    xmm_x23,       xmm_x23     // x23 *= x23
-   addpd    xmm_x01,       PS4_A01     // x01 += a01
-   addpd    xmm_y23,       xmm_y23     // y23 *= 2; faster here than mulpd xmm_y23, xmm_two
-   movapd   xmm_yy01,      xmm_y01     // yy01 = y01
-   movapd   PS4_X23,       xmm_x23     // save xx23 for magnitude backout checking
-   mulpd    xmm_yy01,      xmm_yy01    // yy01 *= yy01
-   subpd    xmm_x23,       xmm_yy23    // x23 -= yy23
-   mulpd    xmm_y01,       xmm_x01     // y01 *= x01
-   addpd    xmm_y23,       PS4_B23     // y23 += b23
-   mulpd    xmm_x01,       xmm_x01     // x01 *= x01
-   movapd   PS4_YY23,      xmm_yy23    // save yy23 for magnitude backout checking
-   mulpd    xmm_y01,       xmm_two     // y01 *= 2; add slower here
-   addpd    xmm_x23,       PS4_A23     // x23 += a23
-   movapd   xmm_mag,       xmm_x01     // mag01 = x01
-   movapd   xmm_yy23,      xmm_y23     // yy23 = y23
-   subpd    xmm_x01,       xmm_yy01    // x01 -= yy01
-   mulpd    xmm_yy23,      xmm_yy23    // yy23 *= yy23
-   addpd    xmm_y01,       PS4_B01     // y01 += b01
-   mulpd    xmm_y23,       xmm_x23     // y23 *= x23
-   // ----- Start of 2nd iteration block ------
-   addpd    xmm_mag,       xmm_yy01
-   mulpd    xmm_x23,       xmm_x23
-   addpd    xmm_x01,       PS4_A01
-   mulpd    xmm_y23,       xmm_two
-   movapd   xmm_yy01,      xmm_y01
-   movapd   PS4_MAG01,     xmm_mag     // new, mag store for normalized iteration count alg -- not much effect on speed
-   cmpnltpd xmm_mag,       PS4_RAD     // compare point 0, 1 magnitudes (mag >= rad): let cpu reorder these
-   movmskpd edx,           xmm_mag     // save result in edx
-   movapd   xmm_mag,       xmm_x23
-   mulpd    xmm_yy01,      xmm_yy01
-   subpd    xmm_x23,       xmm_yy23
-   mulpd    xmm_y01,       xmm_x01
-   addpd    xmm_y23,       PS4_B23
-   mulpd    xmm_x01,       xmm_x01
-   addpd    xmm_mag,       xmm_yy23
-   mulpd    xmm_y01,       xmm_two
-   addpd    xmm_x23,       PS4_A23
-   add      edx,           edx         // shift point 01 mag compare results left 2
-   add      edx,           edx
-   movapd   xmm_yy23,      xmm_y23
-   subpd    xmm_x01,       xmm_yy01
-   movapd   PS4_MAG23,     xmm_mag     // new, mag store for normalized iteration count alg -- not much effect on speed
-   cmpnltpd xmm_mag,       PS4_RAD     // compare point 2, 3 magnitudes
-   mulpd    xmm_yy23,      xmm_yy23
-   addpd    xmm_y01,       PS4_B01
-   movmskpd ecx,           xmm_mag
-   mulpd    xmm_y23,       xmm_x23
-   or       ecx,           edx         // Continue iterating until max iters reached for this call,
-   jnz      done                       // or one of the points diverged.
-   cmp      PS4_CUR_MAX_ITERS, eax     // No penalty for comparing from memory vs. register here
-   jne      iter_loop
-
-done:
-   subpd    xmm_y01,       PS4_B01     // subtract out pre-add (see loop top)
-   movapd   PS4_Y01,       xmm_y01     // save y01 state
-   movapd   PS4_Y23,       xmm_y23     // save y23 state
-
-   // Get previous magnitudes. See AMD code
-   mulpd    xmm_two,       PS4_YY01    // Use xmm_two for tmp var; tmp1 = 2 * yy01
-   movapd   xmm_mag,       PS4_X23     // tmp2 = xx23
-   addpd    xmm_two,       PS4_X01     // get mag01 = xx01 - yy01 + 2 * yy01 = xx01 + yy01
-   addpd    xmm_mag,       PS4_YY23    // get mag23 = xx23 + yy23
-   movapd   PS4_MAGPREV01, xmm_two     // store prev_mag 01
-   movapd   PS4_MAGPREV23, xmm_mag     // store prev_mag 23
-
-   xor      edx,           edx         // Get a 0
-   add      PS4_ITERCTR_L, eax         // Update iteration counter. Multiply by 36 to get effective flops.
-   adc      PS4_ITERCTR_H, edx         // Update iterctr high dword
-
-   movapd   PS4_YY01,      xmm_yy01    // save yy01 state
-   movapd   PS4_X23,       xmm_x23     // save x23 state
-   movapd   PS4_X01,       xmm_x01     // save x01 state
-   movapd   PS4_YY23,      xmm_yy23    // save yy23 state
-
-   add      PS4_ITERS0,    eax         // update point iteration counts
-   add      PS4_ITERS1,    eax
-   add      PS4_ITERS2,    eax
-   add      PS4_ITERS3,    eax
-   }
-}
-
-// SSE (single precision) algorithm for AMD; iterates 8 points at a time,
-// or 16 iterations per loop. Based on AMD SSE2 algorithm.
-
-// Loop appears to take 42.25 clocks- the 8 extra int compare/cmov
-// instructions add 2 extra clocks per loop vs. the SSE2 algorithm.
-// Tried rearranging them but current order seems best.
-
-static unsigned iterate_amd_sse(man_pointstruct *ps_ptr) // sip8
-{
-   __asm
-   {
-   mov      ebx,           ps_ptr            // Get pointstruct pointer
-   movaps   xmm_x47,       PS8_X47           // Restore point states
-   movaps   xmm_x03,       PS8_X03
-   movaps   xmm_two,       PS8_TWO
-   movaps   xmm_y47,       PS8_Y47
-   movaps   xmm_y03,       PS8_Y03
-   movaps   xmm_yy47,      PS8_YY47
-
-   mov      edx,           DIV_EXP_FLOAT     // Exp for magnitude exponent comparison. Slower to compare to const directly
-   mov      ecx,           PS8_CUR_MAX_ITERS // max iters to do this call; always even
-   mov      eax,           0                 // Iteration counter (for each of the 4 points)
-   jmp      skip_top                         // Allows removing yy03 restore above
-   nop
-   nop                                       // Achieve the magic alignment...
-   nop
-   nop
-   nop
-   nop
-   nop
-   nop
-   nop
-
-iter_loop:
-   movaps   PS8_YY03,      xmm_yy03    // save yy03 for mag backout checking
-   movaps   PS8_X03,       xmm_x03     // save x03 for mag backout checking; contains xx03 - yy03 here
-skip_top:
-   addps    xmm_y03,       PS8_B03     // y03 += b03; faster at top of loop. Initial y03 = 0
-   mulps    xmm_y47,       xmm_x47     // y47 *= x47; faster at top of loop.
-   add      eax,           2           // update iteration counter; faster here than 2 insts below
-   mulps    xmm_x47,       xmm_x47     // x47 *= x47
-   addps    xmm_x03,       PS8_A03     // x03 += a03
-   addps    xmm_y47,       xmm_y47     // y47 *= 2; faster here than mulps xmm_y47, xmm_two
-   movaps   xmm_yy03,      xmm_y03     // yy03 = y03
-   movaps   PS8_X47,       xmm_x47     // save xx47 for magnitude backout checking
-   mulps    xmm_yy03,      xmm_yy03    // yy03 *= yy03
-   subps    xmm_x47,       xmm_yy47    // x47 -= yy47
-   mulps    xmm_y03,       xmm_x03     // y03 *= x03
-   addps    xmm_y47,       PS8_B47     // y47 += b47
-   mulps    xmm_x03,       xmm_x03     // x03 *= x03
-   movaps   PS8_YY47,      xmm_yy47    // save yy47 for magnitude backout checking
-   mulps    xmm_y03,       xmm_two     // y03 *= 2; add slower here; bb stall
-   addps    xmm_x47,       PS8_A47     // x47 += a47
-   movaps   xmm_mag,       xmm_x03     // mag03 = x03
-   movaps   xmm_yy47,      xmm_y47     // yy47 = y47
-   subps    xmm_x03,       xmm_yy03    // x03 -= yy03
-   mulps    xmm_yy47,      xmm_yy47    // yy47 *= yy47
-   addps    xmm_y03,       PS8_B03     // y03 += b03
-   mulps    xmm_y47,       xmm_x47     // y47 *= x47
-   // ----- Start of 2nd iteration block ------
-   addps    xmm_mag,       xmm_yy03
-   mulps    xmm_x47,       xmm_x47
-   addps    xmm_x03,       PS8_A03
-   movaps   xmm_yy03,      xmm_y03     // these 2 instrs: faster in this order than reversed (fixes y47 dep?)
-   mulps    xmm_y47,       xmm_two     // (yy03 is apparently just "marked" to get y03 here; doesn't cause a dep delay)
-   movaps   PS8_MAG03,     xmm_mag     // save point 0-3 magnitudes for comparison
-   movaps   xmm_mag,       xmm_x47
-   mulps    xmm_yy03,      xmm_yy03
-   subps    xmm_x47,       xmm_yy47
-   mulps    xmm_y03,       xmm_x03
-   addps    xmm_y47,       PS8_B47
-   mulps    xmm_x03,       xmm_x03
-   addps    xmm_mag,       xmm_yy47
-   movaps   PS8_MAG47,     xmm_mag     // Save point 4-7 magnitudes. Best here, despite dep
-   cmp      PS8_MEXP0,     edx         // Compare the magnitude exponents of points 0-3
-   cmovge   ecx,           eax         // to the divergence threshold. AMD doesn't seem to mind
-   cmp      PS8_MEXP1,     edx         // the store fowarding issue, but Intel does.
-   cmovge   ecx,           eax         // Conditional moves set ecx to eax on divergence,
-   cmp      PS8_MEXP2,     edx         // breaking the loop.
-   cmovge   ecx,           eax
-   cmp      PS8_MEXP3,     edx
-   cmovge   ecx,           eax
-   mulps    xmm_y03,       xmm_two     // add y, y and mul y, two seem equal speed here
-   addps    xmm_x47,       PS8_A47
-   movaps   xmm_yy47,      xmm_y47
-   subps    xmm_x03,       xmm_yy03
-   mulps    xmm_yy47,      xmm_yy47
-   cmp      PS8_MEXP4,     edx         // Compare the magnitude exponents of points 4-7.
-   cmovge   ecx,           eax
-   cmp      PS8_MEXP5,     edx
-   cmovge   ecx,           eax
-   cmp      PS8_MEXP6,     edx
-   cmovge   ecx,           eax
-   cmp      PS8_MEXP7,     edx
-   //cmovge   ecx,           eax       // jge done seems a hair faster. When changing instrs, don't forget
-   jge      done                       // to adjust nops to put jne iter_loop on a 16-byte boundary.
-   cmp      ecx,           eax         // Continue iterating until max iters reached for this call,
-   jne      iter_loop                  // or one of the points diverged.
-
-done:
-   // Get previous magnitudes. See AMD SSE2 code
-   movaps   PS8_Y03,       xmm_y03     // save y03 state
-   movaps   PS8_Y47,       xmm_y47     // save y47 state
-
-   mulps    xmm_two,       PS8_YY03    // Use xmm_two for tmp var; tmp1 = 2 * yy03
-   movaps   xmm_mag,       PS8_X47     // tmp2 = xx47
-   addps    xmm_two,       PS8_X03     // get mag03 = xx03 - yy03 + 2 * yy03 = xx03 + yy03
-   addps    xmm_mag,       PS8_YY47    // get mag47 = xx47 + yy47
-   movaps   PS8_MAGPREV03, xmm_two     // store prev_mag 03
-   movaps   PS8_MAGPREV47, xmm_mag     // store prev_mag 47
-
-   xor      ecx,           ecx         // Get a 0
-   add      PS8_ITERCTR_L, eax         // Update iteration counter. Multiply by 72 to get effective flops.
-   adc      PS8_ITERCTR_H, ecx         // Update iterctr high dword
-
-   movaps   PS8_YY03,      xmm_yy03    // save yy03 state
-   movaps   PS8_X47,       xmm_x47     // save x47 state
-   movaps   PS8_X03,       xmm_x03     // save x03 state
-   movaps   PS8_YY47,      xmm_yy47    // save yy47 state
-
-   add      PS8_ITERS0,    eax         // update point iteration counts
-   add      PS8_ITERS1,    eax
-   add      PS8_ITERS2,    eax
-   add      PS8_ITERS3,    eax
-   add      PS8_ITERS4,    eax
-   add      PS8_ITERS5,    eax
-   add      PS8_ITERS6,    eax
-   add      PS8_ITERS7,    eax
-   // return value (iterations done per point) is in eax
-   }
-}
-
-// SSE (single precision) algorithm for Intel; iterates 8 points at a time,
-// or 16 iterations per loop. Based on Intel SSE2 algorithm.
-static unsigned iterate_intel_sse(man_pointstruct *ps_ptr) // sip8
-{
-   __asm
-   {
-   mov      ebx,           ps_ptr      // Get pointstruct pointer
-   movaps   xmm_yy03,      PS8_YY03    // Restore point states
-   movaps   xmm_x47,       PS8_X47
-   movaps   xmm_x03,       PS8_X03
-   movaps   xmm_two,       PS8_TWO
-   movaps   xmm_y47,       PS8_Y47
-   movaps   xmm_y03,       PS8_Y03
-   movaps   xmm_yy47,      PS8_YY47
-   addps    xmm_y03,       PS8_B03     // pre-add y03 to get correct initial condition
-
-   mov      eax,           2           // iteration counter (for each of the 4 points)
-   jmp      skip_top
-
-iter_loop:                             // alignment doesn't seem to matter on Intel
-   movaps   PS8_YY03,      xmm_yy03    // save yy03 for mag backout checking
-   movaps   PS8_X03,       xmm_x03     // save x03 for mag backout checking; contains xx03 - yy03 here
-   add      eax,           2           // update iteration counter
-skip_top:
-   mulps    xmm_x47,       xmm_x47     // x47 *= x47
-   addps    xmm_x03,       PS8_A03     // x03 += a03
-   addps    xmm_y47,       xmm_y47     // y47 *= 2; faster here than mulps xmm_y47, xmm_two
-   movaps   xmm_yy03,      xmm_y03     // yy03 = y03
-   movaps   PS8_X47,       xmm_x47     // save xx47 for magnitude backout checking
-   mulps    xmm_yy03,      xmm_yy03    // yy03 *= yy03
-   subps    xmm_x47,       xmm_yy47    // x47 -= yy47
-   mulps    xmm_y03,       xmm_x03     // y03 *= x03
-   addps    xmm_y47,       PS8_B47     // y47 += b47
-   mulps    xmm_x03,       xmm_x03     // x03 *= x03
-   movaps   PS8_YY47,      xmm_yy47    // save yy47 for magnitude backout checking
-   mulps    xmm_y03,       xmm_two     // y03 *= 2; add slower here
-   addps    xmm_x47,       PS8_A47     // x47 += a47
-   movaps   xmm_mag,       xmm_x03     // mag03 = x03
-   movaps   xmm_yy47,      xmm_y47     // yy47 = y47
-   subps    xmm_x03,       xmm_yy03    // x03 -= yy03
-   mulps    xmm_yy47,      xmm_yy47    // yy47 *= yy47
-   addps    xmm_y03,       PS8_B03     // y03 += b03
-   mulps    xmm_y47,       xmm_x47     // y47 *= x47
-   // ----- Start of 2nd iteration block ------
-   addps    xmm_mag,       xmm_yy03
-   mulps    xmm_x47,       xmm_x47
-   addps    xmm_x03,       PS8_A03
-   mulps    xmm_y47,       xmm_two
-   movaps   xmm_yy03,      xmm_y03
-   movapd   PS8_MAG03,     xmm_mag     // new, mag store for normalized iteration count alg -- not much effect on speed
-   cmpnltps xmm_mag,       PS8_RAD     // compare point 0-3 magnitudes (mag >= rad): let cpu reorder these
-   movmskps edx,           xmm_mag     // save result in edx
-   movaps   xmm_mag,       xmm_x47
-   mulps    xmm_yy03,      xmm_yy03
-   subps    xmm_x47,       xmm_yy47
-   mulps    xmm_y03,       xmm_x03
-   addps    xmm_y47,       PS8_B47
-   mulps    xmm_x03,       xmm_x03
-   addps    xmm_mag,       xmm_yy47
-   mulps    xmm_y03,       xmm_two
-   addps    xmm_x47,       PS8_A47
-   shl      edx,           4           // shift point 0-3 mag compare results left 4
-   movaps   xmm_yy47,      xmm_y47
-   subps    xmm_x03,       xmm_yy03
-   movapd   PS8_MAG47,     xmm_mag     // new, mag store for normalized iteration count alg -- not much effect on speed
-   cmpnltps xmm_mag,       PS8_RAD     // compare point 4-7 magnitudes
-   mulps    xmm_yy47,      xmm_yy47
-   addps    xmm_y03,       PS8_B03
-   movmskps ecx,           xmm_mag
-   mulps    xmm_y47,       xmm_x47
-   or       ecx,           edx         // Continue iterating until max iters reached for this call,
-   jnz      done                       // or one of the points diverged.
-   cmp      PS8_CUR_MAX_ITERS, eax     // No penalty for comparing from memory vs. register here
-   jne      iter_loop
-
- done:
-   subps    xmm_y03,       PS8_B03     // subtract out pre-add (see loop top)
-   movaps   PS8_Y03,       xmm_y03     // save y03 state
-   movaps   PS8_Y47,       xmm_y47     // save y47 state
-
-   // Get previous magnitudes. See AMD SSE2 code
-   mulps    xmm_two,       PS8_YY03    // Use xmm_two for tmp var; tmp1 = 2 * yy03
-   movaps   xmm_mag,       PS8_X47     // tmp2 = xx47
-   addps    xmm_two,       PS8_X03     // get mag03 = xx03 - yy03 + 2 * yy03 = xx03 + yy03
-   addps    xmm_mag,       PS8_YY47    // get mag47 = xx47 + yy47
-   movaps   PS8_MAGPREV03, xmm_two     // store prev_mag 03
-   movaps   PS8_MAGPREV47, xmm_mag     // store prev_mag 47
-
-   xor      edx,           edx         // Get a 0
-   add      PS8_ITERCTR_L, eax         // Update iteration counter. Multiply by 72 to get effective flops.
-   adc      PS8_ITERCTR_H, edx         // Update iterctr high dword
-
-   movaps   PS8_YY03,      xmm_yy03    // save yy03 state
-   movaps   PS8_X47,       xmm_x47     // save x47 state
-   movaps   PS8_X03,       xmm_x03     // save x03 state
-   movaps   PS8_YY47,      xmm_yy47    // save yy47 state
-
-   add      PS8_ITERS0,    eax         // update point iteration counts
-   add      PS8_ITERS1,    eax
-   add      PS8_ITERS2,    eax
-   add      PS8_ITERS3,    eax
-   add      PS8_ITERS4,    eax
-   add      PS8_ITERS5,    eax
-   add      PS8_ITERS6,    eax
-   add      PS8_ITERS7,    eax
-   }
-}
-
-// Queuing functions
-
-// The queue_status field of the pointstruct structure keeps track of which point
-// queue slots are free. Each 3 bits gives a free slot.
-// Push: shift left 3, OR in free slot number.
-// Pop: slot number = low 3 bits, shift right 3.
-// Queue is full when queue_status == QUEUE_FULL.
-// Initialize with 3, 2, 1, 0 in bits 11-0, QUEUE_FULL in bits 15-12
-// Also used for single precision algorithm, to track up to 8 queue slots
-
-#define QUEUE_FULL   0xF
-
-// Condition indicating point[ind] diverged
-#define DIVERGED(p, ind)         (((int *)p->mag)[1 + (ind << 1)] >= DIV_EXP)
-
-// Condition indicating point[ind] diverged on the previous iteration
-#define DIVERGED_PREV(p, ind)    (((int *)p->magprev)[1 + (ind << 1)] >= DIV_EXP)
-
-// For single-precision (SSE) version
-#define DIVERGED_S(p, ind)       (((int *)p->mag)[ind] >= DIV_EXP_FLOAT)
-#define DIVERGED_PREV_S(p, ind)  (((int *)p->magprev)[ind] >= DIV_EXP_FLOAT)
-
-// Queue a point for iteration using the 4-point SSE2 algorithm. On entry, ps_ptr->ab_in
-// should contain the real and imaginary parts of the point to iterate on, and
-// iters_ptr should be the address of the point in the iteration count array.
-//
-// Can't assume all 4 point b's will be the same (pixels on the previous line may
-// still be iterating).
-
-// Rewriting this in ASM would probably save a lot of overhead (important for
-// realtime zooming and panning)
-
-static void FASTCALL queue_4point_sse2(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp
-{
-   unsigned i, iters, max, queue_status, *ptr;
-   man_calc_struct *m;
-
-   m = (man_calc_struct *) calc_struct;
-
-   queue_status = ps_ptr->queue_status;
-
-   if (queue_status == QUEUE_FULL) // If all points in use, iterate to clear at least one point first
-   {
-      m->mandel_iterate(ps_ptr);    // Returns (iters done) if any point hit max iterations, or diverged
-      max = 0;
-      for (i = 0; i < 4; i++) // compiler fully unrolls this
-      {
-         // Find which point(s) are done and retire them (store iteration count to array).
-         // Iteration counts will later be mapped to colors using the current palette.
-         // Timing test: removing array stores results in NO time savings on bmark.log.
-
-         iters = ps_ptr->iters[i];
-         if (DIVERGED(ps_ptr, i))
-         {
-            // If actually diverged on previous iteration, dec iters.
-            // *ps_ptr->iters_ptr[i] = iters - DIVERGED_PREV(ps_ptr, i);
-
-            // This is about 3% slower (with the branch and extra stores) than the old code (above).
-            // Needed to get the correct magnitude for the normalized iteration count algorithm.
-
-            ptr = ps_ptr->iters_ptr[i];
-            if (DIVERGED_PREV(ps_ptr, i))
-            {
-               *ptr = iters - 1;
-               MAG(m, ptr) = (float) ps_ptr->magprev[i];
-            }
-            else
-            {
-               *ptr = iters;
-               MAG(m, ptr) = (float) ps_ptr->mag[i];
-            }
-
-            // Push free slot. Use this form to allow compiler to use the lea instruction
-            queue_status = queue_status * 8 + i;
-         }
-         // Gets here most often. See if this point has the most accumulated iterations.
-         // Also check if point reached max iters and retire if so. Definite overhead
-         // improvement to combine the max iters check with the max check- measurable with
-         // small max_iters (e.g., when realtime zooming)
-         else
-            if (iters >= max)
-               if (iters == m->max_iters)
-               {
-                  *ps_ptr->iters_ptr[i] = iters;         // don't need mag store for max_iters
-                  queue_status = queue_status * 8 + i;   // Push free slot
-               }
-               else
-                  max = iters;
-
-      }
-      // Set the maximum iterations to do next loop: max iters - iters already done.
-      // The next loop must break if the point with the most accumulated iterations (max)
-      // reaches max_iters.
-      ps_ptr->cur_max_iters = m->max_iters - max;
-
-      // Most common case: comes here with one point free. Retiring multiple points only
-      // happens about 1-5% of the time for complex images. For images with vast areas
-      // of a single color, can go to 50%.
-   }
-
-   i = queue_status & 3;                     // Get next free slot
-   ps_ptr->queue_status = queue_status >> 3; // Pop free slot
-
-   // Initialize pointstruct fields
-   ps_ptr->a[i] = ps_ptr->ab_in[0]; // Set input point
-   ps_ptr->b[i] = ps_ptr->ab_in[1];
-   ps_ptr->y[i] = 0.0;              // Set initial conditions
-   ps_ptr->x[i] = 0.0;
-   ps_ptr->yy[i] = 0.0;
-   ps_ptr->iters[i] = 0;
-   ps_ptr->iters_ptr[i] = iters_ptr;
-}
-
-// Similar queuing function for the 8-point SSE algorithm
-static void FASTCALL queue_8point_sse(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr) // sqp8
-{
-   unsigned i, iters, max, queue_status, *ptr;
-   man_calc_struct *m;
-
-   m = (man_calc_struct *) calc_struct;
-   queue_status = ps_ptr->queue_status;
-
-   if (queue_status == QUEUE_FULL)
-   {
-      m->mandel_iterate(ps_ptr);
-
-      max = 0;
-      for (i = 0; i < 8; i++)
-      {
-         iters = ps_ptr->iters[i];
-         if (DIVERGED_S(ps_ptr, i))
-         {
-            // *ps_ptr->iters_ptr[i] = iters - DIVERGED_PREV_S(ps_ptr, i);
-
-            ptr = ps_ptr->iters_ptr[i];
-            if (DIVERGED_PREV_S(ps_ptr, i))
-            {
-               *ptr = iters - 1;
-               MAG(m, ptr) = ((float *) ps_ptr->magprev)[i];
-            }
-            else
-            {
-               *ptr = iters;
-               MAG(m, ptr) = ((float *) ps_ptr->mag)[i];
-            }
-            queue_status = queue_status * 8 + i;
-         }
-         else
-            if (iters >= max)
-               if (iters == m->max_iters)
-               {
-                  *ps_ptr->iters_ptr[i] = iters;
-                  queue_status = queue_status * 8 + i;
-               }
-               else
-                  max = iters;
-      }
-      ps_ptr->cur_max_iters = m->max_iters - max;
-   }
-
-   i = queue_status & 7;
-   ps_ptr->queue_status = queue_status >> 3;
-
-   // Initialize pointstruct fields as packed 32-bit floats
-   ((float *) ps_ptr->a)[i] = (float) ps_ptr->ab_in[0];  // Set input point- convert from doubles
-   ((float *) ps_ptr->b)[i] = (float) ps_ptr->ab_in[1];  // generated by the main loop
-   ((float *) ps_ptr->y)[i] = 0.0;                       // Set initial conditions
-   ((float *) ps_ptr->x)[i] = 0.0;
-   ((float *) ps_ptr->yy)[i] = 0.0;
-   ps_ptr->iters[i] = 0;
-   ps_ptr->iters_ptr[i] = iters_ptr;
-}
-
-// Calculate the image, using the currently set precision and algorithm. Calculations in here are
-// always done in double (or extended) precision, regardless of the iteration algorithm's precision.
-
-// Now called from multiple threads. Calculates a list of stripes from the thread state structure
-// (passed in PARAM). See man_calculate().
-
-unsigned __stdcall man_calculate_threaded(LPVOID param) // smc
-{
-   int i, n, x, y, xstart, xend, ystart, yend, line_size, points_guessed;
-   unsigned *iters_ptr;
-   man_pointstruct *ps_ptr;
-   thread_state *t;
-   stripe *s;
-   man_calc_struct *m;
-
-   t = (thread_state *) param;
-   s = t->stripes;
-   n = t->num_stripes;
-   ps_ptr = t->ps_ptr;
-   m = (man_calc_struct *) t->calc_struct;
-
-   line_size = m->iter_data_line_size;
-   points_guessed = 0;
-
-   // Calculate all the stripes. Needs to handle num_stripes == 0
-   for (i = 0; i < n; i++)
-   {
-      // Use these for benchmarking thread creation/execution overhead
-      // return 0;                  // for CreateThread method
-      // SetEvent(t->done_event);   // for QueueUserWorkItem method
-      // return 0;
-
-      xstart = s->xstart;
-      xend = s->xend;
-      ystart = s->ystart;
-      yend = s->yend;
-
-      // Optimization for panning: set alg to exact mode for very thin regions. Due to the
-      // Fast algorithm's 4x4 cell size it often computes more pixels than Exact for these
-      // regions. Effect is most apparent with high iter count images.
-
-      #define FE_SWITCHOVER_THRESH  2 // only do it for 1-pixel wide regions for now. best value TBD...
-
-      m->cur_alg = m->alg;
-      if ((xend - xstart) < FE_SWITCHOVER_THRESH || (yend - ystart) < FE_SWITCHOVER_THRESH )
-         m->cur_alg |= ALG_EXACT;
-
-      // Main loop. Queue each point in the image for iteration. Queue_point will return
-      // immediately if its queue isn't full (needs 4 points for the asm version), otherwise
-      // it will iterate on all the points in the queue.
-
-      if (m->cur_alg & ALG_EXACT) // Exact algorithm: calculates every pixel
-      {
-         y = ystart;
-         do
-         {
-            x = xstart;
-            ps_ptr->ab_in[1] = m->img_im[y];    // Load IM coordinate from the array
-            iters_ptr = m->iter_data + y * line_size + x;
-            do
-            {
-               ps_ptr->ab_in[0] = m->img_re[x]; // Load RE coordinate from the array
-               m->queue_point(m, ps_ptr, iters_ptr++);
-            }
-            while (++x <= xend);
-         }
-         while (++y <= yend);
-      }
-      else // Fast "wave" algorithm from old code: guesses pixels.
-      {
-         int wave, xoffs, inc, p0, p1, p2, p3, offs0, offs1, offs2, offs3;
-
-         // Doing the full calculation (all waves) on horizontal chunks to improve cache locality
-         // gives no speedup (tested before realtime zooming was implemented- maybe should test again).
-
-         for (wave = 0; wave < 7; wave++)
-         {
-            inc = wave_inc[wave];
-            y = wave_ystart[wave] + ystart;
-
-            // Special case for wave 0 (always calculates all pixels). Makes realtime
-            // zooming measurably faster. X starts at xstart for wave 0, so can use do-while.
-            // For Y, need to calculate all waves even if out of range, because subsequent
-            // waves look forward to pixels calculated in previous waves (wave 0 starts at y = 3)
-
-            if (!wave) // it's faster with the special case inside the wave loop than outside
-            {
-               do
-               {
-                  x = xstart;
-                  ps_ptr->ab_in[1] = m->img_im[y];    // Load IM coordinate from the array
-                  iters_ptr = m->iter_data + y * line_size + x; // adding a line to the ptr every y loop is slower
-                  do
-                  {
-                     ps_ptr->ab_in[0] = m->img_re[x]; // Load RE coordinate from the array
-                     m->queue_point(m, ps_ptr, iters_ptr);
-                     iters_ptr += inc;
-                     x += inc;
-                  }
-                  while (x <= xend);
-               }
-               while ((y += inc) <= yend);
-            }
-            else  // waves 1-6 check neighboring pixels
-            {
-               offs0 = wave_ptr_offs[wave][0]; // pointer offsets of neighboring pixels
-               offs1 = wave_ptr_offs[wave][1];
-               offs2 = wave_ptr_offs[wave][2];
-               offs3 = wave_ptr_offs[wave][3];
-
-               xoffs = wave_xstart[wave] + xstart;
-
-               do
-               {
-                  x = xoffs;
-                  ps_ptr->ab_in[1] = m->img_im[y];
-                  iters_ptr = m->iter_data + y * line_size + x;
-
-                  // No faster to have a special case for waves 1 and 4 that loads only 2 pixels/loop
-                  while (x <= xend)
-                  {
-                     // If all 4 neighboring pixels (p0 - p3) are the same, set this pixel to
-                     // their value, else iterate.
-
-                     p0 = iters_ptr[offs0];
-                     p1 = iters_ptr[offs1];
-                     p2 = iters_ptr[offs2];
-                     p3 = iters_ptr[offs3];
-
-                     if (p0 == p1 && p0 == p2 && p0 == p3) // can't use sum compares here (causes corrupted pixels)
-                     {
-                        // aargh... compiler (or AMD CPU) generates different performance on
-                        // zoomtest depending on which point is stored here. They're all the same...
-                        // p3: 18.5s  p2: 18.3s  p1: 18.7s  p0: 19.2s  (+/- 0.1s repeatability)
-
-                        *iters_ptr = p2;
-
-                        // This works suprisingly well- degradation is really only noticeable
-                        // at high frequency transitions (e.g. with striped palettes).
-                        // Maybe average the mags at the 4 offsets to make it better
-
-                        // The mag store causes about a 7.5% slowdown on zoomtest.
-                        MAG(m, iters_ptr) = MAG(m, &iters_ptr[offs2]);
-
-                        points_guessed++; // this adds no measureable overhead
-                     }
-                     else
-                     {
-                        ps_ptr->ab_in[0] = m->img_re[x]; // Load RE coordinate from the array
-                        m->queue_point(m, ps_ptr, iters_ptr);
-                     }
-                     iters_ptr += inc;
-                     x += inc;
-                  }
-               }
-               while ((y += inc) <= yend);
-            }
-            // really should flush at the end of each wave, but any errors should have no visual effect
-         }  // end of wave loop
-      }
-      s++;  // go to next stripe
-   }        // end of stripe loop
-
-   t->total_iters += ps_ptr->iterctr;   // accumulate iters, for thread load balance measurement
-   t->points_guessed = points_guessed;
-
-   // Up to 4 points could be left in the queue (or 8 for SSE). Queue non-diverging dummy points
-   // to flush them out. This is tricky. Be careful changing it... can cause corrupted pixel bugs.
-   // Turns out that 4 more points (8 for SSE) must always be queued. They could be stored
-   // to the dummy value if all points left in the queue still have max_iters remaining.
-
-   ps_ptr->ab_in[0] = 0.0;
-   ps_ptr->ab_in[1] = 0.0;
-
-   // Add some extra logic here to get the exact iteration count (i.e, exclude dummy iterations).
-   // It's actually pretty tough to calculate
-   for (i = m->precision == PRECISION_SINGLE ? 8 : 4; i--;)
-      m->queue_point(m, ps_ptr, m->iter_data + m->image_size);
-
-   // Thread 0 always runs in the master thread, so doesn't need to signal. Save overhead.
-   if (t->thread_num)
-      SetEvent(t->done_event); // For other threads, signal master thread that we're done
-
-   return 0;
-}
-
-// Check for precision loss- occurs if the two doubles (or converted floats)
-// in ptest are equal to each other. Returns PLOSS_FLOAT for float loss,
-// PLOSS_DOUBLE for double loss, etc. or 0 for no loss.
-
-// New more conservative version demands that bits beyond the lsb should also
-// differ. If only the lsb differs, bound to get degradation during iteration.
-
-#define PLOSS_DOUBLE    2
-#define PLOSS_FLOAT     1
-
-int check_precision_loss(double *ptest)
-{
-   float f[2];
-   int i0[2], i1[2];
-
-   // Check double loss
-   i0[0] = *((int *) &ptest[0]) & ~1;  // get low dword of 1st double; mask off lsb
-   i0[1] = *((int *) &ptest[0] + 1);   // get high dword
-
-   i1[0] = *((int *) &ptest[1]) & ~1;  // get low dword of 2nd double; mask off lsb
-   i1[1] = *((int *) &ptest[1] + 1);   // get high dword
-
-   if ((i0[1] == i1[1]) && (i0[0] == i1[0]))
-      return PLOSS_DOUBLE | PLOSS_FLOAT; // double loss is also float loss
-
-   // Check float loss
-   f[0] = (float) ptest[0];            // convert doubles to floats
-   f[1] = (float) ptest[1];
-
-   i0[0] = *((int *) &f[0]) & ~1;      // get 1st float; mask off lsb
-   i1[0] = *((int *) &f[1]) & ~1;      // get 2nd float; mask off lsb
-
-   if (i0[0] == i1[0])
-      return PLOSS_FLOAT;
-
-   return 0;
-}
-
-// Calculate the real and imaginary arrays for the current rectangle, set precision/algorithm,
-// and do other misc setup operations. Call before starting mandelbrot calculation.
-
-// Panning is now tracked as an offset from re/im, so the current rectangle is offset from
-// re/im by pan_xoffs + xstart / 2 and pan_yoffs + ystart / 2.
-
-void man_setup(man_calc_struct *m, int xstart, int xend, int ystart, int yend) // sms
-{
-   int i, x, y, xsize, ysize, ploss;
-   long long step;
-   unsigned queue_init, flags;
-   man_pointstruct *ps_ptr;
-
-   m->max_iters &= ~1;     // make max iters even- required by optimized alg
-   xsize = m->xsize;
-   ysize = m->ysize;
-   flags = m->flags;
-
-   // Make re/im arrays, to avoid doing xsize * ysize flops in the main loop.
-   // Also check for precision loss (two consecutive values equal or differing only in the lsb)
-
-   // Cut overhead by only going from start to end - not whole image size
-   // Need to do more than 1 point to detect precision loss... otherwise auto mode won't work.
-   // To be safe use at least 4 (allocate 4 extra).
-
-   // Updated to use offsets (pan_xoffs and pan_yoffs) for panning, rather than updating re/im
-   // on every pan. These are added in below. See comments at top (bug fix)
-
-   // If saving, don't check precision loss, and don't recalculate the re array
-   // after the first row.
-
-   if (!(flags & FLAG_IS_SAVE))
-   {
-      xend += 4;  // only need these for non-save (precision loss checking)
-      yend += 4;
-   }
-
-   if (flags & FLAG_CALC_RE_ARRAY) // this flag should be 1 for main calculation
-   {
-      ploss = 0;
-      x = xstart;
-      step = -(xsize >> 1) + xstart + m->pan_xoffs;
-      do
-      {
-         m->img_re[x] = m->re + get_re_im_offs(m, step++);
-         if (!(flags & FLAG_IS_SAVE) && x > xstart)
-            ploss |= check_precision_loss(&m->img_re[x - 1]);
-      }
-      while (++x <= xend);
-   }
-
-   step = -(ysize >> 1) + ystart + m->pan_yoffs;
-   y = ystart;
-   do
-   {
-      m->img_im[y] = m->im - get_re_im_offs(m, step++);
-      if (!(flags & FLAG_IS_SAVE) && y > ystart)
-         ploss |= check_precision_loss(&m->img_im[y - 1]);
-   }
-   while (++y <= yend);
-
-   if (!(flags & FLAG_IS_SAVE)) // only do auto precision if not saving
-   {
-      precision_loss = 0;
-
-      // Set precision loss flag. If in auto precision mode, set single or double calculation
-      // precision based on loss detection.
-      switch (m->precision)
-      {
-         case PRECISION_AUTO:
-            m->precision = PRECISION_SINGLE;
-            if (ploss & PLOSS_FLOAT)
-               m->precision = PRECISION_DOUBLE; // deliberate fallthrough
-         case PRECISION_DOUBLE:
-            if (ploss & PLOSS_DOUBLE)
-               precision_loss = 1;
-            break;
-         case PRECISION_SINGLE:
-            if (ploss & PLOSS_FLOAT)
-               precision_loss = 1;
-            break;
-         default: // should never get here (x87 is suppressed until implemented)
-            break;
-      }
-   }
-
-   // Set iteration and queue_point function pointers and initialize queues
-
-   // Alg will always be C if no sse support.
-   // Should change algorithm in dialog box if it's reset to C here.
-   if (((m->alg & ALG_C) || (sse_support < 2 && m->precision == PRECISION_DOUBLE)))
-   {
-      m->queue_point = queue_point_c;
-      m->mandel_iterate = iterate_c; // Unoptimized C algorithm
-   }
-   else
-   {
-      if (m->precision == PRECISION_DOUBLE)
-      {
-         queue_init = (QUEUE_FULL << 12) | (3 << 9) | (2 << 6) | (1 << 3) | 0;
-         m->queue_point = queue_4point_sse2;
-         m->mandel_iterate = (m->alg & ALG_INTEL) ? iterate_intel_sse2 : iterate_amd_sse2;
-      }
-      else
-      {
-         queue_init = (QUEUE_FULL << 24) | (7 << 21) | (6 << 18) | (5 << 15) |
-                                           (4 << 12) | (3 << 9) | (2 << 6) | (1 << 3) | 0;
-         m->queue_point = queue_8point_sse;
-         m->mandel_iterate = (m->alg & ALG_INTEL) ? iterate_intel_sse : iterate_amd_sse;
-      }
-   }
-
-   // Set pointstruct initial values
-   for (i = 0; i < num_threads; i++)
-   {
-      ps_ptr = m->thread_states[i].ps_ptr;
-      ps_ptr->queue_status = queue_init;
-      ps_ptr->cur_max_iters = m->max_iters;
-      ps_ptr->iterctr = 0;
-   }
-}
-
-// Man_calculate() splits the calculation up into multiple threads, each calling
-// the man_calculate_threaded() function.
-//
-// Current alg: divide the calculation rectangle into N stripes per thread (N
-// depends on the number of threads). More stripes help load balancing by making it
-// unlikely that the stripes will have wildly different iteration counts. But too
-// many stripes cause a slowdown due to excess overhead.
-//
-// Example, image rectangle and stripes for two threads:
-//
-//       1 Stripe            2 Stripes         etc...
-//
-//  +----------------+   +----------------+
-//  |                |   |   Thread 0     |
-//  |   Thread 0     |   |----------------|
-//  |                |   |   Thread 1     |
-//  +----------------|   |----------------|
-//  |                |   |   Thread 0     |
-//  |   Thread 1     |   |----------------|
-//  |                |   |   Thread 1     |
-//  +----------------+   +----------------+
-//
-//  The rectangle is sometimes divided horizontally:
-//
-//  +-------------------------------+
-//  |  T0   |  T1   |  T0   |  T1   |
-//  +-------------------------------+
-//
-// This is necessary so that 1-pixel high rectangles (as often found in panning) can
-// still be divided. Horizontal stripes (vertical division) would be preferred because
-// x is done in the inner loop. Also memory access is better on horizontal stripes.
-// Arbitrarily decide to do horizontal division only if the stripe height is < some
-// constant (say 8, = 2x fast alg cell size).
-//
-// Returns the time taken to do the calculation.
-
-double man_calculate(man_calc_struct *m, int xstart, int xend, int ystart, int yend) // smc
-{
-   TIME_UNIT start_time;
-   double iteration_time;
-   int i, xsize, ysize, step, thread_ind, stripe_ind, num_stripes, frac, frac_step, this_step;
-   stripe *s;
-
-   all_recalculated = 0;
-   if (status & STAT_NEED_RECALC) // if need recalculation, recalculate all. No effect for saving
-   {
-      xstart = 0;                 // reset rectangle to full screen
-      xend = m->xsize - 1;
-      ystart = 0;
-      yend = m->ysize - 1;
-      status &= ~STAT_NEED_RECALC;
-      all_recalculated = 1;
-   }
-
-   man_setup(m, xstart, xend, ystart, yend);
-
-   xsize = xend - xstart + 1;
-   ysize = yend - ystart + 1;
-
-   // Get the number of stripes per thread based on number of threads (extract bits 3-0
-   // for 1 thread, 7-4 for two threads, etc).
-   num_stripes = (cfg_settings.stripes_per_thread.val >> (num_threads_ind << 2)) & 0xF;
-
-   // Need to check min/max here (couldn't be checked automatically by log-reading function)
-   if (num_stripes < 1)
-      num_stripes = 1;
-   if (num_stripes > MAX_STRIPES)
-      num_stripes = MAX_STRIPES;
-
-   // Now multiply by num_threads to get total number of stripes for the image.
-   num_stripes <<= num_threads_ind;
-
-   // With pathologically small images, some threads may not calculate anything.
-   for (i = 0; i < num_threads; i++)
-      m->thread_states[i].num_stripes = 0;
+   man_calc_struct *m;
 
-   // Start at the last thread, so that thread 0 gets any leftovers at the end. Thread 0 is
-   // the master and doesn't suffer the overhead of being spawned, so it should get the extra work.
+   m = &main_man_calc_struct;
+   for (i = 0; i < m->max_threads; i++)
+      m->thread_states[i].total_iters = 0;
+}
 
-   thread_ind = num_threads - 1;
-   stripe_ind = 0;
+// Reset frames/sec timing values
+void reset_fps_values(void)
+{
+   total_frames = 0;
+   interval_frames = 0;
+   calc_interval_time = 0.0;
+   calc_total_time = 0.0;
+   interval_time = 0.0;
+   total_time = 0.0;
+}
 
-   // Divide along the y axis if stripe height is >= 8 (see above), or ysize is >= xsize
+// Set the new point and magnification based on x0, x1, y0, y1. If zoom_box is 0,
+// multiplies/divides the magnification by a fixed value. If zoom_box is 1, calculates
+// the new zoom from the ratio of the zoom box size (defined by x0, x1, y0, y1)
+// to the window size. Recenters the image on x0, y0 (if no zoom box) or the center
+// of the zoom box.
 
-   if ((ysize >= (num_stripes << 3)) || (ysize >= xsize))
-   {
-      if (!(step = ysize / num_stripes))  // step size (height of each stripe)
-      {
-         num_stripes = ysize;             // if more stripes than pixels of height,
-         step = 1;                        // limit stripes and threads
-      }
+// Re/im should be updated with the current pan offsets before calling this (this is
+// done on buttondown events in the window function).
 
-      // Use fractional steps to get the threads as evenly balanced as possible. For each
-      // thread, the stripe height could either be step or step + 1 (they all get the
-      // same step as a group).
-      //
-      // Dual Opteron 280, Double, Fast, 4 threads, 4 stripes/thread, tune.log:
-      // With fractional steps      :  4.788s, efficiency 97.8%
-      // Without fractional steps   :  4.980s, efficiency 94.1%
+void update_re_im_mag(int zoom_box, int in_outn, int x0, int y0, int x1, int y1)
+{
+   double tmp_mag, xz, yz;
+   int x, y;
+   man_calc_struct *m;
 
-      frac = frac_step = ysize - (num_stripes * step);
-      this_step = step;
+   m = &main_man_calc_struct;
 
-      for (i = 0; i < num_stripes; i++)
-      {
-         m->thread_states[thread_ind].num_stripes++;
-         s = &m->thread_states[thread_ind].stripes[stripe_ind];
-         s->xstart = xstart;
-         s->xend = xend;
-         s->ystart = ystart;
-         s->yend = ystart + this_step - 1;
-         ystart += this_step;
-
-         // Next stripe goes to next thread. If it wraps, reset and increment each thread's stripe index.
-         if (--thread_ind < 0)
-         {
-            thread_ind = num_threads - 1;
-            stripe_ind++;
+   tmp_mag = m->mag;
 
-            // Now that each thread has a stripe, update the fraction, and if it wraps
-            // increase the stripe height for the next group by 1.
-            this_step = step;
-            if ((frac += frac_step) >= num_stripes)
-            {
-               frac -= num_stripes;
-               this_step++;   // comment this out to compare efficiencies without fractional steps
-            }
-         }
-      }
-      // Give thread 0 any leftovers.
-      s->yend = yend;
-   }
-   else // Similar code to above for dividing along the x axis
+   if (!zoom_box) // just zoom in or out
    {
-      if (!(step = xsize / num_stripes))
-      {
-         num_stripes = xsize;
-         step = 1;
-      }
-      frac = frac_step = xsize - (num_stripes * step);
-      this_step = step;
-
-      for (i = 0; i < num_stripes; i++)
-      {
-         m->thread_states[thread_ind].num_stripes++;
-         s = &m->thread_states[thread_ind].stripes[stripe_ind];
-         s->xstart = xstart;
-         s->xend = xstart + this_step - 1;
-         s->ystart = ystart;
-         s->yend = yend;
-         xstart += this_step;
-
-         if (--thread_ind < 0)
-         {
-            thread_ind = num_threads - 1;
-            stripe_ind++;
-            this_step = step;
-            if ((frac += frac_step) >= num_stripes)
-            {
-               frac -= num_stripes;
-               this_step++;
-            }
-         }
-      }
-      s->xend = xend;
+      x = x0;     // point center
+      y = y0;
+      if (in_outn)
+         tmp_mag *= MAG_ZOOM_FACTOR;
+      else
+         tmp_mag *= (1.0 / MAG_ZOOM_FACTOR);
    }
+   // Zoom based on box. For zooming in, uses the box size and center to set the
+   // new point and magnification
+   else
+   {
+      x = abs(x0 - x1);
+      y = abs(y0 - y1);
 
-   // Run the threads on the stripes calculated above.
-   // These threading functions are slow. Benchmarks on an Athlon 64 4000+ 2.4 GHz:
-   //                                                                                   Equivalent SSE2
-   // Functions (tested with 4 threads)                             uS   Clock Cycles   iters (per core)
-   // --------------------------------------------------------------------------------------------------
-   // 4 CreateThread + WaitForMultipleObjects + 4 CloseHandle     173.0     415200      83040
-   // 4 _beginthreadex + WaitForMultipleObjects + 4 CloseHandle   224.0     537600      107520
-   // 4 QueueUserWorkItem + 4 SetEvent + WaitForMultipleObjects     7.6      18240      3648
-   // 4 SetEvent                                                    1.0       2400      480
-   // 4 Null (loop overhead + mandel function call only)            0.01        24      4
-   //
-   // The QueueUserWorkItem method is probably fast enough. The first two are usually on par with
-   // the iteration time while panning, negating any multi-core advantage (for panning).
-
-   // Don't call C library routines in threads. 4K stack size is more than enough
-
-   start_time = get_timer();
-
-   // Using WT_EXECUTEINPERSISTENTTHREAD is 50% slower than without.
-   // Leaving out WT_EXECUTELONGFUNCTION makes the initial run twice as slow, then same speed.
+      // Get smaller of xzoom and yzoom
+      xz = (double) m->xsize / (double) x;
+      yz = (double) m->ysize / (double) y;
 
-   // Use the master thread (here) to do some of the work. Queue any other threads. Saves some
-   // overhead, and doesn't spawn any new threads at all if there's only one thread.
+      if (xz < yz)
+         tmp_mag *= xz;
+      else
+         tmp_mag *= yz;
 
-   for (i = 1; i < num_threads; i++)
-      QueueUserWorkItem(man_calculate_threaded, &m->thread_states[i],
-                        WT_EXECUTELONGFUNCTION | (MAX_QUEUE_THREADS << 16));
+      x = (x0 + x1) >> 1; // new point center:
+      y = (y0 + y1) >> 1; // center of zoom box
+   }
 
-   // Could also queue thread 0 too, then have this master thread display the progress if
-   // the calculation is really slow...
-   man_calculate_threaded(&m->thread_states[0]);
+   // Get new point center, based on x, y
 
-   if (num_threads > 1)
-      WaitForMultipleObjects(num_threads - 1, &m->thread_done_events[1], TRUE, INFINITE); // wait till all threads are done
+   //if (in_outn) // uncomment to not center when zooming out
+   update_re_im(m, x - (m->xsize >> 1), y - (m->ysize >> 1)); // re/im already updated with any pan offsets here
 
-   if (!(m->flags & FLAG_IS_SAVE)) // don't update these if doing save
-   {
-      iteration_time = get_seconds_elapsed(start_time);
-      file_tot_time += iteration_time;
-      return iteration_time;
-   }
-   else
-      return 0.0;
+   // Update mag
+   if (tmp_mag >= MAG_MIN) // preserve closest min, to allow
+      m->mag = tmp_mag;       // zooming back to original mag
+   normalize_mag(m);
 }
 
 // ----------------------- Quadrant/panning functions -----------------------------------
@@ -2361,6 +906,15 @@ int intersect_rect(rectangle *rdest, rectangle *r1, rectangle *r2)
    return 1;
 }
 
+// Latch the calculation settings that come from the cfg file
+void get_calc_settings(man_calc_struct *m)
+{
+   m->kernel = cfg_settings.kernel.val;
+   m->chains = cfg_settings.chains.val;
+   m->auto_fixed = cfg_settings.autofixed.val;
+   m->formula = cfg_settings.formula.val;
+}
+
 // Iterate on the update rectangles, and palette-map the iteration data
 // to the quadrants. Only used for main calculation, not while saving.
 void man_calculate_quadrants(void) // smq
@@ -2373,6 +927,7 @@ void man_calculate_quadrants(void) // smq
    m = &main_man_calc_struct;
 
    iter_time = 0.0;
+   get_calc_settings(m);
 
    // First calculate the update rectangles (up to 2).
    for (i = 0; i < 2; i++)
@@ -2388,6 +943,7 @@ void man_calculate_quadrants(void) // smq
                                        update_rect[i].y[0] - screen_ypos,  // ystart
                                        update_rect[i].y[1] - screen_ypos); // yend
       }
+   file_tot_time += iter_time;
 
    // Now palette-map the update rectangles into their quadrants. Each rectangle can
    // occupy 1-4 quadrants.
@@ -2587,7 +1143,7 @@ void pan_image(int offs_x, int offs_y)
 
 char *get_image_info(int update_iters_sec)
 {
-   static char s[1024 + 32 * MAX_THREADS];
+   static char s[1024 + 2 * CENTER_STR_SIZE + 32 * MAX_INFO_THREADS];
    static char iters_str[256];
    static unsigned long long ictr = 0;
    static double guessed_pct = 0.0;
@@ -2598,19 +1154,26 @@ char *get_image_info(int update_iters_sec)
    unsigned long long ictr_total_raw;
    double cur_pct, max_cur_pct, tot_pct, max_tot_pct;
    int i, points_guessed;
+   unsigned points_periodic;
    thread_state *t;
-   char tmp[256];
+   char tmp[256], re_str[CENTER_STR_SIZE], im_str[CENTER_STR_SIZE], mag_str[64];
    man_calc_struct *m;
 
    m = &main_man_calc_struct;
 
+   // The thread counters belong to any realtime zoom frame in flight, so let it finish
+   // (it still gets shown in order; see start_zoom_frame)
+   pipe_wait(&zoom_pipe);
+
    ictr_raw = 0;
    ictr_total_raw = 0;
    points_guessed = 0;
-   for (i = 0; i < num_threads; i++)
+   points_periodic = 0;
+   for (i = 0; i < m->num_threads; i++)
    {
       t = &m->thread_states[i];
       points_guessed += t->points_guessed;
+      points_periodic += t->ps_ptr->periodic_ctr; // retired early by periodicity checking
       ictr_raw += t->ps_ptr->iterctr;         // N iterations per tick
       ictr_total_raw += t->total_iters;
    }
@@ -2621,14 +1184,7 @@ char *get_image_info(int update_iters_sec)
       // For the SSE2 ASM versions, each tick is 4 iterations.
       // For the SSE ASM versions, each tick is 8 iterations.
 
-      ictr = ictr_raw;
-      if (!(m->alg & ALG_C))
-      {
-         if (m->precision == PRECISION_DOUBLE && sse_support >= 2)
-            ictr <<= 2;
-         if (m->precision == PRECISION_SINGLE && sse_support >= 1)
-            ictr <<= 3;
-      }
+      ictr = ictr_raw * m->iters_per_tick;
 
       if (iter_time < 0.001)  // Prevent division by 0. If the time is in this neighborhood
          iter_time = 0.001;   // the iters/sec won't be accurate anyway.
@@ -2638,16 +1194,21 @@ char *get_image_info(int update_iters_sec)
       guessed_pct = 100.0 * (double) points_guessed / (double) m->image_size;
 
       // Since one flop is optimized out per 18 flops in the ASM versions,
-      // factor should really be 8.5 for those. But actually does 9 "effective" flops per iteration
+      // factor should really be 8.5 for those. But actually does 9 "effective" flops per iteration.
+      // The FMA versions do 10 (fused multiply-adds count as 2); see man_setup.
 
       sprintf_s(iters_str, sizeof(iters_str), "%-4.4gM (%-.2f GFlops)", miters_s,
-                miters_s * 9.0 * 1e-3);
+                miters_s * m->flops_per_iter * 1e-3);
    }
 
+   // With new panning method, need to get actual screen centerpoint using pan offsets
+   get_center_strs(m, re_str, im_str);
+   get_mag_str(m, mag_str, sizeof(mag_str));
+
    sprintf_s(s, sizeof(s),   // Microsoft wants secure version
-              "Real\t%-16.16lf\r\n"
-              "Imag\t%-16.16lf\r\n"
-              "Mag\t%-16lf\r\n"
+              "Real\t%s\r\n"
+              "Imag\t%s\r\n"
+              "Mag\t%s\r\n"
               "\r\n"
               "Size\t%u x %u\r\n"
               "Time\t%-3.3fs\r\n"
@@ -2657,13 +1218,16 @@ char *get_image_info(int update_iters_sec)
 
               "Avg iters/pixel\t%-.1lf\r\n"
               "Points guessed\t%-.1lf%%\r\n"
-              "Total iters\t%-.0lf\r\n",
-
-              // With new panning method, need to get actual screen centerpoint using pan offsets
-              m->re + get_re_im_offs(m, m->pan_xoffs),
-              m->im - get_re_im_offs(m, m->pan_yoffs),
-              m->mag, m->xsize, m->ysize, iter_time, iters_str,  // Miters/s string created above
-              avg_iters, guessed_pct, (double) ictr
+              "Total iters\t%-.0lf\r\n"
+              "Kernel\t%s\r\n"
+              "Glitched\t%u\r\n"
+              "Series skip\t%u\r\n"
+              "Periodic\t%u\r\n",
+
+              re_str, im_str,
+              mag_str, m->xsize, m->ysize, iter_time, iters_str,  // Miters/s string created above
+              avg_iters, guessed_pct, (double) ictr, m->kernel_name, m->glitches,
+              m->series.iters, points_periodic
               );
 
    // Get each thread's percentage of the total load, to check balance.
@@ -2673,14 +1237,16 @@ char *get_image_info(int update_iters_sec)
 
    max_cur_pct = 0.0;
    max_tot_pct = 0.0;
-   for (i = 0; i < num_threads; i++)
+   for (i = 0; i < m->num_threads; i++)
    {
       t = &m->thread_states[i];
-      sprintf_s(tmp, sizeof(tmp),
-               "Thread %d\t%#3.3g   %#3.3g\r\n", i,
-               cur_pct = (double) t->ps_ptr->iterctr / (double) ictr_raw * 100.0,
-               tot_pct = (double) t->total_iters / (double) ictr_total_raw * 100.0);
-      strcat_s(s, sizeof(s), tmp);
+      cur_pct = (double) t->ps_ptr->iterctr / (double) ictr_raw * 100.0;
+      tot_pct = (double) t->total_iters / (double) ictr_total_raw * 100.0;
+      if (i < MAX_INFO_THREADS)
+      {
+         sprintf_s(tmp, sizeof(tmp), "Thread %d\t%#3.3g   %#3.3g\r\n", i, cur_pct, tot_pct);
+         strcat_s(s, sizeof(s), tmp);
+      }
 
       if (cur_pct > max_cur_pct)
          max_cur_pct = cur_pct;
@@ -2694,8 +1260,8 @@ char *get_image_info(int update_iters_sec)
               "Efficiency %%\t%#3.3g   %#3.3g\r\n"
               "\r\nTotal calc time\t%-.3lfs\r\n" // resets whenever new file is opened
               "\r\n(C) 2006-2008 Paul Gentieu",
-              100.0 * 100.0 / (num_threads * max_cur_pct),
-              100.0 * 100.0 / (num_threads * max_tot_pct),
+              100.0 * 100.0 / (m->num_threads * max_cur_pct),
+              100.0 * 100.0 / (m->num_threads * max_tot_pct),
               file_tot_time);
    strcat_s(s, sizeof(s), tmp);
 
@@ -2980,8 +1546,64 @@ void get_mouse_re_im(int mx, int my)
    mx -= (m->xsize >> 1); // Get offset from image center
    my -= (m->ysize >> 1);
 
-   mouse_re = m->re + get_re_im_offs(m, mx);
-   mouse_im = m->im - get_re_im_offs(m, my);
+   sync_re_im_hp(m);
+   mouse_re = m->re_hp;
+   mouse_im = m->im_hp;
+   add_re_im_offs(m, &mouse_re, &mouse_im, mx, my);
+}
+
+// Realtime zoom pipeline. Each frame is calculated (iterated and palette mapped) in the pipeline
+// thread while the previous one is blitted, so the calculation threads aren't idle during the
+// blit and the rest of the per-frame overhead (see pipe_frame). The whole image is recalculated
+// every frame, so only the UL quadrant is shown; the UR and LL quadrant bitmaps serve as the
+// back buffers, and a finished frame is shown by swapping its bitmap into UL.
+
+static const int zoom_quads[2] = { UR, LL };
+
+// Calculate a frame into back buffer BUF (pipeline thread)
+static void calc_zoom_frame(void *param, int buf)
+{
+   man_calc_struct *m;
+
+   m = &main_man_calc_struct;
+   if (fused_palette)
+      set_fused_palette(m, quad[zoom_quads[buf]].bitmap_data);
+   zoom_iter_time[buf] = man_calculate(m, 0, m->xsize - 1, 0, m->ysize - 1);
+   if (!fused_palette)
+      apply_palette(m, quad[zoom_quads[buf]].bitmap_data, m->iter_data, m->xsize, m->ysize);
+   m->max_iters_last = m->max_iters;  // last iters actually calculated, for palette code
+}
+
+// Show the frame in back buffer BUF
+static void present_zoom_frame(void *param, int buf)
+{
+   iter_time = zoom_iter_time[buf];
+   file_tot_time += iter_time;
+   swap_quadrants(&quad[UL], &quad[zoom_quads[buf]]);
+
+   InvalidateRect(hwnd_main, NULL, 0); // cause repaint with image data
+   UpdateWindow(hwnd_main);
+   GdiFlush(); // blit done before the bitmap is calculated into again
+}
+
+// Start calculating the next frame, and show the previous one meanwhile. Same as
+// do_man_calculate(1) while zooming, but with the calculation in the pipeline thread.
+void start_zoom_frame(void)
+{
+   man_calc_struct *m;
+
+   m = &main_man_calc_struct;
+
+   m->max_iters &= ~1;                 // make max iters even (required by optimized algorithm)
+   update_re_im(m, m->pan_xoffs, m->pan_yoffs);
+   reset_quadrants();
+   get_dialog_fields();
+   get_calc_settings(m);
+   status &= ~(STAT_NEED_RECALC | STAT_RECALC_FOR_PALETTE | STAT_CANCELLED);
+   all_recalculated = 1;
+
+   iter_time = 0.0; // gets the iteration time of the frame shown, if any
+   pipe_frame(&zoom_pipe);
 }
 
 // Do realtime zooming. Has two modes:
@@ -3001,6 +1623,11 @@ int do_zooming(void)
 
    m = &main_man_calc_struct;
 
+   // Wait for the frame in flight before changing anything (see start_zoom_frame). The wait
+   // is part of this frame's time.
+   start_time = get_timer();
+   pipe_wait(&zoom_pipe);
+
    // If a panning key is pressed, temporarily exit to do the pan, then resume any zooming
    // (but abort zooming started with the zoom button). Need to improve this...
    // Problem is that zoom frame rate is vastly lower than pan rate
@@ -3024,23 +1651,25 @@ int do_zooming(void)
          do_rtzoom = prev_do_rtzoom;               // after stopping zoom
       }
    }
-   if (!do_rtzoom) // Return if not zooming
+   if (!do_rtzoom) // Return if not zooming (showing the last frame first)
+   {
+      pipe_flush(&zoom_pipe);
       return 0;
+   }
 
    update_re_im(m, m->pan_xoffs, m->pan_yoffs);       // update re/im from any pan offsets and reset offsets
 
    step = rtzoom_mag_steps[cfg_settings.zoom_rate.val];
 
-   start_time = get_timer();
-
    if (do_rtzoom & RTZOOM_IN)
       m->mag *= step;
    else
    {
       m->mag /= step;
-      if (m->mag < MAG_MIN)
+      if (m->mag < MAG_MIN && !m->mag_exp)
          m->mag = MAG_MIN;
    }
+   normalize_mag(m);
    if (!(do_rtzoom & RTZOOM_WITH_BUTTON)) // if zooming using the mouse
    {
       // Set the new image center re/im to keep the position at mouse[1]
@@ -3049,22 +1678,27 @@ int do_zooming(void)
       mx = mouse_x[1] - (m->xsize >> 1); // Get offset from image center
       my = mouse_y[1] - (m->ysize >> 1);
 
-      m->re = mouse_re - get_re_im_offs(m, mx);
-      m->im = mouse_im + get_re_im_offs(m, my);
+      m->re_hp = mouse_re;
+      m->im_hp = mouse_im;
+      add_re_im_offs(m, &m->re_hp, &m->im_hp, -mx, -my);
+      m->re = hp_to_double(&m->re_hp);
+      m->im = hp_to_double(&m->im_hp);
    }
    else // if zooming using the button, stop when we hit the start mag
-      if (m->mag > zoom_start_mag)
+      if (m->mag_exp > zoom_start_mag_exp || (m->mag_exp == zoom_start_mag_exp && m->mag > zoom_start_mag))
       {
          m->mag = zoom_start_mag;
+         m->mag_exp = zoom_start_mag_exp;
          done = 1; // setting do_rtzoom 0 here wipes out fps numbers after button zoom is done
       }
 
-   do_man_calculate(1);
+   start_zoom_frame();
 
    update_benchmarks(get_seconds_elapsed(start_time), 1);
 
    if (done) // If we just finished button zoom, update info
    {
+      pipe_flush(&zoom_pipe);
       do_rtzoom = 0;
       file_tot_time = get_seconds_elapsed(zoom_start_time); // use for benchmarking
       SetWindowText(hwnd_info, get_image_info(1)); // Update all info
@@ -3072,10 +1706,13 @@ int do_zooming(void)
    return 1;
 }
 
-// Simple function for recalculating after a window size change (if enabled)
+// Simple function for recalculating after a window size change (if enabled), or after a
+// calculation was cancelled by input that didn't start a new one (see do_man_calculate)
 int do_recalc(void)
 {
-   if (status & STAT_RECALC_IMMEDIATELY)
+   // Not while a button is held (e.g. dragging a zoom box): the button up would cancel it again
+   if ((status & STAT_RECALC_IMMEDIATELY) ||
+       ((status & STAT_CANCELLED) && GetKeyState(VK_LBUTTON) >= 0 && GetKeyState(VK_RBUTTON) >= 0))
    {
       do_man_calculate(1);
       status &= ~STAT_RECALC_IMMEDIATELY;
@@ -3083,85 +1720,179 @@ int do_recalc(void)
    return 0;
 }
 
+// Switch between the Mandelbrot set (or other formula) and the Julia set for the point under
+// the mouse. Going back centers the image on the Julia set's c.
+void toggle_julia(void)
+{
+   man_calc_struct *m;
+
+   m = &main_man_calc_struct;
+
+   if (!m->julia)
+   {
+      m->julia_re = hp_to_double(&mouse_re);
+      m->julia_im = hp_to_double(&mouse_im);
+      m->re = m->im = 0.0;
+   }
+   else
+   {
+      m->re = m->julia_re;
+      m->im = m->julia_im;
+   }
+   m->julia ^= 1;
+   m->pan_xoffs = 0;
+   m->pan_yoffs = 0;
+   m->mag = HOME_MAG;
+   m->mag_exp = 0;
+
+   InvalidateRect(hwnd_dialog, NULL, TRUE); // erase any Julia preview
+   SendMessage(hwnd_dialog, WM_COMMAND, ID_CALCULATE, 0);
+}
+
+// Show a preview of the Julia set for the point under the mouse in the thumbnail frame, if
+// enabled (OPT_JULIA_PREVIEW) and the frame has room. Called from the main loop only when
+// nothing else is going on, so it never holds up zooming or panning, and julia_preview keeps
+// each one within JULIA_PREVIEW_BUDGET (by adjusting its max iters).
+//
+// Returns 1 if it drew a preview, else 0 (if idle).
+
+#define JULIA_PREVIEW_XSIZE      160
+#define JULIA_PREVIEW_YSIZE      120
+#define JULIA_PREVIEW_MIN_HEIGHT 40      // don't bother if the frame is smaller than this
+#define JULIA_PREVIEW_BUDGET     0.004   // seconds
+
+int do_julia_preview(void)
+{
+   static unsigned rgb[JULIA_PREVIEW_XSIZE * JULIA_PREVIEW_YSIZE];
+   static double prev_re = 0.0, prev_im = 0.0;
+   BITMAPINFO bmi;
+   BITMAPINFOHEADER *h;
+   RECT rc;
+   HDC hdc;
+   man_view v;
+   man_calc_struct *m;
+   int w, ht;
+
+   m = &main_man_calc_struct;
+
+   if (!(cfg_settings.options.val & OPT_JULIA_PREVIEW) || m->julia || (status & STAT_DIALOG_HIDDEN))
+      return 0;
+
+   memset(&v, 0, sizeof(v));
+   v.julia_re = hp_to_double(&mouse_re);
+   v.julia_im = hp_to_double(&mouse_im);
+   if (v.julia_re == prev_re && v.julia_im == prev_im)
+      return 0;
+
+   // Get the frame rectangle in dialog coords, and fit the preview in it (same aspect ratio)
+   GetWindowRect(hwnd_thumbnail_frame, &rc);
+   MapWindowPoints(NULL, hwnd_dialog, (POINT *) &rc, 2);
+   w = rc.right - rc.left;
+   ht = (w * JULIA_PREVIEW_YSIZE) / JULIA_PREVIEW_XSIZE;
+   if (ht > rc.bottom - rc.top)
+   {
+      ht = rc.bottom - rc.top;
+      w = (ht * JULIA_PREVIEW_XSIZE) / JULIA_PREVIEW_YSIZE;
+   }
+   if (ht < JULIA_PREVIEW_MIN_HEIGHT)
+      return 0;
+
+   v.xsize = JULIA_PREVIEW_XSIZE;
+   v.ysize = JULIA_PREVIEW_YSIZE;
+   v.max_iters = m->max_iters;
+   v.alg = m->alg;
+   v.palette = m->palette;
+   v.rendering_alg = m->rendering_alg;
+   v.pal_xor = m->pal_xor;
+   v.max_iters_color = m->max_iters_color;
+   v.kernel = cfg_settings.kernel.val;
+   v.formula = cfg_settings.formula.val;
+
+   if (julia_preview(&preview_man_calc_struct, &v, rgb, JULIA_PREVIEW_BUDGET) < 0.0)
+      return 0;
+   prev_re = v.julia_re;
+   prev_im = v.julia_im;
+
+   memset(&bmi, 0, sizeof(bmi));
+   h = &bmi.bmiHeader;
+   h->biSize         = sizeof(BITMAPINFOHEADER);
+   h->biWidth        = JULIA_PREVIEW_XSIZE;
+   h->biHeight       = -JULIA_PREVIEW_YSIZE;
+   h->biPlanes       = 1;
+   h->biBitCount     = 32;
+   h->biCompression  = BI_RGB;
+
+   hdc = GetDC(hwnd_dialog);
+   SetStretchBltMode(hdc, COLORONCOLOR);
+   StretchDIBits(hdc, rc.left + ((rc.right - rc.left - w) >> 1), rc.top, w, ht,
+                 0, 0, JULIA_PREVIEW_XSIZE, JULIA_PREVIEW_YSIZE, rgb, &bmi, DIB_RGB_COLORS, SRCCOPY);
+   ReleaseDC(hwnd_dialog, hdc);
+
+   return 1;
+}
+
 // Initialize values that never change. Call once at the beginning of the program.
-void init_man(void)
+int init_man(void)
 {
-   int i, j;
-   man_pointstruct *ps_ptr;
-   HANDLE e;
+   int j;
    man_calc_struct *m;
 
    for (j = 0; j < 2; j++) // Initialize both main and save calculation structures
    {
       m = j ? &save_man_calc_struct : &main_man_calc_struct;
 
-      m->flags = j ? FLAG_IS_SAVE | FLAG_CALC_RE_ARRAY: FLAG_CALC_RE_ARRAY;
+      if (!init_man_calc_struct(m, j ? FLAG_IS_SAVE | FLAG_CALC_RE_ARRAY: FLAG_CALC_RE_ARRAY))
+         return 0;
+
       m->palette = DEFAULT_PAL;
       m->rendering_alg = cfg_settings.options.val & OPT_NORMALIZED ? RALG_NORMALIZED: RALG_STANDARD;
       m->precision = PRECISION_AUTO;
       m->mag = HOME_MAG;
       m->max_iters = HOME_MAX_ITERS;
+   }
+   // Julia preview (see do_julia_preview). Man_render allocates its arrays
+   if (!init_man_calc_struct(&preview_man_calc_struct, FLAG_CALC_RE_ARRAY))
+      return 0;
+   return pipe_init(&zoom_pipe, calc_zoom_frame, present_zoom_frame, NULL, 0);
+}
 
-      // Initialize the thread state structures
-      for (i = 0; i < MAX_THREADS; i++)
-      {
-         m->thread_states[i].thread_num = i;
-         m->thread_states[i].calc_struct = m;
+// ----------------------- GUI / misc functions -----------------------------------
 
-         // Create an auto-reset done event for each thread. The thread sets it when done with a calculation
-         e = CreateEvent(NULL, FALSE, FALSE, NULL);
-         m->thread_states[i].done_event = e;
-         m->thread_done_events[i] = e;
+// Make the number of threads choices for the dialog: 1, 2, 4... up to the number of cores N,
+// then N itself. Any number of threads can be used (see set_num_threads), so there's no fixed
+// list.
 
-         // Init each thread's point structure
-         m->thread_states[i].ps_ptr = ps_ptr = &m->pointstruct_array[i];
+static void add_num_threads_str(int n)
+{
+   sprintf_s(num_threads_buf[num_threads_choices], sizeof(num_threads_buf[0]), "%d", n);
+   num_threads_strs[num_threads_choices] = num_threads_buf[num_threads_choices];
+   num_threads_choices++;
+}
 
-         // Init 64-bit double and 32-bit float fields with divergence radius and constant 2.0
-         ps_ptr->two_d[1] = ps_ptr->two_d[0] = 2.0;
-         ps_ptr->two_f[3] = ps_ptr->two_f[2] = ps_ptr->two_f[1] = ps_ptr->two_f[0] = 2.0;
+void init_num_threads_strs(int n)
+{
+   int i;
 
-         ps_ptr->rad_d[1] = ps_ptr->rad_d[0] = DIVERGED_THRESH;
-         ps_ptr->rad_f[3] = ps_ptr->rad_f[2] = ps_ptr->rad_f[1] = ps_ptr->rad_f[0] = DIVERGED_THRESH;
-      }
-   }
+   num_threads_choices = 0;
+   for (i = 1; i < n; i <<= 1)
+      add_num_threads_str(i);
+   add_num_threads_str(n);
 }
 
-// ----------------------- GUI / misc functions -----------------------------------
-
 // Detect whether the CPU supports SSE2 and conditional move instructions; used to
 // set algorithms. Also detect the number of cores
 
-#define FEATURE_SSE     0x02000000
-#define FEATURE_SSE2    0x04000000
-#define FEATURE_CMOV    0x00008000
-
 void get_cpu_info(void)
 {
-   unsigned vendor[4];
-   unsigned features;
-   SYSTEM_INFO info;
+   char vendor[13];
    man_calc_struct *m;
 
    m = &main_man_calc_struct;
 
-   vendor[3] = 0;
-
-   __asm
-   {
-      // If the (ancient) CPU doesn't support the CPUID instruction, we would never get here...
-
-      xor eax, eax   // get vendor
-      cpuid
-      mov vendor,     ebx
-      mov vendor + 4, edx
-      mov vendor + 8, ecx
-      mov eax, 1     // get features
-      cpuid
-      mov features, edx
-   }
+   detect_cpu_features(vendor);
 
    // Use vendor to select default algorithm
-   if (!strcmp((const char *) vendor, "AuthenticAMD"))
+   if (!strcmp(vendor, "AuthenticAMD"))
       m->alg = ALG_FAST_ASM_AMD;
    else
       m->alg = ALG_FAST_ASM_INTEL;
@@ -3170,94 +1901,21 @@ void get_cpu_info(void)
    if (cfg_settings.options.val & OPT_EXACT_ALG)
       m->alg |= ALG_EXACT;
 
-   sse_support = 0;
-   if ((features & (FEATURE_SSE | FEATURE_CMOV)) == (FEATURE_SSE | FEATURE_CMOV))
-      sse_support = 1;
-   if ((features & (FEATURE_SSE2 | FEATURE_CMOV)) == (FEATURE_SSE2 | FEATURE_CMOV))
-      sse_support = 2;
-
-   if (sse_support < 2)
+   if (!(cpu_features & CPU_SSE2))
    {
       MessageBox(NULL, "Your (obsolete) CPU does not support SSE2 instructions.\r\n"
                        "Performance will be suboptimal.",  "Warning", MB_OK | MB_ICONSTOP | MB_TASKMODAL);
 
       // Ok to stay in auto precision mode with only sse support- will switch
       // to C algorithm for double. If no sse support, no choice but to use C
-      if (!sse_support)
+      if (!(cpu_features & CPU_SSE))
          m->alg = ALG_FAST_C;
    }
 
    // Set the default number of threads to the number of cores. Does this count a hyperthreading
    // single core as more than one core? Should ignore these as hyperthreading won't help.
-   GetSystemInfo(&info);
-   num_threads = info.dwNumberOfProcessors;
-
-   // Convert number of threads (cores) to a selection index for the dropdown box
-
-   // Get log2(num_threads)
-   for (num_threads_ind = 0; num_threads_ind <= MAX_THREADS_IND; num_threads_ind++)
-      if ((1 << num_threads_ind) >= num_threads)
-         break;
-
-   num_threads = 1 << num_threads_ind;
-}
-
-// Allocate all the memory needed by the calculation engine. This needs to be called
-// (after freeing the previous mem) whenever the image size changes. 
-int alloc_man_mem(man_calc_struct *m, int width, int height)
-{
-   int n;
-
-   m->iter_data_line_size = width + 2;
-   m->image_size = width * height; // new image size
-
-   // Because the fast algorithm checks offsets from the current pixel location, iter_data needs dummy
-   // lines to accomodate off-screen checks. Needs one line at y = -1, and 6 at y = ysize. Also needs
-   // two dummy pixels at the end of each line.
-
-   // Need separate pointer to be able to free later
-
-   m->iter_data_start = (unsigned *) malloc(n = m->iter_data_line_size * (height + 7) * sizeof(m->iter_data_start[0]));
-   if (m->iter_data_start != NULL)
-      memset(m->iter_data_start, 0, n);
-
-   m->iter_data = m->iter_data_start + m->iter_data_line_size; // create dummy lines at y = -1 for fast alg
-
-   // Create a corresponding array for the magnitudes. Don't really need the dummy lines but this
-   // allows using a fixed offset from iter_data
-   m->mag_data = (float *) malloc(m->iter_data_line_size * (height + 7) * sizeof(m->mag_data[0]));
-
-   m->mag_data_offs = (int)((char *) m->mag_data - (char *) m->iter_data);
-
-   // These two need 4 extra dummy values
-   m->img_re = (double *) malloc((width + 4) * sizeof(m->img_re[0]));
-   m->img_im = (double *) malloc((height + 4) * sizeof(m->img_im[0]));
-
-   // Buffer for PNG save (not needed for main calculation). 4 bytes per pixel
-   if (m->flags & FLAG_IS_SAVE)
-   {
-      m->png_buffer = (unsigned char *) malloc((width << 2) * height * sizeof(unsigned char));
-      if (m->png_buffer == NULL)
-         return 0;
-   }
-
-   if (m->iter_data_start == NULL || m->mag_data == NULL || m->img_re == NULL || m->img_im == NULL)
-      return 0;
-   return 1;
-}
-
-// Free all memory allocated above
-void free_man_mem(man_calc_struct *m)
-{
-   if (m->iter_data_start != NULL)
-   {
-      free(m->iter_data_start);
-      free(m->mag_data);
-      free(m->img_re);
-      free(m->img_im);
-      if (m->png_buffer != NULL)
-         free(m->png_buffer);
-   }
+   set_num_threads(get_num_processors());
+   init_num_threads_strs(num_threads);
 }
 
 // Rename this; now does a lot more than create a bitmap
@@ -3271,7 +1929,7 @@ int create_bitmap(int width, int height)
 {
    BITMAPINFO bmi;
    BITMAPINFOHEADER *h;
-   int i, j, err;
+   int i, err;
    int bmihsize = sizeof(BITMAPINFOHEADER);
    static int prev_width = 0;
    static int prev_height = 0;
@@ -3283,6 +1941,8 @@ int create_bitmap(int width, int height)
    if (prev_width == width && prev_height == height)
       return 0;
 
+   pipe_flush(&zoom_pipe); // finish any realtime zoom frame before freeing its bitmap
+
    // free any existing arrays/bitmaps
    if (m->iter_data_start != NULL)
       for (i = 0; i < 4; i++)
@@ -3319,12 +1979,6 @@ int create_bitmap(int width, int height)
    prev_height = height;
    m->min_dimension = (width < height) ? width: height; // set smaller dimension
 
-   // Precalculate pointer offsets of neighboring pixels for the fast "wave" algorithm
-   // (these only change when image width changes). Not needed for save
-   for (j = 1; j < 7; j++)
-      for (i = 0; i < 4; i++)
-         wave_ptr_offs[j][i] = wave_yoffs[j][i] * m->iter_data_line_size + wave_xoffs[j][i];
-
    reset_quadrants();   // reset to recalculate all
    reset_fps_values();  // reset frames/sec timing values
    reset_pan_state();   // reset pan filters and movement state
@@ -3394,7 +2048,11 @@ void get_user_palette(void)
       tmp = bmp_flag ? load_palette_from_bmp(fp) : load_palette(fp);
 
       if (tmp)          // load_palette* assigns a nonzero number to the palette
-         m->palette = tmp; // if valid, which can then be used with apply_palette.
+      {                 // if valid, which can then be used with apply_palette.
+         m->palette = tmp;
+         m->prev_pal = 0xFFFFFFFF; // tell apply_palette that user palette changed. Save
+         preview_man_calc_struct.prev_pal = 0xFFFFFFFF; // function resets this value for its
+      }                                                 // own structure
       else
          MessageBox( NULL, bmp_flag ? "Unsupported file format. Please supply an uncompressed 24-bit bitmap."
                                     : "Unrecognized file format.",
@@ -3427,13 +2085,23 @@ int get_alg(void)
    return get_string_index(str, alg_strs, NUM_ELEM(alg_strs));
 }
 
+// Get the index of the current number of threads in the dialog choices
+int get_num_threads_index(void)
+{
+   char str[16];
+   int i;
+
+   sprintf_s(str, sizeof(str), "%d", num_threads);
+   i = get_string_index(str, num_threads_strs, num_threads_choices);
+   return i >= 0 ? i : num_threads_choices - 1;
+}
+
 void get_num_threads(void)
 {
    char str[256];
 
    GetDlgItemText(hwnd_dialog, IDC_THREADS, str, sizeof(str));
-   num_threads_ind = get_string_index(str, num_threads_strs, NUM_ELEM(num_threads_strs));
-   num_threads = 1 << num_threads_ind;
+   set_num_threads(atoi(str));
 }
 
 // Increase, decrease, or just clip the max iterations
@@ -3464,9 +2132,10 @@ void set_home_image(void)
 
    m->pan_xoffs = 0; // Reset any pan offsets
    m->pan_yoffs = 0;
-   m->re = HOME_RE;
-   m->im = HOME_IM;
+   m->re = m->julia ? 0.0 : HOME_RE; // Julia sets are centered on 0
+   m->im = m->julia ? 0.0 : HOME_IM;
    m->mag = HOME_MAG;
+   m->mag_exp = 0;
    m->max_iters = HOME_MAX_ITERS;   // Better to reset the max iters here. Don't want large #
    update_iters(0, 0);              // from previous image
 }
@@ -3488,8 +2157,6 @@ void get_dialog_fields(void)
    m->alg = get_alg();
    m->precision = get_precision();
    m->rendering_alg = get_rendering_alg();
-   if (m->precision == PRECISION_EXTENDED) // don't allow on-the-fly change to this (unimplemented)
-      m->precision = PRECISION_DOUBLE;
 
    get_builtin_palette();
 
@@ -3523,13 +2190,14 @@ void print_status_line(int calc)
    if (!(status & STAT_DOING_SAVE)) // if currently saving, keep saving status in first part of line
    {
       sprintf_s(s, sizeof(s), "%s%s", calc ? "Calculating..." : "Ready ",
-                calc ? "" : precision_loss ? "[Prec Loss]" : "");
+                calc ? "" : m->precision_loss ? "[Prec Loss]" : m->perturb ? "[Perturbation]" : "");
 
       SetWindowText(hwnd_status, s);
    }
 
    sprintf_s(s, sizeof(s), "%d/%d  %c", log_pos + 1, log_count,
-             m->precision == PRECISION_SINGLE ? 'S' : m->precision == PRECISION_DOUBLE ? 'D' : 'E');
+             m->precision == PRECISION_SINGLE ? 'S' : m->precision == PRECISION_DOUBLE ? 'D' :
+             m->precision == PRECISION_FIXED ? 'F' : 'E');
    SetWindowText(hwnd_status2, s);
 }
 
@@ -3588,28 +2256,32 @@ void check_alg(HWND hwnd)
    m->precision = get_precision();
    m->alg = get_alg();
    m->rendering_alg = get_rendering_alg();
-   if (m->precision == PRECISION_EXTENDED)
-   {
-      not_implemented_yet();
-      SendDlgItemMessage(hwnd, IDC_PRECISION, CB_SETCURSEL, PRECISION_DOUBLE, 0);
-   }
-   else if (m->precision == PRECISION_DOUBLE)
+   if (m->precision == PRECISION_DOUBLE)
    {
-      if (sse_support < 2 && !(m->alg & ALG_C)) // If CPU doesn't support SSE2, can only run C version
+      if (!(cpu_features & CPU_SSE2) && ALG_TYPE(m->alg) != ALG_C) // If CPU doesn't support SSE2, can only run C version
       {
          unsupported_alg_prec();
          SendDlgItemMessage(hwnd, IDC_ALGORITHM, CB_SETCURSEL, ALG_FAST_C, 0);
       }
    }
-   else
+   else if (m->precision != PRECISION_FIXED) // fixed point kernels are C; they run on any CPU
    {
-      if (!sse_support && !(m->alg & ALG_C)) // If CPU doesn't support SSE, can only run C version
+      if (!(cpu_features & CPU_SSE) && ALG_TYPE(m->alg) != ALG_C) // If CPU doesn't support SSE, can only run C version
       {
          unsupported_alg_prec();
          SendDlgItemMessage(hwnd, IDC_ALGORITHM, CB_SETCURSEL, ALG_FAST_C, 0);
       }
    }
 
+   // FMA algs need FMA3 support. Use the AMD version of the alg instead
+   if (ALG_TYPE(m->alg) == ALG_FMA && !(cpu_features & CPU_FMA))
+   {
+      MessageBox(NULL, "Your CPU does not support FMA instructions.\n"
+                       "Using AMD algorithm.", NULL, MB_OK | MB_ICONSTOP | MB_TASKMODAL);
+      m->alg &= ALG_EXACT;
+      SendDlgItemMessage(hwnd, IDC_ALGORITHM, CB_SETCURSEL, m->alg, 0);
+   }
+
    // Give user a choice to switch to exact alg if using normalized rendering
 
    if (!(m->alg & ALG_EXACT) && (m->rendering_alg == RALG_NORMALIZED))
@@ -3618,12 +2290,30 @@ void check_alg(HWND hwnd)
          SendDlgItemMessage(hwnd, IDC_ALGORITHM, CB_SETCURSEL, m->alg |= ALG_EXACT, 0);
          status |= STAT_RECALC_FOR_PALETTE; // need to recalc if switching to exact
       }
+
+   // DE shading needs the distance estimates, which are only calculated when needed
+   if (m->rendering_alg == RALG_DE && !m->de)
+      status |= STAT_RECALC_FOR_PALETTE;
    set_alg_warning();
 }
 
+// Cancel poll for full recalculations (see cancel_calc). The engine calls it from the thread
+// that called man_calculate, which is this one, so it sees our message queue. Only mouse clicks
+// cancel: zooms happen on button up, so the click that started the calculation is already out of
+// the queue. Keys can't be used because the key up of a hotkey (e.g. 'N') would cancel its own
+// calculation. GetQueueStatus doesn't dispatch any messages, so this is safe to call mid-calculation.
+static int input_pending(void *param)
+{
+   return (HIWORD(GetQueueStatus(QS_MOUSEBUTTON)) & QS_MOUSEBUTTON) != 0;
+}
+
 // Calculate all or a portion of the set. If recalc_all is nonzero, recalculate entire image,
 // update image info/status line and set a wait cursor during calculation. Otherwise only
 // recalculate the update rectangles and don't update info.
+//
+// A full recalculation gets cancelled if a mouse button is pressed meanwhile, so a new view can
+// start right away. The partly done image is shown as a preview, and gets recalculated when the
+// input is handled (see do_recalc), if the input didn't already start a new view.
 
 void do_man_calculate(int recalc_all) // sdmc
 {
@@ -3632,6 +2322,8 @@ void do_man_calculate(int recalc_all) // sdmc
 
    m = &main_man_calc_struct;
 
+   pipe_flush(&zoom_pipe);             // finish any realtime zoom frame first
+
    m->max_iters &= ~1;                 // make max iters even (required by optimized algorithm)
    if (m->max_iters != m->max_iters_last) // need to recalculate all if max iters changed
       status |= STAT_NEED_RECALC;
@@ -3652,17 +2344,34 @@ void do_man_calculate(int recalc_all) // sdmc
       status &= ~STAT_RECALC_FOR_PALETTE; // no longer need to recalc for palette
    }
 
+   all_recalculated = 0;
+   if (status & STAT_NEED_RECALC)   // whole image gets recalculated (quadrants were reset above)
+   {
+      status &= ~STAT_NEED_RECALC;
+      all_recalculated = 1;
+   }
+
+   if (recalc_all && !do_rtzoom)
+      m->cancel_poll = input_pending;
    man_calculate_quadrants();
+   m->cancel_poll = NULL;
    m->max_iters_last = m->max_iters;  // last iters actually calculated, for palette code
 
+   status &= ~STAT_CANCELLED;
+   if (m->cancelled)
+      status |= STAT_NEED_RECALC | STAT_CANCELLED;
+
    InvalidateRect(hwnd_main, NULL, 0); // cause repaint with image data
    UpdateWindow(hwnd_main);
 
    // Don't update this stuff if realtime zooming. Will be done at intervals
    if (recalc_all && !do_rtzoom)
    {
-      SetWindowText(hwnd_info, get_image_info(1));       // update time, GFlops
-      print_status_line(0);
+      if (!m->cancelled)
+      {
+         SetWindowText(hwnd_info, get_image_info(1));    // update time, GFlops
+         print_status_line(0);
+      }
       SetCursor(cursor);                                 // restore old cursor
    }
 }
@@ -3827,24 +2536,40 @@ unsigned __stdcall do_save(LPVOID param)
    // Copy relevant image parameters to the save calculation structure from the main structure
    // (whose image is currently displayed).
 
-   // Get saved image re/im from the main re/im + pan offsets
-   s->re = m->re + get_re_im_offs(m, m->pan_xoffs);
-   s->im = m->im - get_re_im_offs(m, m->pan_yoffs);
+   // Get saved image re/im from the main re/im + pan offsets (at high precision, for deep images)
+   sync_re_im_hp(m);
+   s->re_hp = m->re_hp;
+   s->im_hp = m->im_hp;
+   add_re_im_offs(m, &s->re_hp, &s->im_hp, m->pan_xoffs, m->pan_yoffs);
+   s->re = hp_to_double(&s->re_hp);
+   s->im = hp_to_double(&s->im_hp);
 
    // min_dimension is used to calc. coords- needs to reflect the actual ysize
    s->min_dimension = (save_xsize > save_ysize) ? save_ysize : save_xsize;
    s->mag = m->mag;
+   s->mag_exp = m->mag_exp;
    s->max_iters = s->max_iters_last = m->max_iters;
 
    // Can get unexpected precision loss when the saved image is larger than the on-screen image.
-   // Always use best precision to minimize occurrences
-   s->precision = PRECISION_DOUBLE; // m->precision
+   // Always use best precision to minimize occurrences (at least double; keep extended or fixed
+   // point if the main image used it, with the 128-bit fixed point kernel)
+   s->precision = (m->precision == PRECISION_EXTENDED || m->precision == PRECISION_FIXED) ?
+                  m->precision : PRECISION_DOUBLE;
+   s->fixed_bits = 128;
+   s->perturb = m->perturb;         // precision loss isn't checked when saving (see man_setup)
    s->alg = m->alg | ALG_EXACT;     // exact will be faster for 1-pixel high rows. Want for best quality anyway.
    s->palette = m->palette;
    s->prev_pal = 0xFFFFFFFF;        // always recalc. pal lookup table before starting
    s->pal_xor = m->pal_xor;
    s->max_iters_color = m->max_iters_color;
    s->rendering_alg = m->rendering_alg;
+   s->kernel = cfg_settings.kernel.val;
+   s->chains = cfg_settings.chains.val;
+   s->auto_fixed = cfg_settings.autofixed.val;
+   s->formula = cfg_settings.formula.val;
+   s->julia = m->julia;
+   s->julia_re = m->julia_re;
+   s->julia_im = m->julia_im;
    s->flags |= FLAG_CALC_RE_ARRAY;  // tell man_calculate to calculate the real array initially
 
    // Make sure all image data above is already captured before possibly popping a message
@@ -3947,7 +2672,7 @@ INT_PTR CALLBACK man_dialog_proc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPa
          init_combo_box(hwnd, IDC_PALETTE, palette_strs, NUM_ELEM(palette_strs), m->palette);
          init_combo_box(hwnd, IDC_RENDERING, rendering_strs, NUM_ELEM(rendering_strs), m->rendering_alg);
          init_combo_box(hwnd, IDC_ALGORITHM, alg_strs, NUM_ELEM(alg_strs), m->alg);
-         init_combo_box(hwnd, IDC_THREADS, num_threads_strs, MAX_THREADS_IND + 1, num_threads_ind);
+         init_combo_box(hwnd, IDC_THREADS, num_threads_strs, num_threads_choices, get_num_threads_index());
          init_combo_box(hwnd, IDC_LOGFILE, file_strs, NUM_ELEM(file_strs), 0);
 
          // default save filename- later have this scan for next available
@@ -4072,6 +2797,8 @@ INT_PTR CALLBACK man_dialog_proc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPa
 
       case WM_COMMAND:
 
+         pipe_flush(&zoom_pipe); // settings can change (see start_zoom_frame)
+
          switch (LOWORD(wParam))
          {
             case IDC_LOGFILE:
@@ -4260,7 +2987,9 @@ INT_PTR CALLBACK man_dialog_proc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPa
                reset_thread_load_counters();
                zoom_start_time = get_timer();
                zoom_start_mag = m->mag;
+               zoom_start_mag_exp = m->mag_exp;
                m->mag = MAG_MIN;
+               m->mag_exp = 0;
                do_rtzoom = RTZOOM_IN | RTZOOM_WITH_BUTTON;
                return TRUE;
 
@@ -4622,6 +3351,8 @@ LRESULT CALLBACK MainWndProc(HWND hwnd, UINT nMsg, WPARAM wParam, LPARAM lParam)
          if (lParam & PREV_KEYDOWN) // aargh... ignore key autorepeats. Were wiping out prev_do_rtzoom.
             return TRUE;
 
+         pipe_flush(&zoom_pipe); // keys can change the image (see start_zoom_frame)
+
          if (allow_mode_change)
          {
             if (wParam == 'Z') // toggle zoom mode
@@ -4668,6 +3399,9 @@ LRESULT CALLBACK MainWndProc(HWND hwnd, UINT nMsg, WPARAM wParam, LPARAM lParam)
                status ^= STAT_PALETTE_LOCKED;
                print_palette_status();
                break;
+            case 'J': // 'J' switches to the Julia set for the point under the mouse, and back.
+               toggle_julia();
+               break;
             case 'I': // 'I' toggles palette inversion.
                m->pal_xor ^= 0xFFFFFF;
                SendMessage(hwnd_dialog, WM_COMMAND, MAKELONG(IDC_PALETTE, CBN_SELCHANGE), 0);
@@ -4823,7 +3557,8 @@ int __stdcall WinMain(HINSTANCE hInst, HINSTANCE hPrev, LPSTR lpCmd, int nShow)
    read_cfg_file();
    get_cpu_info();
    get_system_metrics();
-   init_man();
+   if (!init_man())
+      return 0;
    if (!(num_builtin_palettes = init_palettes(DIVERGED_THRESH)))
       return 0;
 
@@ -4893,7 +3628,7 @@ int __stdcall WinMain(HINSTANCE hInst, HINSTANCE hPrev, LPSTR lpCmd, int nShow)
       else
       {
          // Do heavy computation here
-         if (!do_zooming() && !do_panning() && !do_recalc())
+         if (!do_zooming() && !do_panning() && !do_recalc() && !do_julia_preview())
             Sleep(2); // don't use 100% of CPU when idle. Also see do_panning()
       }
    }
@@ -4904,6 +3639,7 @@ int __stdcall WinMain(HINSTANCE hInst, HINSTANCE hPrev, LPSTR lpCmd, int nShow)
 
    free_man_mem(&main_man_calc_struct);
    free_man_mem(&save_man_calc_struct);
+   free_man_mem(&preview_man_calc_struct);
 
    return (int) msg.wParam;
 }
@@ -26,6 +26,8 @@
 //
 // 11/12/08 PG: Initial for v1.10. Split off most definitions from the C files
 // into this header file.
+//
+// Include port.h (or windows.h for the GUI) before this file.
 
 #define CFG_FILE "quickman.cfg"         // configuration file containing default settings
 
@@ -33,7 +35,8 @@
 #define PRECISION_AUTO        0 // Automatically determined based on magnification
 #define PRECISION_SINGLE      1 // 32-bit float
 #define PRECISION_DOUBLE      2 // 64-bit double
-#define PRECISION_EXTENDED    3 // 80-bit (x87) double or larger
+#define PRECISION_EXTENDED    3 // double-double (about 106-bit mantissa)
+#define PRECISION_FIXED       4 // 64-bit fixed point, or 128-bit once that loses precision
 
 // Available algorithms
 #define ALG_FAST_ASM_AMD      0 // Use the "wave" algorithm to guess pixels
@@ -42,26 +45,90 @@
 #define ALG_EXACT_ASM_INTEL   3 //
 #define ALG_FAST_C            4 // Unoptimized C versions
 #define ALG_EXACT_C           5 //
-//#define ALG_ERROR           6 // Show error image: exact ^ fast
+#define ALG_FAST_FMA          6 // Fused multiply-add (FMA3) versions; need AVX2 and FMA
+#define ALG_EXACT_FMA         7 //
+//#define ALG_ERROR           8 // Show error image: exact ^ fast
 
 #define ALG_EXACT             1 // using Exact alg if this bit set (change with above)
-#define ALG_INTEL             2 // using Intel alg if this bit set
-#define ALG_C                 4 // using C alg if this bit set
+#define ALG_TYPE(alg)         ((alg) & 6) // iteration function type in bits 2-1: one of the below
+#define ALG_AMD               0
+#define ALG_INTEL             2
+#define ALG_C                 4
+#define ALG_FMA               6
+
+// Bits in cpu_features: SIMD instruction sets usable by the iteration functions. The AVX ones
+// also require OS support for saving the ymm (zmm and mask) registers.
+#define CPU_SSE               1  // SSE and CMOV
+#define CPU_SSE2              2  // SSE2 and CMOV
+#define CPU_AVX               4
+#define CPU_AVX2              8
+#define CPU_FMA               16 // FMA3
+#define CPU_AVX512            32 // AVX-512F
+
+// Kernel (iteration function) levels. By default the widest kernel the CPU supports is used;
+// the "kernel" setting in quickman.cfg or a logfile entry can force a narrower one.
+#define KERNEL_AUTO           0 // widest available
+#define KERNEL_C              1 // unoptimized C
+#define KERNEL_SSE            2 // 4 doubles (SSE2) / 8 floats (SSE)
+#define KERNEL_AVX            3 // 8-16 doubles / 16-32 floats (2-4 chains)
+#define KERNEL_AVX512         4 // 16-32 doubles / 32 floats
+#define KERNEL_MAX            4
+
+// Autotuned kernel choices (see autotune and the "tuned" setting). A hex digit each for the
+// kernel level (KERNEL_*) and chain count at single, double and extended precision (0 = untuned:
+// widest kernel, default chains), used where the kernel setting is 0 (and for the chains, where the
+// chains setting is 0 too). TUNED_INTEL selects the Intel versions of the ASM kernels for ALG_AMD.
+#define TUNED_KERNEL(t, prec)       (((t) >> (8 * ((prec) - PRECISION_SINGLE))) & 15)
+#define TUNED_CHAINS(t, prec)       (((t) >> (8 * ((prec) - PRECISION_SINGLE) + 4)) & 15)
+#define TUNED(prec, kernel, chains) (((kernel) | ((chains) << 4)) << (8 * ((prec) - PRECISION_SINGLE)))
+#define TUNED_INTEL                 0x1000000
+
+// Formulas: z = f(z) + c, with z = x + iy. The others are double precision only (no extended,
+// fixed point or perturbation), and don't get the interior pre-pass or distance estimates.
+#define FORMULA_MANDELBROT    0 // z^2 (keep this 0)
+#define FORMULA_MULTIBROT3    1 // z^3
+#define FORMULA_MULTIBROT4    2 // z^4
+#define FORMULA_BURNING_SHIP  3 // (|x| + i|y|)^2
+#define FORMULA_TRICORN       4 // conj(z)^2
+#define NUM_FORMULAS          5
 
 // Rendering algorithms
 #define RALG_STANDARD         0 // keep this 0
 #define RALG_NORMALIZED       1
+#define RALG_DE               2 // standard, darkened near the set by the distance estimate
 
 #define NUM_ELEM(a) (sizeof(a) / sizeof(a[0]))
 
-#define MAX_THREADS_IND     5 // Set this to set maximum number of threads (== 2^this)
-#define MAX_THREADS        (1 << MAX_THREADS_IND)
+// Sanity limit on the number of calculation threads. Any number up to this can be used; the
+// thread states are allocated as needed (see alloc_threads).
+#define MAX_THREADS        4096
 
-// Max threads that can be running at once, with save going on in the background
-#define MAX_QUEUE_THREADS  (MAX_THREADS * 2 + 3)
+// Max Windows pool threads for the background work items (image save, help). The calculation
+// threads have their own pool (see run_pool).
+#define MAX_QUEUE_THREADS  4
 
 //#define USE_PERFORMANCE_COUNTER   // See get_timer()
 
+// The hand-tuned inline ASM (iteration cores, x87 conversions) only builds with 32-bit MSVC.
+// Other builds use the equivalent SSE/SSE2 intrinsic versions in engine.c. The ASM iteration
+// cores have no periodicity checking (see PERIOD_FIRST_SAVE), so they're only used if
+// USE_ASM_ITERATE is defined too; otherwise 32-bit MSVC also uses the intrinsic versions.
+#if defined(_MSC_VER) && defined(_M_IX86)
+#define USE_ASM_KERNELS
+//#define USE_ASM_ITERATE
+#endif
+
+// The AVX2 kernels are intrinsics compiled for their own target, so they need a compiler that
+// knows the instructions (VS2012 or later, gcc, clang). They're only used if the CPU supports them.
+#if !defined(_MSC_VER) || _MSC_VER >= 1700
+#define USE_AVX_KERNELS
+#endif
+
+// Same for the AVX-512 kernels (VS2017 or later)
+#if !defined(_MSC_VER) || _MSC_VER >= 1910
+#define USE_AVX512_KERNELS
+#endif
+
 #ifdef USE_PERFORMANCE_COUNTER
 typedef LARGE_INTEGER TIME_UNIT;
 #else
@@ -106,6 +173,8 @@ typedef DWORD TIME_UNIT;
 
 #define MIN_ITERS             2            // allow to go down to min possible, for overhead testing
 #define MAX_ITERS             0x08000000   // keep upper 4 bits free in iter array, in case we need them for something
+#define ITERS_GLITCHED        0x80000000   // flag in iter array: point glitched in the perturbation engine (cleared by man_calculate)
+#define ITERS_NONE            0            // iter array value of points not calculated yet (see man_calculate)
 
 #define MIN_SIZE              4            // min image size dimension. Code should work down to 1 x 1
 
@@ -120,6 +189,7 @@ typedef DWORD TIME_UNIT;
 #define STAT_PALETTE_LOCKED      32 // 1 if the palette is currently locked (ignore logfile palettes)
 #define STAT_HELP_SHOWING        64 // 1 if the help window is showing
 #define STAT_DOING_SAVE         128 // 1 if doing a save
+#define STAT_CANCELLED          256 // 1 if the last full calculation was cancelled by input (see do_recalc)
 
 // Quadrant-based panning structures
 
@@ -132,7 +202,9 @@ typedef struct
 }
 rectangle;
 
-// Structure for quadrants used in panning
+#ifdef _WIN32
+
+// Structure for quadrants used in panning (GUI only)
 typedef struct
 {
    int status;          // see below
@@ -159,82 +231,201 @@ quadrant;
 // Values for the quadrant status word
 #define QSTAT_DO_BLIT      1  // if set, blit this quadrant's data to the screen
 
+#endif // _WIN32
+
 // Structures and variables used in iteration
 
-// Structure to hold the state of 4 iterating points (or 8 for SSE). For SSE (single precision),
-// 32-bit floats are packed into the fields, otherwise 64-bit doubles. This needs
-// to be 16-byte aligned. Project/compiler options can't guarantee this alignment:
-// must use syntax below.
+// Structure to hold the state of 4 iterating points (8 for SSE, 8-16/16-32 for AVX2 double/single,
+// 16-32/32 for AVX-512; see the multi-chain kernels). For single precision, 32-bit floats are
+// packed into the fields, otherwise 64-bit doubles. This needs to be 64-byte aligned (for the
+// 512-bit kernels). Project/compiler options can't guarantee this alignment: must use syntax below.
 //
-// Only the first 4/8 values of each array are used (unless otherwise noted). But the
-// additional values are still necessary to force each array to occupy its own 64-byte
-// cache line (i.e, no sharing). With line sharing there can be conflicts that cost cycles.
+// The per-point arrays are sized for the widest kernels: 32 doubles or 32 floats (so the float
+// kernels only use the first half). Narrower kernels only use the first 4/8/16/24 values. But
+// the additional values are still necessary to force each array to occupy its own 64-byte cache
+// lines (i.e, no sharing). With line sharing there can be conflicts that cost cycles. The
+// double-double kernels iterate 8 points, with the high parts in values 0-7 and the low parts
+// in 8-15.
 //
 // May even want to give each 128 bits (xmm reg) its own cache line- change x to x01, x23, etc.
 // Initialization and divergence detection would be nastier
 //
 // Tried expanding x, y, and yy to 16 doubles so ..23 regs could have own cache line: no effect
 
+#define MAX_QUEUE_POINTS      32 // max points iterated at once by any kernel
+#define BATCH_POINTS          64 // points buffered for the batched queue functions (see queue_batch_point)
+
+// High precision number for the perturbation engine (see perturb.c): sign-magnitude fixed
+// point with HP_LIMBS 32-bit limbs. Limb 0 is the integer part. 64 limbs goes to about 1e580
+// (see hp_limbs_for_mag); this is the magnification limit.
+
+#define HP_LIMBS              64
+
+// Extended exponent number: val * 2^exp. For pixel spacings and deltas past the double exponent
+// range (magnifications beyond about 1e300). Val isn't necessarily normalized.
+typedef struct
+{
+   double val;
+   int exp;
+}
+floatexp;
+
+// Values for man_calc_struct perturb field (and kernel table entries)
+#define PERTURB_DOUBLE        1  // deltas are doubles
+#define PERTURB_FLOATEXP      2  // deltas are doubles times 2^delta_exp, rescaled per point
+
+typedef struct
+{
+   unsigned limb[HP_LIMBS];      // most significant first
+   int neg;                      // 1 if negative
+}
+hp_num;
+
+// 128-bit fixed point number for the fixed point kernels (see iterate_fixed64): two's complement
+// hi:lo, with FIXED_INT_BITS integer bits (including the sign). The 64-bit kernel uses just hi.
+#define FIXED_INT_BITS        7
+#define FIXED_POINTS          4  // points iterated at once by the fixed point kernels
+
+typedef struct
+{
+   unsigned long long lo;
+   long long hi;
+}
+fixed_num;
+
+// Reference orbit for the perturbation engine. The orbit is rounded to doubles for the kernels.
+typedef struct
+{
+   double *x;                    // Z_n, n = 0 to max_iters (+1)
+   double *y;
+   double *thresh;               // glitch threshold for each Z_n; infinite past the end of the orbit
+   unsigned len;                 // orbit length (iteration where the reference diverged, or max_iters)
+   unsigned size;                // allocated entries
+
+   hp_num re;                    // what the orbit was calculated for, to avoid recalculating it
+   hp_num im;
+   unsigned max_iters;
+   int limbs;
+}
+perturb_ref;
+
+// Series approximation of the deltas from a reference orbit, for skipping the first iterations
+// (see perturb_series_calc). After iters iterations, dz = a * u + b * u^2 + c * u^3 (complex),
+// where u = dc * inv_scale, all times 2^exp. The scaling keeps the coefficients in range at any
+// magnification.
+typedef struct
+{
+   double a[2];                  // complex coefficients (re, im)
+   double b[2];
+   double c[2];
+   double inv_scale;
+   int exp;
+   unsigned iters;               // iterations skipped (0 if the approximation can't be used)
+}
+perturb_series;
+
 typedef struct // sps
 {
-   double x[8];                  // 0   x, y, yy = the state of the iterating points
-   double y[8];                  // 64
-   double yy[8];                 // 128
-   double a[8];                  // 192 Real coordinate of point
-   double b[8];                  // 256 Imag coordinate of point
-   double mag[8];                // 320 Magnitudes from current iteration
-   double magprev[8];            // 384 Magnitudes from previous iteration
-   double two_d[8];              // 448 Only 1st 2 used; must be set to 2.0. Used in SSE2 routine.
-   float two_f[16];              // 512 Only 1st 4 used; must be set to 2.0. Used in SSE routine.
-   double rad_d[8];              // 576 Radius^2 for divergence detection; only 1st 2 used; only used in Intel version
-   float rad_f[16];              // 640 only 1st 4 used
+   double x[32];                 // 0    x, y, yy = the state of the iterating points
+   double y[32];                 // 256
+   double yy[32];                // 512
+   double a[32];                 // 768  Real coordinate of point
+   double b[32];                 // 1024 Imag coordinate of point
+   double mag[32];               // 1280 Magnitudes from current iteration
+   double magprev[32];           // 1536 Magnitudes from previous iteration
+   double two_d[8];              // 1792 Only 1st 2 used; must be set to 2.0. Used in SSE2 routine.
+   float two_f[16];              // 1856 Only 1st 4 used; must be set to 2.0. Used in SSE routine.
+   double rad_d[8];              // 1920 Radius^2 for divergence detection; only 1st 2 used; only used in Intel version
+   float rad_f[16];              // 1984 only 1st 4 used
 
    // Even though the following fields aren't used in the inner loop, there's a slight decrease in
    // performance if they aren't aligned to a 64-byte cache line.
 
-   unsigned iters[16];           // 704 Current iteration counts; only 1st 4/8 used
-   unsigned *iters_ptr[16];      // 768 Pointer into iteration count array; only 1st 4/8 used
-   float *mag_ptr[16];           // 832 Pointer into iteration count array; only 1st 4/8 used
-   unsigned long long iterctr;   // 896 Iterations counter, for benchmarking. M$ 64-bit aligns this, adding (crash-causing) extra padding if not already on a 64-bit boundary...
-   double ab_in[2];              // 904 loop sets ab_in to the point to iterate on (ab_in[0] = re, ab_in[1] = im). Others unused. MS also 64-bit aligns this
-   unsigned cur_max_iters;       // 920 Max iters to do this loop
+   unsigned iters[MAX_QUEUE_POINTS];      // 2048 Current iteration counts
+   unsigned *iters_ptr[MAX_QUEUE_POINTS]; // 2176 Pointer into iteration count array
+   float *mag_ptr[MAX_QUEUE_POINTS];      // 2304 Pointer into iteration count array
+   unsigned long long iterctr;   // 2432 Iterations counter, for benchmarking. M$ 64-bit aligns this, adding (crash-causing) extra padding if not already on a 64-bit boundary...
+   double ab_in[2];              // 2440 loop sets ab_in to the point to iterate on (ab_in[0] = re, ab_in[1] = im). Others unused. MS also 64-bit aligns this
+   unsigned cur_max_iters;       // 2456 Max iters to do this loop
    unsigned queue_status;        // Status of pointstruct queue (free/full slots)
-   unsigned pad[8];              // Pad to make size a multiple of 64. Necessary, otherwise code will crash with 2 or more threads due to array misalignment.
+   double ab_lo[2];              // Low parts of ab_in, for the double-double kernels
+   perturb_ref *ref;             // Reference orbit, for the perturbation kernels
+   perturb_series *series;       // Starting values for new points (NULL: start at iteration 0)
+   int delta_exp;                // Exponent of a and b for the floatexp kernels (dc = a * 2^delta_exp)
+   unsigned periodic;            // Bitmask of points the kernel found periodic (see PERIOD_FIRST_SAVE)
+   unsigned periodic_ctr;        // Points retired early by periodicity checking, for get_image_info
+   unsigned period_save;         // Iterations to the first of the period_next counts (may be early)
+   double period_tol;            // Periodicity tolerance: max |dx| + |dy| for a repeat
+   double julia_c[2];            // Julia mode c (see set_start_point)
+   unsigned batch_n;             // Points in the batch buffer below
+   int julia;                    // 1 in Julia mode: ab_in is the starting z, not c
+   unsigned pad[sizeof(void *) == 8 ? 3 : 5]; // Pad to make size a multiple of 64 (and align the arrays below). Necessary, otherwise code will crash with 2 or more threads due to array misalignment.
+   double period_x[32];          // Saved orbit points for periodicity checking
+   double period_y[32];
+   unsigned period_next[MAX_QUEUE_POINTS]; // Each point's next save count (see PERIOD_FIRST_SAVE)
+   double dx[16];                // Derivative dz/dc, for the distance estimation kernels
+   double dy[16];
+   double batch_re[BATCH_POINTS];         // Batch buffer: points waiting for a free queue slot
+   double batch_im[BATCH_POINTS];
+   unsigned *batch_ptr[BATCH_POINTS];
+   fixed_num fx[FIXED_POINTS];            // Fixed point kernel states (xx, yy = squares of x, y)
+   fixed_num fy[FIXED_POINTS];
+   fixed_num fxx[FIXED_POINTS];
+   fixed_num fyy[FIXED_POINTS];
+   fixed_num fa[FIXED_POINTS];            // Fixed point coordinates
+   fixed_num fb[FIXED_POINTS];
 }
 man_pointstruct;
 
-// Pointers to structure members for asm functions.
+// Pointers to structure members for asm functions (32-bit offsets; see above).
 // There should be some function to calculate these automatically, but use constants for now.
 // Changing structure order can slow things down anyway so it shouldn't be done without good reason.
+// The intrinsic kernels access the structure fields directly. The field offsets are checked
+// against the structure when the asm is built (see ps_offsets_check).
+
+#define PS_OFFS_X             0
+#define PS_OFFS_Y             256
+#define PS_OFFS_YY            512
+#define PS_OFFS_A             768
+#define PS_OFFS_B             1024
+#define PS_OFFS_MAG           1280
+#define PS_OFFS_MAGPREV       1536
+#define PS_OFFS_TWO_D         1792
+#define PS_OFFS_TWO_F         1856
+#define PS_OFFS_RAD_D         1920
+#define PS_OFFS_RAD_F         1984
+#define PS_OFFS_ITERS         2048
+#define PS_OFFS_ITERCTR       2432
+#define PS_OFFS_CUR_MAX_ITERS 2456
 
 // Aliases for 4 double-precision points. EBX points to the beginning of the structure.
-#define PS4_X01            [ebx + 0]
-#define PS4_X23            [ebx + 0 + 16]
-#define PS4_Y01            [ebx + 64]
-#define PS4_Y23            [ebx + 64 + 16]
-#define PS4_YY01           [ebx + 128]
-#define PS4_YY23           [ebx + 128 + 16]
-#define PS4_A01            [ebx + 192]
-#define PS4_A23            [ebx + 192 + 16]
-#define PS4_B01            [ebx + 256]
-#define PS4_B23            [ebx + 256 + 16]
-#define PS4_MAG01          [ebx + 320]          // Magnitudes of points 0 and 1
-#define PS4_MEXP0          [ebx + 320 + 4]      // Locations of exponent bits in magnitudes
-#define PS4_MEXP1          [ebx + 320 + 12]
-#define PS4_MAG23          [ebx + 320 + 16]     // Magnitudes of points 2 and 3
-#define PS4_MEXP2          [ebx + 320 + 20]
-#define PS4_MEXP3          [ebx + 320 + 28]
-#define PS4_MAGPREV01      [ebx + 384]          // Magnitudes of points 0 and 1 after the previous iteration
-#define PS4_MAGPREV23      [ebx + 384 + 16]     // ditto for points 2 and 3
-#define PS4_TWO            [ebx + 448]
-#define PS4_RAD            [ebx + 576]
-#define PS4_ITERS0         [ebx + 704]
-#define PS4_ITERS1         [ebx + 704 + 4]
-#define PS4_ITERS2         [ebx + 704 + 8]
-#define PS4_ITERS3         [ebx + 704 + 12]
-#define PS4_ITERCTR_L      [ebx + 896]
-#define PS4_ITERCTR_H      [ebx + 900]
-#define PS4_CUR_MAX_ITERS  [ebx + 920]
+#define PS4_X01            [ebx + PS_OFFS_X]
+#define PS4_X23            [ebx + PS_OFFS_X + 16]
+#define PS4_Y01            [ebx + PS_OFFS_Y]
+#define PS4_Y23            [ebx + PS_OFFS_Y + 16]
+#define PS4_YY01           [ebx + PS_OFFS_YY]
+#define PS4_YY23           [ebx + PS_OFFS_YY + 16]
+#define PS4_A01            [ebx + PS_OFFS_A]
+#define PS4_A23            [ebx + PS_OFFS_A + 16]
+#define PS4_B01            [ebx + PS_OFFS_B]
+#define PS4_B23            [ebx + PS_OFFS_B + 16]
+#define PS4_MAG01          [ebx + PS_OFFS_MAG]           // Magnitudes of points 0 and 1
+#define PS4_MEXP0          [ebx + PS_OFFS_MAG + 4]       // Locations of exponent bits in magnitudes
+#define PS4_MEXP1          [ebx + PS_OFFS_MAG + 12]
+#define PS4_MAG23          [ebx + PS_OFFS_MAG + 16]      // Magnitudes of points 2 and 3
+#define PS4_MEXP2          [ebx + PS_OFFS_MAG + 20]
+#define PS4_MEXP3          [ebx + PS_OFFS_MAG + 28]
+#define PS4_MAGPREV01      [ebx + PS_OFFS_MAGPREV]       // Magnitudes of points 0 and 1 after the previous iteration
+#define PS4_MAGPREV23      [ebx + PS_OFFS_MAGPREV + 16]  // ditto for points 2 and 3
+#define PS4_TWO            [ebx + PS_OFFS_TWO_D]
+#define PS4_RAD            [ebx + PS_OFFS_RAD_D]
+#define PS4_ITERS0         [ebx + PS_OFFS_ITERS]
+#define PS4_ITERS1         [ebx + PS_OFFS_ITERS + 4]
+#define PS4_ITERS2         [ebx + PS_OFFS_ITERS + 8]
+#define PS4_ITERS3         [ebx + PS_OFFS_ITERS + 12]
+#define PS4_ITERCTR_L      [ebx + PS_OFFS_ITERCTR]
+#define PS4_ITERCTR_H      [ebx + PS_OFFS_ITERCTR + 4]
+#define PS4_CUR_MAX_ITERS  [ebx + PS_OFFS_CUR_MAX_ITERS]
 
 // Aliases for 8 single precision points
 #define PS8_X03            PS4_X01
@@ -247,28 +438,28 @@ man_pointstruct;
 #define PS8_A47            PS4_A23
 #define PS8_B03            PS4_B01
 #define PS8_B47            PS4_B23
-#define PS8_MAG03          [ebx + 320]
-#define PS8_MEXP0          [ebx + 320]
-#define PS8_MEXP1          [ebx + 320 + 4]
-#define PS8_MEXP2          [ebx + 320 + 8]
-#define PS8_MEXP3          [ebx + 320 + 12]
-#define PS8_MAG47          [ebx + 320 + 16]
-#define PS8_MEXP4          [ebx + 320 + 16]
-#define PS8_MEXP5          [ebx + 320 + 20]
-#define PS8_MEXP6          [ebx + 320 + 24]
-#define PS8_MEXP7          [ebx + 320 + 28]
+#define PS8_MAG03          [ebx + PS_OFFS_MAG]
+#define PS8_MEXP0          [ebx + PS_OFFS_MAG]
+#define PS8_MEXP1          [ebx + PS_OFFS_MAG + 4]
+#define PS8_MEXP2          [ebx + PS_OFFS_MAG + 8]
+#define PS8_MEXP3          [ebx + PS_OFFS_MAG + 12]
+#define PS8_MAG47          [ebx + PS_OFFS_MAG + 16]
+#define PS8_MEXP4          [ebx + PS_OFFS_MAG + 16]
+#define PS8_MEXP5          [ebx + PS_OFFS_MAG + 20]
+#define PS8_MEXP6          [ebx + PS_OFFS_MAG + 24]
+#define PS8_MEXP7          [ebx + PS_OFFS_MAG + 28]
 #define PS8_MAGPREV03      PS4_MAGPREV01
 #define PS8_MAGPREV47      PS4_MAGPREV23
-#define PS8_TWO            [ebx + 512]
-#define PS8_RAD            [ebx + 640]
-#define PS8_ITERS0         [ebx + 704]       // Iteration counters for 8 points
-#define PS8_ITERS1         [ebx + 704 + 4]
-#define PS8_ITERS2         [ebx + 704 + 8]
-#define PS8_ITERS3         [ebx + 704 + 12]
-#define PS8_ITERS4         [ebx + 704 + 16]
-#define PS8_ITERS5         [ebx + 704 + 20]
-#define PS8_ITERS6         [ebx + 704 + 24]
-#define PS8_ITERS7         [ebx + 704 + 28]
+#define PS8_TWO            [ebx + PS_OFFS_TWO_F]
+#define PS8_RAD            [ebx + PS_OFFS_RAD_F]
+#define PS8_ITERS0         [ebx + PS_OFFS_ITERS]         // Iteration counters for 8 points
+#define PS8_ITERS1         [ebx + PS_OFFS_ITERS + 4]
+#define PS8_ITERS2         [ebx + PS_OFFS_ITERS + 8]
+#define PS8_ITERS3         [ebx + PS_OFFS_ITERS + 12]
+#define PS8_ITERS4         [ebx + PS_OFFS_ITERS + 16]
+#define PS8_ITERS5         [ebx + PS_OFFS_ITERS + 20]
+#define PS8_ITERS6         [ebx + PS_OFFS_ITERS + 24]
+#define PS8_ITERS7         [ebx + PS_OFFS_ITERS + 28]
 #define PS8_ITERCTR_L      PS4_ITERCTR_L
 #define PS8_ITERCTR_H      PS4_ITERCTR_H
 #define PS8_CUR_MAX_ITERS  PS4_CUR_MAX_ITERS
@@ -304,20 +495,24 @@ typedef struct
    setting pal_xor;         // value to XOR with the palette to create the image palette (0xFFFFFF for invert, etc)
    setting options;         // options bitfield
 
-   // Stripes per thread (bitfield; 4 bits per num_threads index). For example, bits 7-4 give
-   // the number of stripes per thread for two threads, 11-8 are for four threads, etc.
+   // Stripes per thread (bitfield; 4 bits per num_threads index). No longer used: the image is
+   // split into tiles that the threads share out dynamically (see man_calculate). Still read so
+   // older cfg files work.
 
    setting stripes_per_thread;
    setting blit_stripe_thickness;   // thickness of stripes used in striped_blit
    setting pfcmin;                  // pan filter constant min and max
    setting pfcmax;                  // 10000 times the real value for these
+   setting kernel;                  // kernel override (KERNEL_*); 0 = widest the CPU supports
+   setting chains;                  // kernel chains (2-4; see the multi-chain iteration functions); 0 = default
+   setting autofixed;               // 1 = auto precision uses fixed point instead of double past single
+   setting formula;                 // FORMULA_*
+   setting tuned;                   // TUNED_* kernel choices from autotune (qmrender -autotune); 0 = none
+   setting numa;                    // NUMA_* thread and memory placement policy
+   setting fused;                   // 1 = palette map the tiles as they're calculated (see set_fused_palette)
 }
 settings;
 
-// Default for stripes per thread bitfield.
-// 32 threads: 2; 16 threads: 3; 8 threads: 4; 4 threads: 4; 2 threads: 7; 1 thread: 1
-#define SPT_DEFAULT  0x234471
-
 // Bits in options bitfield
 #define OPT_RECALC_ON_RESIZE        1     // 1 to recalculate immediately whenever the window is resized, 0 = not
 #define OPT_DIALOG_IN_FULLSCREEN    2     // 1 if the control dialog should initially be visible
@@ -325,9 +520,11 @@ settings;
                                           // can always toggle on/off with C key
 #define OPT_NORMALIZED              4     // if 1, start with the normalized rendering algorithm (otherwise standard)
 #define OPT_EXACT_ALG               8     // if 1, start with an exact algorithm (default fast)
+#define OPT_JULIA_PREVIEW           16    // if 1, show a preview of the Julia set for the point under
+                                          // the mouse in the control dialog (see do_julia_preview)
 
 // Default for options bitfield
-#define OPTIONS_DEFAULT (OPT_RECALC_ON_RESIZE)
+#define OPTIONS_DEFAULT (OPT_RECALC_ON_RESIZE | OPT_JULIA_PREVIEW)
 
 // A log entry structure. It can have its own set of settings. The settings fields are all
 // initialized to -1, then set to any values in the logfile that are found for this entry.
@@ -339,8 +536,11 @@ typedef struct
    double re;
    double im;
    double mag;
+   int mag_exp;      // magnification is mag * 2^mag_exp (see normalize_mag)
    unsigned max_iters;
    unsigned palette;
+   hp_num re_hp;     // re/im at full precision, for deep images
+   hp_num im_hp;
 
    // Kinda wasteful to have the entire settings struct here when all we need are the
    // val fields, but it's easier this way
@@ -348,7 +548,7 @@ typedef struct
 }
 log_entry;
 
-// A stripe for the thread function to calculate. See man_calculate().
+// A tile (rectangle) for the thread function to calculate or palette map. See man_calculate().
 typedef struct
 {
    int xstart;
@@ -358,19 +558,41 @@ typedef struct
 }
 stripe;
 
-// Maximum number of stripes per image to give each thread. See man_calculate().
-#define MAX_STRIPES        8
+// Tiles per thread the image is split into, and the size limits (see make_tiles)
+#define TILES_PER_THREAD   16
+#define TILE_MIN_HEIGHT    8  // 2x the fast alg cell size
+#define TILE_MIN_WIDTH     16
+
+// NUMA policies (numa_policy; the "numa" setting). The calling thread (thread 0) is never pinned.
+#define NUMA_OFF           0  // threads and memory go wherever the OS puts them
+#define NUMA_PIN           1  // pin the pool threads to CPUs (thread n to CPU n)
+#define NUMA_LOCAL         2  // also first-touch the image buffers from the threads that use
+                              // them, and give each thread a point structure in its own memory
+
+// A fast algorithm guess waiting for its neighbors (see guess_point)
+typedef struct
+{
+   unsigned *ptr;                // the point
+   int wave;                     // its wave, for the neighbor offsets (see wave_ptr_offs)
+}
+deferred_point;
 
 // Thread state structure
 typedef struct
 {
    int thread_num;               // thread number
-   man_pointstruct *ps_ptr;      // pointer to this thread's iterating point structure, from array in man_calc_struct
-   stripe stripes[MAX_STRIPES];  // list of stripes for this thread to calculate
-   int num_stripes;
-   HANDLE done_event;            // event set by thread when calculation is finished
+   man_pointstruct *ps_ptr;      // pointer to this thread's iterating point structure (64-byte aligned)
+   volatile unsigned long long tiles; // this thread's tile deque: range of man_calc_struct tiles (see get_tile)
+   HANDLE start_event;           // event set to start the thread's part of a run_pool call
    void *calc_struct;            // pointer to parent man_calc_struct
 
+   // Deferred guesses (see guess_point), and the points fused palette mapping skipped because
+   // they weren't done yet (see map_tile_fused). Grown as needed.
+   deferred_point *deferred;
+   int num_deferred, deferred_size;
+   unsigned **fused_skip;
+   int fused_skips, fused_skip_size;
+
    // Nonessential variables (for profiling, load balance testing, etc)
    unsigned long long total_iters;  // iters value that keeps accumulating until reset (before next zoom, etc)
    unsigned points_guessed;         // points guessed in fast algorithm
@@ -407,7 +629,6 @@ typedef struct
    unsigned *pal;
    unsigned pal_size;
    unsigned max_iters_color;
-   int thread_num;
 }
 pal_work;
 
@@ -420,20 +641,60 @@ pal_work;
 
 typedef struct // smcs
 {
-   // This MUST be the first structure member, due to alignment requirements
-   man_pointstruct pointstruct_array[MAX_THREADS];
-
    // These function pointers get set based on the algorithm in use
 
    // Point queueing function (C/SSE/SSE2/x87)
    void (FASTCALL *queue_point)(void *calc_struct, man_pointstruct *ps_ptr, unsigned *iters_ptr);
 
+   // Batched queueing function: queues all the points in the pointstruct batch buffer (see
+   // queue_batch_point). NULL if the kernel in use doesn't have one.
+   void (FASTCALL *queue_batch)(void *calc_struct, man_pointstruct *ps_ptr);
+
    // Iteration function (C/SSE/SSE2/x87, AMD/Intel). Returns the number of iterations done per point.
    unsigned (*mandel_iterate)(man_pointstruct *ps_ptr);
 
-   // State structures and events for each thread used in the calculation
-   thread_state thread_states[MAX_THREADS];
-   HANDLE thread_done_events[MAX_THREADS];
+   // Cardioid/bulb test for a block of points on one line (see interior_mask_c). NULL if the
+   // interior pre-pass isn't used for this calculation.
+   unsigned long long (*interior_mask)(const double *re, double im, int n);
+
+   // Points iterated in parallel by the iteration function: each pointstruct iterctr tick
+   // is this many iterations. Also the number of points in the queue.
+   unsigned iters_per_tick;
+
+   // Floating point operations per iteration done by the iteration function, for the GFlops
+   // figure. Fused multiply-adds count as 2.
+   unsigned flops_per_iter;
+
+   char *kernel_name;   // name of the iteration function in use, for display
+   unsigned queue_init; // initial queue_status for the queue function in use
+   int kernel_single;   // 1 if the iteration function computes in single precision (the C
+                        // kernel computes in double at any precision)
+
+   // State structures for each thread used in the calculation (see alloc_threads)
+   thread_state *thread_states;
+   int max_threads;           // number of thread states allocated
+   int num_threads;           // threads used for this structure's calculations (see man_setup)
+
+   // Thread pool (see run_pool) and the tiles it works on (see make_tiles)
+   void (*pool_func)(void *calc_struct, thread_state *t); // function each thread runs; NULL = exit
+   int pool_threads;          // threads started so far, including the calling thread
+   volatile LONG pool_pending; // pool threads that haven't finished their part yet
+   HANDLE pool_done_event;    // set by the last pool thread to finish
+   stripe *tiles;             // tiles, grouped by the thread they're dealt to (TILES_PER_THREAD per thread state)
+   stripe *tile_grid;         // work arrays for make_tiles: tiles in image order,
+   int *tile_bounds;          // and band/column boundaries
+   int num_tiles;
+   int tile_threads;          // number of tile deques (threads the tiles were dealt to)
+   stripe last_rect;          // rectangle of the previous calculation, and whether its counts
+   int last_valid;            // can be used (for cost prediction; see predict_tiles)
+
+   // Cancellation (see cancel_calc). The calculation in progress is abandoned when cancel_gen
+   // no longer matches the calc_gen it started with.
+   volatile LONG cancel_gen;  // bumped by cancel_calc()
+   LONG calc_gen;             // cancel_gen when the calculation started
+   int cancelled;             // 1 if the most recent calculation was cancelled (image only partly done)
+   int (*cancel_poll)(void *param); // if not NULL, polled by the calculating thread; cancels on nonzero
+   void *cancel_param;
 
    // Image size and offset parameters
    int xsize;
@@ -450,25 +711,60 @@ typedef struct // smcs
    // Calculation parameters
    double re;           // real part of image center coordinate
    double im;           // imaginary part of image center coordinate
-   double mag;          // magnification
+   double mag;          // magnification, times 2^mag_exp
+   int mag_exp;         // 0 unless the magnification is past the double range (see normalize_mag)
    unsigned max_iters;  // maximum iterations to do per point
+
+   // High precision re/im, for deep images (see perturb.c). Re/im are these rounded to doubles.
+   // If re/im are set directly, these get reset from them (see sync_re_im_hp).
+   hp_num re_hp;
+   hp_num im_hp;
    unsigned max_iters_last; // last max_iters used in a calculation
 
    // GUI parameters, latched before the calculation starts
    int alg;             // algorithm
    int cur_alg;         // current algorithm (can switch during panning)
    int precision;       // user-desired precision
+   int precision_loss;  // 1 if precision loss detected on most recent calculation
+   int perturb;         // PERTURB_* if the perturbation engine was used on the most recent calculation (set by caller when saving)
+   unsigned glitches;   // points left glitched after the most recent perturbation calculation
+   int glitch_pass;     // nonzero while recalculating glitched points (see man_calculate)
+   int kernel;          // kernel override (KERNEL_*; 0 = widest available)
+   int chains;          // preferred number of kernel chains (2-4; 0 = kernel table default)
+   int auto_fixed;      // 1 if auto precision should use fixed point instead of double past single
+   int formula;         // FORMULA_*
+   int julia;           // 1 for the Julia set of c = (julia_re, julia_im): pixels are the starting z
+   double julia_re;
+   double julia_im;
+   unsigned preview_iters; // max iters for julia_preview, adjusted to keep within its time budget
+   int de;              // 1 if the kernels compute distance estimates (for RALG_DE)
+   double de_scale;     // 1 / pixel spacing: distance estimates are in pixels
+   int fixed_bits;      // 64 or 128: fixed point kernel used (set by caller when saving)
+   fixed_num fixed_re;  // re_hp/im_hp as fixed point, for the fixed point kernels
+   fixed_num fixed_im;
 
    // Dynamically allocated arrays
    double *img_re;      // arrays for holding the RE, IM coordinates
    double *img_im;      // of each pixel in the image
+   double *img_re_lo;   // low parts of the above, for double-double precision (offsets from
+                        // re/im for fixed point)
+   double *img_im_lo;
+   double *tile_cost;   // work array for tile cost prediction (see predict_tiles)
 
    unsigned *iter_data_start; // for dummy line creation: see alloc_man_mem
    unsigned *iter_data;       // iteration counts for each pixel in the image. Converted to a bitmap by applying the palette.
    int iter_data_line_size;   // size of one line of iteration data (needs 2 dummy pixels at the end of each line)
+   unsigned *iter_data_dummy; // where dummy points used to flush the queues are stored
 
    float *mag_data;     // magnitude (squared) for each point
-   int mag_data_offs;   // byte offset of mag_data from iter_data. Could be negative; must be int
+   ptrdiff_t mag_data_offs; // byte offset of mag_data from iter_data. Could be negative; must be signed (and pointer-sized for 64-bit builds)
+   float *de_data;      // distance estimate for each point, in pixels (only set if de is nonzero)
+   ptrdiff_t de_data_offs;  // same as mag_data_offs
+
+   perturb_ref ref[2];  // perturbation reference orbits: image center and glitch correction
+   perturb_series series; // series approximation for the image center reference
+
+   int wave_ptr_offs[7][4];   // pointer offsets of neighboring pixels for the fast alg; depend on iter_data_line_size
 
    unsigned char *png_buffer; // buffer for data to write to PNG file
 
@@ -479,8 +775,8 @@ typedef struct // smcs
    unsigned max_iters_color;               // color of max iters points, from logfile/cfgfile
    int rendering_alg;                      // rendering algorithm: standard or normalized iteration count
 
-   pal_work pal_work_array[MAX_THREADS];   // work for palette mapping threads
-   HANDLE pal_events[MAX_THREADS];
+   pal_work pal_work;                      // work for palette mapping threads
+   int fused;                              // 1 if man_calculate maps its tiles as it goes (see set_fused_palette)
    unsigned pal_lookup[PAL_LOOKUP_MAX + 1]; // palette lookup table; need one extra entry for max_iters
 
    // Misc items
@@ -496,8 +792,134 @@ man_calc_struct;
 // to an entry in the mag_data array of a man_calc_struct.
 #define MAG(m, iter_ptr) *((float *) ((char *) iter_ptr + m->mag_data_offs))
 
+// Same for the distance estimate, in the de_data array
+#define DE(m, iter_ptr) *((float *) ((char *) iter_ptr + m->de_data_offs))
+
+// View parameters for the headless interface (see man_render). These are the same values
+// the GUI gets from its dialog box and logfiles.
+typedef struct
+{
+   double re;                 // image center
+   double im;
+   char *re_str;              // image center as decimal strings, for more precision than a double
+   char *im_str;              // (deep images). NULL to use re/im
+   double mag;                // magnification
+   char *mag_str;             // magnification as a string, for past the double range. NULL to use mag
+   unsigned max_iters;
+   int xsize;                 // image size
+   int ysize;
+   int alg;                   // ALG_*
+   int precision;             // PRECISION_*. Returns the precision actually used (for auto)
+   unsigned palette;          // palette number
+   int rendering_alg;         // RALG_*
+   unsigned pal_xor;          // 0xFFFFFF to invert palette
+   unsigned max_iters_color;  // RGB color of max_iters points
+   int kernel;                // KERNEL_* override; 0 = widest available
+   int chains;                // preferred kernel chains (2-4); 0 = default
+   int auto_fixed;            // 1 = auto precision uses fixed point instead of double past single
+   int formula;               // FORMULA_*
+   int julia;                 // 1 for the Julia set of c = (julia_re, julia_im) (see man_calc_struct)
+   double julia_re;
+   double julia_im;
+}
+man_view;
+
+// One variant timed by autotune
+typedef struct
+{
+   int precision;             // PRECISION_*
+   int kernel;                // KERNEL_* level
+   int chains;                // chain count (0 for the kernels without chains)
+   int intel;                 // 1 for the Intel version of the ASM kernel
+   char *name;                // kernel name
+   double time;               // sum of the best times for the tuning views
+}
+tune_result;
+
+#define MAX_TUNE_RESULTS   32
+
+// Frame pipeline, for animations (see pipe_frame). Frames alternate between two buffers, which
+// belong to the callbacks: the pipeline just passes the index (0 or 1).
+typedef struct
+{
+   void (*calc)(void *param, int buf);    // calculate a frame into buffer buf (runs in the pipeline thread)
+   void (*present)(void *param, int buf); // present the frame in buffer buf (runs in the caller's thread)
+   void *param;                           // passed to the callbacks
+   int serial;          // 1 = no pipelining: calculate each frame, then present it (also if the thread couldn't start)
+   int buf;             // buffer of the frame in flight, or of the last one finished
+   int busy;            // 1 if a frame is being calculated
+   int ready;           // 1 if the frame in buf is finished but not presented yet
+   int exit;            // tells the pipeline thread to exit
+   HANDLE start_event;  // set to start calculating a frame
+   HANDLE done_event;   // set by the pipeline thread when the frame is done
+}
+frame_pipe;
+
+// Size of the strings from get_center_strs: enough digits for the deepest magnification
+#define CENTER_STR_SIZE    650
+
 // Prototypes
 void do_man_calculate(int recalc_all);
+void get_center_strs(man_calc_struct *m, char *re_str, char *im_str);
+void get_dialog_fields(void);
+
+// From engine.c
+extern int num_threads;       // number of calculation threads
+extern unsigned cpu_features; // CPU_* bits
+extern unsigned kernel_tuning; // TUNED_* bitfield
+extern int numa_policy;       // NUMA_*
+extern int fused_palette;     // 1 to palette map images as they're calculated (see set_fused_palette)
+
+TIME_UNIT get_timer(void);
+double get_seconds_elapsed(TIME_UNIT start_time);
+double get_re_im_offs(man_calc_struct *m, long long offs);
+floatexp get_re_im_offs_fe(man_calc_struct *m, long long offs);
+void add_re_im_offs(man_calc_struct *m, hp_num *re, hp_num *im, long long xoffs, long long yoffs);
+void normalize_mag(man_calc_struct *m);
+void get_mag_str(man_calc_struct *m, char *s, int size);
+void update_re_im(man_calc_struct *m, long long xoffs, long long yoffs);
+void sync_re_im_hp(man_calc_struct *m);
+void man_setup(man_calc_struct *m, int xstart, int xend, int ystart, int yend);
+void make_tiles(man_calc_struct *m, int xstart, int xend, int ystart, int yend, int threads, int predict);
+stripe *get_tile(man_calc_struct *m, thread_state *t);
+void run_pool(man_calc_struct *m, void (*func)(void *calc_struct, thread_state *t), int threads);
+double man_calculate(man_calc_struct *m, int xstart, int xend, int ystart, int yend);
+void cancel_calc(man_calc_struct *m);
+int alloc_man_mem(man_calc_struct *m, int width, int height);
+void free_man_mem(man_calc_struct *m);
+int init_man_calc_struct(man_calc_struct *m, unsigned flags);
+void detect_cpu_features(char *vendor);
+int get_max_kernel(void);
+void set_num_threads(int n);
+int init_engine(int threads);
+man_calc_struct *alloc_man_calc_struct(unsigned flags);
+void free_man_calc_struct(man_calc_struct *m);
+double man_render(man_calc_struct *m, man_view *v, unsigned *rgb);
+double julia_preview(man_calc_struct *m, man_view *v, unsigned *rgb, double budget);
+unsigned autotune(man_calc_struct *m, tune_result *results, int *num_results, int repeat);
+void get_man_data(man_calc_struct *m, unsigned *iters, float *mags);
+int pipe_init(frame_pipe *p, void (*calc)(void *param, int buf), void (*present)(void *param, int buf),
+              void *param, int serial);
+void pipe_wait(frame_pipe *p);
+void pipe_frame(frame_pipe *p);
+void pipe_flush(frame_pipe *p);
+void pipe_free(frame_pipe *p);
+
+// From perturb.c
+void hp_from_double(hp_num *h, double d);
+double hp_to_double(const hp_num *h);
+void hp_add_fe(hp_num *h, floatexp f);
+int hp_from_string(hp_num *h, const char *s);
+void hp_to_string(const hp_num *h, char *s, int size, int digits);
+int hp_limbs_for_mag(double mag, int mag_exp);
+void fe_from_string(floatexp *f, const char *s);
+void fe_to_string(floatexp f, char *s, int size);
+int perturb_ref_calc(perturb_ref *ref, const hp_num *re, const hp_num *im, unsigned max_iters, int n);
+void perturb_ref_free(perturb_ref *ref);
+void hp_to_dd(const hp_num *h, double *hi, double *lo);
+void hp_to_fixed(const hp_num *h, fixed_num *f);
+void perturb_series_calc(perturb_series *s, const perturb_ref *ref, double re0, double re1, double im0, double im1,
+                         int delta_exp);
 
 // From palettes.c and imagesave.c
 int png_save_start(char *file, int width, int height);
@@ -508,3 +930,6 @@ int load_palette(FILE *fp);
 int load_palette_from_bmp(FILE *fp);
 int get_palette_rgb_val(int ind, char *str, int length, unsigned *rgb);
 void apply_palette(man_calc_struct *m, unsigned *dest, unsigned *src, unsigned xsize, unsigned ysize);
+void init_pal_work(man_calc_struct *m, unsigned *dest, unsigned *src, unsigned xsize, unsigned ysize);
+void map_palette_tile(man_calc_struct *m, stripe *s);
+void set_fused_palette(man_calc_struct *m, unsigned *dest);
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Autotuner test. -autotune should store a tuned setting in quickman.cfg (in the current
+# directory), and the kernels it picks should give the same counts as the SSE/SSE2 ones (the C
+# kernel does single precision in double).
+#
+# Usage: tests/autotune.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+QM=$(cd "$(dirname "$QM")" && pwd)/$(basename "$QM")
+mkdir $TMP.dir
+trap 'rm -rf $TMP.*' EXIT
+
+(cd $TMP.dir && "$QM" -autotune -size 64x48 > /dev/null)
+tuned=$(sed -n 's/^tuned \(0x[0-9A-Fa-f]*\).*/\1/p' $TMP.dir/quickman.cfg 2>/dev/null)
+check "tuned setting stored" -n "$tuned"
+
+VIEW="-re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 160x120 -alg 1"
+for p in 1 2; do
+   render sse $VIEW -prec $p -kernel 2 > /dev/null
+   render t $VIEW -prec $p -tuned ${tuned:-0} > /dev/null
+   same "precision $p tuned vs SSE" sse t
+done
+
+exit $FAIL
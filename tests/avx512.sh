@@ -0,0 +1,23 @@
+#!/bin/sh
+# AVX-512 kernel test: the exact algorithm's counts match the C kernel in double precision, and
+# the SSE kernel in single precision (the C kernel does single precision in double).
+#
+# Usage: tests/avx512.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+need_cpu avx512f
+
+for view in "-re -0.7 -im 0.001 -mag 1.35 -iters 256" \
+            "-re -0.7435 -im 0.1314 -mag 3e3 -iters 3000" \
+            "-re -0.1 -im 0.9 -mag 40 -iters 1000"
+do
+   render c -size 160x120 $view -alg 5 -prec 2 > /dev/null
+   render avx512 -size 160x120 $view -alg 1 -prec 2 -kernel 4 > /dev/null
+   same "double, $view" c avx512
+   render sse -size 160x120 $view -alg 1 -prec 1 -kernel 2 > /dev/null
+   render avx512 -size 160x120 $view -alg 1 -prec 1 -kernel 4 > /dev/null
+   same "single, $view" sse avx512
+done
+
+exit $FAIL
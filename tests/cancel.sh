@@ -0,0 +1,32 @@
+#!/bin/sh
+# Cancellation test. Cancelling a long render should make the engine return soon after, for
+# the fast and exact algorithms and for each of the deep zoom engines, and a render that ends
+# before the cancel should just finish.
+#
+# Usage: tests/cancel.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+RE=-0.74349398499142309281199588739272197831822540668333942903700517490506172180175781
+IM=0.13118503503488265803672769813873628707451153635688001486414577811956405639648438
+LONG="-iters 200000 -size 1280x960 -threads 4 -cancel 20"
+
+# Cancels the render and checks it returned within 200ms (generous, for loaded machines)
+cancel()        # description options...
+{
+   desc=$1
+   shift
+   ms=$("$QM" "$@" $LONG | sed -n 's/Cancelled after [0-9]*ms, returned \([0-9]*\).*/\1/p')
+   check "$desc: cancelled, returned in ${ms:-?}ms" "${ms:-1000}" -lt 200
+}
+
+cancel "fast" -re -0.7435 -im 0.1314 -mag 3e3 -alg 0
+cancel "exact" -re -0.7435 -im 0.1314 -mag 3e3 -alg 1
+cancel "double-double" -re -0.7435 -im 0.1314 -mag 3e3 -alg 1 -prec 3
+cancel "fixed point" -re -0.7435 -im 0.1314 -mag 3e3 -alg 1 -prec 4
+cancel "perturbation" -re $RE -im $IM -mag 1e30 -alg 1
+
+"$QM" -size 64x48 -cancel 500 | grep -q "Finished before the cancel"
+check "short render finishes" $? -eq 0
+
+exit $FAIL
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Chain count test. -chains should pick the double precision AVX and AVX-512 kernels with that
+# many chains (2 is the default, which has no suffix), and they should all give the same counts
+# as the C kernel.
+#
+# Usage: tests/chains.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+need_cpu avx
+
+levels=3
+grep -qw avx512f /proc/cpuinfo && levels="3 4"
+
+VIEW="-re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 160x120 -alg 1 -prec 2"
+
+render c $VIEW -kernel 1 > /dev/null
+for k in $levels; do
+   for n in 2 3 4; do
+      if [ $n = 2 ]; then
+         render k $VIEW -kernel $k -chains $n | grep -q "kernel [^(]*, [0-9]* threads"
+      else
+         render k $VIEW -kernel $k -chains $n | grep -q "kernel .* ($n chains), [0-9]* threads"
+      fi
+      check "kernel $k, $n chains picked" $? -eq 0
+      same "kernel $k, $n chains vs C" c k
+   done
+done
+
+exit $FAIL
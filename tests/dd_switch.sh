@@ -0,0 +1,23 @@
+#!/bin/sh
+# Double-double precision switch test. Near a minibrot, double-double rounding errors outgrow
+# the pixel spacing well before its mantissa runs out. Check that auto precision still uses it
+# just below the switch point and matches perturbation there, and that it has switched to
+# perturbation at 1e25 (where double-double gets about 5% of the pixels wrong).
+#
+# Usage: tests/dd_switch.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+RE=-0.74349398499142309281199588739272197831822540668333942903700517490506172180175781
+IM=0.13118503503488265803672769813873628707451153635688001486414577811956405639648438
+VIEW="-re $RE -im $IM -iters 6750 -size 160x120 -alg 1"
+
+render dd $VIEW -mag 2e19 -prec 0 | grep -q "Precision Extended,"
+check "mag 2e19 uses double-double" $? -eq 0
+render ref $VIEW -mag 2e19 -prec 2 > /dev/null
+same "mag 2e19 vs perturbation" dd ref 40      # about 0.2% of the pixels
+
+render auto $VIEW -mag 1e25 -prec 0 | grep -q "Precision Double \[Perturbation\]"
+check "mag 1e25 uses perturbation" $? -eq 0
+
+exit $FAIL
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Distance estimation test. The DE kernels should give the same counts as the plain ones, and
+# since they have no periodicity checking, this also checks that periodicity checking doesn't
+# change any counts on a view with interior points. DE shading should change the image.
+#
+# Usage: tests/de.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+# Compares the DE and plain renders of the view
+compare()       # view options...
+{
+   view=$1
+   shift
+   render plain "$@" -size 160x120 -alg 1 -prec 2 -o $TMP.plain.ppm > /dev/null
+   render de "$@" -size 160x120 -alg 1 -prec 2 -de -o $TMP.de.ppm | grep -q "kernel .* DE,"
+   check "$view: DE kernel used" $? -eq 0
+   same "$view: DE counts" plain de
+   cmp -s $TMP.plain.ppm $TMP.de.ppm
+   check "$view: DE shading" $? -ne 0
+}
+
+compare "home" -re -0.7 -im 0.001 -mag 1.35 -iters 1000
+compare "seahorse" -re -0.7435 -im 0.1314 -mag 3e3 -iters 3000
+
+exit $FAIL
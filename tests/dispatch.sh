@@ -0,0 +1,33 @@
+#!/bin/sh
+# Kernel dispatch test: -kernel picks the kernel of that level (if the CPU has it), the default
+# is the widest one the CPU has, and the SSE2 kernel matches the C one.
+#
+# Usage: tests/dispatch.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+# The kernel name qmrender reports for the options
+kernel()        # options...
+{
+   "$QM" -size 64x48 -alg 1 "$@" | sed -n 's/.*, kernel \(.*\), [0-9]* threads/\1/p'
+}
+
+check "level 1 double" "$(kernel -prec 2 -kernel 1)" = "C"
+check "level 2 double" "$(kernel -prec 2 -kernel 2)" = "SSE2"
+check "level 2 single" "$(kernel -prec 1 -kernel 2)" = "SSE"
+widest=SSE2
+if grep -qw avx /proc/cpuinfo; then
+   check "level 3 double" "$(kernel -prec 2 -kernel 3)" = "AVX"
+   widest=AVX
+fi
+if grep -qw avx512f /proc/cpuinfo; then
+   check "level 4 double" "$(kernel -prec 2 -kernel 4)" = "AVX-512"
+   widest=AVX-512
+fi
+check "default double" "$(kernel -prec 2)" = "$widest"
+
+render c -size 160x120 -re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -alg 5 -prec 2 > /dev/null
+render sse2 -size 160x120 -re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -alg 1 -prec 2 -kernel 2 > /dev/null
+same "SSE2 vs C" c sse2
+
+exit $FAIL
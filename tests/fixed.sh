@@ -0,0 +1,29 @@
+#!/bin/sh
+# Fixed point test. The 64-bit kernel should be used at shallow magnifications and the 128-bit
+# one past double precision, and both should match double-double except for the odd chaotic
+# pixel near the set (where any two precisions disagree).
+#
+# Usage: tests/fixed.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+RE=-0.74349398499142309281199588739272197831822540668333942903700517490506172180175781
+IM=0.13118503503488265803672769813873628707451153635688001486414577811956405639648438
+
+# Renders the view in fixed point and double-double, checks the fixed point kernel's width, and
+# compares the counts
+compare()       # bits max options...
+{
+   bits=$1
+   max=$2
+   shift 2
+   render fx "$@" -size 160x120 -alg 1 -prec 4 | grep -q "kernel .*$bits-bit fixed point"
+   check "$bits-bit kernel used" $? -eq 0
+   render dd "$@" -size 160x120 -alg 1 -prec 3 > /dev/null
+   same "$bits-bit vs double-double" fx dd $max
+}
+
+compare 64 20 -re -0.7757 -im 0.1365 -mag 1e5 -iters 2000
+compare 128 40 -re $RE -im $IM -mag 1e17 -iters 6750
+
+exit $FAIL
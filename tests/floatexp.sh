@@ -0,0 +1,19 @@
+#!/bin/sh
+# Floatexp perturbation test. Past 1e300 the deltas underflow doubles, so the floatexp kernels
+# should take over. The view is the Misiurewicz point c = i, which has detail at any depth and
+# an exact reference orbit; the image for -i should be its mirror image.
+#
+# Usage: tests/floatexp.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+VIEW="-re 0 -mag 1e320 -iters 20000 -size 100x100 -alg 1 -prec 0"
+
+render up $VIEW -im 1 | grep -q "kernel .*floatexp perturbation"
+check "mag 1e320 uses floatexp" $? -eq 0
+levels=$(od -An -tu4 -v $TMP.up | tr -s ' ' '\n' | sed '/^$/d' | sort -u | wc -l)
+check "mag 1e320 has detail" $levels -gt 10
+render down $VIEW -im -1 > /dev/null
+check "mag 1e320 mirror image" $(flipped_diffs up down 100 100) -le 10
+
+exit $FAIL
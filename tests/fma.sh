@@ -0,0 +1,27 @@
+#!/bin/sh
+# FMA kernel test: the AVX and AVX-512 FMA kernels give the same counts, in both precisions.
+# FMA rounds differently, so they only mostly match the C kernel (within 1% of pixels).
+#
+# Usage: tests/fma.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+need_cpu fma
+
+for view in "-re -0.7 -im 0.001 -mag 1.35 -iters 256" \
+            "-re -0.7435 -im 0.1314 -mag 3e3 -iters 3000" \
+            "-re -0.1 -im 0.9 -mag 40 -iters 1000"
+do
+   render c -size 160x120 $view -alg 5 -prec 2 > /dev/null
+   render fma -size 160x120 $view -alg 7 -prec 2 -kernel 3 > /dev/null
+   same "double vs C, $view" c fma 192
+   if grep -qw avx512f /proc/cpuinfo; then
+      render fma512 -size 160x120 $view -alg 7 -prec 2 -kernel 4 > /dev/null
+      same "double AVX vs AVX-512, $view" fma fma512
+      render fma -size 160x120 $view -alg 7 -prec 1 -kernel 3 > /dev/null
+      render fma512 -size 160x120 $view -alg 7 -prec 1 -kernel 4 > /dev/null
+      same "single AVX vs AVX-512, $view" fma fma512
+   fi
+done
+
+exit $FAIL
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Formula test. For each of the other formulas, the SSE2, AVX and AVX-512 kernels should give
+# the same counts as the C one, and the formulas that are symmetric about the real axis (all
+# but the Burning Ship) should give a mirror image for -im.
+#
+# Usage: tests/formulas.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+VIEW="-re -0.2 -mag 0.8 -iters 500 -size 160x120 -prec 2"
+
+for f in 1 2 3 4; do
+   render c $VIEW -im 0.3 -formula $f -alg 5 | grep -q "kernel C .*, [0-9]* threads"
+   check "formula $f C kernel used" $? -eq 0
+   for k in 2 3 4; do
+      render k $VIEW -im 0.3 -formula $f -alg 1 -kernel $k > /dev/null
+      same "formula $f kernel $k vs C" c k
+   done
+   if [ $f != 3 ]; then
+      render down $VIEW -im -0.3 -formula $f -alg 5 > /dev/null
+      check "formula $f mirror image" $(flipped_diffs c down 160 120) -eq 0
+   fi
+done
+
+exit $FAIL
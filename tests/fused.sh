@@ -0,0 +1,31 @@
+#!/bin/sh
+# Fused palette mapping test. Mapping the tiles as they're calculated should give the same image
+# as mapping the whole image after, including with perturbation glitch correction (whose points
+# get mapped at the end) and for the DE shading and normalized palettes.
+#
+# Usage: tests/fused.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+RE=-0.74349398499142309281199588739272197831822540668333942903700517490506172180175781
+IM=0.13118503503488265803672769813873628707451153635688001486414577811956405639648438
+
+# Renders the view with and without fused mapping and compares the images
+compare()       # description options...
+{
+   desc=$1
+   shift
+   "$QM" "$@" -threads 4 -fused 0 -o $TMP.unfused.ppm > /dev/null
+   "$QM" "$@" -threads 4 -fused 1 -o $TMP.fused.ppm > /dev/null
+   cmp -s $TMP.unfused.ppm $TMP.fused.ppm
+   check "$desc: fused vs unfused" $? -eq 0
+}
+
+compare "fast" -re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 320x240 -alg 0
+compare "exact" -re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 320x240 -alg 1
+compare "palette 3" -re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 320x240 -alg 1 -pal 3
+compare "normalized" -re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 320x240 -alg 1 -norm
+compare "DE" -re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 320x240 -alg 1 -de
+compare "perturbation" -re $RE -im $IM -mag 1e30 -iters 20000 -size 160x120 -alg 1
+
+exit $FAIL
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Julia set test. The Julia set's center pixel (z = 0) iterates the same orbit as the Mandelbrot
+# set's pixel at c, the set is symmetric under z -> -z, and the SSE2, AVX and AVX-512 kernels
+# should give the same counts as the C one.
+#
+# Usage: tests/julia.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+VIEW="-re 0 -im 0 -mag 0.7 -iters 1000 -size 160x120 -prec 2"
+CENTER=$((60 * 160 + 80))
+
+for c in "-0.7435 0.1314" "-0.1 0.651" "0.285 0.01"; do
+   render c $VIEW -julia $c -alg 5 | grep -q "Julia set for c"
+   check "c = $c Julia mode" $? -eq 0
+   render m -re ${c% *} -im ${c#* } -mag 0.7 -iters 1000 -size 160x120 -prec 2 -alg 5 > /dev/null
+   check "c = $c center vs Mandelbrot" $(pixel c $CENTER) -eq $(pixel m $CENTER)
+   check "c = $c symmetry" $(flipped_diffs c c 160 120 xy) -eq 0
+   for k in 2 3 4; do
+      render k $VIEW -julia $c -alg 1 -kernel $k > /dev/null
+      same "c = $c kernel $k vs C" c k
+   done
+done
+
+exit $FAIL
@@ -0,0 +1,78 @@
+# Helpers for the qmrender tests (see the Makefile test target). Each test sources this, and
+# takes the qmrender binary as its argument. Renders are compared by their -iterfile counts.
+
+QM=${1:-./qmrender}
+TMP=${TMPDIR:-/tmp}/qmtest.$$
+FAIL=0
+
+trap 'rm -f $TMP.*' EXIT
+
+# Render with the given options, writing the counts to $TMP.name. Prints qmrender's output
+render()        # name options...
+{
+   name=$1
+   shift
+   "$QM" "$@" -iterfile $TMP.$name
+}
+
+# Prints the number of pixels with different counts in two renders
+count_diffs()   # name1 name2
+{
+   od -An -tu4 -v $TMP.$1 | tr -s ' ' '\n' | sed '/^$/d' > $TMP.diff1
+   od -An -tu4 -v $TMP.$2 | tr -s ' ' '\n' | sed '/^$/d' > $TMP.diff2
+   paste $TMP.diff1 $TMP.diff2 | awk '$1 != $2 { n++ } END { print n + 0 }'
+}
+
+# Prints the number of pixels with different counts in a render and the mirror image of another
+# about the center row (row y <-> h - y; row 0 has no mirror). With xy, also mirrors the columns,
+# which makes it the image rotated 180 degrees about the center pixel
+flipped_diffs() # name1 name2 w h [xy]
+{
+   od -An -tu4 -v $TMP.$1 | tr -s ' ' '\n' | sed '/^$/d' > $TMP.diff1
+   od -An -tu4 -v $TMP.$2 | tr -s ' ' '\n' | sed '/^$/d' > $TMP.diff2
+   awk -v w=$3 -v h=$4 -v xy=$5 '
+      NR == FNR { a[NR - 1] = $1; next }
+      { i = FNR - 1; x = i % w; y = int(i / w)
+        if (y > 0 && (!xy || x > 0)) b[(xy ? w - x : x) + (h - y) * w] = $1 }
+      END { for (i in b) if (a[i] != b[i]) n++; print n + 0 }' $TMP.diff1 $TMP.diff2
+}
+
+# Prints the count of pixel n (row major, from 0)
+pixel()         # name n
+{
+   od -An -tu4 -v -j $(($2 * 4)) -N 4 $TMP.$1 | tr -d ' '
+}
+
+# Passes if the test expression holds
+check()         # description test-expression...
+{
+   desc=$1
+   shift
+   if [ "$@" ]; then
+      echo "$desc: ok"
+   else
+      echo "$desc: FAIL"
+      FAIL=1
+   fi
+}
+
+# Passes if two renders have the same counts (or differ in at most max pixels)
+same()          # description name1 name2 [max]
+{
+   n=$(count_diffs $2 $3)
+   if [ $n -le ${4:-0} ]; then
+      echo "$1: ok"
+   else
+      echo "$1: FAIL ($n pixels differ)"
+      FAIL=1
+   fi
+}
+
+# Skips the rest of the test if the CPU doesn't have the /proc/cpuinfo flag
+need_cpu()      # flag
+{
+   if ! grep -qw "$1" /proc/cpuinfo 2>/dev/null; then
+      echo "no $1: skipped"
+      exit 0
+   fi
+}
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Thread count limit test. Thread counts past the old limit of 32 should work and give the same
+# image as one thread, and counts outside 1..MAX_THREADS should be rejected.
+#
+# Usage: tests/manythreads.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+VIEW="-re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 320x240 -alg 1"
+
+render t1 $VIEW -threads 1 > /dev/null
+for t in 33 64 300; do
+   render t $VIEW -threads $t | grep -q ", $t threads"
+   check "$t threads used" $? -eq 0
+   same "$t threads vs 1" t1 t
+done
+for t in 0 -1 4097; do
+   "$QM" -size 64x48 -threads $t > /dev/null
+   check "$t threads rejected" $? -ne 0
+done
+
+exit $FAIL
@@ -0,0 +1,18 @@
+#!/bin/sh
+# NUMA placement test. Pinning the threads and placing the buffers on their nodes shouldn't
+# change the image (on a machine with one node, it just pins the threads).
+#
+# Usage: tests/numa.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+VIEW="-re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 320x240 -alg 1 -threads 4"
+
+render n0 $VIEW -numa 0 > /dev/null
+for n in 1 2; do
+   render n $VIEW -numa $n > /dev/null
+   check "numa $n runs" $? -eq 0
+   same "numa $n vs 0" n0 n
+done
+
+exit $FAIL
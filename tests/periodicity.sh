@@ -0,0 +1,30 @@
+#!/bin/sh
+# Periodicity checking test. On the home view, some interior points should be retired early,
+# and the C and SIMD kernels should give the same counts. The SIMD kernels should retire the
+# same points; the C kernel checks every iteration rather than every 2, so near max_iters it can
+# find a few more. A kernel level the CPU doesn't have falls back to the widest one it has.
+#
+# Usage: tests/periodicity.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+VIEW="-re -0.7 -im 0.001 -mag 1.35 -iters 1000 -size 160x120 -alg 1 -prec 2"
+
+# The number of points qmrender reports as periodic
+periodic()      # name options...
+{
+   render "$@" | sed -n 's/\([0-9]*\) points found periodic.*/\1/p'
+}
+
+c=$(periodic c $VIEW -kernel 1)
+check "C retires points" "${c:-0}" -gt 0
+sse=$(periodic k2 $VIEW -kernel 2)
+check "SSE retires points" "${sse:-0}" -gt 0
+same "kernel 2 vs C" c k2
+for k in 3 4; do
+   n=$(periodic k$k $VIEW -kernel $k)
+   check "kernel $k retires the same points as SSE" "${n:-0}" -eq "${sse:-0}"
+   same "kernel $k vs C" c k$k
+done
+
+exit $FAIL
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Perturbation test. Past the double range of magnifications, auto precision should switch to
+# perturbation, and since the reference orbit for the conjugate center is the conjugate orbit,
+# the image for -im should be the mirror image of the one for im. Glitch correction picks its
+# new references in scan order, which isn't mirrored, so a few pixels can still differ.
+#
+# Usage: tests/perturb.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+RE=-0.74349398499142309281199588739272197831822540668333942903700517490506172180175781
+IM=0.13118503503488265803672769813873628707451153635688001486414577811956405639648438
+VIEW="-re $RE -iters 20000 -size 100x100 -alg 1 -prec 0"
+
+for mag in 1e20 1e30; do
+   render up $VIEW -im $IM -mag $mag | grep -q "Precision Double \[Perturbation\]"
+   check "mag $mag uses perturbation" $? -eq 0
+   render down $VIEW -im -$IM -mag $mag > /dev/null
+   check "mag $mag mirror image" $(flipped_diffs up down 100 100) -le 10
+done
+
+exit $FAIL
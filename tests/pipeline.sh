@@ -0,0 +1,24 @@
+#!/bin/sh
+# Frame pipeline test. A zoom sequence should give the same frames pipelined as one after the
+# other, for any thread count, and each frame the same image as rendering its view on its own.
+#
+# Usage: tests/pipeline.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+FRAMES="-frames 4 -zoom 2 -size 160x120 -alg 1"
+
+"$QM" $FRAMES -serial -threads 1 -o $TMP.serial.ppm > /dev/null
+for t in 1 3 7; do
+   "$QM" $FRAMES -threads $t -o $TMP.pipe$t.ppm | grep -q "4 frames,"
+   check "$t threads: 4 frames rendered" $? -eq 0
+   for n in 0 1 2 3; do
+      cmp -s $TMP.serial000$n.ppm $TMP.pipe${t}000$n.ppm
+      check "$t threads: frame $n vs serial" $? -eq 0
+   done
+done
+"$QM" -mag 10.8 -size 160x120 -alg 1 -o $TMP.single.ppm > /dev/null    # 1.35 * 2^3
+cmp -s $TMP.serial0003.ppm $TMP.single.ppm
+check "frame 3 vs its view" $? -eq 0
+
+exit $FAIL
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Headless render test: qmrender writes a PPM image and the iteration counts of the home view,
+# with max iters in the main cardioid and quick escapes at the corners. The fast algorithm only
+# guesses a few pixels differently from the exact one.
+#
+# Usage: tests/render.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+render exact -size 160x120 -alg 1 -prec 2 -o $TMP.ppm > /dev/null
+render fast -size 160x120 -alg 0 -prec 2 > /dev/null
+
+check "PPM header" "$(head -c 15 $TMP.ppm | tr '\n' ' ')" = "P6 160 120 255 "
+check "PPM size" $(wc -c < $TMP.ppm) -eq $((15 + 160 * 120 * 3))
+check "count file size" $(wc -c < $TMP.exact) -eq $((160 * 120 * 4))
+check "center in the set" $(pixel exact $((60 * 160 + 80))) -eq 256
+check "corner escapes" $(pixel exact 0) -lt 4
+same "fast vs exact" exact fast 20
+
+exit $FAIL
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Series approximation test. On deep images the series should skip a good part of the orbit,
+# and since every point starts at the skipped count, no pixel should have a smaller count.
+#
+# Usage: tests/series.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+RE=-0.74349398499142309281199588739272197831822540668333942903700517490506172180175781
+IM=0.13118503503488265803672769813873628707451153635688001486414577811956405639648438
+VIEW="-re $RE -im $IM -iters 20000 -size 100x100 -alg 1 -prec 0"
+
+for mag in 1e20 1e30; do
+   skipped=$(render s $VIEW -mag $mag | sed -n 's/Series approximation skipped \([0-9]*\).*/\1/p')
+   check "mag $mag skips iterations" "${skipped:-0}" -gt 100
+   min=$(od -An -tu4 -v $TMP.s | tr -s ' ' '\n' | sed '/^$/d' | sort -n | head -1)
+   check "mag $mag no count below $skipped" "$min" -ge "${skipped:-0}"
+done
+
+exit $FAIL
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Thread pool test. The exact algorithm should give the same image for any thread count
+# (including on a deep image, with perturbation glitch correction), and the fast algorithm the
+# same image from run to run for a given count (see make_tiles).
+#
+# Usage: tests/threads.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+RE=-0.74349398499142309281199588739272197831822540668333942903700517490506172180175781
+IM=0.13118503503488265803672769813873628707451153635688001486414577811956405639648438
+
+# Renders the view with several thread counts and compares them
+compare()       # view options...
+{
+   view=$1
+   shift
+   render t1 "$@" -alg 1 -threads 1 > /dev/null
+   for t in 2 3 7 16; do
+      render t "$@" -alg 1 -threads $t > /dev/null
+      same "$view: exact, $t threads vs 1" t1 t
+   done
+   render f1 "$@" -alg 0 -threads 7 > /dev/null
+   for r in 1 2 3; do
+      render f "$@" -alg 0 -threads 7 > /dev/null
+      same "$view: fast, 7 threads, run $r" f1 f
+   done
+}
+
+compare "home" -re -0.7 -im 0.001 -mag 1.35 -iters 1000 -size 320x240
+compare "seahorse" -re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 320x240
+compare "deep" -re $RE -im $IM -mag 1e30 -iters 20000 -size 160x120
+
+exit $FAIL
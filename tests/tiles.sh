@@ -0,0 +1,26 @@
+#!/bin/sh
+# Tile cost prediction test. With -repeat, each calculation after the first sizes its tiles by
+# the counts of the one before (see predict_tiles). The exact algorithm should still give the
+# same image as one thread, and the fast algorithm the same image from run to run.
+#
+# Usage: tests/tiles.sh [qmrender]
+
+. "$(dirname "$0")/lib.sh"
+
+# Renders the view with predicted tiles and compares
+compare()       # view options...
+{
+   view=$1
+   shift
+   render one "$@" -alg 1 -threads 1 > /dev/null
+   render pred "$@" -alg 1 -threads 7 -repeat 3 > /dev/null
+   same "$view: exact, predicted tiles vs 1 thread" one pred
+   render f1 "$@" -alg 0 -threads 7 -repeat 3 > /dev/null
+   render f2 "$@" -alg 0 -threads 7 -repeat 3 > /dev/null
+   same "$view: fast, predicted tiles from run to run" f1 f2
+}
+
+compare "home" -re -0.7 -im 0.001 -mag 1.35 -iters 1000 -size 320x240
+compare "seahorse" -re -0.7435 -im 0.1314 -mag 3e3 -iters 3000 -size 320x240
+
+exit $FAIL